@@ -67,10 +67,20 @@ int main(int argc, char *argv[])
 		{'a', "record-audio",		"GLC_AUDIO_RECORD",		NULL},
 		{'s', "start",			"GLC_START",			 "1"},
 		{'e', "colorspace",		"GLC_COLORSPACE",		NULL},
+		{ 0 , "gpu-colorspace",		"GLC_GPU_COLORSPACE",		 "1"},
+		{ 0 , "gpu-resize",		"GLC_GPU_SCALE",		 "1"},
 		{'k', "hotkey",			"GLC_HOTKEY",			NULL},
 		{ 0 , "reload",			"GLC_RELOAD_HOTKEY",		NULL},
 		{'n', "lock-fps",		"GLC_LOCK_FPS",			 "1"},
 		{ 0 , "pbo",			"GLC_TRY_PBO",			 "1"},
+		{ 0 , "pbo-count",		"GLC_PBO_COUNT",		NULL},
+		{ 0 , "pbo-persistent",		"GLC_PBO_PERSISTENT",		 "1"},
+		{ 0 , "query-state",		"GLC_TRACK_GL_STATE",		 "0"},
+		{ 0 , "autotune",		"GLC_AUTOTUNE",			 "1"},
+		{ 0 , "skip-repeats",		"GLC_SKIP_REPEATS",		 "1"},
+		{ 0 , "tiles",			"GLC_TILES",			 "1"},
+		{ 0 , "tile-size",		"GLC_TILE_SIZE",		NULL},
+		{ 0 , "key-interval",		"GLC_KEY_INTERVAL",		NULL},
 		{'z', "compression",		"GLC_COMPRESS",			NULL},
 		{ 0 , "sync",			"GLC_SYNC",			 "1"},
 		{ 0 , "byte-aligned",		"GLC_CAPTURE_DWORD_ALIGNED",	 "0"},
@@ -79,13 +89,20 @@ int main(int argc, char *argv[])
 		{'l', "log-file",		"GLC_LOG_FILE",			NULL},
 		{ 0 , "audio-skip",		"GLC_AUDIO_SKIP",		 "1"},
 		{ 0 , "disable-audio",		"GLC_AUDIO",			 "0"},
+		{ 0 , "lanes",			"GLC_LANES",			 "1"},
 		{'g', "glfinish",		"GLC_CAPTURE_GLFINISH",		 "1"},
 		{'j', "force-sdl-alsa-drv",	"SDL_AUDIODRIVER",	      "alsa"},
 		{'b', "capture",		"GLC_CAPTURE",			NULL},
 		{ 0 , "compressed",		"GLC_COMPRESSED_BUFFER_SIZE",	NULL},
 		{ 0 , "uncompressed",		"GLC_UNCOMPRESSED_BUFFER_SIZE",	NULL},
 		{ 0 , "unscaled",		"GLC_UNSCALED_BUFFER_SIZE",	NULL},
+		{ 0 , "elastic",		"GLC_ELASTIC_BUFFER_SIZE",	NULL},
 		{'P', "rtprio",                 "GLC_RTPRIO",                   NULL},
+		{ 0 , "threads",		"GLC_THREADS",			NULL},
+		{ 0 , "stripes",		"GLC_STRIPES",			NULL},
+		{ 0 , "affinity",		"GLC_AFFINITY",			NULL},
+		{ 0 , "exclude-cpus",		"GLC_AFFINITY_EXCLUDE",		NULL},
+		{ 0 , "buffer-memory",		"GLC_BUFFER_MEMORY",		NULL},
 		{ 0 , "pipe",                   "GLC_PIPE",                     NULL},
 		{ 0 , "pipe_invert",            "GLC_PIPE_INVERT",               "1"},
 		{ 0 , "pipe_delay",		"GLC_PIPE_DELAY",		 "0"},
@@ -179,12 +196,31 @@ usage:
 	       "  -s, --start                start capturing immediately\n"
 	       "  -e, --colorspace=CSP       keep as 'bgr' or convert to '420jpeg'\n"
 	       "                               default value is '420jpeg'\n"
+	       "      --gpu-colorspace       convert to '420jpeg' with a shader before\n"
+	       "                               reading frames back, when GL allows it\n"
+	       "      --gpu-resize           shrink pictures with a framebuffer blit\n"
+	       "                               before reading frames back\n"
 	       "  -k, --hotkey=HOTKEY        capture hotkey, <Ctrl> and <Shift> modifiers are\n"
 	       "                               supported, default hotkey is '<Shift>F8'\n"
 	       "      --reload=HOTKEY        reload hotkey, switches to next capture file\n"
 	       "                               default reload key is '<Shift>F9'\n"
 	       "  -n, --lock-fps             lock fps when capturing\n"
 	       "      --pbo                  use GL_ARB_pixel_buffer_object if available\n"
+	       "      --pbo-count=NUM        cycle through NUM PBOs, up to 8, so the\n"
+	       "                               driver has NUM frames to finish a transfer\n"
+	       "      --pbo-persistent       pass persistently mapped PBOs downstream\n"
+	       "                               instead of copying frames out of them\n"
+	       "      --query-state          query GL state on every frame instead of\n"
+	       "                               tracking calls changing it\n"
+	       "      --autotune             time readback settings on first frames and\n"
+	       "                               keep the fastest, cached per GL renderer\n"
+	       "      --skip-repeats         send unchanged frames as repeats of the\n"
+	       "                               previous one instead of the full picture\n"
+	       "      --tiles                send only tiles that changed since the\n"
+	       "                               previous frame, not with --pipe\n"
+	       "      --tile-size=SIZE       tiles of SIZE x SIZE pixels, default is 32\n"
+	       "      --key-interval=NUM     full frame every NUM frames with --tiles,\n"
+	       "                               default is 120, 0 means only when needed\n"
 	       "  -z, --compression=METHOD   compress stream using METHOD\n"
 	       "                               'none', 'quicklz' and 'lzo' are supported\n"
 	       "                               'quicklz' is used by default\n"
@@ -202,6 +238,8 @@ usage:
 	       "      --audio-skip           skip audio packets if buffer is full\n"
 	       "                               or capture thread is busy\n"
 	       "      --disable-audio        don't capture audio\n"
+	       "      --lanes                give audio and video a buffer of their own\n"
+	       "                               instead of sharing the stream buffer\n"
 	       "  -g, --glfinish             capture at glFinish()\n"
 	       "  -j, --force-sdl-alsa-drv   force SDL to use ALSA audio driver\n"
 	       "  -b, --capture=BUFFER       capture 'front' or 'back' buffer\n"
@@ -212,7 +250,23 @@ usage:
 	       "                               default is 25 MiB\n"
 	       "      --unscaled=SIZE        unscaled picture stream buffer size in MiB,\n"
 	       "                               default is 25 MiB\n"
+	       "      --elastic=SIZE         keep frames that don't fit in the stream buffer\n"
+	       "                               in up to SIZE MiB of memory grown on demand\n"
+	       "                               instead of dropping them, disabled by default\n"
 	       "  -P, --rtprio               use rt priority for alsa threads\n"
+	       "      --threads=NUM          run filters in a shared pool of NUM threads\n"
+	       "                               filters have their own threads by default\n"
+	       "      --stripes=NUM          split each frame between NUM extra threads\n"
+	       "                               lowers per frame latency of conversions\n"
+	       "      --affinity=SPEC        restrict glc threads to some CPUs, SPEC is a\n"
+	       "                               ';' separated list of [module=]cpus where\n"
+	       "                               cpus is a list like '0-3,8', 'l3' or 'node'\n"
+	       "                               eg. 'pack=l3;file=l3;4-7'\n"
+	       "      --exclude-cpus=LIST    keep glc threads off CPUs in LIST, eg. the\n"
+	       "                               ones running the application render thread\n"
+	       "      --buffer-memory=LIST   prepare stream buffers at init, LIST is a ','\n"
+	       "                               separated list of 'prefault', 'hugepages'\n"
+	       "                               (transparent) and 'mlock'\n"
 	       "      --pipe=rhs_cmd         pipe the video stream to an ext. app (ie: ffmpeg)\n"
 	       "                               The external program will be invoked with 4 args:\n"
 	       "                                 1. video_size (wxh)\n"
@@ -135,6 +135,7 @@ int alsa_capture_init(alsa_capture_t *alsa_capture, glc_t *glc, alsa_real_api_t
 	(*alsa_capture)->interrupt_pipe[0] = -1;
 	(*alsa_capture)->interrupt_pipe[1] = -1;
 	(*alsa_capture)->thread.ask_rt = 1;
+	(*alsa_capture)->thread.name = "alsa_capture";
 
 	return 0;
 }
@@ -629,6 +630,7 @@ int alsa_capture_process_pcm(alsa_capture_t alsa_capture, ps_packet_t *packet)
 
 		if (unlikely((ret = ps_packet_close(packet))))
 			goto cancel;
+		glc_thread_pool_notify(alsa_capture->glc);
 
 		/* just check for xrun */
 		return -alsa_capture_xrun(alsa_capture, alsa_capture_pcm_error(alsa_capture));
@@ -39,6 +39,7 @@
 #include <glc/common/log.h>
 #include <glc/common/state.h>
 #include <glc/common/util.h>
+#include <glc/common/thread.h>
 #include <glc/common/optimization.h>
 
 #include "audio_capture.h"
@@ -288,6 +289,7 @@ int audio_capture_data(audio_capture_t audio_capture,
 		goto err;
 	if (unlikely((ret = ps_packet_close(&audio_capture->packet))))
 		goto err;
+	glc_thread_pool_notify(audio_capture->glc);
 
 	return 0;
 err:
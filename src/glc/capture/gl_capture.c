@@ -52,9 +52,14 @@
 #include <glc/common/state.h>
 #include <glc/common/util.h>
 #include <glc/common/rational.h>
+#include <glc/common/elastic.h>
+#include <glc/common/thread.h>
 #include <glc/common/optimization.h>
 
 #include "gl_capture.h"
+#include "gl_ycbcr.h"
+#include "gl_scale.h"
+#include "gl_tune.h"
 
 #define GL_CAPTURE_TRY_PBO          0x1
 #define GL_CAPTURE_USE_PBO          0x2
@@ -63,43 +68,23 @@
 #define GL_CAPTURE_CROP            0x10
 #define GL_CAPTURE_LOCK_FPS        0x20
 #define GL_CAPTURE_IGNORE_TIME     0x40
-
-/*
- * The next functions come from:
- * http://locklessinc.com/articles/locks/
- */
-
-/* Compile read-write barrier */
-#define barrier() asm volatile("": : :"memory")
-
-/* Pause instruction to prevent excess processor bus usage */
-#define cpu_relax() asm volatile("pause\n": : :"memory")
-
-static inline uint32_t xchg_32(volatile void *ptr, uint32_t x)
-{
-	__asm__ __volatile__("xchgl %0,%1"
-				:"=r" ((uint32_t) x)
-				:"m" (*(volatile uint32_t *)ptr), "0" (x)
-				:"memory");
-	return x;
-}
-
-#define SPINBUSY 1
-typedef volatile uint32_t spinlock_t;
-
-static void spin_lock(spinlock_t *lock)
-{
-	do {
-		if (likely(!xchg_32(lock, SPINBUSY))) return;
-		while (*lock) cpu_relax();
-	} while(1);
-}
-
-static void spin_unlock(spinlock_t *lock)
-{
-	barrier();
-	*lock = 0;
-}
+#define GL_CAPTURE_TRY_PERSISTENT  0x80
+#define GL_CAPTURE_USE_PERSISTENT 0x100
+#define GL_CAPTURE_TRY_YCBCR      0x200
+#define GL_CAPTURE_TRACK_STATE    0x400
+#define GL_CAPTURE_AUTOTUNE       0x800
+#define GL_CAPTURE_TUNE_FORMAT   0x1000
+#define GL_CAPTURE_SKIP_REPEATS  0x2000
+
+/* persistent PBOs, twice the ring depth so frames can be held downstream */
+#define GL_CAPTURE_PBO_SLOTS       (2 * GL_CAPTURE_MAX_PBO)
+/* pixels offset in a persistent PBO, frame header goes right before */
+#define GL_CAPTURE_PBO_ALIGN       64
+/* frames between size queries until a ConfigureNotify is seen */
+#define GL_CAPTURE_GEOMETRY_POLL   60
+
+/* buckets of the stream hash table, a power of 2 */
+#define GL_CAPTURE_VIDEO_BUCKETS   64
 
 typedef void (*FuncPtr)(void);
 typedef FuncPtr (*GLXGetProcAddressProc)(const GLubyte *procName);
@@ -116,6 +101,42 @@ typedef void (*glBindBufferProc)(GLenum target,
 typedef GLvoid *(*glMapBufferProc)(GLenum target,
                                    GLenum access);
 typedef GLboolean (*glUnmapBufferProc)(GLenum target);
+typedef GLsync (*glFenceSyncProc)(GLenum condition,
+                                  GLbitfield flags);
+typedef GLenum (*glClientWaitSyncProc)(GLsync sync,
+                                       GLbitfield flags,
+                                       GLuint64 timeout);
+typedef void (*glDeleteSyncProc)(GLsync sync);
+typedef void (*glBufferStorageProc)(GLenum target,
+                                    GLsizeiptr size,
+                                    const GLvoid *data,
+                                    GLbitfield flags);
+typedef GLvoid *(*glMapBufferRangeProc)(GLenum target,
+                                        GLintptr offset,
+                                        GLsizeiptr length,
+                                        GLbitfield access);
+
+struct gl_capture_pbo_hold_s;
+
+/* persistent PBO slot, held until downstream drops its frame */
+struct gl_capture_pbo_slot_s {
+	volatile int held;
+	struct gl_capture_pbo_hold_s *hold;
+};
+
+/*
+ * Persistent PBO ring bookkeeping. A ring destroyed while frames are
+ * still held is orphaned: its buffers are deleted once every frame
+ * is dropped, or left to the context if that never happens in time.
+ */
+struct gl_capture_pbo_hold_s {
+	struct gl_capture_pbo_slot_s slot[GL_CAPTURE_PBO_SLOTS];
+	GLuint pbo[GL_CAPTURE_PBO_SLOTS];
+	unsigned int num;
+	/* held slots, plus one for the stream or orphan list owning it */
+	volatile unsigned int refs;
+	struct gl_capture_pbo_hold_s *next;
+};
 
 struct gl_capture_video_stream_s {
 	glc_state_video_t state_video;
@@ -128,34 +149,70 @@ struct gl_capture_video_stream_s {
 	GLXDrawable drawable;
 	Window attribWin;
 	ps_packet_t packet;
-	glc_utime_t last, pbo_time;
+	glc_utime_t last;
+
+	/*
+	 * size of attribute window, (w << 32) | h or 0 if unknown. Written
+	 * from the event thread on ConfigureNotify.
+	 */
+	volatile uint64_t geometry;
+	volatile int geometry_events;
+	unsigned int geometry_age;
 
 	unsigned int w, h;
 	unsigned int cw, ch, row, cx, cy;
+	unsigned int sw, sh; /* picture read, after scaling */
+	size_t size; /* picture data read per frame */
+
+	/* scales and converts on GPU when set */
+	gl_scale_t scale;
+	gl_ycbcr_t ycbcr;
 
 	float brightness, contrast;
 	float gamma_red, gamma_green, gamma_blue;
 
 	int indicator_list;
 
-	struct gl_capture_video_stream_s *next;
+	/* list of every stream, and hash bucket chain */
+	struct gl_capture_video_stream_s *next, *hnext;
 
-	GLuint pbo;
-	int pbo_active;
+	/*
+	 * PBO ring, transfers are started at head and read from the oldest.
+	 * At most pbo_depth transfers are in flight.
+	 */
+	GLuint pbo[GL_CAPTURE_PBO_SLOTS];
+	glc_utime_t pbo_time[GL_CAPTURE_PBO_SLOTS];
+	GLsync pbo_fence[GL_CAPTURE_PBO_SLOTS];
+	unsigned int pbo_num, pbo_depth, pbo_head, pbo_pending;
+	unsigned int pbo_deferred; /* frames skipped instead of stalling */
+
+	/* persistent PBOs, a slot is held until downstream drops its frame */
+	char *pbo_map[GL_CAPTURE_PBO_SLOTS];
+	struct gl_capture_pbo_hold_s *pbo_hold;
+	unsigned int pbo_starved; /* transfers skipped, every slot held */
+
+	/* hash of last picture sent, valid until format or color changes */
+	u_int64_t last_hash;
+	int last_hash_valid;
 
 	/* stats related vars */
 	unsigned num_frames;
 	unsigned num_captured_frames;
+	unsigned num_repeated_frames;
 	uint64_t capture_time_ns;
 	int      gather_stats;
 };
 
 struct gl_capture_s {
 	glc_t *glc;
-	spinlock_t capture_spinlock;
+	/* held for reading by gl_capture_frame(), for writing to stop capturing */
+	pthread_rwlock_t capture_rwlock;
 	glc_flags_t flags;
+	unsigned int generation;
 
 	GLenum capture_buffer;   /* GL_FRONT or GL_BACK */
+	unsigned int pbo_count;
+	double scale_factor;     /* scaling done on GPU */
 	glc_utime_t fps_period;  /* time in ns between 2 frames */
 
 	/*
@@ -165,10 +222,29 @@ struct gl_capture_s {
 	glc_utime_t fps_rem;     /* fix to apply every fps_rem_period frames */
 	unsigned fps_rem_period; /* period in frames which fps_rem is applied */
 
+	/*
+	 * streams are never removed before gl_capture_destroy(), so the list
+	 * and the hash table are read without locking. mutex serializes
+	 * insertions.
+	 */
 	struct gl_capture_video_stream_s *video;
+	struct gl_capture_video_stream_s *video_hash[GL_CAPTURE_VIDEO_BUCKETS];
 
 	ps_buffer_t *to;
 
+	/* overflow store used when to is full */
+	glc_elastic_t elastic;
+	size_t elastic_chunk, elastic_max;
+
+	/* readback settings picked on first frames are stored there */
+	char *tune_profile;
+	/* timing in progress and the stream it reads, guarded by mutex */
+	gl_tune_t tune;
+	struct gl_capture_video_stream_s *tune_video;
+
+	/* persistent PBO rings destroyed while held, guarded by mutex */
+	struct gl_capture_pbo_hold_s *pbo_orphans;
+
 	pthread_mutex_t mutex;
 
 	unsigned int bpp;
@@ -186,6 +262,13 @@ struct gl_capture_s {
 	glBindBufferProc      glBindBuffer;
 	glMapBufferProc       glMapBuffer;
 	glUnmapBufferProc     glUnmapBuffer;
+	/* optional, GL 3.2 or GL_ARB_sync */
+	glFenceSyncProc       glFenceSync;
+	glClientWaitSyncProc  glClientWaitSync;
+	glDeleteSyncProc      glDeleteSync;
+	/* optional, GL 4.4 or GL_ARB_buffer_storage */
+	glBufferStorageProc   glBufferStorage;
+	glMapBufferRangeProc  glMapBufferRange;
 };
 
 static int gl_capture_get_video_stream(gl_capture_t gl_capture,
@@ -204,29 +287,97 @@ static void gl_capture_error(gl_capture_t gl_capture, int err);
 
 static int gl_capture_get_geometry(gl_capture_t gl_capture,
 			    Display *dpy, Window win, unsigned int *w, unsigned int *h);
+static void gl_capture_cached_geometry(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				unsigned int *w, unsigned int *h);
+static void gl_capture_calc_area(gl_capture_t gl_capture,
+				unsigned int w, unsigned int h,
+				unsigned int *x, unsigned int *y,
+				unsigned int *cw, unsigned int *ch);
 static int gl_capture_calc_geometry(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video,
 				unsigned int w, unsigned int h);
+static void gl_capture_cpu_format(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
 static int gl_capture_update_screen(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 static int gl_capture_update_color(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video,
 				ps_packet_t *packet);
+static int gl_capture_write_message(gl_capture_t gl_capture, ps_packet_t *packet,
+				glc_message_header_t *hdr,
+				const void *message, size_t message_size);
 
 static int gl_capture_get_pixels(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video, char *to);
+static int gl_capture_write_repeat(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_video_frame_header_t *pic, char **spill);
+static int gl_capture_tune(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+static struct gl_capture_app_state_s *gl_capture_app_state(gl_capture_t gl_capture);
+static GLuint gl_capture_pack_buffer(gl_capture_t gl_capture);
 static int gl_capture_gen_indicator_list(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 
+static int gl_capture_load_gl(gl_capture_t gl_capture);
 static int gl_capture_init_pbo(gl_capture_t gl);
 static int gl_capture_create_pbo(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 static int gl_capture_destroy_pbo(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
 static int gl_capture_start_pbo(gl_capture_t gl_capture,
-				struct gl_capture_video_stream_s *video);
+				struct gl_capture_video_stream_s *video,
+				glc_utime_t time);
 static int gl_capture_read_pbo(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video, char *to);
+static int gl_capture_pbo_ready(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video);
+static int gl_capture_create_persistent_pbo(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video);
+static int gl_capture_ref_pbo(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				glc_video_frame_header_t *pic, glc_packet_ref_t *ref);
+static void gl_capture_pbo_release(void *arg);
+static void gl_capture_reap_pbo(gl_capture_t gl_capture, int final);
+
+static inline unsigned int gl_capture_pbo_oldest(struct gl_capture_video_stream_s *video)
+{
+	return (video->pbo_head + video->pbo_num - video->pbo_pending) % video->pbo_num;
+}
+
+/* tells apart gl_capture objects allocated at the same address */
+static unsigned int gl_capture_generation = 0;
+
+/* last stream looked up by a thread, it usually renders a single drawable */
+static __thread struct {
+	gl_capture_t gl_capture;
+	unsigned int generation;
+	Display *dpy;
+	GLXDrawable drawable;
+	struct gl_capture_video_stream_s *video;
+} gl_capture_last;
+
+/*
+ * GL state of the context current in a thread, as set by the
+ * application and reported with gl_capture_track_*()
+ */
+struct gl_capture_app_state_s {
+	int known;  /* queried since last context switch */
+	int inside; /* calls are made by gl_capture */
+	GLuint read_framebuffer, draw_framebuffer, pack_buffer, program;
+	GLenum active_texture;
+	GLenum read_buffer; /* of the window, 0 if unknown */
+	GLint pack_alignment, pack_row_length, pack_skip_rows, pack_skip_pixels;
+};
+
+static __thread struct gl_capture_app_state_s gl_capture_app;
+
+static inline unsigned int gl_capture_video_bucket(Display *dpy, GLXDrawable drawable)
+{
+	uint64_t key = (uint64_t) (uintptr_t) dpy ^ (uint64_t) drawable;
+	return (key * 0x9E3779B97F4A7C15ULL) >> 58;
+}
 
 int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc)
 {
@@ -240,8 +391,13 @@ int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc)
 	(*gl_capture)->format = GL_BGRA;		/* capture as BGRA data by default */
 	(*gl_capture)->bpp = 4;				/* since we use BGRA */
 	(*gl_capture)->capture_buffer = GL_FRONT;	/* front buffer is default */
+	(*gl_capture)->pbo_count = 1;
+	(*gl_capture)->scale_factor = 1.0;
+
+	(*gl_capture)->generation = __sync_add_and_fetch(&gl_capture_generation, 1);
 
 	pthread_mutex_init(&(*gl_capture)->mutex, NULL);
+	pthread_rwlock_init(&(*gl_capture)->capture_rwlock, NULL);
 
 	return 0;
 }
@@ -255,6 +411,28 @@ int gl_capture_set_buffer(gl_capture_t gl_capture, ps_buffer_t *buffer)
 	return 0;
 }
 
+int gl_capture_set_elastic(gl_capture_t gl_capture, size_t chunk_size,
+			   size_t max_size)
+{
+	if (unlikely(gl_capture->elastic))
+		return EALREADY;
+
+	if (unlikely(max_size && (!chunk_size || chunk_size > max_size)))
+		return EINVAL;
+
+	gl_capture->elastic_chunk = chunk_size;
+	gl_capture->elastic_max = max_size;
+	return 0;
+}
+
+int gl_capture_get_elastic_stat(gl_capture_t gl_capture, glc_elastic_stat_t *stat)
+{
+	if (!gl_capture->elastic)
+		return EAGAIN;
+
+	return glc_elastic_get_stat(gl_capture->elastic, stat);
+}
+
 int gl_capture_set_read_buffer(gl_capture_t gl_capture, GLenum buffer)
 {
 	if (buffer == GL_FRONT)
@@ -330,6 +508,124 @@ int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo)
 	return 0;
 }
 
+int gl_capture_try_persistent_pbo(gl_capture_t gl_capture, int try_persistent)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_USE_PBO)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change persistent PBO; PBO is in use");
+		return EAGAIN;
+	}
+
+	if (try_persistent)
+		gl_capture->flags |= GL_CAPTURE_TRY_PERSISTENT;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_TRY_PERSISTENT;
+
+	return 0;
+}
+
+int gl_capture_convert_ycbcr(gl_capture_t gl_capture, int convert)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_CAPTURING)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change colorspace conversion while capturing");
+		return EAGAIN;
+	}
+
+	if (convert)
+		gl_capture->flags |= GL_CAPTURE_TRY_YCBCR;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_TRY_YCBCR;
+
+	return 0;
+}
+
+int gl_capture_set_scale(gl_capture_t gl_capture, double scale)
+{
+	if (unlikely((scale <= 0) || (scale > 1)))
+		return EINVAL;
+
+	if (unlikely(gl_capture->flags & GL_CAPTURE_CAPTURING)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change scaling while capturing");
+		return EAGAIN;
+	}
+
+	gl_capture->scale_factor = scale;
+	return 0;
+}
+
+int gl_capture_track_state(gl_capture_t gl_capture, int track)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_CAPTURING)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change state tracking while capturing");
+		return EAGAIN;
+	}
+
+	if (track)
+		gl_capture->flags |= GL_CAPTURE_TRACK_STATE;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_TRACK_STATE;
+
+	return 0;
+}
+
+int gl_capture_skip_repeats(gl_capture_t gl_capture, int skip)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_CAPTURING)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change repeated frames handling while capturing");
+		return EAGAIN;
+	}
+
+	if (skip) {
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "sending unchanged frames as repeats");
+		gl_capture->flags |= GL_CAPTURE_SKIP_REPEATS;
+	} else
+		gl_capture->flags &= ~GL_CAPTURE_SKIP_REPEATS;
+
+	return 0;
+}
+
+int gl_capture_autotune(gl_capture_t gl_capture, const char *profile, int any_format)
+{
+	if (unlikely(gl_capture->flags & GL_CAPTURE_CAPTURING)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't calibrate readback while capturing");
+		return EAGAIN;
+	}
+
+	free(gl_capture->tune_profile);
+	gl_capture->tune_profile = NULL;
+	if ((profile) && (unlikely(!(gl_capture->tune_profile = strdup(profile)))))
+		return ENOMEM;
+
+	gl_capture->flags |= GL_CAPTURE_AUTOTUNE;
+	if (any_format)
+		gl_capture->flags |= GL_CAPTURE_TUNE_FORMAT;
+	else
+		gl_capture->flags &= ~GL_CAPTURE_TUNE_FORMAT;
+
+	return 0;
+}
+
+int gl_capture_set_pbo_count(gl_capture_t gl_capture, unsigned int count)
+{
+	if (unlikely((count < 1) || (count > GL_CAPTURE_MAX_PBO)))
+		return EINVAL;
+
+	if (unlikely(gl_capture->flags & GL_CAPTURE_USE_PBO)) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't change PBO count; PBO is in use");
+		return EAGAIN;
+	}
+
+	gl_capture->pbo_count = count;
+	return 0;
+}
+
 int gl_capture_set_pixel_format(gl_capture_t gl_capture, GLenum format)
 {
 	if (format == GL_BGRA) {
@@ -402,12 +698,21 @@ int gl_capture_lock_fps(gl_capture_t gl_capture, int lock_fps)
 
 int gl_capture_start(gl_capture_t gl_capture)
 {
+	int ret;
+
 	if (unlikely(!gl_capture->to)) {
 		glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
 			 "no target buffer specified");
 		return EAGAIN;
 	}
 
+	if ((gl_capture->elastic_max) && (!gl_capture->elastic)) {
+		if (unlikely((ret = glc_elastic_init(&gl_capture->elastic, gl_capture->glc,
+						     gl_capture->to, gl_capture->elastic_chunk,
+						     gl_capture->elastic_max))))
+			return ret;
+	}
+
 	if (gl_capture->flags & GL_CAPTURE_CAPTURING)
 		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
 			 "capturing is already active");
@@ -415,16 +720,17 @@ int gl_capture_start(gl_capture_t gl_capture)
 		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 			 "starting capturing");
 
-	gl_capture->flags |= GL_CAPTURE_CAPTURING;
+	__sync_or_and_fetch(&gl_capture->flags, GL_CAPTURE_CAPTURING);
 	return 0;
 }
 
 int gl_capture_stop(gl_capture_t gl_capture)
 {
 	if (gl_capture->flags & GL_CAPTURE_CAPTURING) {
-		spin_lock(&gl_capture->capture_spinlock);
-		gl_capture->flags &= ~GL_CAPTURE_CAPTURING;
-		spin_unlock(&gl_capture->capture_spinlock);
+		__sync_and_and_fetch(&gl_capture->flags, ~GL_CAPTURE_CAPTURING);
+		/* wait for frames in flight */
+		pthread_rwlock_wrlock(&gl_capture->capture_rwlock);
+		pthread_rwlock_unlock(&gl_capture->capture_rwlock);
 		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 			 "stopping capturing");
 		gl_capture_clear_video_streams(gl_capture);
@@ -440,6 +746,10 @@ void gl_capture_error(gl_capture_t gl_capture, int err)
 	glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
 		"%s (%d)", strerror(err), err);
 
+	/* nothing to flush anymore */
+	if (gl_capture->elastic)
+		glc_elastic_cancel(gl_capture->elastic);
+
 	/* stop capturing */
 	if (gl_capture->flags & GL_CAPTURE_CAPTURING)
 		gl_capture_stop(gl_capture);
@@ -461,22 +771,48 @@ int gl_capture_destroy(gl_capture_t gl_capture)
 		glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
 			"captured %u frames in %" PRIu64 " nsec",
 			del->num_captured_frames, del->capture_time_ns);
+		if (del->pbo_deferred)
+			glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
+				"avoided %u PBO stalls", del->pbo_deferred);
+		if (del->pbo_starved)
+			glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
+				"skipped %u transfers, every PBO held downstream",
+				del->pbo_starved);
+		if (del->num_repeated_frames)
+			glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
+				"sent %u unchanged frames as repeats",
+				del->num_repeated_frames);
 
 		/* we might be in wrong thread */
 		if (del->indicator_list)
 			glDeleteLists(del->indicator_list, 1);
+		if (del->ycbcr)
+			gl_ycbcr_destroy(del->ycbcr);
+		if (del->scale)
+			gl_scale_destroy(del->scale);
 
-		if (del->pbo)
+		if (del->pbo_num)
 			gl_capture_destroy_pbo(gl_capture, del);
 
 		ps_packet_destroy(&del->packet);
 		free(del);
 	}
+	gl_capture_reap_pbo(gl_capture, 1);
+	if (gl_capture->tune)
+		gl_tune_destroy(gl_capture->tune);
+
+	if (gl_capture->elastic) {
+		/* returns at once if the store was cancelled */
+		glc_elastic_flush(gl_capture->elastic);
+		glc_elastic_destroy(gl_capture->elastic);
+	}
 
 	pthread_mutex_destroy(&gl_capture->mutex);
+	pthread_rwlock_destroy(&gl_capture->capture_rwlock);
 
 	if (gl_capture->libGL_handle)
 		dlclose(gl_capture->libGL_handle);
+	free(gl_capture->tune_profile);
 	free(gl_capture);
 
 	return 0;
@@ -494,6 +830,39 @@ int gl_capture_get_geometry(gl_capture_t gl_capture, Display *dpy, Window win,
 	return 0;
 }
 
+/**
+ * \brief size of the stream window, without a server round trip if possible
+ *
+ * Once a ConfigureNotify has been seen for the window, the size it
+ * carried is trusted. Until then, the application might not select
+ * StructureNotifyMask so the server is still asked, but only every
+ * GL_CAPTURE_GEOMETRY_POLL frames.
+ */
+void gl_capture_cached_geometry(gl_capture_t gl_capture,
+				struct gl_capture_video_stream_s *video,
+				unsigned int *w, unsigned int *h)
+{
+	uint64_t geometry = __atomic_load_n(&video->geometry, __ATOMIC_ACQUIRE);
+
+	if (unlikely((!geometry) ||
+		     ((!video->geometry_events) &&
+		      (++video->geometry_age >= GL_CAPTURE_GEOMETRY_POLL)))) {
+		gl_capture_get_geometry(gl_capture, video->dpy,
+					video->attribWin ? video->attribWin : video->drawable,
+					w, h);
+		video->geometry_age = 0;
+
+		/* a ConfigureNotify received meanwhile is more recent */
+		if (__atomic_compare_exchange_n(&video->geometry, &geometry,
+						((uint64_t) *w << 32) | *h, 0,
+						__ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+			return;
+	}
+
+	*w = geometry >> 32;
+	*h = geometry & 0xffffffff;
+}
+
 int gl_capture_update_screen(gl_capture_t gl_capture,
 			     struct gl_capture_video_stream_s *video)
 {
@@ -502,57 +871,176 @@ int gl_capture_update_screen(gl_capture_t gl_capture,
 	return 0;
 }
 
-int gl_capture_calc_geometry(gl_capture_t gl_capture,
-			     struct gl_capture_video_stream_s *video,
-			     unsigned int w, unsigned int h)
+/**
+ * \brief area of a w x h window that is captured
+ */
+void gl_capture_calc_area(gl_capture_t gl_capture,
+			  unsigned int w, unsigned int h,
+			  unsigned int *x, unsigned int *y,
+			  unsigned int *cw, unsigned int *ch)
 {
-	video->w = w;
-	video->h = h;
-
 	/* calculate image area when cropping */
 	if (gl_capture->flags & GL_CAPTURE_CROP) {
-		if (gl_capture->crop_x > video->w)
-			video->cx = 0;
+		if (gl_capture->crop_x > w)
+			*x = 0;
 		else
-			video->cx = gl_capture->crop_x;
+			*x = gl_capture->crop_x;
 
-		if (gl_capture->crop_y > video->h)
-			video->cy = 0;
+		if (gl_capture->crop_y > h)
+			*y = 0;
 		else
-			video->cy = gl_capture->crop_y;
+			*y = gl_capture->crop_y;
 
-		if (gl_capture->crop_w + video->cx > video->w)
-			video->cw = video->w - video->cx;
+		if (gl_capture->crop_w + *x > w)
+			*cw = w - *x;
 		else
-			video->cw = gl_capture->crop_w;
+			*cw = gl_capture->crop_w;
 
-		if (gl_capture->crop_h + video->cy > video->h)
-			video->ch = video->h - video->cy;
+		if (gl_capture->crop_h + *y > h)
+			*ch = h - *y;
 		else
-			video->ch = gl_capture->crop_h;
+			*ch = gl_capture->crop_h;
 
 		/* we need to recalc y coord for OpenGL */
-		video->cy = video->h - video->ch - video->cy;
+		*y = h - *ch - *y;
 	} else {
-		video->cw = video->w;
-		video->ch = video->h;
-		video->cx = video->cy = 0;
+		*cw = w;
+		*ch = h;
+		*x = *y = 0;
 	}
+}
+
+int gl_capture_calc_geometry(gl_capture_t gl_capture,
+			     struct gl_capture_video_stream_s *video,
+			     unsigned int w, unsigned int h)
+{
+	video->w = w;
+	video->h = h;
+	gl_capture_calc_area(gl_capture, w, h, &video->cx, &video->cy,
+			     &video->cw, &video->ch);
 
 	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
 		 "calculated capture area for video %d is %ux%u+%u+%u",
 		 video->id, video->cw, video->ch, video->cx, video->cy);
 
-	video->row = video->cw * gl_capture->bpp;
+	video->sw = video->cw;
+	video->sh = video->ch;
+	if ((video->scale) &&
+	    (unlikely(gl_scale_set_size(video->scale, video->cw, video->ch,
+					&video->sw, &video->sh)))) {
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			"scaling video %d on CPU", video->id);
+		gl_scale_destroy(video->scale);
+		video->scale = NULL;
+		__sync_and_and_fetch(&video->flags, ~GLC_VIDEO_SCALED);
+		/* Y'CbCr data would not be scaled at all */
+		if (video->ycbcr)
+			gl_capture_cpu_format(gl_capture, video);
+	}
+
+	if (video->ycbcr) {
+		if (likely(!gl_ycbcr_set_size(video->ycbcr, video->sw, video->sh))) {
+			video->size = gl_ycbcr_size(video->ycbcr, &video->row, NULL);
+			return 0;
+		}
+		gl_capture_cpu_format(gl_capture, video);
+	}
+
+	video->row = video->sw * gl_capture->bpp;
 	if (unlikely(video->row % gl_capture->pack_alignment != 0))
 		video->row += gl_capture->pack_alignment -
 			      video->row % gl_capture->pack_alignment;
+	video->size = video->row * video->sh;
 	return 0;
 }
 
+/**
+ * \brief stop converting on GPU, read pixel format as is
+ */
+void gl_capture_cpu_format(gl_capture_t gl_capture,
+			   struct gl_capture_video_stream_s *video)
+{
+	glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+		"can't convert video %d to Y'CbCr on GPU anymore", video->id);
+	gl_ycbcr_destroy(video->ycbcr);
+	video->ycbcr = NULL;
+	video->format = (gl_capture->format == GL_BGRA) ? GLC_VIDEO_BGRA : GLC_VIDEO_BGR;
+	if (gl_capture->pack_alignment == 8)
+		__sync_or_and_fetch(&video->flags, GLC_VIDEO_DWORD_ALIGNED);
+}
+
+/**
+ * \brief read a picture
+ * \param to destination, or offset if a pixel pack buffer is bound
+ */
 int gl_capture_get_pixels(gl_capture_t gl_capture,
 			  struct gl_capture_video_stream_s *video, char *to)
 {
+	struct gl_capture_app_state_s *app;
+	gl_ycbcr_state_t ycbcr_app;
+	GLuint framebuffer = 0;
+	GLenum buffer = gl_capture->capture_buffer;
+	unsigned int x = video->cx, y = video->cy;
+
+	if (video->scale) {
+		if (!video->ycbcr)
+			return gl_scale_read(video->scale, buffer, x, y,
+					     gl_capture->format,
+					     gl_capture->pack_alignment, to);
+
+		/* convert the scaled picture */
+		gl_scale_blit(video->scale, buffer, x, y, &framebuffer);
+		buffer = GL_COLOR_ATTACHMENT0;
+		x = y = 0;
+	}
+
+	if (video->ycbcr) {
+		if (!(app = gl_capture_app_state(gl_capture)))
+			return gl_ycbcr_read(video->ycbcr, framebuffer, buffer,
+					     x, y, NULL, to);
+
+		ycbcr_app.program          = app->program;
+		ycbcr_app.active_texture   = app->active_texture;
+		ycbcr_app.read_framebuffer = app->read_framebuffer;
+		ycbcr_app.draw_framebuffer = app->draw_framebuffer;
+		ycbcr_app.pack_alignment   = app->pack_alignment;
+		ycbcr_app.pack_row_length  = app->pack_row_length;
+		ycbcr_app.pack_skip_rows   = app->pack_skip_rows;
+		ycbcr_app.pack_skip_pixels = app->pack_skip_pixels;
+		return gl_ycbcr_read(video->ycbcr, framebuffer, buffer,
+				     x, y, &ycbcr_app, to);
+	}
+
+	/* change and restore only what differs, nothing is queried */
+	if ((app = gl_capture_app_state(gl_capture)) &&
+	    (!app->read_framebuffer) && (app->read_buffer)) {
+		if (app->read_buffer != buffer)
+			glReadBuffer(buffer);
+		if (app->pack_alignment != gl_capture->pack_alignment)
+			glPixelStorei(GL_PACK_ALIGNMENT, gl_capture->pack_alignment);
+		if (unlikely(app->pack_row_length || app->pack_skip_rows ||
+			     app->pack_skip_pixels)) {
+			glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+			glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+			glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+		}
+
+		glReadPixels(x, y, video->cw, video->ch,
+			gl_capture->format, GL_UNSIGNED_BYTE, to);
+
+		if (unlikely(app->pack_row_length || app->pack_skip_rows ||
+			     app->pack_skip_pixels)) {
+			glPixelStorei(GL_PACK_ROW_LENGTH, app->pack_row_length);
+			glPixelStorei(GL_PACK_SKIP_ROWS, app->pack_skip_rows);
+			glPixelStorei(GL_PACK_SKIP_PIXELS, app->pack_skip_pixels);
+		}
+		if (app->pack_alignment != gl_capture->pack_alignment)
+			glPixelStorei(GL_PACK_ALIGNMENT, app->pack_alignment);
+		if (app->read_buffer != buffer)
+			glReadBuffer(app->read_buffer);
+		return 0;
+	}
+
 	glPushAttrib(GL_PIXEL_MODE_BIT);
 	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
 
@@ -567,6 +1055,63 @@ int gl_capture_get_pixels(gl_capture_t gl_capture,
 	return 0;
 }
 
+/**
+ * \brief application GL state, queried once after a context switch
+ * \return NULL if state is not tracked
+ */
+struct gl_capture_app_state_s *gl_capture_app_state(gl_capture_t gl_capture)
+{
+	GLint value;
+
+	if (!(gl_capture->flags & GL_CAPTURE_TRACK_STATE))
+		return NULL;
+	if (likely(gl_capture_app.known))
+		return &gl_capture_app;
+
+	value = 0; /* left as is without framebuffer objects */
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &value);
+	gl_capture_app.read_framebuffer = value;
+	value = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);
+	gl_capture_app.draw_framebuffer = value;
+	value = 0; /* left as is without shaders */
+	glGetIntegerv(GL_CURRENT_PROGRAM, &value);
+	gl_capture_app.program = value;
+	value = GL_TEXTURE0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &value);
+	gl_capture_app.active_texture = value;
+	/* read buffer of the window is not known while an FBO is bound */
+	gl_capture_app.read_buffer = 0;
+	if (!gl_capture_app.read_framebuffer) {
+		glGetIntegerv(GL_READ_BUFFER, &value);
+		gl_capture_app.read_buffer = value;
+	}
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &value);
+	gl_capture_app.pack_buffer = value;
+	glGetIntegerv(GL_PACK_ALIGNMENT, &gl_capture_app.pack_alignment);
+	glGetIntegerv(GL_PACK_ROW_LENGTH, &gl_capture_app.pack_row_length);
+	glGetIntegerv(GL_PACK_SKIP_ROWS, &gl_capture_app.pack_skip_rows);
+	glGetIntegerv(GL_PACK_SKIP_PIXELS, &gl_capture_app.pack_skip_pixels);
+
+	gl_capture_app.known = 1;
+	return &gl_capture_app;
+}
+
+/**
+ * \brief pixel pack buffer bound by the application
+ */
+GLuint gl_capture_pack_buffer(gl_capture_t gl_capture)
+{
+	struct gl_capture_app_state_s *app;
+	GLint binding;
+
+	if ((app = gl_capture_app_state(gl_capture)))
+		return app->pack_buffer;
+
+	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
+	return binding;
+}
+
 int gl_capture_gen_indicator_list(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s *video)
 {
@@ -598,6 +1143,29 @@ int gl_capture_gen_indicator_list(gl_capture_t gl_capture,
 	return 0;
 }
 
+/**
+ * \brief get glXGetProcAddressARB() from libGL, not from the hook
+ *
+ * Must be called with mutex held.
+ */
+int gl_capture_load_gl(gl_capture_t gl_capture)
+{
+	if (gl_capture->glXGetProcAddress)
+		return 0;
+
+	if (!gl_capture->libGL_handle)
+		gl_capture->libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
+	if (unlikely(!gl_capture->libGL_handle))
+		return ENOTSUP;
+	gl_capture->glXGetProcAddress =
+		(GLXGetProcAddressProc)
+		dlsym(gl_capture->libGL_handle, "glXGetProcAddressARB");
+	if (unlikely(!gl_capture->glXGetProcAddress))
+		return ENOTSUP;
+
+	return 0;
+}
+
 int gl_capture_init_pbo(gl_capture_t gl_capture)
 {
 	const char *gl_extensions = (const char *) glGetString(GL_EXTENSIONS);
@@ -608,13 +1176,7 @@ int gl_capture_init_pbo(gl_capture_t gl_capture)
 	if (unlikely(!strstr(gl_extensions, "GL_ARB_pixel_buffer_object")))
 		return ENOTSUP;
 
-	gl_capture->libGL_handle = dlopen("libGL.so.1", RTLD_LAZY);
-	if (unlikely(!gl_capture->libGL_handle))
-		return ENOTSUP;
-	gl_capture->glXGetProcAddress =
-		(GLXGetProcAddressProc)
-		dlsym(gl_capture->libGL_handle, "glXGetProcAddressARB");
-	if (unlikely(!gl_capture->glXGetProcAddress))
+	if (unlikely(gl_capture_load_gl(gl_capture)))
 		return ENOTSUP;
 	gl_capture->glGenBuffers =
 		(glGenBuffersProc)
@@ -650,6 +1212,38 @@ int gl_capture_init_pbo(gl_capture_t gl_capture)
 	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 		 "using GL_ARB_pixel_buffer_object");
 
+	/* without fences, mapping a PBO waits for its transfer */
+	gl_capture->glFenceSync =
+		(glFenceSyncProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glFenceSync");
+	gl_capture->glClientWaitSync =
+		(glClientWaitSyncProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glClientWaitSync");
+	gl_capture->glDeleteSync =
+		(glDeleteSyncProc)
+		gl_capture->glXGetProcAddress((const GLubyte *) "glDeleteSync");
+	if ((gl_capture->glFenceSync) && (gl_capture->glClientWaitSync) &&
+	    (gl_capture->glDeleteSync))
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			 "using GL_ARB_sync to poll PBO transfers");
+	else
+		gl_capture->glFenceSync = NULL;
+
+	/* persistent mapping is useless without fences */
+	if ((gl_capture->flags & GL_CAPTURE_TRY_PERSISTENT) && (gl_capture->glFenceSync)) {
+		gl_capture->glBufferStorage =
+			(glBufferStorageProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glBufferStorage");
+		gl_capture->glMapBufferRange =
+			(glMapBufferRangeProc)
+			gl_capture->glXGetProcAddress((const GLubyte *) "glMapBufferRange");
+		if ((gl_capture->glBufferStorage) && (gl_capture->glMapBufferRange)) {
+			glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+				 "using GL_ARB_buffer_storage, frames are not copied");
+			gl_capture->flags |= GL_CAPTURE_USE_PERSISTENT;
+		}
+	}
+
 	return 0;
 }
 
@@ -657,123 +1251,371 @@ int gl_capture_create_pbo(gl_capture_t gl_capture,
 			  struct gl_capture_video_stream_s *video)
 {
 	GLint binding;
+	unsigned int i;
 
-	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "creating PBO");
+	gl_capture_reap_pbo(gl_capture, 0);
 
-	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
-	glPushAttrib(GL_ALL_ATTRIB_BITS);
+	if (gl_capture->flags & GL_CAPTURE_USE_PERSISTENT) {
+		if (!gl_capture_create_persistent_pbo(gl_capture, video))
+			return 0;
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			 "can't map persistent PBO, falling back to copies");
+		gl_capture->flags &= ~GL_CAPTURE_USE_PERSISTENT;
+	}
 
-	gl_capture->glGenBuffers(1, &video->pbo);
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
-	gl_capture->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, video->row * video->ch,
-				NULL, GL_STREAM_READ);
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "creating %u PBO",
+		gl_capture->pbo_count);
+
+	binding = gl_capture_pack_buffer(gl_capture);
+
+	gl_capture->glGenBuffers(gl_capture->pbo_count, video->pbo);
+	for (i = 0; i < gl_capture->pbo_count; i++) {
+		gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[i]);
+		gl_capture->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, video->size,
+					NULL, GL_STREAM_READ);
+	}
+	video->pbo_num = video->pbo_depth = gl_capture->pbo_count;
+	video->pbo_head = video->pbo_pending = 0;
 
-	glPopAttrib();
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
 	return 0;
 }
 
-int gl_capture_destroy_pbo(gl_capture_t gl_capture,
-			   struct gl_capture_video_stream_s *video)
-{
-	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying PBO");
-	gl_capture->glDeleteBuffers(1, &video->pbo);
+/**
+ * \brief create persistently mapped PBOs
+ *
+ * Frames are handed downstream as references to the mapped memory,
+ * with the frame header written right before the pixels.
+ */
+int gl_capture_create_persistent_pbo(gl_capture_t gl_capture,
+				     struct gl_capture_video_stream_s *video)
+{
+	GLbitfield access = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT |
+			    GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr size = GL_CAPTURE_PBO_ALIGN + video->size;
+	unsigned int i, num = 2 * gl_capture->pbo_count;
+	GLint binding;
+	int ret = 0;
+
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+		"creating %u persistent PBO", num);
+
+	if (unlikely(!(video->pbo_hold = (struct gl_capture_pbo_hold_s *)
+		       calloc(1, sizeof(struct gl_capture_pbo_hold_s)))))
+		return ENOMEM;
+	video->pbo_hold->refs = 1;
+	for (i = 0; i < num; i++)
+		video->pbo_hold->slot[i].hold = video->pbo_hold;
+
+	binding = gl_capture_pack_buffer(gl_capture);
+
+	gl_capture->glGenBuffers(num, video->pbo);
+	for (i = 0; i < num; i++) {
+		gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[i]);
+		/* client storage, the CPU reads every byte of it */
+		gl_capture->glBufferStorage(GL_PIXEL_PACK_BUFFER_ARB, size, NULL,
+					    access | GL_CLIENT_STORAGE_BIT);
+		video->pbo_map[i] = (char *)
+			gl_capture->glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0, size,
+						     access);
+		if (unlikely(!video->pbo_map[i]))
+			ret = ENOTSUP;
+	}
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
+
+	if (unlikely(ret)) {
+		gl_capture->glDeleteBuffers(num, video->pbo);
+		free(video->pbo_hold);
+		video->pbo_hold = NULL;
+		return ret;
+	}
+
+	video->pbo_num = num;
+	video->pbo_depth = gl_capture->pbo_count;
+	video->pbo_head = video->pbo_pending = 0;
 	return 0;
 }
 
-int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+int gl_capture_destroy_pbo(gl_capture_t gl_capture,
+			   struct gl_capture_video_stream_s *video)
 {
-	GLint binding;
+	struct gl_capture_pbo_hold_s *hold = video->pbo_hold;
+	unsigned int i;
 
-	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
-	glPushAttrib(GL_PIXEL_MODE_BIT);
-	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture", "destroying PBO");
+	if (video->pbo_pending)
+		glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+			"video %d: dropped %u frames pending in PBO",
+			video->id, video->pbo_pending);
 
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
+	for (i = 0; i < video->pbo_num; i++) {
+		if (video->pbo_fence[i]) {
+			gl_capture->glDeleteSync(video->pbo_fence[i]);
+			video->pbo_fence[i] = NULL;
+		}
+	}
 
-	glReadBuffer(gl_capture->capture_buffer);
-	glPixelStorei(GL_PACK_ALIGNMENT, gl_capture->pack_alignment);
-	/* to = ((char *)NULL + (offset)) */
-	glReadPixels(video->cx, video->cy, video->cw, video->ch,
-		gl_capture->format, GL_UNSIGNED_BYTE, NULL);
+	video->pbo_hold = NULL;
+	if ((hold) && (__sync_fetch_and_add(&hold->refs, 0) > 1)) {
+		/* memory is still read downstream, don't wait for it */
+		memcpy(hold->pbo, video->pbo, video->pbo_num * sizeof(GLuint));
+		hold->num = video->pbo_num;
+		pthread_mutex_lock(&gl_capture->mutex);
+		hold->next = gl_capture->pbo_orphans;
+		gl_capture->pbo_orphans = hold;
+		pthread_mutex_unlock(&gl_capture->mutex);
+		glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
+			"persistent PBO still held, deleting it later");
+	} else {
+		free(hold);
+		gl_capture->glDeleteBuffers(video->pbo_num, video->pbo);
+	}
 
-	glPopClientAttrib();
-	glPopAttrib();
+	video->pbo_num = video->pbo_depth = video->pbo_head = video->pbo_pending = 0;
+	return 0;
+}
+
+/**
+ * \brief delete orphaned persistent PBOs no longer held
+ *
+ * Needs the GL context. On final call, rings still held are left
+ * to the last gl_capture_pbo_release() and their buffers to the
+ * context.
+ */
+void gl_capture_reap_pbo(gl_capture_t gl_capture, int final)
+{
+	struct gl_capture_pbo_hold_s **prev, *hold;
+
+	if (likely(!gl_capture->pbo_orphans))
+		return;
+
+	pthread_mutex_lock(&gl_capture->mutex);
+	prev = &gl_capture->pbo_orphans;
+	while ((hold = *prev)) {
+		/* nothing takes a new hold on an orphan */
+		if (__sync_fetch_and_add(&hold->refs, 0) == 1) {
+			*prev = hold->next;
+			gl_capture->glDeleteBuffers(hold->num, hold->pbo);
+			free(hold);
+		} else if (final) {
+			*prev = hold->next;
+			glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+				"persistent PBO still held, not deleting it");
+			if (!__sync_sub_and_fetch(&hold->refs, 1))
+				free(hold);
+		} else
+			prev = &hold->next;
+	}
+	pthread_mutex_unlock(&gl_capture->mutex);
+}
+
+/**
+ * \brief start a transfer into the PBO at head of the ring
+ *
+ * Ring must not be full.
+ * \return 0 on success, EBUSY if PBO is still held downstream
+ */
+int gl_capture_start_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			 glc_utime_t time)
+{
+	GLint binding;
+	size_t offset = 0;
+
+	if (video->pbo_hold) {
+		if (video->pbo_hold->slot[video->pbo_head].held)
+			return EBUSY;
+		offset = GL_CAPTURE_PBO_ALIGN;
+	}
+
+	binding = gl_capture_pack_buffer(gl_capture);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[video->pbo_head]);
+	/* to = ((char *)NULL + (offset)) */
+	gl_capture_get_pixels(gl_capture, video, (char *) NULL + offset);
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
+
+	if (gl_capture->glFenceSync) {
+		if (video->pbo_fence[video->pbo_head])
+			gl_capture->glDeleteSync(video->pbo_fence[video->pbo_head]);
+		video->pbo_fence[video->pbo_head] =
+			gl_capture->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	video->pbo_time[video->pbo_head] = time;
+	video->pbo_head = (video->pbo_head + 1) % video->pbo_num;
+	video->pbo_pending++;
 	return 0;
 }
 
-int gl_capture_read_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+/**
+ * \brief read the oldest transfer of the ring
+ *
+ * Ring must not be empty.
+ */
+int gl_capture_read_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+			char *to)
 {
 	GLvoid *buf;
 	GLint binding;
+	unsigned int oldest = gl_capture_pbo_oldest(video);
 
-	glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &binding);
+	binding = gl_capture_pack_buffer(gl_capture);
 
-	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo);
+	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, video->pbo[oldest]);
 	buf = gl_capture->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
 	if (unlikely(!buf))
 		return EINVAL;
 
-	ps_packet_write(&video->packet, buf, video->row * video->ch);
+	memcpy(to, buf, video->size);
 
 	gl_capture->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+	video->pbo_pending--;
 
 	gl_capture->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, binding);
 	return 0;
 }
 
+/**
+ * \brief hand the oldest transfer of the ring downstream by reference
+ *
+ * Ring must not be empty and transfer must be done. The PBO is held
+ * until the last reference is dropped.
+ */
+int gl_capture_ref_pbo(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video,
+		       glc_video_frame_header_t *pic, glc_packet_ref_t *ref)
+{
+	unsigned int oldest = gl_capture_pbo_oldest(video);
+	char *data = video->pbo_map[oldest] + GL_CAPTURE_PBO_ALIGN
+		     - sizeof(glc_video_frame_header_t);
+	int ret;
+
+	memcpy(data, pic, sizeof(glc_video_frame_header_t));
+
+	__sync_add_and_fetch(&video->pbo_hold->refs, 1);
+	video->pbo_hold->slot[oldest].held = 1;
+	if (unlikely((ret = glc_packet_ref_wrap(ref, data,
+				sizeof(glc_video_frame_header_t) + video->size,
+				gl_capture_pbo_release,
+				(void *) &video->pbo_hold->slot[oldest])))) {
+		video->pbo_hold->slot[oldest].held = 0;
+		__sync_sub_and_fetch(&video->pbo_hold->refs, 1);
+		return ret;
+	}
+
+	video->pbo_pending--;
+	return 0;
+}
+
+void gl_capture_pbo_release(void *arg)
+{
+	struct gl_capture_pbo_slot_s *slot = (struct gl_capture_pbo_slot_s *) arg;
+	struct gl_capture_pbo_hold_s *hold = slot->hold;
+
+	__sync_lock_release(&slot->held);
+	/* ring was orphaned and gl_capture is gone */
+	if (!__sync_sub_and_fetch(&hold->refs, 1))
+		free(hold);
+}
+
+/**
+ * \brief check, without waiting, if oldest transfer of the ring is done
+ *
+ * Always true when fences are not available.
+ */
+int gl_capture_pbo_ready(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	unsigned int oldest = gl_capture_pbo_oldest(video);
+	GLenum status;
+
+	if (!video->pbo_fence[oldest])
+		return 1;
+
+	status = gl_capture->glClientWaitSync(video->pbo_fence[oldest],
+					      GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+		return 0;
+
+	/* signaled or failed, either way mapping won't wait on it */
+	gl_capture->glDeleteSync(video->pbo_fence[oldest]);
+	video->pbo_fence[oldest] = NULL;
+	return 1;
+}
+
 int gl_capture_get_video_stream(gl_capture_t gl_capture,
 				struct gl_capture_video_stream_s **video,
 				Display *dpy, GLXDrawable drawable)
 {
 	struct gl_capture_video_stream_s *fvideo;
+	unsigned int bucket;
 
-	fvideo = gl_capture->video;
-	while (fvideo != NULL) {
-		if ((fvideo->drawable == drawable) && (fvideo->dpy == dpy))
-			break;
-
-		fvideo = fvideo->next;
+	if (likely((gl_capture_last.gl_capture == gl_capture) &&
+		   (gl_capture_last.generation == gl_capture->generation) &&
+		   (gl_capture_last.drawable == drawable) &&
+		   (gl_capture_last.dpy == dpy))) {
+		*video = gl_capture_last.video;
+		return 0;
 	}
 
-	if (fvideo == NULL) {
-		fvideo = (struct gl_capture_video_stream_s *)
-			calloc(1, sizeof(struct gl_capture_video_stream_s));
-
-		fvideo->dpy          = dpy;
-		fvideo->drawable     = drawable;
-		fvideo->flags        = GLC_VIDEO_NEED_COLOR_UPDATE;
-		fvideo->gather_stats = glc_log_get_level(gl_capture->glc) >= GLC_PERF;
-		ps_packet_init(&fvideo->packet, gl_capture->to);
+	bucket = gl_capture_video_bucket(dpy, drawable);
+	fvideo = __atomic_load_n(&gl_capture->video_hash[bucket], __ATOMIC_ACQUIRE);
+	while ((fvideo != NULL) &&
+	       ((fvideo->drawable != drawable) || (fvideo->dpy != dpy)))
+		fvideo = fvideo->hnext;
 
-		glc_state_video_new(gl_capture->glc, &fvideo->id, &fvideo->state_video);
+	if (unlikely(fvideo == NULL)) {
+		pthread_mutex_lock(&gl_capture->mutex);
 
-		fvideo->next      = gl_capture->video;
+		/* another thread might have added it meanwhile */
+		fvideo = gl_capture->video_hash[bucket];
+		while ((fvideo != NULL) &&
+		       ((fvideo->drawable != drawable) || (fvideo->dpy != dpy)))
+			fvideo = fvideo->hnext;
+
+		if (fvideo == NULL) {
+			fvideo = (struct gl_capture_video_stream_s *)
+				calloc(1, sizeof(struct gl_capture_video_stream_s));
+
+			fvideo->dpy          = dpy;
+			fvideo->drawable     = drawable;
+			fvideo->flags        = GLC_VIDEO_NEED_COLOR_UPDATE;
+			fvideo->gather_stats = glc_log_get_level(gl_capture->glc) >= GLC_PERF;
+			ps_packet_init(&fvideo->packet, gl_capture->to);
+
+			glc_state_video_new(gl_capture->glc, &fvideo->id, &fvideo->state_video);
+
+			/* publish only once fully initialized */
+			fvideo->next  = gl_capture->video;
+			fvideo->hnext = gl_capture->video_hash[bucket];
+			__atomic_store_n(&gl_capture->video, fvideo, __ATOMIC_RELEASE);
+			__atomic_store_n(&gl_capture->video_hash[bucket], fvideo,
+					 __ATOMIC_RELEASE);
+		}
 
-		/* linked list multithread sync RCU style! */
-		gl_capture->video = fvideo;
+		pthread_mutex_unlock(&gl_capture->mutex);
 	}
-	__sync_or_and_fetch(&fvideo->flags, GLC_VIDEO_CAPTURING);
+
+	gl_capture_last.gl_capture = gl_capture;
+	gl_capture_last.generation = gl_capture->generation;
+	gl_capture_last.dpy        = dpy;
+	gl_capture_last.drawable   = drawable;
+	gl_capture_last.video      = fvideo;
+
 	*video = fvideo;
 	return 0;
 }
 
-static inline void gl_capture_release_video_stream(struct gl_capture_video_stream_s *video)
-{
-	__sync_and_and_fetch(&video->flags, ~GLC_VIDEO_CAPTURING);
-}
-
 int gl_capture_clear_video_streams(gl_capture_t gl_capture)
 {
 	struct gl_capture_video_stream_s *fvideo;
 	fvideo = gl_capture->video;
 	while (fvideo != NULL) {
-		while (unlikely(fvideo->flags & GLC_VIDEO_CAPTURING)) {
-			struct timespec one_ms = { .tv_sec = 0, .tv_nsec = 1000000 };
-			clock_nanosleep(CLOCK_MONOTONIC, 0, &one_ms, NULL);
-		}
 		fvideo->last = 0;
+		/* transfers in flight would come out stale on restart */
+		if (fvideo->pbo_pending) {
+			glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+				"video %d: dropped %u frames pending in PBO",
+				fvideo->id, fvideo->pbo_pending);
+			fvideo->pbo_pending = 0;
+		}
 		fvideo = fvideo->next;
 	}
 	return 0;
@@ -788,6 +1630,42 @@ int gl_capture_init_video_format(gl_capture_t gl_capture,
 	/* reset gamma values */
 	video->gamma_red = video->gamma_green = video->gamma_blue = 1.0;
 
+	if ((gl_capture->scale_factor != 1.0) && (!video->scale)) {
+		pthread_mutex_lock(&gl_capture->mutex);
+		if ((gl_capture_load_gl(gl_capture)) ||
+		    (gl_scale_init(&video->scale, gl_capture->glc,
+				   (gl_scale_get_proc_t) gl_capture->glXGetProcAddress,
+				   gl_capture->scale_factor))) {
+			glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+				"can't scale video %d on GPU", video->id);
+			video->scale = NULL;
+		}
+		pthread_mutex_unlock(&gl_capture->mutex);
+	}
+
+	if (video->scale)
+		__sync_or_and_fetch(&video->flags, GLC_VIDEO_SCALED);
+
+	/* Y'CbCr data is not scaled by CPU filters */
+	if ((gl_capture->flags & GL_CAPTURE_TRY_YCBCR) && (!video->ycbcr) &&
+	    ((gl_capture->scale_factor == 1.0) || (video->scale))) {
+		pthread_mutex_lock(&gl_capture->mutex);
+		if ((gl_capture_load_gl(gl_capture)) ||
+		    (gl_ycbcr_init(&video->ycbcr, gl_capture->glc,
+				   (gl_ycbcr_get_proc_t) gl_capture->glXGetProcAddress))) {
+			glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+				"can't convert video %d to Y'CbCr on GPU", video->id);
+			video->ycbcr = NULL;
+		}
+		pthread_mutex_unlock(&gl_capture->mutex);
+	}
+
+	if (video->ycbcr) {
+		video->format = GLC_VIDEO_YCBCR_420JPEG;
+		__sync_and_and_fetch(&video->flags, ~GLC_VIDEO_DWORD_ALIGNED);
+		return 0;
+	}
+
 	if (gl_capture->format == GL_BGRA)
 		video->format = GLC_VIDEO_BGRA;
 	else
@@ -807,6 +1685,10 @@ int gl_capture_write_video_format_message(gl_capture_t gl_capture,
 	glc_video_format_message_t format_msg;
 
 	gl_capture_calc_geometry(gl_capture, video, w, h);
+	if (gl_capture->elastic)
+		glc_elastic_expect(gl_capture->elastic, video->size +
+				   sizeof(glc_message_header_t) +
+				   sizeof(glc_video_frame_header_t));
 
 	glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
 		 "creating/updating configuration for video %d", video->id);
@@ -814,22 +1696,29 @@ int gl_capture_write_video_format_message(gl_capture_t gl_capture,
 	msg.type = GLC_MESSAGE_VIDEO_FORMAT;
 	format_msg.flags  = video->flags &
 			    ~(GLC_VIDEO_CAPTURING|GLC_VIDEO_NEED_COLOR_UPDATE);
+	if (gl_capture->flags & GL_CAPTURE_SKIP_REPEATS)
+		format_msg.flags |= GLC_VIDEO_REPEATS;
 	format_msg.format = video->format;
 	format_msg.id     = video->id;
-	format_msg.width  = video->cw;
-	format_msg.height = video->ch;
+	format_msg.width  = video->sw;
+	format_msg.height = video->sh;
+	if (video->ycbcr) {
+		gl_ycbcr_size(video->ycbcr, &w, &h);
+		format_msg.width  = w;
+		format_msg.height = h;
+	}
 
-	ps_packet_open(&video->packet, PS_PACKET_WRITE);
-	ps_packet_write(&video->packet, &msg, sizeof(glc_message_header_t));
-	ps_packet_write(&video->packet, &format_msg, sizeof(glc_video_format_message_t));
-	ps_packet_close(&video->packet);
+	gl_capture_write_message(gl_capture, &video->packet, &msg,
+				 &format_msg, sizeof(glc_video_format_message_t));
+	/* next picture can't repeat one of another size */
+	video->last_hash_valid = 0;
 
 	glc_log(gl_capture->glc, GLC_DEBUG, "gl_capture",
 		 "video %d: %ux%u (%ux%u), 0x%02x flags", video->id,
 		 video->cw, video->ch, video->w, video->h, video->flags);
 
 	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
-		if (video->pbo)
+		if (video->pbo_num)
 			gl_capture_destroy_pbo(gl_capture, video);
 
 		if (gl_capture_create_pbo(gl_capture, video)) {
@@ -842,11 +1731,105 @@ int gl_capture_write_video_format_message(gl_capture_t gl_capture,
 	return 0;
 }
 
+/**
+ * \brief pick pixel format, pack alignment and PBO use
+ *
+ * Settings stored for the renderer are used if there are any,
+ * otherwise every combination is timed on the capture area of
+ * the first stream, one read per frame. Called with mutex held.
+ * \return 0 once settings are picked, EAGAIN while timing,
+ *         otherwise an error code
+ */
+int gl_capture_tune(gl_capture_t gl_capture, struct gl_capture_video_stream_s *video)
+{
+	const char *renderer = (const char *) glGetString(GL_RENDERER);
+	gl_tune_config_t config;
+	unsigned int w, h, x, y, cw, ch;
+	int flags = 0, ret;
+
+	if (!gl_capture->tune) {
+		if (unlikely((ret = gl_capture_load_gl(gl_capture))))
+			return ret;
+
+		if (gl_capture->flags & GL_CAPTURE_TUNE_FORMAT)
+			flags |= GL_TUNE_FORMAT;
+		if (!gl_capture_init_pbo(gl_capture))
+			flags |= GL_TUNE_PBO;
+
+		config.format = gl_capture->format;
+		config.pack_alignment = gl_capture->pack_alignment;
+		config.pbo = (gl_capture->flags & GL_CAPTURE_TRY_PBO) && (flags & GL_TUNE_PBO);
+
+		if ((gl_capture->tune_profile) && (renderer) &&
+		    (!gl_tune_load(gl_capture->glc, gl_capture->tune_profile, renderer,
+				   flags, &config)))
+			goto apply;
+
+		if (unlikely((ret = gl_tune_init(&gl_capture->tune, gl_capture->glc,
+						 (gl_tune_get_proc_t) gl_capture->glXGetProcAddress,
+						 flags, &config))))
+			goto err;
+		gl_capture->tune_video = video;
+	} else if (video != gl_capture->tune_video)
+		return EAGAIN; /* other contexts wait for the settings */
+
+	gl_capture_cached_geometry(gl_capture, video, &w, &h);
+	gl_capture_calc_area(gl_capture, w, h, &x, &y, &cw, &ch);
+	if ((ret = gl_tune_step(gl_capture->tune, gl_capture->capture_buffer,
+				x, y, cw, ch)) == EAGAIN)
+		return ret;
+	if (likely(!ret))
+		ret = gl_tune_result(gl_capture->tune, &config);
+
+	gl_tune_destroy(gl_capture->tune);
+	gl_capture->tune = NULL;
+	gl_capture->tune_video = NULL;
+	if (unlikely(ret))
+		goto err;
+
+	if ((gl_capture->tune_profile) && (renderer) &&
+	    (unlikely((ret = gl_tune_save(gl_capture->glc, gl_capture->tune_profile,
+					  renderer, &config)))))
+		glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+			"can't write %s: %s (%d)", gl_capture->tune_profile,
+			strerror(ret), ret);
+
+apply:
+	glc_log(gl_capture->glc, GLC_PERF, "gl_capture",
+		"reading frames as %s, alignment %d, %s",
+		config.format == GL_BGR ? "GL_BGR" : "GL_BGRA", config.pack_alignment,
+		config.pbo ? "through PBO" : "directly");
+
+	gl_capture_set_pixel_format(gl_capture, config.format);
+	gl_capture_set_pack_alignment(gl_capture, config.pack_alignment);
+	gl_capture_try_pbo(gl_capture, config.pbo);
+	return 0;
+err:
+	glc_log(gl_capture->glc, GLC_WARN, "gl_capture",
+		"can't calibrate readback: %s (%d)", strerror(ret), ret);
+	return ret;
+}
+
 int gl_capture_update_video_stream(gl_capture_t gl_capture,
 			  struct gl_capture_video_stream_s *video)
 {
 	unsigned int w, h;
 
+	/*
+	 * readback settings are picked before anything depends on them,
+	 * frames read to time them are not captured
+	 */
+	if (unlikely(gl_capture->flags & GL_CAPTURE_AUTOTUNE)) {
+		pthread_mutex_lock(&gl_capture->mutex);
+		if ((gl_capture->flags & GL_CAPTURE_AUTOTUNE) &&
+		    (gl_capture_tune(gl_capture, video) == EAGAIN)) {
+			pthread_mutex_unlock(&gl_capture->mutex);
+			return EAGAIN;
+		}
+		gl_capture->flags &= ~GL_CAPTURE_AUTOTUNE;
+		pthread_mutex_unlock(&gl_capture->mutex);
+	}
+
 	/* initialize PBO if not already done */
 	if (unlikely((!(gl_capture->flags & GL_CAPTURE_USE_PBO)) &&
 	    (gl_capture->flags & GL_CAPTURE_TRY_PBO))) {
@@ -865,9 +1848,7 @@ int gl_capture_update_video_stream(gl_capture_t gl_capture,
 		pthread_mutex_unlock(&gl_capture->mutex);
 	}
 
-	gl_capture_get_geometry(gl_capture, video->dpy,
-				video->attribWin ? video->attribWin : video->drawable,
-				&w, &h);
+	gl_capture_cached_geometry(gl_capture, video, &w, &h);
 
 	if (unlikely(!video->format)) {
 		gl_capture_init_video_format(gl_capture,video);
@@ -899,20 +1880,25 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 	struct gl_capture_video_stream_s *video;
 	glc_message_header_t msg;
 	glc_video_frame_header_t pic;
+	glc_ref_message_t ref_msg;
 	glc_utime_t now;
 	glc_utime_t before_capture = 0, after_capture = 0;
-	char *dma;
-	int ret = 0;
-
-	spin_lock(&gl_capture->capture_spinlock);
+	char *dma, *spill = NULL;
+	size_t size;
+	u_int64_t hash = 0;
+	int by_ref, repeat = 0, hashed = 0, ret = 0;
 
-	if (!(gl_capture->flags & GL_CAPTURE_CAPTURING)) {
-		spin_unlock(&gl_capture->capture_spinlock);
+	if (!(__atomic_load_n(&gl_capture->flags, __ATOMIC_RELAXED) & GL_CAPTURE_CAPTURING))
 		return 0; /* capturing not active */
+
+	pthread_rwlock_rdlock(&gl_capture->capture_rwlock);
+	if (unlikely(!(gl_capture->flags & GL_CAPTURE_CAPTURING))) {
+		pthread_rwlock_unlock(&gl_capture->capture_rwlock);
+		return 0; /* stopped meanwhile */
 	}
+	gl_capture_app.inside = 1;
 
 	gl_capture_get_video_stream(gl_capture, &video, dpy, drawable);
-	spin_unlock(&gl_capture->capture_spinlock);
 
 	/* get current time */
 	if (unlikely(gl_capture->flags & GL_CAPTURE_IGNORE_TIME))
@@ -932,69 +1918,214 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 			now - video->last);
 
 	/* not really needed until now */
-	gl_capture_update_video_stream(gl_capture, video);
+	if (unlikely(gl_capture_update_video_stream(gl_capture, video) == EAGAIN))
+		goto finish;
 	video->num_frames++;
 
-	/* if PBO is not active, just start transfer and finish */
+	/* until the PBO ring is full, just start transfers and finish */
 	if (unlikely((gl_capture->flags & GL_CAPTURE_USE_PBO) &&
-	     __sync_bool_compare_and_swap(&video->pbo_active,0,1))) {
-		ret = gl_capture_start_pbo(gl_capture, video);
-		video->pbo_time = now;
+		     (video->pbo_pending < video->pbo_depth))) {
+		if ((ret = gl_capture_start_pbo(gl_capture, video, now)) == EBUSY) {
+			video->pbo_starved++;
+			ret = 0;
+		}
 		goto finish;
 	}
 
-	if (unlikely(ps_packet_open(&video->packet,
-				((gl_capture->flags & GL_CAPTURE_LOCK_FPS) ||
-				(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
-				(PS_PACKET_WRITE) :
-				(PS_PACKET_WRITE | PS_PACKET_TRY))))
+	/*
+	 * mapping a PBO still in flight would stall the application,
+	 * try again on next frame instead
+	 */
+	if ((gl_capture->flags & GL_CAPTURE_USE_PBO) &&
+	    (!gl_capture_pbo_ready(gl_capture, video))) {
+		video->pbo_deferred++;
 		goto finish;
+	}
 
-	if (unlikely((ret = ps_packet_setsize(&video->packet, video->row * video->ch
-						+ sizeof(glc_message_header_t)
-						+ sizeof(glc_video_frame_header_t)))))
-		goto cancel;
+	/* persistent PBOs are not copied, only referenced */
+	by_ref = (gl_capture->flags & GL_CAPTURE_USE_PBO) && (video->pbo_hold);
+	ref_msg.ref = NULL;
 
-	msg.type = GLC_MESSAGE_VIDEO_FRAME;
-	if (unlikely((ret = ps_packet_write(&video->packet,
-					    &msg, sizeof(glc_message_header_t)))))
-		goto cancel;
+	/* mapped picture can be compared before anything is written */
+	if ((by_ref) && (gl_capture->flags & GL_CAPTURE_SKIP_REPEATS)) {
+		hash = glc_util_hash(video->pbo_map[gl_capture_pbo_oldest(video)] +
+				     GL_CAPTURE_PBO_ALIGN, video->size);
+		hashed = 1;
+		repeat = (video->last_hash_valid) && (hash == video->last_hash);
+	}
+
+	if (repeat)
+		size = sizeof(glc_message_header_t) + sizeof(glc_video_frame_header_t);
+	else if (by_ref)
+		size = sizeof(glc_message_header_t) + sizeof(glc_ref_message_t);
+	else
+		size = video->size + sizeof(glc_message_header_t)
+		       + sizeof(glc_video_frame_header_t);
+
+	/* frames already spilled have to reach the buffer first */
+	if (likely((!gl_capture->elastic) || (!glc_elastic_pending(gl_capture->elastic)))) {
+		if (unlikely((ret = ps_packet_open(&video->packet,
+					((gl_capture->flags & GL_CAPTURE_LOCK_FPS) ||
+					(gl_capture->flags & GL_CAPTURE_IGNORE_TIME)) ?
+					(PS_PACKET_WRITE) :
+					(PS_PACKET_WRITE | PS_PACKET_TRY))))) {
+			/* full buffer spills like a frame that does not fit */
+			if ((ret != EBUSY) || (!gl_capture->elastic)) {
+				ret = 0;
+				goto finish;
+			}
+		} else if (unlikely((ret = ps_packet_setsize(&video->packet, size)))) {
+			if ((ret != EBUSY) || (!gl_capture->elastic))
+				goto cancel;
+			ps_packet_cancel(&video->packet);
+		}
+	} else
+		ret = EBUSY;
+
+	if (unlikely(ret == EBUSY)) {
+		if (unlikely((ret = glc_elastic_write_open(gl_capture->elastic,
+							   size, &spill)))) {
+			if (ret == ENOSPC)
+				glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+					"dropped frame #%u, elastic buffer full",
+					video->num_frames);
+			if ((ret == ENOSPC) || (ret == EINTR))
+				ret = 0;
+			goto finish;
+		}
+	}
+
+	if (repeat)
+		msg.type = GLC_MESSAGE_VIDEO_REPEAT;
+	else
+		msg.type = by_ref ? GLC_MESSAGE_REF : GLC_MESSAGE_VIDEO_FRAME;
 
 	/*
-	 * if we are using PBO we will actually write previous picture to buffer.
-	 * Also, make sure that pbo_time is not in the future. This could happen if
-	 * the state time is reset by reloading the capture between a pbo start
-	 * and a pbo read.
+	 * if we are using PBO we will actually write the oldest picture of the
+	 * ring to buffer. Also, make sure that its time is not in the future.
+	 * This could happen if the state time is reset by reloading the capture
+	 * between a pbo start and a pbo read.
 	 */
-	pic.time = (gl_capture->flags & GL_CAPTURE_USE_PBO &&
-		    video->pbo_time < now)?video->pbo_time:now;
+	pic.time = now;
+	if ((gl_capture->flags & GL_CAPTURE_USE_PBO) &&
+	    (video->pbo_time[gl_capture_pbo_oldest(video)] < now))
+		pic.time = video->pbo_time[gl_capture_pbo_oldest(video)];
 	pic.id   = video->id;
-	if (unlikely((ret = ps_packet_write(&video->packet,
-					    &pic, sizeof(glc_video_frame_header_t)))))
-		goto cancel;
 
-	if (video->gather_stats)
-		before_capture = glc_state_time(gl_capture->glc);
-	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
-		if (unlikely((ret = gl_capture_read_pbo(gl_capture, video))))
+	if (repeat) {
+		if (unlikely(spill != NULL)) {
+			memcpy(spill, &msg, sizeof(glc_message_header_t));
+			memcpy(&spill[sizeof(glc_message_header_t)], &pic,
+			       sizeof(glc_video_frame_header_t));
+		} else {
+			if (unlikely((ret = ps_packet_write(&video->packet,
+							    &msg, sizeof(glc_message_header_t)))))
+				goto cancel;
+			if (unlikely((ret = ps_packet_write(&video->packet,
+							    &pic, sizeof(glc_video_frame_header_t)))))
+				goto cancel;
+		}
+
+		/* oldest transfer is not needed, its slot is free again */
+		video->pbo_pending--;
+		video->num_repeated_frames++;
+
+		if ((ret = gl_capture_start_pbo(gl_capture, video, now)) == EBUSY) {
+			video->pbo_starved++;
+			ret = 0;
+		}
+		goto close;
+	}
+
+	if (by_ref) {
+		ref_msg.header.type = GLC_MESSAGE_VIDEO_FRAME;
+		ref_msg.size = sizeof(glc_video_frame_header_t) + video->size;
+		if (unlikely((ret = gl_capture_ref_pbo(gl_capture, video, &pic,
+						       &ref_msg.ref))))
 			goto cancel;
 
-		ret = gl_capture_start_pbo(gl_capture, video);
-		video->pbo_time = now;
+		if (unlikely(spill != NULL)) {
+			memcpy(spill, &msg, sizeof(glc_message_header_t));
+			memcpy(&spill[sizeof(glc_message_header_t)], &ref_msg,
+			       sizeof(glc_ref_message_t));
+		} else {
+			if (unlikely((ret = ps_packet_write(&video->packet,
+							    &msg, sizeof(glc_message_header_t)))))
+				goto cancel;
+			if (unlikely((ret = ps_packet_write(&video->packet,
+							    &ref_msg, sizeof(glc_ref_message_t)))))
+				goto cancel;
+		}
+
+		if ((ret = gl_capture_start_pbo(gl_capture, video, now)) == EBUSY) {
+			video->pbo_starved++;
+			ret = 0;
+		}
+		goto close;
+	}
+
+	if (unlikely(spill != NULL)) {
+		memcpy(spill, &msg, sizeof(glc_message_header_t));
+		memcpy(&spill[sizeof(glc_message_header_t)], &pic,
+		       sizeof(glc_video_frame_header_t));
+		dma = &spill[sizeof(glc_message_header_t) + sizeof(glc_video_frame_header_t)];
 	} else {
+		if (unlikely((ret = ps_packet_write(&video->packet,
+						    &msg, sizeof(glc_message_header_t)))))
+			goto cancel;
+		if (unlikely((ret = ps_packet_write(&video->packet,
+						    &pic, sizeof(glc_video_frame_header_t)))))
+			goto cancel;
 		if (unlikely((ret = ps_packet_dma(&video->packet, (void *) &dma,
-					video->row * video->ch, PS_ACCEPT_FAKE_DMA))))
+					video->size, PS_ACCEPT_FAKE_DMA))))
 			goto cancel;
+	}
 
+	if (video->gather_stats)
+		before_capture = glc_state_time(gl_capture->glc);
+	if (gl_capture->flags & GL_CAPTURE_USE_PBO) {
+		if (unlikely((ret = gl_capture_read_pbo(gl_capture, video, dma))))
+			goto cancel;
+
+		ret = gl_capture_start_pbo(gl_capture, video, now);
+	} else
 		ret = gl_capture_get_pixels(gl_capture, video, dma);
-	}
 	if (video->gather_stats) {
 		after_capture = glc_state_time(gl_capture->glc);
 		video->capture_time_ns += after_capture - before_capture;
 	}
 
-	ps_packet_close(&video->packet);
+	/* an unchanged picture is sent as a repeat of the previous one */
+	if ((gl_capture->flags & GL_CAPTURE_SKIP_REPEATS) && (likely(!ret))) {
+		hash = glc_util_hash(dma, video->size);
+		hashed = 1;
+		if ((video->last_hash_valid) && (hash == video->last_hash)) {
+			if (unlikely((ret = gl_capture_write_repeat(gl_capture, video,
+								    &pic, &spill)))) {
+				if ((ret == EBUSY) || (ret == ENOSPC) || (ret == EINTR)) {
+					ret = 0;
+					glc_log(gl_capture->glc, GLC_INFO, "gl_capture",
+						"dropped frame #%u, buffer not ready",
+						video->num_frames);
+				}
+				goto finish;
+			}
+			video->num_repeated_frames++;
+		}
+	}
+
+close:
+	if (unlikely(spill != NULL))
+		glc_elastic_write_close(gl_capture->elastic, spill);
+	else {
+		ps_packet_close(&video->packet);
+		glc_thread_pool_notify(gl_capture->glc);
+	}
 	video->num_captured_frames++;
+	if (hashed) {
+		video->last_hash = hash;
+		video->last_hash_valid = 1;
+	}
 	now = glc_state_time(gl_capture->glc);
 
 	if (unlikely((gl_capture->flags & GL_CAPTURE_LOCK_FPS) &&
@@ -1012,7 +2143,8 @@ int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable drawable
 		video->last += gl_capture->fps_rem;
 
 finish:
-	gl_capture_release_video_stream(video);
+	gl_capture_app.inside = 0;
+	pthread_rwlock_unlock(&gl_capture->capture_rwlock);
 	if (unlikely(ret != 0))
 		gl_capture_error(gl_capture, ret);
 
@@ -1027,7 +2159,12 @@ cancel:
 			"dropped frame #%u, buffer not ready",
 			video->num_frames);
 	}
-	ps_packet_cancel(&video->packet);
+	if (ref_msg.ref)
+		glc_packet_ref_put(ref_msg.ref);
+	if (unlikely(spill != NULL))
+		glc_elastic_write_cancel(gl_capture->elastic, spill);
+	else
+		ps_packet_cancel(&video->packet);
 	goto finish;
 }
 
@@ -1047,6 +2184,58 @@ int gl_capture_refresh_color_correction(gl_capture_t gl_capture)
 	return 0;
 }
 
+/**
+ * \brief replace the picture just read by a repeat of the previous one
+ *
+ * The full size packet is dropped and a header only packet is written
+ * in its place, in the elastic store if the picture was spilled.
+ * \return 0 on success otherwise an error code, nothing is left open
+ *         on error
+ */
+int gl_capture_write_repeat(gl_capture_t gl_capture,
+			    struct gl_capture_video_stream_s *video,
+			    glc_video_frame_header_t *pic, char **spill)
+{
+	glc_message_header_t msg;
+	size_t size = sizeof(glc_message_header_t) + sizeof(glc_video_frame_header_t);
+	int ret;
+
+	msg.type = GLC_MESSAGE_VIDEO_REPEAT;
+
+	if (*spill != NULL) {
+		glc_elastic_write_cancel(gl_capture->elastic, *spill);
+		*spill = NULL;
+		if (unlikely((ret = glc_elastic_write_open(gl_capture->elastic,
+							   size, spill)))) {
+			*spill = NULL;
+			return ret;
+		}
+		memcpy(*spill, &msg, sizeof(glc_message_header_t));
+		memcpy(&(*spill)[sizeof(glc_message_header_t)], pic,
+		       sizeof(glc_video_frame_header_t));
+		return 0;
+	}
+
+	/*
+	 * space just given back by the picture is normally enough for
+	 * the header, so the wait is short and the repeat is not dropped
+	 */
+	ps_packet_cancel(&video->packet);
+	if (unlikely((ret = ps_packet_open(&video->packet, PS_PACKET_WRITE))))
+		return ret;
+	if (unlikely((ret = ps_packet_write(&video->packet,
+					    &msg, sizeof(glc_message_header_t)))))
+		goto err;
+	if (unlikely((ret = ps_packet_write(&video->packet,
+					    pic, sizeof(glc_video_frame_header_t)))))
+		goto err;
+	return 0;
+
+err:
+	ps_packet_cancel(&video->packet);
+	return ret;
+}
+
 /** \todo support GammaRamp */
 int gl_capture_update_color(gl_capture_t gl_capture,
 			    struct gl_capture_video_stream_s *video,
@@ -1079,28 +2268,81 @@ int gl_capture_update_color(gl_capture_t gl_capture,
 		"color correction: brightness=%f, contrast=%f, red=%f, green=%f, blue=%f",
 		 msg.brightness, msg.contrast, msg.red, msg.green, msg.blue);
 
-	if (unlikely((ret = ps_packet_open(packet, PS_PACKET_WRITE))))
-		goto err;
-	if (unlikely((ret = ps_packet_write(packet,
-				&msg_hdr, sizeof(glc_message_header_t)))))
-		goto err;
-	if (unlikely((ret = ps_packet_write(packet,
-				&msg, sizeof(glc_color_message_t)))))
-		goto err;
-	if (unlikely((ret = ps_packet_close(packet))))
+	if (unlikely((ret = gl_capture_write_message(gl_capture, packet, &msg_hdr,
+						     &msg, sizeof(glc_color_message_t)))))
 		goto err;
 
+	/* previous picture was corrected with old values */
+	video->last_hash_valid = 0;
 	return 0;
 
 err:
-	ps_packet_cancel(packet);
-
 	glc_log(gl_capture->glc, GLC_ERROR, "gl_capture",
 		 "can't write gamma correction information to buffer: %s (%d)",
 		 strerror(ret), ret);
 	return ret;
 }
 
+int gl_capture_push_message(gl_capture_t gl_capture, glc_message_header_t *hdr,
+			    const void *message, size_t message_size)
+{
+	ps_packet_t packet;
+	int ret;
+
+	if (unlikely((ret = ps_packet_init(&packet, gl_capture->to))))
+		return ret;
+	ret = gl_capture_write_message(gl_capture, &packet, hdr,
+				       message, message_size);
+	ps_packet_destroy(&packet);
+	return ret;
+}
+
+/**
+ * \brief write a message behind frames in the elastic store
+ *
+ * Falls back to waiting for the store only if it is full.
+ */
+int gl_capture_write_message(gl_capture_t gl_capture, ps_packet_t *packet,
+			     glc_message_header_t *hdr,
+			     const void *message, size_t message_size)
+{
+	char *spill;
+	int ret;
+
+	if ((gl_capture->elastic) && (glc_elastic_pending(gl_capture->elastic))) {
+		if (likely(!(ret = glc_elastic_write_open(gl_capture->elastic,
+						sizeof(glc_message_header_t) + message_size,
+						&spill)))) {
+			memcpy(spill, hdr, sizeof(glc_message_header_t));
+			if (message_size)
+				memcpy(&spill[sizeof(glc_message_header_t)],
+				       message, message_size);
+			return glc_elastic_write_close(gl_capture->elastic, spill);
+		}
+		if (ret != ENOSPC)
+			return ret;
+		if (unlikely((ret = glc_elastic_flush(gl_capture->elastic))))
+			return ret;
+	}
+
+	if (unlikely((ret = ps_packet_open(packet, PS_PACKET_WRITE))))
+		return ret;
+	if (unlikely((ret = ps_packet_write(packet, hdr,
+					    sizeof(glc_message_header_t)))))
+		goto cancel;
+	if ((message_size) &&
+	    (unlikely((ret = ps_packet_write(packet, (void *) message,
+					     message_size)))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_close(packet))))
+		goto cancel;
+	glc_thread_pool_notify(gl_capture->glc);
+	return 0;
+cancel:
+	ps_packet_cancel(packet);
+	return ret;
+}
+
 int gl_capture_set_attribute_window(gl_capture_t gl_capture, Display *dpy,
 				    GLXDrawable drawable, Window window)
 {
@@ -1111,8 +2353,122 @@ int gl_capture_set_attribute_window(gl_capture_t gl_capture, Display *dpy,
 		"setting attribute window %p for drawable %p",
 		(void *) window, (void *) drawable);
 	video->attribWin = window;
+	video->geometry_events = 0;
+	__atomic_store_n(&video->geometry, 0, __ATOMIC_RELEASE);
 	return 0;
 }
 
-/**  \} */
+int gl_capture_window_configured(gl_capture_t gl_capture, Display *dpy,
+				 Window window, unsigned int w, unsigned int h)
+{
+	struct gl_capture_video_stream_s *video;
+
+	/* streams are only added at list head, it can be walked without locking */
+	for (video = gl_capture->video; video != NULL; video = video->next) {
+		if ((video->dpy != dpy) ||
+		    ((video->attribWin ? video->attribWin : video->drawable) != window))
+			continue;
+
+		video->geometry_events = 1;
+		__atomic_store_n(&video->geometry, ((uint64_t) w << 32) | h,
+				 __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+void gl_capture_track_bind_buffer(GLenum target, GLuint buffer)
+{
+	if ((target == GL_PIXEL_PACK_BUFFER_ARB) && (likely(!gl_capture_app.inside)))
+		gl_capture_app.pack_buffer = buffer;
+}
+
+void gl_capture_track_delete_buffers(GLsizei n, const GLuint *buffers)
+{
+	GLsizei i;
+
+	if (unlikely(gl_capture_app.inside))
+		return;
+
+	/* deleting a bound buffer reverts the binding to 0 */
+	for (i = 0; i < n; i++) {
+		if ((buffers[i]) && (buffers[i] == gl_capture_app.pack_buffer))
+			gl_capture_app.pack_buffer = 0;
+	}
+}
+
+void gl_capture_track_bind_framebuffer(GLenum target, GLuint framebuffer)
+{
+	if (unlikely(gl_capture_app.inside))
+		return;
+
+	if ((target == GL_FRAMEBUFFER) || (target == GL_READ_FRAMEBUFFER))
+		gl_capture_app.read_framebuffer = framebuffer;
+	if ((target == GL_FRAMEBUFFER) || (target == GL_DRAW_FRAMEBUFFER))
+		gl_capture_app.draw_framebuffer = framebuffer;
+}
+
+void gl_capture_track_delete_framebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	GLsizei i;
+
+	if (unlikely(gl_capture_app.inside))
+		return;
+
+	for (i = 0; i < n; i++) {
+		if (!framebuffers[i])
+			continue;
+		if (framebuffers[i] == gl_capture_app.read_framebuffer)
+			gl_capture_app.read_framebuffer = 0;
+		if (framebuffers[i] == gl_capture_app.draw_framebuffer)
+			gl_capture_app.draw_framebuffer = 0;
+	}
+}
+
+void gl_capture_track_use_program(GLuint program)
+{
+	if (likely(!gl_capture_app.inside))
+		gl_capture_app.program = program;
+}
+
+void gl_capture_track_active_texture(GLenum texture)
+{
+	if (likely(!gl_capture_app.inside))
+		gl_capture_app.active_texture = texture;
+}
+
+void gl_capture_track_read_buffer(GLenum mode)
+{
+	/* only the window read buffer matters */
+	if ((!gl_capture_app.read_framebuffer) && (likely(!gl_capture_app.inside)))
+		gl_capture_app.read_buffer = mode;
+}
+
+void gl_capture_track_pixel_store(GLenum pname, GLint param)
+{
+	if (unlikely(gl_capture_app.inside))
+		return;
+
+	switch (pname) {
+	case GL_PACK_ALIGNMENT:
+		gl_capture_app.pack_alignment = param;
+		break;
+	case GL_PACK_ROW_LENGTH:
+		gl_capture_app.pack_row_length = param;
+		break;
+	case GL_PACK_SKIP_ROWS:
+		gl_capture_app.pack_skip_rows = param;
+		break;
+	case GL_PACK_SKIP_PIXELS:
+		gl_capture_app.pack_skip_pixels = param;
+		break;
+	}
+}
 
+void gl_capture_track_reset()
+{
+	if (likely(!gl_capture_app.inside))
+		gl_capture_app.known = 0;
+}
+
+/**  \} */
@@ -20,6 +20,7 @@
 #include <GL/glx.h>
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/common/elastic.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,6 +49,31 @@ __PUBLIC int gl_capture_init(gl_capture_t *gl_capture, glc_t *glc);
  */
 __PUBLIC int gl_capture_set_buffer(gl_capture_t gl_capture, ps_buffer_t *buffer);
 
+/**
+ * \brief set elastic overflow store size
+ *
+ * Frames that do not fit in the target buffer are kept in a store
+ * that grows in chunk_size steps up to max_size instead of being
+ * dropped, and are written to the buffer as soon as it has room.
+ * Store is created at gl_capture_start(). Disabled by default.
+ * \param gl_capture gl_capture object
+ * \param chunk_size store growth step
+ * \param max_size maximum store size, 0 disables the store
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_elastic(gl_capture_t gl_capture, size_t chunk_size,
+				    size_t max_size);
+
+/**
+ * \brief get elastic overflow store statistics
+ * \param gl_capture gl_capture object
+ * \param stat returned statistics
+ * \return 0 on success, EAGAIN if there is no store
+ *         otherwise an error code
+ */
+__PUBLIC int gl_capture_get_elastic_stat(gl_capture_t gl_capture,
+					 glc_elastic_stat_t *stat);
+
 /**
  * \brief set OpenGL read buffer for capturing
  *
@@ -84,6 +110,66 @@ __PUBLIC int gl_capture_set_pack_alignment(gl_capture_t gl_capture,
  */
 __PUBLIC int gl_capture_try_pbo(gl_capture_t gl_capture, int try_pbo);
 
+/** maximum number of PBOs per video stream */
+#define GL_CAPTURE_MAX_PBO 8
+
+/**
+ * \brief set number of PBOs per video stream
+ *
+ * Transfers go round a ring of count PBOs and the oldest one is
+ * mapped, so the driver has count frames to complete a transfer
+ * before mapping stalls the render thread. Captured frames are
+ * count frames late but keep their own timestamp. Default is 1.
+ * \param gl_capture gl_capture object
+ * \param count number of PBOs, 1 to GL_CAPTURE_MAX_PBO
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_pbo_count(gl_capture_t gl_capture, unsigned int count);
+
+/**
+ * \brief use persistently mapped PBOs if available
+ *
+ * With GL_ARB_buffer_storage and GL_ARB_sync, frames are read into
+ * PBOs that stay mapped and are sent downstream as GLC_MESSAGE_REF
+ * instead of being copied into the target buffer. Twice the PBO
+ * count is allocated so frames can be held while new transfers are
+ * started, a transfer is skipped when every PBO is still held.
+ * Disabled by default.
+ * \param gl_capture gl_capture object
+ * \param try_persistent 0 = use mapped copies, 1 = try persistent PBOs
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_try_persistent_pbo(gl_capture_t gl_capture, int try_persistent);
+
+/**
+ * \brief convert frames to Y'CbCr on GPU if possible
+ *
+ * Frames are converted to GLC_VIDEO_YCBCR_420JPEG by a shader before
+ * being read back, moving 1.5 bytes per pixel instead of 3 or 4.
+ * Needs GLSL, framebuffer objects and GL_R8, streams keep the pixel
+ * format set with gl_capture_set_pixel_format() otherwise. Disabled
+ * by default.
+ * \param gl_capture gl_capture object
+ * \param convert 0 = read pixel format as is, 1 = convert on GPU
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_convert_ycbcr(gl_capture_t gl_capture, int convert);
+
+/**
+ * \brief scale frames on GPU before reading them back
+ *
+ * Captured area is blitted with linear filtering into a framebuffer
+ * object of the scaled size, so readback and any Y'CbCr conversion
+ * only process the small picture. Format messages of such streams
+ * carry GLC_VIDEO_SCALED. Streams are read at full size when GL
+ * lacks framebuffer blits or the read buffer is multisampled.
+ * Default is 1.0, no scaling.
+ * \param gl_capture gl_capture object
+ * \param scale scale factor, between 0 and 1
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_set_scale(gl_capture_t gl_capture, double scale);
+
 /**
  * \brief set pixel format
  *
@@ -194,6 +280,20 @@ __PUBLIC int gl_capture_frame(gl_capture_t gl_capture, Display *dpy, GLXDrawable
  */
 __PUBLIC int gl_capture_refresh_color_correction(gl_capture_t gl_capture);
 
+/**
+ * \brief write a message to the target buffer
+ *
+ * Goes through the elastic store while it holds frames so the
+ * message does not overtake them.
+ * \param gl_capture gl_capture object
+ * \param hdr message header
+ * \param message message, can be NULL if message_size is 0
+ * \param message_size size of message
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_push_message(gl_capture_t gl_capture, glc_message_header_t *hdr,
+				     const void *message, size_t message_size);
+
 /**
  * \brief set attribute window for drawable
  *
@@ -217,6 +317,133 @@ __PUBLIC int gl_capture_refresh_color_correction(gl_capture_t gl_capture);
 __PUBLIC int gl_capture_set_attribute_window(gl_capture_t gl_capture, Display *dpy,
 					     GLXDrawable drawable, Window window);
 
+/**
+ * \brief window size changed
+ *
+ * Call on every ConfigureNotify the application receives. Streams
+ * of that window then use the size from the event instead of asking
+ * the X server on every captured frame. May be called from any thread.
+ * \param gl_capture gl_capture object
+ * \param dpy X Display
+ * \param window configured window
+ * \param w new width
+ * \param h new height
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_window_configured(gl_capture_t gl_capture, Display *dpy,
+					  Window window, unsigned int w, unsigned int h);
+
+/**
+ * \brief trust application GL state reported by the gl_capture_track_*()
+ *        functions
+ *
+ * Capturing then restores pack buffer binding, read buffer and pack
+ * pixel storage from the reported values instead of querying them or
+ * pushing attributes, which may sync with the server on every frame.
+ * State is queried once after each context switch. Only enable it if
+ * every change of that state is reported. Disabled by default.
+ * \param gl_capture gl_capture object
+ * \param track 0 = query state, 1 = use reported state
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_track_state(gl_capture_t gl_capture, int track);
+
+/**
+ * \brief pick fastest readback settings on first captured frames
+ *
+ * Pixel formats, pack alignments and PBO or direct reads are timed
+ * once, one read per frame on the capture area, and the fastest
+ * combination replaces current settings. Frames read for timing, a
+ * couple dozen at most, are not captured. The
+ * choice is stored in profile for the GL_RENDERER in use and reused
+ * next time instead of timing again. Disabled by default.
+ * \param gl_capture gl_capture object
+ * \param profile profile file, NULL to time on every start
+ * \param any_format 1 = GL_BGR and GL_BGRA may be picked,
+ *                   0 = keep current pixel format
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_autotune(gl_capture_t gl_capture, const char *profile,
+				 int any_format);
+
+/**
+ * \brief send unchanged frames as repeats of the previous one
+ *
+ * Every picture read is hashed, one equal to the last picture sent
+ * goes downstream as a GLC_MESSAGE_VIDEO_REPEAT holding only the
+ * frame header. Disabled by default.
+ * \param gl_capture gl_capture object
+ * \param skip 0 = send every frame, 1 = send repeats
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int gl_capture_skip_repeats(gl_capture_t gl_capture, int skip);
+
+/**
+ * \brief report glBindBuffer()
+ *
+ * The gl_capture_track_*() functions record state of the context
+ * current in calling thread, for every gl_capture object. Calls made
+ * by gl_capture itself are ignored.
+ * \param target buffer target
+ * \param buffer bound buffer
+ */
+__PUBLIC void gl_capture_track_bind_buffer(GLenum target, GLuint buffer);
+
+/**
+ * \brief report glDeleteBuffers()
+ * \param n number of buffers
+ * \param buffers deleted buffers
+ */
+__PUBLIC void gl_capture_track_delete_buffers(GLsizei n, const GLuint *buffers);
+
+/**
+ * \brief report glBindFramebuffer()
+ * \param target framebuffer target
+ * \param framebuffer bound framebuffer
+ */
+__PUBLIC void gl_capture_track_bind_framebuffer(GLenum target, GLuint framebuffer);
+
+/**
+ * \brief report glDeleteFramebuffers()
+ * \param n number of framebuffers
+ * \param framebuffers deleted framebuffers
+ */
+__PUBLIC void gl_capture_track_delete_framebuffers(GLsizei n,
+						   const GLuint *framebuffers);
+
+/**
+ * \brief report glUseProgram()
+ * \param program program in use
+ */
+__PUBLIC void gl_capture_track_use_program(GLuint program);
+
+/**
+ * \brief report glActiveTexture()
+ * \param texture active texture unit
+ */
+__PUBLIC void gl_capture_track_active_texture(GLenum texture);
+
+/**
+ * \brief report glReadBuffer()
+ * \param mode read buffer
+ */
+__PUBLIC void gl_capture_track_read_buffer(GLenum mode);
+
+/**
+ * \brief report glPixelStorei() or glPixelStoref()
+ * \param pname parameter
+ * \param param value
+ */
+__PUBLIC void gl_capture_track_pixel_store(GLenum pname, GLint param);
+
+/**
+ * \brief forget tracked state
+ *
+ * Report context switches and state restored from attribute stacks
+ * with this, state is queried again on next capture.
+ */
+__PUBLIC void gl_capture_track_reset();
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,278 @@
+/**
+ * \file glc/capture/gl_scale.c
+ * \brief GPU side picture scaling
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup gl_scale
+ *  \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/log.h>
+#include <glc/common/optimization.h>
+
+#include "gl_scale.h"
+
+struct gl_scale_s {
+	glc_t *glc;
+	double factor;
+
+	unsigned int w, h;   /* captured area */
+	unsigned int sw, sh; /* scaled picture */
+
+	GLuint rbo, fbo;
+
+	PFNGLGENFRAMEBUFFERSPROC         glGenFramebuffers;
+	PFNGLBINDFRAMEBUFFERPROC         glBindFramebuffer;
+	PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbuffer;
+	PFNGLCHECKFRAMEBUFFERSTATUSPROC  glCheckFramebufferStatus;
+	PFNGLDELETEFRAMEBUFFERSPROC      glDeleteFramebuffers;
+	PFNGLGENRENDERBUFFERSPROC        glGenRenderbuffers;
+	PFNGLBINDRENDERBUFFERPROC        glBindRenderbuffer;
+	PFNGLRENDERBUFFERSTORAGEPROC     glRenderbufferStorage;
+	PFNGLDELETERENDERBUFFERSPROC     glDeleteRenderbuffers;
+	PFNGLBLITFRAMEBUFFERPROC         glBlitFramebuffer;
+};
+
+static int gl_scale_supported();
+static int gl_scale_load(gl_scale_t scale, gl_scale_get_proc_t get_proc);
+
+int gl_scale_init(gl_scale_t *scale, glc_t *glc,
+		  gl_scale_get_proc_t get_proc, double factor)
+{
+	int ret;
+
+	if (unlikely((factor <= 0) || (factor > 1)))
+		return EINVAL;
+	if (unlikely(!gl_scale_supported()))
+		return ENOTSUP;
+
+	*scale = (gl_scale_t) calloc(1, sizeof(struct gl_scale_s));
+	if (unlikely(!*scale))
+		return ENOMEM;
+	(*scale)->glc = glc;
+	(*scale)->factor = factor;
+
+	if (unlikely((ret = gl_scale_load(*scale, get_proc)))) {
+		free(*scale);
+		*scale = NULL;
+		return ret;
+	}
+
+	glc_log(glc, GLC_INFO, "gl_scale", "scaling with factor %f on GPU", factor);
+	return 0;
+}
+
+int gl_scale_destroy(gl_scale_t scale)
+{
+	/* we might be in wrong thread */
+	if (scale->fbo)
+		scale->glDeleteFramebuffers(1, &scale->fbo);
+	if (scale->rbo)
+		scale->glDeleteRenderbuffers(1, &scale->rbo);
+
+	free(scale);
+	return 0;
+}
+
+/**
+ * \brief glBlitFramebuffer() is needed
+ *
+ * glXGetProcAddress() never fails with some implementations, so
+ * version and extensions are checked instead.
+ */
+int gl_scale_supported()
+{
+	const char *version = (const char *) glGetString(GL_VERSION);
+	const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+	int major = 0, minor = 0;
+
+	if (unlikely((!version) || (!extensions)))
+		return 0;
+	if (sscanf(version, "%d.%d", &major, &minor) != 2)
+		return 0;
+
+	if (major >= 3)
+		return 1;
+	return strstr(extensions, "GL_ARB_framebuffer_object") != NULL;
+}
+
+#define GL_SCALE_PROC(type, name) \
+	if (unlikely(!(scale->name = (type) get_proc((const GLubyte *) #name)))) \
+		return ENOTSUP;
+
+int gl_scale_load(gl_scale_t scale, gl_scale_get_proc_t get_proc)
+{
+	GL_SCALE_PROC(PFNGLGENFRAMEBUFFERSPROC,         glGenFramebuffers)
+	GL_SCALE_PROC(PFNGLBINDFRAMEBUFFERPROC,         glBindFramebuffer)
+	GL_SCALE_PROC(PFNGLFRAMEBUFFERRENDERBUFFERPROC, glFramebufferRenderbuffer)
+	GL_SCALE_PROC(PFNGLCHECKFRAMEBUFFERSTATUSPROC,  glCheckFramebufferStatus)
+	GL_SCALE_PROC(PFNGLDELETEFRAMEBUFFERSPROC,      glDeleteFramebuffers)
+	GL_SCALE_PROC(PFNGLGENRENDERBUFFERSPROC,        glGenRenderbuffers)
+	GL_SCALE_PROC(PFNGLBINDRENDERBUFFERPROC,        glBindRenderbuffer)
+	GL_SCALE_PROC(PFNGLRENDERBUFFERSTORAGEPROC,     glRenderbufferStorage)
+	GL_SCALE_PROC(PFNGLDELETERENDERBUFFERSPROC,     glDeleteRenderbuffers)
+	GL_SCALE_PROC(PFNGLBLITFRAMEBUFFERPROC,         glBlitFramebuffer)
+	return 0;
+}
+
+int gl_scale_set_size(gl_scale_t scale, unsigned int w, unsigned int h,
+		      unsigned int *sw, unsigned int *sh)
+{
+	GLint read_fbo, draw_fbo, renderbuffer, samples;
+	GLenum status;
+
+	if (unlikely((!w) || (!h)))
+		return EINVAL;
+	if ((w == scale->w) && (h == scale->h))
+		goto done;
+
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer);
+
+	/* a multisampled source can't be blitted to a different size */
+	scale->glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glGetIntegerv(GL_SAMPLE_BUFFERS, &samples);
+	if (unlikely(samples)) {
+		scale->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+		scale->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+		glc_log(scale->glc, GLC_WARN, "gl_scale",
+			"can't scale multisampled framebuffer");
+		return ENOTSUP;
+	}
+
+	if (!scale->fbo) {
+		scale->glGenRenderbuffers(1, &scale->rbo);
+		scale->glGenFramebuffers(1, &scale->fbo);
+	}
+
+	scale->w = w;
+	scale->h = h;
+	/* same rounding as the scale filter */
+	scale->sw = scale->factor * w;
+	scale->sh = scale->factor * h;
+	if (unlikely(!scale->sw))
+		scale->sw = 1;
+	if (unlikely(!scale->sh))
+		scale->sh = 1;
+
+	scale->glBindRenderbuffer(GL_RENDERBUFFER, scale->rbo);
+	scale->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, scale->sw, scale->sh);
+
+	scale->glBindFramebuffer(GL_FRAMEBUFFER, scale->fbo);
+	scale->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+					 GL_RENDERBUFFER, scale->rbo);
+	status = scale->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	scale->glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	scale->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	scale->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+
+	if (unlikely(status != GL_FRAMEBUFFER_COMPLETE)) {
+		glc_log(scale->glc, GLC_ERROR, "gl_scale",
+			"incomplete framebuffer (0x%04x)", status);
+		scale->w = scale->h = 0;
+		return ENOTSUP;
+	}
+
+	glc_log(scale->glc, GLC_DEBUG, "gl_scale", "scaling %ux%u to %ux%u",
+		scale->w, scale->h, scale->sw, scale->sh);
+done:
+	if (sw)
+		*sw = scale->sw;
+	if (sh)
+		*sh = scale->sh;
+	return 0;
+}
+
+int gl_scale_blit(gl_scale_t scale, GLenum read_buffer,
+		  unsigned int x, unsigned int y, GLuint *framebuffer)
+{
+	GLint read_fbo, draw_fbo;
+
+	if (unlikely(!scale->w))
+		return EINVAL;
+
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	/* scissor test applies to blits, sRGB conversion too */
+	glPushAttrib(GL_PIXEL_MODE_BIT | GL_ENABLE_BIT | GL_SCISSOR_BIT);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_FRAMEBUFFER_SRGB);
+
+	scale->glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(read_buffer);
+	scale->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, scale->fbo);
+	scale->glBlitFramebuffer(x, y, x + scale->w, y + scale->h,
+				 0, 0, scale->sw, scale->sh,
+				 GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+	/* bindings first, popped state belongs to the application framebuffer */
+	scale->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	scale->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	glPopAttrib();
+
+	*framebuffer = scale->fbo;
+	return 0;
+}
+
+int gl_scale_read(gl_scale_t scale, GLenum read_buffer,
+		  unsigned int x, unsigned int y,
+		  GLenum format, GLint alignment, GLvoid *to)
+{
+	GLint read_fbo;
+	GLuint fbo;
+	int ret;
+
+	if (unlikely((ret = gl_scale_blit(scale, read_buffer, x, y, &fbo))))
+		return ret;
+
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glPushAttrib(GL_PIXEL_MODE_BIT);
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+
+	scale->glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+	glReadPixels(0, 0, scale->sw, scale->sh, format, GL_UNSIGNED_BYTE, to);
+
+	scale->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	glPopClientAttrib();
+	glPopAttrib();
+
+	return 0;
+}
+
+/**  \} */
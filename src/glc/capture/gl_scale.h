@@ -0,0 +1,126 @@
+/**
+ * \file glc/capture/gl_scale.h
+ * \brief GPU side picture scaling
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup capture
+ *  \{
+ * \defgroup gl_scale GPU scaling
+ *  \{
+ */
+
+#ifndef _GL_SCALE_H
+#define _GL_SCALE_H
+
+#include <GL/gl.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** GL function lookup, ie. glXGetProcAddressARB() */
+typedef void (*(*gl_scale_get_proc_t)(const GLubyte *name))(void);
+
+/**
+ * \brief gl_scale object
+ *
+ * Blits an area of the read buffer into a smaller framebuffer object
+ * with linear filtering, so only the scaled picture is read back.
+ * Scaled size is computed like the scale filter does.
+ *
+ * Every call must be made with the GL context current. GL state
+ * touched is restored.
+ */
+typedef struct gl_scale_s* gl_scale_t;
+
+/**
+ * \brief initialize gl_scale object
+ * \param scale gl_scale object
+ * \param glc glc
+ * \param get_proc GL function lookup
+ * \param factor scale factor, between 0 and 1
+ * \return 0 on success, ENOTSUP if GL lacks framebuffer blits,
+ *         otherwise an error code
+ */
+__PRIVATE int gl_scale_init(gl_scale_t *scale, glc_t *glc,
+			    gl_scale_get_proc_t get_proc, double factor);
+
+/**
+ * \brief destroy gl_scale object
+ * \param scale gl_scale object
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_scale_destroy(gl_scale_t scale);
+
+/**
+ * \brief set size of captured area
+ * \param scale gl_scale object
+ * \param w width
+ * \param h height
+ * \param sw returned scaled width
+ * \param sh returned scaled height
+ * \return 0 on success, ENOTSUP if read buffer is multisampled,
+ *         otherwise an error code
+ */
+__PRIVATE int gl_scale_set_size(gl_scale_t scale, unsigned int w, unsigned int h,
+				unsigned int *sw, unsigned int *sh);
+
+/**
+ * \brief scale area into framebuffer object
+ * \param scale gl_scale object
+ * \param read_buffer GL_FRONT or GL_BACK
+ * \param x left edge of area
+ * \param y bottom edge of area
+ * \param framebuffer returned framebuffer object holding scaled
+ *                    picture in GL_COLOR_ATTACHMENT0
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_scale_blit(gl_scale_t scale, GLenum read_buffer,
+			    unsigned int x, unsigned int y, GLuint *framebuffer);
+
+/**
+ * \brief scale area and read it back
+ * \param scale gl_scale object
+ * \param read_buffer GL_FRONT or GL_BACK
+ * \param x left edge of area
+ * \param y bottom edge of area
+ * \param format GL_BGR or GL_BGRA
+ * \param alignment pack alignment
+ * \param to glReadPixels() destination, an offset if a pixel pack
+ *           buffer is bound
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_scale_read(gl_scale_t scale, GLenum read_buffer,
+			    unsigned int x, unsigned int y,
+			    GLenum format, GLint alignment, GLvoid *to);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -0,0 +1,403 @@
+/**
+ * \file glc/capture/gl_tune.c
+ * \brief readback settings calibration
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup gl_tune
+ *  \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+#include <glc/common/optimization.h>
+
+#include "gl_tune.h"
+
+/** reads per combination, the best one counts */
+#define GL_TUNE_ROUNDS 3
+/** formats x alignments x paths */
+#define GL_TUNE_MAX_CANDIDATES 8
+
+struct gl_tune_pbo_s {
+	GLuint pbo;
+	PFNGLGENBUFFERSARBPROC    glGenBuffers;
+	PFNGLDELETEBUFFERSARBPROC glDeleteBuffers;
+	PFNGLBUFFERDATAARBPROC    glBufferData;
+	PFNGLBINDBUFFERARBPROC    glBindBuffer;
+	PFNGLMAPBUFFERARBPROC     glMapBuffer;
+	PFNGLUNMAPBUFFERARBPROC   glUnmapBuffer;
+};
+
+struct gl_tune_s {
+	glc_t *glc;
+	struct gl_tune_pbo_s pbo;
+	int flags;
+
+	gl_tune_config_t candidate[GL_TUNE_MAX_CANDIDATES];
+	glc_utime_t best[GL_TUNE_MAX_CANDIDATES];
+	unsigned int num_candidates, current, round;
+
+	unsigned int w, h;
+	size_t size;
+	char *buf;
+};
+
+static int gl_tune_load_pbo(struct gl_tune_pbo_s *pbo, gl_tune_get_proc_t get_proc);
+static int gl_tune_set_size(gl_tune_t tune, unsigned int w, unsigned int h);
+static glc_utime_t gl_tune_time(gl_tune_t tune, GLenum read_buffer,
+				unsigned int x, unsigned int y,
+				const gl_tune_config_t *config);
+static const char *gl_tune_format_name(GLenum format);
+
+#define GL_TUNE_PROC(type, name, arb) \
+	if (unlikely(!(pbo->name = (type) get_proc((const GLubyte *) arb)))) \
+		return ENOTSUP;
+
+int gl_tune_load_pbo(struct gl_tune_pbo_s *pbo, gl_tune_get_proc_t get_proc)
+{
+	GL_TUNE_PROC(PFNGLGENBUFFERSARBPROC,    glGenBuffers,    "glGenBuffersARB")
+	GL_TUNE_PROC(PFNGLDELETEBUFFERSARBPROC, glDeleteBuffers, "glDeleteBuffersARB")
+	GL_TUNE_PROC(PFNGLBUFFERDATAARBPROC,    glBufferData,    "glBufferDataARB")
+	GL_TUNE_PROC(PFNGLBINDBUFFERARBPROC,    glBindBuffer,    "glBindBufferARB")
+	GL_TUNE_PROC(PFNGLMAPBUFFERARBPROC,     glMapBuffer,     "glMapBufferARB")
+	GL_TUNE_PROC(PFNGLUNMAPBUFFERARBPROC,   glUnmapBuffer,   "glUnmapBufferARB")
+	return 0;
+}
+
+const char *gl_tune_format_name(GLenum format)
+{
+	return (format == GL_BGR) ? "bgr" : "bgra";
+}
+
+int gl_tune_init(gl_tune_t *tune, glc_t *glc, gl_tune_get_proc_t get_proc,
+		 int flags, const gl_tune_config_t *config)
+{
+	static const GLint alignments[] = { 8, 1 };
+	GLenum formats[2];
+	unsigned int num_formats, f, a;
+	int pbo;
+
+	*tune = (gl_tune_t) calloc(1, sizeof(struct gl_tune_s));
+	if (unlikely(!*tune))
+		return ENOMEM;
+	(*tune)->glc = glc;
+
+	if ((flags & GL_TUNE_PBO) &&
+	    (unlikely(gl_tune_load_pbo(&(*tune)->pbo, get_proc)))) {
+		memset(&(*tune)->pbo, 0, sizeof(struct gl_tune_pbo_s));
+		flags &= ~GL_TUNE_PBO;
+	}
+	(*tune)->flags = flags;
+
+	num_formats = 0;
+	if (flags & GL_TUNE_FORMAT) {
+		formats[num_formats++] = GL_BGRA;
+		formats[num_formats++] = GL_BGR;
+	} else
+		formats[num_formats++] = config->format;
+
+	for (f = 0; f < num_formats; f++) {
+		for (a = 0; a < sizeof(alignments) / sizeof(alignments[0]); a++) {
+			for (pbo = 0; pbo <= !!(flags & GL_TUNE_PBO); pbo++) {
+				(*tune)->candidate[(*tune)->num_candidates].format = formats[f];
+				(*tune)->candidate[(*tune)->num_candidates].pack_alignment =
+					alignments[a];
+				(*tune)->candidate[(*tune)->num_candidates].pbo = pbo;
+				(*tune)->num_candidates++;
+			}
+		}
+	}
+
+	glc_log(glc, GLC_INFO, "gl_tune", "timing %u readback settings, one read per frame",
+		(*tune)->num_candidates);
+	return 0;
+}
+
+int gl_tune_destroy(gl_tune_t tune)
+{
+	/* we might be in wrong thread */
+	if (tune->pbo.pbo)
+		tune->pbo.glDeleteBuffers(1, &tune->pbo.pbo);
+	free(tune->buf);
+	free(tune);
+	return 0;
+}
+
+/**
+ * \brief size buffers for the largest picture of an area
+ */
+int gl_tune_set_size(gl_tune_t tune, unsigned int w, unsigned int h)
+{
+	GLint pack_buffer = 0;
+	size_t size;
+	char *buf;
+
+	/* 4 bytes per pixel and rows padded to 8 */
+	size = ((w * 4 + 7) & ~7) * h;
+	if (size > tune->size) {
+		if (unlikely(!(buf = (char *) realloc(tune->buf, size))))
+			return ENOMEM;
+		tune->buf = buf;
+		tune->size = size;
+
+		if (tune->flags & GL_TUNE_PBO) {
+			glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &pack_buffer);
+			if (!tune->pbo.pbo)
+				tune->pbo.glGenBuffers(1, &tune->pbo.pbo);
+			tune->pbo.glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, tune->pbo.pbo);
+			tune->pbo.glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, NULL,
+					       GL_STREAM_READ);
+			tune->pbo.glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pack_buffer);
+		}
+	}
+
+	if (tune->w)
+		glc_log(tune->glc, GLC_DEBUG, "gl_tune",
+			"capture area is now %ux%u, timing again", w, h);
+	tune->w = w;
+	tune->h = h;
+	tune->current = tune->round = 0;
+	return 0;
+}
+
+int gl_tune_step(gl_tune_t tune, GLenum read_buffer,
+		 unsigned int x, unsigned int y,
+		 unsigned int w, unsigned int h)
+{
+	gl_tune_config_t *config;
+	glc_utime_t time;
+	int ret;
+
+	if (tune->current == tune->num_candidates)
+		return 0;
+	if (unlikely((!w) || (!h)))
+		return EINVAL;
+
+	if (unlikely((w != tune->w) || (h != tune->h))) {
+		if (unlikely((ret = gl_tune_set_size(tune, w, h))))
+			return ret;
+	}
+
+	config = &tune->candidate[tune->current];
+	time = gl_tune_time(tune, read_buffer, x, y, config);
+	if ((!tune->round) || (time < tune->best[tune->current]))
+		tune->best[tune->current] = time;
+
+	if (++tune->round < GL_TUNE_ROUNDS)
+		return EAGAIN;
+
+	glc_log(tune->glc, GLC_PERF, "gl_tune",
+		"%s, alignment %d, %s: %" PRIu64 " nsec",
+		gl_tune_format_name(config->format), config->pack_alignment,
+		config->pbo ? "pbo" : "direct", tune->best[tune->current]);
+
+	tune->round = 0;
+	if (++tune->current < tune->num_candidates)
+		return EAGAIN;
+	return 0;
+}
+
+int gl_tune_result(gl_tune_t tune, gl_tune_config_t *config)
+{
+	unsigned int i, best = 0;
+
+	if (tune->current < tune->num_candidates)
+		return EAGAIN;
+
+	for (i = 1; i < tune->num_candidates; i++) {
+		if (tune->best[i] < tune->best[best])
+			best = i;
+	}
+
+	*config = tune->candidate[best];
+	return 0;
+}
+
+/**
+ * \brief time one read of the capture area
+ */
+glc_utime_t gl_tune_time(gl_tune_t tune, GLenum read_buffer,
+			 unsigned int x, unsigned int y,
+			 const gl_tune_config_t *config)
+{
+	glc_utime_t start, time;
+	GLint pack_buffer = 0;
+	size_t row;
+	GLvoid *map;
+
+	row = tune->w * (config->format == GL_BGR ? 3 : 4);
+	if (row % config->pack_alignment != 0)
+		row += config->pack_alignment - row % config->pack_alignment;
+
+	glPushAttrib(GL_PIXEL_MODE_BIT);
+	glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+	glReadBuffer(read_buffer);
+	glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+	glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, config->pack_alignment);
+
+	/* direct reads must not land in a buffer object */
+	if (tune->flags & GL_TUNE_PBO) {
+		glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING_ARB, &pack_buffer);
+		tune->pbo.glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB,
+				       config->pbo ? tune->pbo.pbo : 0);
+	}
+
+	start = glc_time(tune->glc);
+	if (!config->pbo)
+		glReadPixels(x, y, tune->w, tune->h, config->format,
+			     GL_UNSIGNED_BYTE, tune->buf);
+	else {
+		/* mapping waits for the transfer, which is charged too */
+		glReadPixels(x, y, tune->w, tune->h, config->format,
+			     GL_UNSIGNED_BYTE, NULL);
+		map = tune->pbo.glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY);
+		if (likely(map != NULL)) {
+			memcpy(tune->buf, map, row * tune->h);
+			tune->pbo.glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+		}
+	}
+	time = glc_time(tune->glc) - start;
+
+	if (tune->flags & GL_TUNE_PBO)
+		tune->pbo.glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, pack_buffer);
+	glPopClientAttrib();
+	glPopAttrib();
+
+	return time;
+}
+
+int gl_tune_load(glc_t *glc, const char *profile, const char *renderer,
+		 int flags, gl_tune_config_t *config)
+{
+	gl_tune_config_t stored;
+	char line[512], format[8], path[8];
+	int alignment, offset, found = 0;
+	FILE *file;
+
+	if (!(file = fopen(profile, "r")))
+		return ENOENT;
+
+	/* format alignment path renderer */
+	while (fgets(line, sizeof(line), file)) {
+		line[strcspn(line, "\n")] = '\0';
+		if (sscanf(line, "%7s %d %7s %n", format, &alignment, path, &offset) != 3)
+			continue;
+		if (strcmp(&line[offset], renderer))
+			continue;
+
+		if (!strcmp(format, "bgra"))
+			stored.format = GL_BGRA;
+		else if (!strcmp(format, "bgr"))
+			stored.format = GL_BGR;
+		else
+			continue;
+		if ((alignment != 1) && (alignment != 8))
+			continue;
+		stored.pack_alignment = alignment;
+		stored.pbo = !strcmp(path, "pbo");
+
+		found = 1;
+	}
+	fclose(file);
+
+	if (!found)
+		return ENOENT;
+	if ((!(flags & GL_TUNE_FORMAT)) && (stored.format != config->format))
+		return ENOENT;
+	if ((!(flags & GL_TUNE_PBO)) && (stored.pbo))
+		return ENOENT;
+
+	glc_log(glc, GLC_DEBUG, "gl_tune", "read settings for '%s' from %s",
+		renderer, profile);
+	*config = stored;
+	return 0;
+}
+
+int gl_tune_save(glc_t *glc, const char *profile, const char *renderer,
+		 const gl_tune_config_t *config)
+{
+	char *line = NULL, *tmp, format[8], path[8];
+	int alignment, offset, ret = 0;
+	size_t line_size = 0, len;
+	FILE *from, *to;
+
+	if (unlikely(asprintf(&tmp, "%s.tmp", profile) < 0))
+		return ENOMEM;
+	if (unlikely(!(to = fopen(tmp, "w")))) {
+		ret = errno;
+		free(tmp);
+		return ret;
+	}
+
+	/* lines of other renderers are kept as they are */
+	if ((from = fopen(profile, "r"))) {
+		while ((!ret) && (getline(&line, &line_size, from) != -1)) {
+			len = strcspn(line, "\n");
+			if ((sscanf(line, "%7s %d %7s %n", format, &alignment,
+				    path, &offset) == 3) && ((size_t) offset <= len) &&
+			    (len - offset == strlen(renderer)) &&
+			    (!strncmp(&line[offset], renderer, len - offset)))
+				continue;
+			if (unlikely(fputs(line, to) == EOF))
+				ret = EIO;
+			else if ((line[len] != '\n') && (unlikely(fputc('\n', to) == EOF)))
+				ret = EIO;
+		}
+		free(line);
+		fclose(from);
+	}
+
+	if (unlikely((!ret) &&
+		     (fprintf(to, "%s %d %s %s\n", gl_tune_format_name(config->format),
+			      config->pack_alignment, config->pbo ? "pbo" : "direct",
+			      renderer) < 0)))
+		ret = EIO;
+	if ((unlikely(fclose(to))) && (!ret))
+		ret = errno;
+
+	if ((likely(!ret)) && (unlikely(rename(tmp, profile))))
+		ret = errno;
+	if (unlikely(ret))
+		unlink(tmp);
+	free(tmp);
+
+	if (likely(!ret))
+		glc_log(glc, GLC_DEBUG, "gl_tune", "stored settings for '%s' in %s",
+			renderer, profile);
+	return ret;
+}
+
+/**  \} */
@@ -0,0 +1,156 @@
+/**
+ * \file glc/capture/gl_tune.h
+ * \brief readback settings calibration
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup capture
+ *  \{
+ * \defgroup gl_tune readback calibration
+ *  \{
+ */
+
+#ifndef _GL_TUNE_H
+#define _GL_TUNE_H
+
+#include <GL/gl.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** GL function lookup, ie. glXGetProcAddressARB() */
+typedef void (*(*gl_tune_get_proc_t)(const GLubyte *name))(void);
+
+/** pixel format may be GL_BGR or GL_BGRA */
+#define GL_TUNE_FORMAT   0x1
+/** GL_ARB_pixel_buffer_object is available */
+#define GL_TUNE_PBO      0x2
+
+/**
+ * \brief readback settings
+ */
+typedef struct {
+	/** GL_BGR or GL_BGRA */
+	GLenum format;
+	/** GL_PACK_ALIGNMENT, 1 or 8 */
+	GLint pack_alignment;
+	/** read through a pixel buffer object */
+	int pbo;
+} gl_tune_config_t;
+
+/**
+ * \brief gl_tune object
+ *
+ * Times every allowed combination of settings, one read per frame
+ * so the application never stalls on more than a single readback.
+ * Each combination reads the capture area a few times and keeps its
+ * best time. A PBO read is charged for the whole transfer, from
+ * starting it to mapping and copying the picture, since waiting on
+ * the transfer only disappears when the ring is deep enough.
+ *
+ * Every call but gl_tune_destroy() must be made with the GL context
+ * current. GL state touched is restored.
+ */
+typedef struct gl_tune_s* gl_tune_t;
+
+/**
+ * \brief initialize gl_tune object
+ * \param tune gl_tune object
+ * \param glc glc
+ * \param get_proc GL function lookup, only used with GL_TUNE_PBO
+ * \param flags GL_TUNE_FORMAT and GL_TUNE_PBO
+ * \param config current settings, format is kept without GL_TUNE_FORMAT
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_tune_init(gl_tune_t *tune, glc_t *glc, gl_tune_get_proc_t get_proc,
+			   int flags, const gl_tune_config_t *config);
+
+/**
+ * \brief destroy gl_tune object
+ * \param tune gl_tune object
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_tune_destroy(gl_tune_t tune);
+
+/**
+ * \brief time one read of the current combination
+ *
+ * Timing starts over if the area changes between calls.
+ * \param tune gl_tune object
+ * \param read_buffer GL_FRONT or GL_BACK
+ * \param x x coordinate of capture area
+ * \param y y coordinate of capture area
+ * \param w width of capture area
+ * \param h height of capture area
+ * \return 0 once every combination is timed, EAGAIN if reads remain,
+ *         otherwise an error code
+ */
+__PRIVATE int gl_tune_step(gl_tune_t tune, GLenum read_buffer,
+			   unsigned int x, unsigned int y,
+			   unsigned int w, unsigned int h);
+
+/**
+ * \brief fastest settings timed
+ * \param tune gl_tune object
+ * \param config fastest settings on output
+ * \return 0 on success, EAGAIN if reads remain
+ */
+__PRIVATE int gl_tune_result(gl_tune_t tune, gl_tune_config_t *config);
+
+/**
+ * \brief read settings stored for a renderer
+ * \param glc glc
+ * \param profile profile file
+ * \param renderer GL_RENDERER string
+ * \param flags settings stored must be allowed by these flags
+ * \param config current settings on input, stored ones on output
+ * \return 0 on success, ENOENT if there are no usable settings,
+ *         otherwise an error code
+ */
+__PRIVATE int gl_tune_load(glc_t *glc, const char *profile, const char *renderer,
+			   int flags, gl_tune_config_t *config);
+
+/**
+ * \brief store settings for a renderer
+ *
+ * The profile is rewritten with the line for the renderer replaced,
+ * lines for other renderers are kept.
+ * \param glc glc
+ * \param profile profile file
+ * \param renderer GL_RENDERER string
+ * \param config settings
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_tune_save(glc_t *glc, const char *profile, const char *renderer,
+			   const gl_tune_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -0,0 +1,454 @@
+/**
+ * \file glc/capture/gl_ycbcr.c
+ * \brief GPU side BGR to Y'CbCr conversion
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup gl_ycbcr
+ *  \{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/log.h>
+#include <glc/common/optimization.h>
+
+#include "gl_ycbcr.h"
+
+/*
+ * Target rows [0, h) hold Y', top row first. Each of the h / 2
+ * following rows holds two chroma rows side by side, Cb plane first
+ * then Cr, which is exactly the planar layout once read back.
+ * Coefficients are the same JPEG ones the ycbcr filter uses.
+ */
+static const char *gl_ycbcr_vertex_src =
+	"#version 110\n"
+	"void main()\n"
+	"{\n"
+	"	gl_Position = gl_Vertex;\n"
+	"}\n";
+
+static const char *gl_ycbcr_fragment_src =
+	"#version 110\n"
+	"uniform sampler2D src;\n"
+	"uniform vec2 size;\n"
+	"uniform vec2 luma;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = floor(gl_FragCoord.xy);\n"
+	"	vec3 rgb, k;\n"
+	"	float o;\n"
+	"	if (p.y < luma.y) {\n"
+	"		rgb = texture2D(src, vec2(p.x + 0.5, size.y - p.y - 0.5) / size).rgb;\n"
+	"		k = vec3(0.299, 0.587, 0.114);\n"
+	"		o = 0.0;\n"
+	"	} else {\n"
+	"		float right = step(luma.x * 0.5, p.x);\n"
+	"		float c = 2.0 * (p.y - luma.y) + right;\n"
+	"		float cr = step(luma.y * 0.5, c);\n"
+	"		float cy = c - cr * luma.y * 0.5;\n"
+	"		float cx = p.x - right * luma.x * 0.5;\n"
+	/* sampling the shared corner averages the 2x2 block */
+	"		rgb = texture2D(src, vec2(2.0 * cx + 1.0, size.y - 2.0 * cy - 1.0) / size).rgb;\n"
+	"		k = mix(vec3(-0.168736, -0.331264, 0.5),\n"
+	"			vec3(0.5, -0.418688, -0.081312), cr);\n"
+	"		o = 128.0 / 255.0;\n"
+	"	}\n"
+	"	gl_FragColor = vec4(dot(rgb, k) + o);\n"
+	"}\n";
+
+struct gl_ycbcr_s {
+	glc_t *glc;
+
+	unsigned int w, h;   /* captured area */
+	unsigned int yw, yh; /* luma plane */
+
+	GLuint src, dst, fbo;
+	GLuint program;
+	GLint src_loc, size_loc, luma_loc;
+
+	PFNGLACTIVETEXTUREPROC           glActiveTexture;
+	PFNGLBINDBUFFERPROC              glBindBuffer;
+	PFNGLCREATESHADERPROC            glCreateShader;
+	PFNGLSHADERSOURCEPROC            glShaderSource;
+	PFNGLCOMPILESHADERPROC           glCompileShader;
+	PFNGLGETSHADERIVPROC             glGetShaderiv;
+	PFNGLGETSHADERINFOLOGPROC        glGetShaderInfoLog;
+	PFNGLDELETESHADERPROC            glDeleteShader;
+	PFNGLCREATEPROGRAMPROC           glCreateProgram;
+	PFNGLATTACHSHADERPROC            glAttachShader;
+	PFNGLLINKPROGRAMPROC             glLinkProgram;
+	PFNGLGETPROGRAMIVPROC            glGetProgramiv;
+	PFNGLDELETEPROGRAMPROC           glDeleteProgram;
+	PFNGLUSEPROGRAMPROC              glUseProgram;
+	PFNGLGETUNIFORMLOCATIONPROC      glGetUniformLocation;
+	PFNGLUNIFORM1IPROC               glUniform1i;
+	PFNGLUNIFORM2FPROC               glUniform2f;
+	PFNGLGENFRAMEBUFFERSPROC         glGenFramebuffers;
+	PFNGLBINDFRAMEBUFFERPROC         glBindFramebuffer;
+	PFNGLFRAMEBUFFERTEXTURE2DPROC    glFramebufferTexture2D;
+	PFNGLCHECKFRAMEBUFFERSTATUSPROC  glCheckFramebufferStatus;
+	PFNGLDELETEFRAMEBUFFERSPROC      glDeleteFramebuffers;
+};
+
+static int gl_ycbcr_supported();
+static int gl_ycbcr_load(gl_ycbcr_t ycbcr, gl_ycbcr_get_proc_t get_proc);
+static int gl_ycbcr_compile(gl_ycbcr_t ycbcr, GLenum type, const char *src,
+			    GLuint *shader);
+static int gl_ycbcr_link(gl_ycbcr_t ycbcr);
+
+int gl_ycbcr_init(gl_ycbcr_t *ycbcr, glc_t *glc, gl_ycbcr_get_proc_t get_proc)
+{
+	int ret;
+
+	if (unlikely(!gl_ycbcr_supported()))
+		return ENOTSUP;
+
+	*ycbcr = (gl_ycbcr_t) calloc(1, sizeof(struct gl_ycbcr_s));
+	if (unlikely(!*ycbcr))
+		return ENOMEM;
+	(*ycbcr)->glc = glc;
+
+	if (unlikely((ret = gl_ycbcr_load(*ycbcr, get_proc))))
+		goto err;
+	if (unlikely((ret = gl_ycbcr_link(*ycbcr))))
+		goto err;
+
+	glc_log(glc, GLC_INFO, "gl_ycbcr", "converting to Y'CbCr on GPU");
+	return 0;
+err:
+	free(*ycbcr);
+	*ycbcr = NULL;
+	return ret;
+}
+
+int gl_ycbcr_destroy(gl_ycbcr_t ycbcr)
+{
+	/* we might be in wrong thread */
+	if (ycbcr->fbo)
+		ycbcr->glDeleteFramebuffers(1, &ycbcr->fbo);
+	if (ycbcr->src)
+		glDeleteTextures(1, &ycbcr->src);
+	if (ycbcr->dst)
+		glDeleteTextures(1, &ycbcr->dst);
+	if (ycbcr->program)
+		ycbcr->glDeleteProgram(ycbcr->program);
+
+	free(ycbcr);
+	return 0;
+}
+
+/**
+ * \brief shaders, framebuffer objects and GL_R8 are needed
+ *
+ * glXGetProcAddress() never fails with some implementations, so
+ * version and extensions are checked instead.
+ */
+int gl_ycbcr_supported()
+{
+	const char *version = (const char *) glGetString(GL_VERSION);
+	const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+	int major = 0, minor = 0;
+
+	if (unlikely((!version) || (!extensions)))
+		return 0;
+	if (sscanf(version, "%d.%d", &major, &minor) != 2)
+		return 0;
+
+	if (major >= 3)
+		return 1;
+	return (major == 2) &&
+	       (strstr(extensions, "GL_ARB_framebuffer_object") != NULL) &&
+	       (strstr(extensions, "GL_ARB_texture_rg") != NULL);
+}
+
+#define GL_YCBCR_PROC(type, name) \
+	if (unlikely(!(ycbcr->name = (type) get_proc((const GLubyte *) #name)))) \
+		return ENOTSUP;
+
+int gl_ycbcr_load(gl_ycbcr_t ycbcr, gl_ycbcr_get_proc_t get_proc)
+{
+	GL_YCBCR_PROC(PFNGLACTIVETEXTUREPROC,          glActiveTexture)
+	GL_YCBCR_PROC(PFNGLBINDBUFFERPROC,             glBindBuffer)
+	GL_YCBCR_PROC(PFNGLCREATESHADERPROC,           glCreateShader)
+	GL_YCBCR_PROC(PFNGLSHADERSOURCEPROC,           glShaderSource)
+	GL_YCBCR_PROC(PFNGLCOMPILESHADERPROC,          glCompileShader)
+	GL_YCBCR_PROC(PFNGLGETSHADERIVPROC,            glGetShaderiv)
+	GL_YCBCR_PROC(PFNGLGETSHADERINFOLOGPROC,       glGetShaderInfoLog)
+	GL_YCBCR_PROC(PFNGLDELETESHADERPROC,           glDeleteShader)
+	GL_YCBCR_PROC(PFNGLCREATEPROGRAMPROC,          glCreateProgram)
+	GL_YCBCR_PROC(PFNGLATTACHSHADERPROC,           glAttachShader)
+	GL_YCBCR_PROC(PFNGLLINKPROGRAMPROC,            glLinkProgram)
+	GL_YCBCR_PROC(PFNGLGETPROGRAMIVPROC,           glGetProgramiv)
+	GL_YCBCR_PROC(PFNGLDELETEPROGRAMPROC,          glDeleteProgram)
+	GL_YCBCR_PROC(PFNGLUSEPROGRAMPROC,             glUseProgram)
+	GL_YCBCR_PROC(PFNGLGETUNIFORMLOCATIONPROC,     glGetUniformLocation)
+	GL_YCBCR_PROC(PFNGLUNIFORM1IPROC,              glUniform1i)
+	GL_YCBCR_PROC(PFNGLUNIFORM2FPROC,              glUniform2f)
+	GL_YCBCR_PROC(PFNGLGENFRAMEBUFFERSPROC,        glGenFramebuffers)
+	GL_YCBCR_PROC(PFNGLBINDFRAMEBUFFERPROC,        glBindFramebuffer)
+	GL_YCBCR_PROC(PFNGLFRAMEBUFFERTEXTURE2DPROC,   glFramebufferTexture2D)
+	GL_YCBCR_PROC(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus)
+	GL_YCBCR_PROC(PFNGLDELETEFRAMEBUFFERSPROC,     glDeleteFramebuffers)
+	return 0;
+}
+
+int gl_ycbcr_compile(gl_ycbcr_t ycbcr, GLenum type, const char *src, GLuint *shader)
+{
+	char log[512];
+	GLint status;
+
+	*shader = ycbcr->glCreateShader(type);
+	ycbcr->glShaderSource(*shader, 1, &src, NULL);
+	ycbcr->glCompileShader(*shader);
+	ycbcr->glGetShaderiv(*shader, GL_COMPILE_STATUS, &status);
+	if (unlikely(!status)) {
+		ycbcr->glGetShaderInfoLog(*shader, sizeof(log), NULL, log);
+		glc_log(ycbcr->glc, GLC_ERROR, "gl_ycbcr",
+			"can't compile shader: %s", log);
+		ycbcr->glDeleteShader(*shader);
+		return ENOTSUP;
+	}
+
+	return 0;
+}
+
+int gl_ycbcr_link(gl_ycbcr_t ycbcr)
+{
+	GLuint vertex, fragment;
+	GLint status, program;
+	int ret;
+
+	if (unlikely((ret = gl_ycbcr_compile(ycbcr, GL_VERTEX_SHADER,
+					     gl_ycbcr_vertex_src, &vertex))))
+		return ret;
+	if (unlikely((ret = gl_ycbcr_compile(ycbcr, GL_FRAGMENT_SHADER,
+					     gl_ycbcr_fragment_src, &fragment)))) {
+		ycbcr->glDeleteShader(vertex);
+		return ret;
+	}
+
+	ycbcr->program = ycbcr->glCreateProgram();
+	ycbcr->glAttachShader(ycbcr->program, vertex);
+	ycbcr->glAttachShader(ycbcr->program, fragment);
+	ycbcr->glLinkProgram(ycbcr->program);
+	/* flagged for deletion, freed along with program */
+	ycbcr->glDeleteShader(vertex);
+	ycbcr->glDeleteShader(fragment);
+
+	ycbcr->glGetProgramiv(ycbcr->program, GL_LINK_STATUS, &status);
+	if (unlikely(!status)) {
+		glc_log(ycbcr->glc, GLC_ERROR, "gl_ycbcr", "can't link program");
+		ycbcr->glDeleteProgram(ycbcr->program);
+		ycbcr->program = 0;
+		return ENOTSUP;
+	}
+
+	ycbcr->src_loc  = ycbcr->glGetUniformLocation(ycbcr->program, "src");
+	ycbcr->size_loc = ycbcr->glGetUniformLocation(ycbcr->program, "size");
+	ycbcr->luma_loc = ycbcr->glGetUniformLocation(ycbcr->program, "luma");
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	ycbcr->glUseProgram(ycbcr->program);
+	ycbcr->glUniform1i(ycbcr->src_loc, 0);
+	ycbcr->glUseProgram(program);
+
+	return 0;
+}
+
+int gl_ycbcr_set_size(gl_ycbcr_t ycbcr, unsigned int w, unsigned int h)
+{
+	GLint unpack, read_fbo, draw_fbo;
+	GLenum status;
+
+	if (unlikely((w < 2) || (h < 2)))
+		return EINVAL;
+	if ((w == ycbcr->w) && (h == ycbcr->h))
+		return 0;
+
+	glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack);
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+	glPushAttrib(GL_TEXTURE_BIT);
+
+	/* NULL data would be an offset into a bound unpack buffer */
+	ycbcr->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	ycbcr->glActiveTexture(GL_TEXTURE0);
+
+	if (!ycbcr->src) {
+		glGenTextures(1, &ycbcr->src);
+		glBindTexture(GL_TEXTURE_2D, ycbcr->src);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenTextures(1, &ycbcr->dst);
+		glBindTexture(GL_TEXTURE_2D, ycbcr->dst);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		ycbcr->glGenFramebuffers(1, &ycbcr->fbo);
+	}
+
+	ycbcr->w = w;
+	ycbcr->h = h;
+	ycbcr->yw = w & ~1;
+	ycbcr->yh = h & ~1;
+
+	glBindTexture(GL_TEXTURE_2D, ycbcr->src);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ycbcr->w, ycbcr->h, 0,
+		     GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, ycbcr->dst);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ycbcr->yw, ycbcr->yh + ycbcr->yh / 2, 0,
+		     GL_RED, GL_UNSIGNED_BYTE, NULL);
+
+	ycbcr->glBindFramebuffer(GL_FRAMEBUFFER, ycbcr->fbo);
+	ycbcr->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				      GL_TEXTURE_2D, ycbcr->dst, 0);
+	status = ycbcr->glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	ycbcr->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	ycbcr->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	glPopAttrib();
+	ycbcr->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpack);
+
+	if (unlikely(status != GL_FRAMEBUFFER_COMPLETE)) {
+		glc_log(ycbcr->glc, GLC_ERROR, "gl_ycbcr",
+			"incomplete framebuffer (0x%04x)", status);
+		ycbcr->w = ycbcr->h = 0;
+		return ENOTSUP;
+	}
+
+	glc_log(ycbcr->glc, GLC_DEBUG, "gl_ycbcr", "converting %ux%u to %ux%u",
+		ycbcr->w, ycbcr->h, ycbcr->yw, ycbcr->yh);
+	return 0;
+}
+
+size_t gl_ycbcr_size(gl_ycbcr_t ycbcr, unsigned int *w, unsigned int *h)
+{
+	if (w)
+		*w = ycbcr->yw;
+	if (h)
+		*h = ycbcr->yh;
+	return ycbcr->yw * ycbcr->yh + ycbcr->yw * ycbcr->yh / 2;
+}
+
+int gl_ycbcr_read(gl_ycbcr_t ycbcr, GLuint framebuffer, GLenum read_buffer,
+		  unsigned int x, unsigned int y, const gl_ycbcr_state_t *app,
+		  GLvoid *to)
+{
+	GLint program, read_fbo, draw_fbo, active;
+	int pack;
+
+	if (unlikely(!ycbcr->w))
+		return EINVAL;
+
+	if (app) {
+		program  = app->program;
+		read_fbo = app->read_framebuffer;
+		draw_fbo = app->draw_framebuffer;
+		active   = app->active_texture;
+		/* pack storage is restored by hand, as little as needed */
+		pack = (app->pack_alignment != 1) || app->pack_row_length ||
+		       app->pack_skip_rows || app->pack_skip_pixels;
+	} else {
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_fbo);
+		glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+		glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+		pack = 1;
+	}
+	/* only the groups changed below */
+	glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_VIEWPORT_BIT |
+		     GL_POLYGON_BIT | GL_TEXTURE_BIT | GL_PIXEL_MODE_BIT);
+
+	/* grab captured area */
+	ycbcr->glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, ycbcr->src);
+	ycbcr->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(read_buffer);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, ycbcr->w, ycbcr->h);
+
+	/* convert, every fragment is written once */
+	ycbcr->glBindFramebuffer(GL_FRAMEBUFFER, ycbcr->fbo);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glViewport(0, 0, ycbcr->yw, ycbcr->yh + ycbcr->yh / 2);
+	glDisable(GL_ALPHA_TEST);
+	glDisable(GL_BLEND);
+	glDisable(GL_COLOR_LOGIC_OP);
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_DITHER);
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_STENCIL_TEST);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	ycbcr->glUseProgram(ycbcr->program);
+	ycbcr->glUniform2f(ycbcr->size_loc, ycbcr->w, ycbcr->h);
+	ycbcr->glUniform2f(ycbcr->luma_loc, ycbcr->yw, ycbcr->yh);
+	glBegin(GL_QUADS);
+	glVertex2f(-1.0, -1.0);
+	glVertex2f( 1.0, -1.0);
+	glVertex2f( 1.0,  1.0);
+	glVertex2f(-1.0,  1.0);
+	glEnd();
+
+	/* read planes back */
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	if (pack) {
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glPixelStorei(GL_PACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_PACK_SKIP_ROWS, 0);
+		glPixelStorei(GL_PACK_SKIP_PIXELS, 0);
+	}
+	glReadPixels(0, 0, ycbcr->yw, ycbcr->yh + ycbcr->yh / 2,
+		     GL_RED, GL_UNSIGNED_BYTE, to);
+
+	/* bindings first, popped state belongs to the application framebuffer */
+	ycbcr->glUseProgram(program);
+	ycbcr->glBindFramebuffer(GL_READ_FRAMEBUFFER, read_fbo);
+	ycbcr->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+	if (!app)
+		glPopClientAttrib();
+	else if (pack) {
+		glPixelStorei(GL_PACK_ALIGNMENT, app->pack_alignment);
+		glPixelStorei(GL_PACK_ROW_LENGTH, app->pack_row_length);
+		glPixelStorei(GL_PACK_SKIP_ROWS, app->pack_skip_rows);
+		glPixelStorei(GL_PACK_SKIP_PIXELS, app->pack_skip_pixels);
+	}
+	glPopAttrib();
+	ycbcr->glActiveTexture(active);
+
+	return 0;
+}
+
+/**  \} */
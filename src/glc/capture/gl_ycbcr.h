@@ -0,0 +1,133 @@
+/**
+ * \file glc/capture/gl_ycbcr.h
+ * \brief GPU side BGR to Y'CbCr conversion
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup capture
+ *  \{
+ * \defgroup gl_ycbcr GPU Y'CbCr conversion
+ *  \{
+ */
+
+#ifndef _GL_YCBCR_H
+#define _GL_YCBCR_H
+
+#include <GL/gl.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** GL function lookup, ie. glXGetProcAddressARB() */
+typedef void (*(*gl_ycbcr_get_proc_t)(const GLubyte *name))(void);
+
+/**
+ * \brief gl_ycbcr object
+ *
+ * Renders an area of the read buffer through a shader into a single
+ * channel target holding the Y', Cb and Cr planes back to back, top
+ * row first, in the GLC_VIDEO_YCBCR_420JPEG layout. Reading that
+ * target moves 1.5 bytes per pixel instead of 4 and no CPU
+ * conversion is needed. Width and height are rounded down to even
+ * values, like the ycbcr filter does.
+ *
+ * Every call must be made with the GL context current. GL state
+ * touched is restored, except pixel pack buffer binding which is
+ * left to the caller.
+ */
+typedef struct gl_ycbcr_s* gl_ycbcr_t;
+
+/**
+ * \brief application GL state known to the caller
+ *
+ * Lets gl_ycbcr_read() restore state without querying it.
+ */
+typedef struct {
+	GLuint program;
+	GLenum active_texture;
+	GLuint read_framebuffer, draw_framebuffer;
+	GLint pack_alignment, pack_row_length, pack_skip_rows, pack_skip_pixels;
+} gl_ycbcr_state_t;
+
+/**
+ * \brief initialize gl_ycbcr object
+ * \param ycbcr gl_ycbcr object
+ * \param glc glc
+ * \param get_proc GL function lookup
+ * \return 0 on success, ENOTSUP if GL lacks shaders, framebuffer
+ *         objects or single channel textures, otherwise an error code
+ */
+__PRIVATE int gl_ycbcr_init(gl_ycbcr_t *ycbcr, glc_t *glc, gl_ycbcr_get_proc_t get_proc);
+
+/**
+ * \brief destroy gl_ycbcr object
+ * \param ycbcr gl_ycbcr object
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_ycbcr_destroy(gl_ycbcr_t ycbcr);
+
+/**
+ * \brief set size of captured area
+ * \param ycbcr gl_ycbcr object
+ * \param w width
+ * \param h height
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_ycbcr_set_size(gl_ycbcr_t ycbcr, unsigned int w, unsigned int h);
+
+/**
+ * \brief convert area and read it back
+ * \param ycbcr gl_ycbcr object
+ * \param framebuffer framebuffer to read from, 0 for the window
+ * \param read_buffer GL_FRONT or GL_BACK, or a color attachment of
+ *                    framebuffer
+ * \param x left edge of area
+ * \param y bottom edge of area
+ * \param app application state, NULL to query it
+ * \param to glReadPixels() destination, an offset if a pixel pack
+ *           buffer is bound. Size is gl_ycbcr_size()
+ * \return 0 on success otherwise an error code
+ */
+__PRIVATE int gl_ycbcr_read(gl_ycbcr_t ycbcr, GLuint framebuffer,
+			    GLenum read_buffer, unsigned int x, unsigned int y,
+			    const gl_ycbcr_state_t *app, GLvoid *to);
+
+/**
+ * \brief size of converted picture
+ * \param ycbcr gl_ycbcr object
+ * \param w returned luma width
+ * \param h returned luma height
+ * \return picture size in bytes
+ */
+__PRIVATE size_t gl_ycbcr_size(gl_ycbcr_t ycbcr, unsigned int *w, unsigned int *h);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
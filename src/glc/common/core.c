@@ -33,6 +33,11 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <limits.h>
 
 #include "glc.h"
 #include "core.h"
@@ -40,14 +45,41 @@
 #include "util.h"
 #include "optimization.h"
 
+/* I/O bound threads that weigh as much as a computing one */
+#define GLC_IO_THREADS_PER_CPU   4
+
+#define GLC_AFFINITY_MAX        16
+
+#define GLC_AFFINITY_LIST        0
+#define GLC_AFFINITY_L3          1
+#define GLC_AFFINITY_NODE        2
+
+struct glc_affinity_s {
+	char module[32];
+	int kind;
+	cpu_set_t cpus;
+};
+
 struct glc_core_s {
 	struct timespec init_time;
 	long int single_process_num;
 	long int multi_process_num;
+	long int io_thread_num;
 	long int threads_hint;
 	int      allow_rt;
+
+	struct glc_affinity_s affinity[GLC_AFFINITY_MAX];
+	unsigned int affinity_num;
+	cpu_set_t exclude;
+	int has_exclude;
 };
 
+static int glc_parse_cpu_list(const char *str, cpu_set_t *cpus);
+static int glc_read_sysfs(const char *path, char *buf, size_t size);
+static int glc_cpu_domain(int kind, int cpu, cpu_set_t *cpus);
+static void glc_pick_domain(glc_t *glc, int kind, cpu_set_t *cpus);
+static long int glc_cgroup_cpu_quota(glc_t *glc);
+
 const char *glc_version()
 {
 	return GLC_VERSION;
@@ -62,6 +94,8 @@ int glc_init(glc_t *glc)
 	glc->state = NULL;
 	glc->util  = NULL;
 	glc->log   = NULL;
+	glc->pool  = NULL;
+	glc->stripe = NULL;
 
 	glc->core = (glc_core_t) calloc(1, sizeof(struct glc_core_s));
 
@@ -127,21 +161,53 @@ void glc_account_threads(glc_t *glc, long int single, long int multi)
 	glc->core->multi_process_num  += multi;
 }
 
+void glc_account_io_threads(glc_t *glc, long int count)
+{
+	glc->core->io_thread_num += count;
+}
+
 void glc_compute_threads_hint(glc_t *glc)
 {
-	long int divisor;
+	long int divisor, budget, hint;
 	if (glc->core->multi_process_num)
 		divisor = glc->core->multi_process_num; /* Avoid division by 0 */
 	else
 		divisor = 1;
-	glc->core->threads_hint  = sysconf(_SC_NPROCESSORS_ONLN) - glc->core->single_process_num;
-	glc->core->threads_hint /= divisor;
-	if (unlikely(glc->core->threads_hint <  1))
-		glc->core->threads_hint = 1;
+	budget = glc_cpu_budget(glc);
+	hint   = budget - glc->core->single_process_num -
+		 (glc->core->io_thread_num + GLC_IO_THREADS_PER_CPU - 1) /
+		 GLC_IO_THREADS_PER_CPU;
+	hint  /= divisor;
+	if (unlikely(hint <  1))
+		hint = 1;
 	glc_log(glc, GLC_INFO, "core",
-		"single proc num %ld multi proc num %ld, threads num per multi proc %ld",
-		glc->core->single_process_num, glc->core->multi_process_num,
-		glc->core->threads_hint);
+		"cpu budget %ld single proc num %ld io proc num %ld multi proc num %ld, "
+		"threads num per multi proc %ld", budget,
+		glc->core->single_process_num, glc->core->io_thread_num,
+		glc->core->multi_process_num, hint);
+
+	glc->core->threads_hint = hint;
+}
+
+long int glc_cpu_budget(glc_t *glc)
+{
+	cpu_set_t cpus, excluded;
+	long int budget, quota;
+
+	if (!sched_getaffinity(getpid(), sizeof(cpus), &cpus)) {
+		if (glc->core->has_exclude) {
+			CPU_AND(&excluded, &cpus, &glc->core->exclude);
+			CPU_XOR(&cpus, &cpus, &excluded);
+		}
+		budget = CPU_COUNT(&cpus);
+	} else
+		budget = sysconf(_SC_NPROCESSORS_ONLN);
+
+	quota = glc_cgroup_cpu_quota(glc);
+	if ((quota > 0) && (quota < budget))
+		budget = quota;
+
+	return budget < 1 ? 1 : budget;
 }
 
 void glc_set_allow_rt(glc_t *glc, int allow)
@@ -154,4 +220,319 @@ int glc_allow_rt(glc_t *glc)
 	return glc->core->allow_rt;
 }
 
+int glc_set_affinity(glc_t *glc, const char *module, const char *cpus)
+{
+	struct glc_affinity_s affinity, *dst = NULL;
+	unsigned int i;
+	int ret;
+
+	if (!module)
+		module = "";
+	if (unlikely(strlen(module) >= sizeof(affinity.module)))
+		return EINVAL;
+
+	memset(&affinity, 0, sizeof(affinity));
+	strcpy(affinity.module, module);
+	if (!strcmp(cpus, "l3"))
+		affinity.kind = GLC_AFFINITY_L3;
+	else if (!strcmp(cpus, "node"))
+		affinity.kind = GLC_AFFINITY_NODE;
+	else {
+		affinity.kind = GLC_AFFINITY_LIST;
+		if (unlikely((ret = glc_parse_cpu_list(cpus, &affinity.cpus)))) {
+			glc_log(glc, GLC_ERROR, "core", "invalid cpu list '%s'", cpus);
+			return ret;
+		}
+	}
+
+	for (i = 0; i < glc->core->affinity_num; i++) {
+		if (!strcmp(glc->core->affinity[i].module, module))
+			dst = &glc->core->affinity[i];
+	}
+
+	if (!dst) {
+		if (unlikely(glc->core->affinity_num >= GLC_AFFINITY_MAX))
+			return ENOSPC;
+		dst = &glc->core->affinity[glc->core->affinity_num++];
+	}
+
+	memcpy(dst, &affinity, sizeof(affinity));
+	return 0;
+}
+
+int glc_parse_affinity(glc_t *glc, const char *spec)
+{
+	char *str, *entry, *cpus, *saveptr;
+	int ret = 0;
+
+	if (unlikely(!(str = strdup(spec))))
+		return ENOMEM;
+
+	for (entry = strtok_r(str, ";", &saveptr); entry;
+	     entry = strtok_r(NULL, ";", &saveptr)) {
+		if ((cpus = strchr(entry, '='))) {
+			*cpus++ = '\0';
+			ret = glc_set_affinity(glc, entry, cpus);
+		} else
+			ret = glc_set_affinity(glc, NULL, entry);
+		if (unlikely(ret))
+			break;
+	}
+
+	free(str);
+	return ret;
+}
+
+int glc_exclude_cpus(glc_t *glc, const char *cpus)
+{
+	int ret;
+
+	if (unlikely((ret = glc_parse_cpu_list(cpus, &glc->core->exclude)))) {
+		glc_log(glc, GLC_ERROR, "core", "invalid cpu list '%s'", cpus);
+		return ret;
+	}
+	glc->core->has_exclude = 1;
+	return 0;
+}
+
+int glc_apply_affinity(glc_t *glc, const char *module)
+{
+	struct glc_affinity_s *affinity = NULL;
+	cpu_set_t cpus, allowed;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < glc->core->affinity_num; i++) {
+		if ((module) && (!strcmp(glc->core->affinity[i].module, module))) {
+			affinity = &glc->core->affinity[i];
+			break;
+		}
+		if (!glc->core->affinity[i].module[0])
+			affinity = &glc->core->affinity[i];
+	}
+
+	if ((!affinity) && (!glc->core->has_exclude))
+		return 0;
+
+	/* main thread mask, this thread might already be pinned */
+	if (unlikely(sched_getaffinity(getpid(), sizeof(allowed), &allowed)))
+		return errno;
+	if (glc->core->has_exclude) {
+		for (i = 0; i < CPU_SETSIZE; i++) {
+			if (CPU_ISSET(i, &glc->core->exclude))
+				CPU_CLR(i, &allowed);
+		}
+	}
+
+	if ((!affinity) || (affinity->kind == GLC_AFFINITY_LIST)) {
+		memcpy(&cpus, &allowed, sizeof(cpus));
+		if (affinity)
+			CPU_AND(&cpus, &cpus, &affinity->cpus);
+	} else {
+		memcpy(&cpus, &allowed, sizeof(cpus));
+		glc_pick_domain(glc, affinity->kind, &cpus);
+	}
+
+	if (unlikely(!CPU_COUNT(&cpus))) {
+		glc_log(glc, GLC_WARN, "core", "no cpu left for '%s', affinity not set",
+			module ? module : "default");
+		return EINVAL;
+	}
+
+	if (unlikely((ret = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)))) {
+		glc_log(glc, GLC_ERROR, "core", "can't set affinity: %s (%d)",
+			strerror(ret), ret);
+		return ret;
+	}
+
+	glc_log(glc, GLC_DEBUG, "core", "'%s' thread restricted to %d cpus",
+		module ? module : "default", CPU_COUNT(&cpus));
+	return 0;
+}
+
+/**
+ * \brief parse a CPU list such as "0-3,8,10-11"
+ * \param str CPU list
+ * \param cpus parsed CPU set
+ * \return 0 on success otherwise an error code
+ */
+int glc_parse_cpu_list(const char *str, cpu_set_t *cpus)
+{
+	unsigned long first, last;
+	char *end;
+
+	CPU_ZERO(cpus);
+	while (*str) {
+		first = strtoul(str, &end, 10);
+		if (unlikely(end == str))
+			return EINVAL;
+		last = first;
+		str = end;
+		if (*str == '-') {
+			str++;
+			last = strtoul(str, &end, 10);
+			if (unlikely((end == str) || (last < first)))
+				return EINVAL;
+			str = end;
+		}
+		if (unlikely(last >= CPU_SETSIZE))
+			return EINVAL;
+
+		for (; first <= last; first++)
+			CPU_SET(first, cpus);
+
+		if (*str == ',')
+			str++;
+		else if ((*str) && (*str != '\n'))
+			return EINVAL;
+		else
+			break;
+	}
+
+	return 0;
+}
+
+/**
+ * \brief read a small sysfs file
+ * \return 0 on success otherwise an error code
+ */
+int glc_read_sysfs(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return errno;
+	len = read(fd, buf, size - 1);
+	close(fd);
+
+	if (len < 0)
+		return errno;
+	buf[len] = '\0';
+	return 0;
+}
+
+/**
+ * \brief CPUs sharing a L3 cache or a NUMA node with cpu
+ * \return 0 on success otherwise an error code
+ */
+int glc_cpu_domain(int kind, int cpu, cpu_set_t *cpus)
+{
+	char path[128], buf[1024];
+	cpu_set_t node;
+	int i, ret;
+
+	if (kind == GLC_AFFINITY_L3) {
+		/* cache indexes are not in level order */
+		for (i = 0; ; i++) {
+			snprintf(path, sizeof(path),
+				 "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, i);
+			if ((ret = glc_read_sysfs(path, buf, sizeof(buf))))
+				return ret;
+			if (atoi(buf) == 3)
+				break;
+		}
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, i);
+		if ((ret = glc_read_sysfs(path, buf, sizeof(buf))))
+			return ret;
+		return glc_parse_cpu_list(buf, cpus);
+	}
+
+	for (i = 0; i < 256; i++) {
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", i);
+		if (glc_read_sysfs(path, buf, sizeof(buf)))
+			continue;
+		if ((!glc_parse_cpu_list(buf, &node)) && (CPU_ISSET(cpu, &node))) {
+			memcpy(cpus, &node, sizeof(node));
+			return 0;
+		}
+	}
+	return ENOENT;
+}
+
+/**
+ * \brief restrict cpus to the L3 cache or node holding most of them
+ *
+ * cpus is left untouched if topology information is not available.
+ */
+void glc_pick_domain(glc_t *glc, int kind, cpu_set_t *cpus)
+{
+	cpu_set_t domain, best, seen;
+	int cpu;
+
+	CPU_ZERO(&best);
+	CPU_ZERO(&seen);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if ((!CPU_ISSET(cpu, cpus)) || (CPU_ISSET(cpu, &seen)))
+			continue;
+		if (glc_cpu_domain(kind, cpu, &domain)) {
+			glc_log(glc, GLC_WARN, "core",
+				"no %s topology information, using all cpus",
+				kind == GLC_AFFINITY_L3 ? "l3" : "node");
+			return;
+		}
+		CPU_OR(&seen, &seen, &domain);
+		CPU_AND(&domain, &domain, cpus);
+		if (CPU_COUNT(&domain) > CPU_COUNT(&best))
+			memcpy(&best, &domain, sizeof(best));
+	}
+
+	memcpy(cpus, &best, sizeof(best));
+}
+
+/**
+ * \brief cgroup v2 cpu.max quota of the process
+ *
+ * The whole hierarchy is walked since a parent quota also
+ * applies to its children.
+ * \return quota rounded up to whole CPUs, 0 if there is none
+ */
+long int glc_cgroup_cpu_quota(glc_t *glc)
+{
+	char path[PATH_MAX], buf[PATH_MAX], *cgroup, *end;
+	long long max, period;
+	long int quota = 0, limit;
+	FILE *file;
+
+	if (!(file = fopen("/proc/self/cgroup", "r")))
+		return 0;
+
+	/* unified hierarchy entry is "0::/path" */
+	cgroup = NULL;
+	while (fgets(buf, sizeof(buf), file)) {
+		if (!strncmp(buf, "0::", 3)) {
+			cgroup = &buf[3];
+			break;
+		}
+	}
+	fclose(file);
+	if (!cgroup)
+		return 0;
+	if ((end = strchr(cgroup, '\n')))
+		*end = '\0';
+
+	for (;;) {
+		snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max",
+			 strcmp(cgroup, "/") ? cgroup : "");
+		if ((file = fopen(path, "r"))) {
+			if ((fscanf(file, "%lld %lld", &max, &period) == 2) &&
+			    (max > 0) && (period > 0)) {
+				limit = (max + period - 1) / period;
+				if ((!quota) || (limit < quota))
+					quota = limit;
+			}
+			fclose(file);
+		}
+
+		if ((!(end = strrchr(cgroup, '/'))) || (end == cgroup))
+			break;
+		*end = '\0';
+	}
+
+	if (quota)
+		glc_log(glc, GLC_DEBUG, "core", "cgroup cpu quota is %ld cpus", quota);
+	return quota;
+}
+
 /**  \} */
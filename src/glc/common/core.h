@@ -79,9 +79,9 @@ __PUBLIC glc_utime_t glc_time(glc_t *glc);
  * \brief thread count hint
  *
  * All processing filters that can employ multiple threads use
- * this function to determine how many threads to create. By default
- * this returns number of processors online, but custom value can
- * be set via glc_set_threads_hint().
+ * this function to determine how many threads to create. Value is
+ * computed from the CPU budget by glc_compute_threads_hint(), but
+ * custom value can be set via glc_set_threads_hint().
  * \param glc glc
  * \return thread count hint
  */
@@ -99,11 +99,89 @@ __PUBLIC int glc_set_threads_hint(glc_t *glc, long int count);
 
 __PUBLIC void glc_account_threads(glc_t *glc, long int single, long int multi);
 
+/**
+ * \brief account threads that mostly wait on I/O
+ *
+ * Sinks, sources and audio threads spend most of their time blocked
+ * so they weigh less than computing threads in the CPU budget.
+ * \param glc glc
+ * \param count number of I/O bound threads
+ */
+__PUBLIC void glc_account_io_threads(glc_t *glc, long int count);
+
+/**
+ * \brief compute thread count hint from the CPU budget
+ *
+ * Budget is the number of CPUs the process may run on, minus
+ * excluded CPUs, capped by the cgroup v2 cpu.max quota. Computing
+ * threads accounted with glc_account_threads() are taken out of it,
+ * the rest is shared between multi-threaded processes. Filters pick
+ * up the hint when they are created.
+ * \param glc glc
+ */
 __PUBLIC void glc_compute_threads_hint(glc_t *glc);
 
+/**
+ * \brief CPU budget of the process
+ * \param glc glc
+ * \return number of CPUs glc can use, at least 1
+ */
+__PUBLIC long int glc_cpu_budget(glc_t *glc);
+
 __PUBLIC void glc_set_allow_rt(glc_t *glc, int allow);
 __PUBLIC int glc_allow_rt(glc_t *glc);
 
+/**
+ * \brief restrict threads of a module to a set of CPUs
+ *
+ * cpus is either a CPU list like "0-3,8" or one of the following
+ * keywords, in which case the CPUs are picked when threads start:
+ *   - "l3": CPUs sharing a L3 cache
+ *   - "node": CPUs of a NUMA node
+ *
+ * Among the allowed CPUs, the L3 cache or node offering the most
+ * of them is chosen, so all modules using the keyword end up on the
+ * same one. Excluded CPUs are always left out.
+ * \param glc glc
+ * \param module module name as in glc_thread_t, NULL sets the
+ *               default for modules without their own set
+ * \param cpus CPU list or keyword
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_set_affinity(glc_t *glc, const char *module, const char *cpus);
+
+/**
+ * \brief parse an affinity specification
+ *
+ * Specification is a ';' separated list of module=cpus entries,
+ * an entry without module sets the default, eg. "pack=l3;file=l3;4-7".
+ * \param glc glc
+ * \param spec affinity specification
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_parse_affinity(glc_t *glc, const char *spec);
+
+/**
+ * \brief keep all glc threads off some CPUs
+ *
+ * Useful to leave the cores running the application render
+ * thread alone.
+ * \param glc glc
+ * \param cpus CPU list
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_exclude_cpus(glc_t *glc, const char *cpus);
+
+/**
+ * \brief apply module CPU set to calling thread
+ *
+ * Does nothing if neither affinity nor excluded CPUs are set.
+ * \param glc glc
+ * \param module module name, NULL for default
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_apply_affinity(glc_t *glc, const char *module);
+
 #ifdef __cplusplus
 }
 #endif
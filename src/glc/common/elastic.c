@@ -0,0 +1,585 @@
+/**
+ * \file glc/common/elastic.c
+ * \brief elastic overflow store for stream buffers
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup elastic
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <packetstream.h>
+
+#include "glc.h"
+#include "log.h"
+#include "thread.h"
+#include "elastic.h"
+#include "optimization.h"
+
+/** room taken by the chunk header */
+#define GLC_ELASTIC_HEADER   64
+/** record: header followed by data, padded to 16 bytes */
+#define GLC_ELASTIC_RECORD(size) \
+	(sizeof(struct glc_elastic_record_s) + (((size) + 15) & ~((size_t) 15)))
+
+/** thread wakes up at least this often to check occupancy */
+#define GLC_ELASTIC_TICK     1000000000ULL
+/** spare chunks are released after this long under the low watermark */
+#define GLC_ELASTIC_IDLE     5000000000ULL
+/** how long the thread waits before trying a full buffer again */
+#define GLC_ELASTIC_RETRY    1000000ULL
+
+#define GLC_ELASTIC_RESERVED  0
+#define GLC_ELASTIC_READY     1
+#define GLC_ELASTIC_CANCELLED 2
+
+struct glc_elastic_record_s {
+	size_t size;
+	int state;
+} __attribute__ ((aligned (16)));
+
+/**
+ * \brief chunk, the header lives at the start of the mapping
+ */
+struct glc_elastic_chunk_s {
+	struct glc_elastic_chunk_s *next;
+	size_t size;
+	size_t read, write;
+};
+
+/**
+ * \brief elastic
+ *
+ * Chunks holding packets form a FIFO list from head to tail,
+ * writers append to tail and the thread consumes from head.
+ * A drained chunk goes to the spare list. Everything is
+ * protected by mutex, except packet data which belongs to
+ * its writer until the record is marked ready.
+ */
+struct glc_elastic_s {
+	glc_t *glc;
+	ps_buffer_t *to;
+	size_t chunk_size, max_size;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t data_cond, empty_cond;
+
+	struct glc_elastic_chunk_s *head, *tail, *spare;
+	size_t size, peak, used, expect;
+	unsigned int pending;
+	unsigned long spilled, dropped;
+	glc_utime_t low_since;
+	int grow, cancel;
+
+	glc_simple_thread_t thread;
+};
+
+static void *glc_elastic_thread(void *argptr);
+static int glc_elastic_send(glc_elastic_t elastic, ps_packet_t *packet,
+			    struct glc_elastic_record_s *record);
+static void glc_elastic_pop(glc_elastic_t elastic,
+			    struct glc_elastic_record_s *record);
+static void glc_elastic_grow(glc_elastic_t elastic);
+static void glc_elastic_idle(glc_elastic_t elastic);
+static void glc_elastic_wait(glc_elastic_t elastic, glc_utime_t ns);
+static struct glc_elastic_chunk_s *glc_elastic_get_chunk(glc_elastic_t elastic,
+							 size_t need);
+static size_t glc_elastic_chunk_size(glc_elastic_t elastic, size_t need);
+static struct glc_elastic_chunk_s *glc_elastic_map(size_t size, int flags);
+static void glc_elastic_unmap(struct glc_elastic_chunk_s *chunk);
+static glc_utime_t glc_elastic_time(void);
+
+int glc_elastic_init(glc_elastic_t *elastic, glc_t *glc, ps_buffer_t *to,
+		     size_t chunk_size, size_t max_size)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	if (unlikely(!chunk_size || chunk_size > max_size))
+		return EINVAL;
+
+	if (unlikely(!(*elastic = (glc_elastic_t) calloc(1, sizeof(struct glc_elastic_s)))))
+		return ENOMEM;
+
+	(*elastic)->glc = glc;
+	(*elastic)->to = to;
+	(*elastic)->chunk_size = chunk_size;
+	(*elastic)->max_size = max_size;
+	/* first spill must not fault a fresh mapping in */
+	(*elastic)->grow = 1;
+
+	pthread_mutex_init(&(*elastic)->mutex, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(*elastic)->data_cond, &attr);
+	pthread_cond_init(&(*elastic)->empty_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	(*elastic)->thread.name = "elastic";
+	if (unlikely((ret = glc_simple_thread_create(glc, &(*elastic)->thread,
+						     &glc_elastic_thread, *elastic)))) {
+		pthread_cond_destroy(&(*elastic)->empty_cond);
+		pthread_cond_destroy(&(*elastic)->data_cond);
+		pthread_mutex_destroy(&(*elastic)->mutex);
+		free(*elastic);
+		return ret;
+	}
+
+	return 0;
+}
+
+int glc_elastic_destroy(glc_elastic_t elastic)
+{
+	struct glc_elastic_chunk_s *del;
+
+	glc_elastic_cancel(elastic);
+	glc_simple_thread_wait(elastic->glc, &elastic->thread);
+
+	glc_log(elastic->glc, GLC_PERF, "elastic",
+		"peak size %zu bytes, %lu packets spilled, %lu dropped",
+		elastic->peak, elastic->spilled, elastic->dropped);
+	if (elastic->pending)
+		glc_log(elastic->glc, GLC_WARN, "elastic",
+			"%u packets lost", elastic->pending);
+
+	while ((del = elastic->head)) {
+		elastic->head = del->next;
+		glc_elastic_unmap(del);
+	}
+	while ((del = elastic->spare)) {
+		elastic->spare = del->next;
+		glc_elastic_unmap(del);
+	}
+
+	pthread_cond_destroy(&elastic->empty_cond);
+	pthread_cond_destroy(&elastic->data_cond);
+	pthread_mutex_destroy(&elastic->mutex);
+	free(elastic);
+	return 0;
+}
+
+int glc_elastic_write_open(glc_elastic_t elastic, size_t size, char **data)
+{
+	struct glc_elastic_chunk_s *chunk;
+	struct glc_elastic_record_s *record;
+	size_t need = GLC_ELASTIC_RECORD(size);
+
+	pthread_mutex_lock(&elastic->mutex);
+	if (unlikely(elastic->cancel)) {
+		pthread_mutex_unlock(&elastic->mutex);
+		return EINTR;
+	}
+
+	chunk = elastic->tail;
+	if ((!chunk) || (chunk->write + need > chunk->size)) {
+		if (unlikely(!(chunk = glc_elastic_get_chunk(elastic, need)))) {
+			elastic->dropped++;
+			pthread_mutex_unlock(&elastic->mutex);
+			return ENOSPC;
+		}
+
+		if (elastic->tail)
+			elastic->tail->next = chunk;
+		else
+			elastic->head = chunk;
+		elastic->tail = chunk;
+	}
+
+	record = (struct glc_elastic_record_s *) ((char *) chunk + chunk->write);
+	record->size = size;
+	record->state = GLC_ELASTIC_RESERVED;
+	chunk->write += need;
+
+	elastic->used += need;
+	__sync_add_and_fetch(&elastic->pending, 1);
+	elastic->spilled++;
+
+	/* high watermark, have the thread map a spare chunk ahead of time */
+	if ((!elastic->spare) && (elastic->used > elastic->size / 4 * 3) &&
+	    (elastic->size + glc_elastic_chunk_size(elastic, elastic->expect) <=
+	     elastic->max_size)) {
+		elastic->grow = 1;
+		pthread_cond_signal(&elastic->data_cond);
+	}
+	pthread_mutex_unlock(&elastic->mutex);
+
+	*data = (char *) record + sizeof(struct glc_elastic_record_s);
+	return 0;
+}
+
+int glc_elastic_write_close(glc_elastic_t elastic, char *data)
+{
+	struct glc_elastic_record_s *record = (struct glc_elastic_record_s *)
+		(data - sizeof(struct glc_elastic_record_s));
+
+	pthread_mutex_lock(&elastic->mutex);
+	record->state = GLC_ELASTIC_READY;
+	pthread_cond_signal(&elastic->data_cond);
+	pthread_mutex_unlock(&elastic->mutex);
+	return 0;
+}
+
+int glc_elastic_write_cancel(glc_elastic_t elastic, char *data)
+{
+	struct glc_elastic_record_s *record = (struct glc_elastic_record_s *)
+		(data - sizeof(struct glc_elastic_record_s));
+
+	pthread_mutex_lock(&elastic->mutex);
+	record->state = GLC_ELASTIC_CANCELLED;
+	pthread_cond_signal(&elastic->data_cond);
+	pthread_mutex_unlock(&elastic->mutex);
+	return 0;
+}
+
+int glc_elastic_expect(glc_elastic_t elastic, size_t size)
+{
+	pthread_mutex_lock(&elastic->mutex);
+	if (GLC_ELASTIC_RECORD(size) > elastic->expect) {
+		elastic->expect = GLC_ELASTIC_RECORD(size);
+		elastic->grow = 1;
+		pthread_cond_signal(&elastic->data_cond);
+	}
+	pthread_mutex_unlock(&elastic->mutex);
+	return 0;
+}
+
+unsigned int glc_elastic_pending(glc_elastic_t elastic)
+{
+	return __atomic_load_n(&elastic->pending, __ATOMIC_ACQUIRE);
+}
+
+int glc_elastic_flush(glc_elastic_t elastic)
+{
+	int ret;
+
+	pthread_mutex_lock(&elastic->mutex);
+	while ((elastic->pending) && (!elastic->cancel))
+		pthread_cond_wait(&elastic->empty_cond, &elastic->mutex);
+	ret = elastic->pending ? EINTR : 0;
+	pthread_mutex_unlock(&elastic->mutex);
+
+	return ret;
+}
+
+int glc_elastic_cancel(glc_elastic_t elastic)
+{
+	pthread_mutex_lock(&elastic->mutex);
+	elastic->cancel = 1;
+	pthread_cond_broadcast(&elastic->data_cond);
+	pthread_cond_broadcast(&elastic->empty_cond);
+	pthread_mutex_unlock(&elastic->mutex);
+	return 0;
+}
+
+int glc_elastic_get_stat(glc_elastic_t elastic, glc_elastic_stat_t *stat)
+{
+	pthread_mutex_lock(&elastic->mutex);
+	stat->size    = elastic->size;
+	stat->peak    = elastic->peak;
+	stat->used    = elastic->used;
+	stat->spilled = elastic->spilled;
+	stat->dropped = elastic->dropped;
+	pthread_mutex_unlock(&elastic->mutex);
+	return 0;
+}
+
+void *glc_elastic_thread(void *argptr)
+{
+	glc_elastic_t elastic = (glc_elastic_t) argptr;
+	struct glc_elastic_record_s *record;
+	ps_packet_t packet;
+	int ret = 0;
+
+	if (unlikely((ret = ps_packet_init(&packet, elastic->to))))
+		goto err;
+
+	pthread_mutex_lock(&elastic->mutex);
+	while (!elastic->cancel) {
+		if (elastic->grow) {
+			glc_elastic_grow(elastic);
+			continue;
+		}
+
+		/* drained chunks are never left at head */
+		record = elastic->head ? (struct glc_elastic_record_s *)
+			 ((char *) elastic->head + elastic->head->read) : NULL;
+		if ((!record) || (record->state == GLC_ELASTIC_RESERVED)) {
+			glc_elastic_idle(elastic);
+			continue;
+		}
+
+		if (record->state == GLC_ELASTIC_READY) {
+			pthread_mutex_unlock(&elastic->mutex);
+			ret = glc_elastic_send(elastic, &packet, record);
+			pthread_mutex_lock(&elastic->mutex);
+			if (ret == EBUSY) {
+				/* buffer is full, try again unless cancelled */
+				glc_elastic_wait(elastic, GLC_ELASTIC_RETRY);
+				continue;
+			} else if (unlikely(ret))
+				break;
+			glc_thread_pool_notify(elastic->glc);
+		}
+		glc_elastic_pop(elastic, record);
+	}
+
+	/* nothing reaches the buffer anymore, let writers and flush() know */
+	elastic->cancel = 1;
+	pthread_cond_broadcast(&elastic->empty_cond);
+	pthread_mutex_unlock(&elastic->mutex);
+	ps_packet_destroy(&packet);
+
+	if (likely((!ret) || (ret == EINTR)))
+		return NULL;
+err:
+	glc_log(elastic->glc, GLC_ERROR, "elastic",
+		"%s (%d)", strerror(ret), ret);
+	return NULL;
+}
+
+/**
+ * \brief write a record to the buffer
+ *
+ * Never blocks on the buffer so a cancelled store can't leave
+ * the thread stuck there.
+ * \return 0 on success, EBUSY if buffer is full otherwise an error code
+ */
+int glc_elastic_send(glc_elastic_t elastic, ps_packet_t *packet,
+		     struct glc_elastic_record_s *record)
+{
+	int ret;
+
+	if (unlikely(elastic->cancel))
+		return EINTR;
+	if (unlikely((ret = ps_packet_open(packet, PS_PACKET_WRITE | PS_PACKET_TRY))))
+		return ret;
+	if (unlikely((ret = ps_packet_setsize(packet, record->size))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(packet, (char *) record +
+					    sizeof(struct glc_elastic_record_s),
+					    record->size))))
+		goto cancel;
+
+	return ps_packet_close(packet);
+cancel:
+	ps_packet_cancel(packet);
+	return ret;
+}
+
+/**
+ * \brief release record at head
+ *
+ * Called with mutex held.
+ */
+void glc_elastic_pop(glc_elastic_t elastic, struct glc_elastic_record_s *record)
+{
+	struct glc_elastic_chunk_s *chunk = elastic->head;
+	size_t need = GLC_ELASTIC_RECORD(record->size);
+
+	chunk->read += need;
+	elastic->used -= need;
+
+	if (chunk->read == chunk->write) {
+		if (!(elastic->head = chunk->next))
+			elastic->tail = NULL;
+		chunk->read = chunk->write = GLC_ELASTIC_HEADER;
+		chunk->next = elastic->spare;
+		elastic->spare = chunk;
+	}
+
+	if (!__sync_sub_and_fetch(&elastic->pending, 1))
+		pthread_cond_broadcast(&elastic->empty_cond);
+}
+
+/**
+ * \brief map a prefaulted spare chunk
+ *
+ * Called with mutex held, which is released while the chunk
+ * is being faulted in.
+ */
+void glc_elastic_grow(glc_elastic_t elastic)
+{
+	struct glc_elastic_chunk_s *chunk;
+	size_t size = glc_elastic_chunk_size(elastic, elastic->expect);
+
+	elastic->grow = 0;
+	for (chunk = elastic->spare; chunk; chunk = chunk->next) {
+		if (chunk->size >= size)
+			return;
+	}
+	if (elastic->size + size > elastic->max_size)
+		return;
+
+	/* account for it now so writers do not go over the cap meanwhile */
+	elastic->size += size;
+	if (elastic->size > elastic->peak)
+		elastic->peak = elastic->size;
+
+	pthread_mutex_unlock(&elastic->mutex);
+	chunk = glc_elastic_map(size, MAP_POPULATE);
+	pthread_mutex_lock(&elastic->mutex);
+
+	if (unlikely(!chunk)) {
+		elastic->size -= size;
+		return;
+	}
+
+	chunk->next = elastic->spare;
+	elastic->spare = chunk;
+	glc_log(elastic->glc, GLC_DEBUG, "elastic",
+		"grown to %zu bytes, %zu used", elastic->size, elastic->used);
+}
+
+/**
+ * \brief wait for data, release spare chunks if store stayed idle
+ *
+ * Called with mutex held.
+ */
+void glc_elastic_idle(glc_elastic_t elastic)
+{
+	struct glc_elastic_chunk_s *del;
+	glc_utime_t now = glc_elastic_time();
+	size_t released = 0;
+
+	/* low watermark, one spare is kept ready for the next spill */
+	if ((elastic->spare) && (elastic->spare->next) &&
+	    (elastic->used <= elastic->size / 4)) {
+		if (!elastic->low_since)
+			elastic->low_since = now;
+		else if (now - elastic->low_since >= GLC_ELASTIC_IDLE) {
+			while ((del = elastic->spare->next)) {
+				elastic->spare->next = del->next;
+				elastic->size -= del->size;
+				released += del->size;
+				glc_elastic_unmap(del);
+			}
+			elastic->low_since = 0;
+			glc_log(elastic->glc, GLC_DEBUG, "elastic",
+				"released %zu bytes, %zu left",
+				released, elastic->size);
+		}
+	} else
+		elastic->low_since = 0;
+
+	glc_elastic_wait(elastic, GLC_ELASTIC_TICK);
+}
+
+/**
+ * \brief wait for data at most ns nanoseconds
+ *
+ * Called with mutex held.
+ */
+void glc_elastic_wait(glc_elastic_t elastic, glc_utime_t ns)
+{
+	struct timespec ts;
+	glc_utime_t until = glc_elastic_time() + ns;
+
+	ts.tv_sec = until / 1000000000;
+	ts.tv_nsec = until % 1000000000;
+	pthread_cond_timedwait(&elastic->data_cond, &elastic->mutex, &ts);
+}
+
+/**
+ * \brief take a chunk from spare list or map a new one
+ *
+ * Called with mutex held.
+ * \return chunk or NULL if cap is reached
+ */
+struct glc_elastic_chunk_s *glc_elastic_get_chunk(glc_elastic_t elastic,
+						  size_t need)
+{
+	struct glc_elastic_chunk_s **prev, *chunk;
+	size_t size = glc_elastic_chunk_size(elastic, need);
+
+	for (prev = &elastic->spare; *prev; prev = &(*prev)->next) {
+		if ((*prev)->size - GLC_ELASTIC_HEADER >= need) {
+			chunk = *prev;
+			*prev = chunk->next;
+			chunk->next = NULL;
+			return chunk;
+		}
+	}
+
+	if (elastic->size + size > elastic->max_size)
+		return NULL;
+
+	if (unlikely(!(chunk = glc_elastic_map(size, 0))))
+		return NULL;
+
+	elastic->size += size;
+	if (elastic->size > elastic->peak)
+		elastic->peak = elastic->size;
+
+	return chunk;
+}
+
+/**
+ * \brief size of a chunk that fits a record of need bytes
+ */
+size_t glc_elastic_chunk_size(glc_elastic_t elastic, size_t need)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	/* oversized packets get a chunk of their own */
+	if (need + GLC_ELASTIC_HEADER > elastic->chunk_size)
+		return (need + GLC_ELASTIC_HEADER + page - 1) & ~(page - 1);
+	return elastic->chunk_size;
+}
+
+struct glc_elastic_chunk_s *glc_elastic_map(size_t size, int flags)
+{
+	struct glc_elastic_chunk_s *chunk;
+
+	chunk = (struct glc_elastic_chunk_s *) mmap(NULL, size, PROT_READ | PROT_WRITE,
+						    MAP_PRIVATE | MAP_ANONYMOUS | flags,
+						    -1, 0);
+	if (unlikely(chunk == MAP_FAILED))
+		return NULL;
+
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->read = chunk->write = GLC_ELASTIC_HEADER;
+	return chunk;
+}
+
+void glc_elastic_unmap(struct glc_elastic_chunk_s *chunk)
+{
+	munmap(chunk, chunk->size);
+}
+
+glc_utime_t glc_elastic_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (glc_utime_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**  \} */
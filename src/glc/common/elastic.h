@@ -0,0 +1,186 @@
+/**
+ * \file glc/common/elastic.h
+ * \brief elastic overflow store for stream buffers
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup common
+ *  \{
+ * \defgroup elastic elastic overflow store
+ *  \{
+ */
+
+#ifndef _ELASTIC_H
+#define _ELASTIC_H
+
+#include <packetstream.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** default chunk size */
+#define GLC_ELASTIC_CHUNK_SIZE (8 * 1024 * 1024)
+
+/**
+ * \brief elastic object
+ *
+ * Segmented store sitting in front of a fixed size ps_buffer_t.
+ * Packets that do not fit in the buffer are written in chunks
+ * mapped on demand, up to a cap, and a background thread moves
+ * them into the buffer, in order, as soon as there is room.
+ * Spare chunks are released back to the OS once the store has
+ * been mostly empty for a while.
+ *
+ * Once a packet has been written to the store, every following
+ * packet of the same stream must also go through the store until
+ * glc_elastic_pending() returns 0, otherwise they would overtake
+ * it.
+ */
+typedef struct glc_elastic_s* glc_elastic_t;
+
+/**
+ * \brief elastic statistics
+ */
+typedef struct {
+	/** bytes currently mapped */
+	size_t size;
+	/** largest size reached */
+	size_t peak;
+	/** bytes held by packets waiting for the buffer */
+	size_t used;
+	/** packets that went through the store */
+	unsigned long spilled;
+	/** packets refused because the cap was reached */
+	unsigned long dropped;
+} glc_elastic_stat_t;
+
+/**
+ * \brief initialize elastic object and start its thread
+ * \param elastic elastic object
+ * \param glc glc
+ * \param to target buffer
+ * \param chunk_size size of a chunk, packets larger than this get
+ *                   a chunk of their own
+ * \param max_size maximum amount of memory mapped at a time
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_init(glc_elastic_t *elastic, glc_t *glc, ps_buffer_t *to,
+			      size_t chunk_size, size_t max_size);
+
+/**
+ * \brief stop thread and destroy elastic object
+ *
+ * Packets still in the store are lost, call glc_elastic_flush()
+ * first to keep them.
+ * \param elastic elastic object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_destroy(glc_elastic_t elastic);
+
+/**
+ * \brief reserve room for a packet
+ *
+ * Never blocks. Several threads may have a packet open at the
+ * same time, packets reach the buffer in reservation order.
+ * \param elastic elastic object
+ * \param size packet size
+ * \param data returned pointer to packet data
+ * \return 0 on success, ENOSPC if the cap is reached, EINTR if
+ *         store was cancelled otherwise an error code
+ */
+__PUBLIC int glc_elastic_write_open(glc_elastic_t elastic, size_t size, char **data);
+
+/**
+ * \brief hand packet over to the buffer
+ * \param elastic elastic object
+ * \param data pointer returned by glc_elastic_write_open()
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_write_close(glc_elastic_t elastic, char *data);
+
+/**
+ * \brief drop reserved packet
+ * \param elastic elastic object
+ * \param data pointer returned by glc_elastic_write_open()
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_write_cancel(glc_elastic_t elastic, char *data);
+
+/**
+ * \brief announce size of upcoming packets
+ *
+ * The thread keeps a prefaulted spare chunk this large ready so
+ * the first spill does not fault memory in on the writer.
+ * \param elastic elastic object
+ * \param size packet size
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_expect(glc_elastic_t elastic, size_t size);
+
+/**
+ * \brief number of packets not yet in the buffer
+ *
+ * Lock-free, meant to be checked before every write to the buffer.
+ * \param elastic elastic object
+ * \return number of reserved or queued packets
+ */
+__PUBLIC unsigned int glc_elastic_pending(glc_elastic_t elastic);
+
+/**
+ * \brief block until every packet has reached the buffer
+ *
+ * Waits for the buffer reader, do not call on a thread that
+ * must not stall.
+ * \param elastic elastic object
+ * \return 0 on success, EINTR if store was cancelled
+ */
+__PUBLIC int glc_elastic_flush(glc_elastic_t elastic);
+
+/**
+ * \brief cancel store
+ *
+ * Every call returns EINTR from now on. The thread never blocks
+ * on the buffer so it stops within a millisecond.
+ * \param elastic elastic object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_cancel(glc_elastic_t elastic);
+
+/**
+ * \brief get statistics
+ * \param elastic elastic object
+ * \param stat returned statistics
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_elastic_get_stat(glc_elastic_t elastic, glc_elastic_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
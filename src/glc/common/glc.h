@@ -84,7 +84,7 @@ extern "C" {
  */
 
 /** stream version */
-#define GLC_STREAM_VERSION                  0x5
+#define GLC_STREAM_VERSION                  0x7
 /** file signature = "GLC" */
 #define GLC_SIGNATURE                0x00434c47
 
@@ -118,6 +118,10 @@ typedef struct glc_util_s* glc_util_t;
 typedef struct glc_log_s* glc_log_t;
 /** glc state */
 typedef struct glc_state_s* glc_state_t;
+/** glc shared worker pool */
+typedef struct glc_thread_pool_s* glc_thread_pool_t;
+/** glc stripe workers */
+typedef struct glc_stripe_s* glc_stripe_t;
 
 /**
  * \brief glc structure
@@ -131,6 +135,10 @@ typedef struct {
 	glc_log_t log;
 	/** state internal structure */
 	glc_state_t state;
+	/** shared worker pool, NULL if filters use their own threads */
+	glc_thread_pool_t pool;
+	/** stripe workers, NULL if frames are not split */
+	glc_stripe_t stripe;
 	/** state flags */
 	glc_flags_t state_flags;
 } glc_t;
@@ -208,6 +216,12 @@ typedef u_int8_t glc_message_type_t;
 #define GLC_MESSAGE_LZJB               0x0a
 /** callback request */
 #define GLC_CALLBACK_REQUEST           0x0b
+/** reference to an in-memory packet */
+#define GLC_MESSAGE_REF                0x0c
+/** previous video frame shown again, only a video data header */
+#define GLC_MESSAGE_VIDEO_REPEAT       0x0d
+/** changed tiles of previous video frame */
+#define GLC_MESSAGE_VIDEO_TILES        0x0e
 
 /**
  * \brief stream message header
@@ -278,6 +292,12 @@ typedef struct {
 #define GLC_VIDEO_DWORD_ALIGNED         0x1
 #define GLC_VIDEO_CAPTURING             0x2
 #define GLC_VIDEO_NEED_COLOR_UPDATE     0x4
+/** already scaled by capture, scaling filters leave the size as is */
+#define GLC_VIDEO_SCALED                0x8
+/** unchanged frames may be sent as GLC_MESSAGE_VIDEO_REPEAT */
+#define GLC_VIDEO_REPEATS              0x10
+/** frames may be sent as GLC_MESSAGE_VIDEO_TILES */
+#define GLC_VIDEO_TILES                0x20
 
 /**
  * \brief video data header
@@ -289,6 +309,25 @@ typedef struct {
 	glc_utime_t time;
 } __attribute__((packed)) glc_video_frame_header_t;
 
+/**
+ * \brief video tiles header
+ *
+ * Frame is cut in size x size tiles, numbered row by row from
+ * the first one in memory. Edge tiles are clipped to the frame.
+ * Header is followed by count u_int32_t tile numbers, in
+ * increasing order, and then by the data of these tiles. Tile
+ * data is stored plane by plane, row by row. Y'CbCr 4:2:0
+ * chroma planes are cut in size / 2 tiles.
+ */
+typedef struct {
+	/** frame header, time is the one of the new frame */
+	glc_video_frame_header_t frame;
+	/** tile width and height in pixels, even */
+	u_int32_t size;
+	/** number of tiles */
+	u_int32_t count;
+} __attribute__((packed)) glc_video_tiles_header_t;
+
 /** audio format type */
 typedef u_int8_t glc_audio_format_t;
 /** signed 16bit little-endian */
@@ -370,6 +409,22 @@ typedef struct {
 	void *arg;
 } glc_callback_request_t;
 
+/**
+ * \brief packet reference
+ * \note only for program internal use (not in on-disk stream)
+ * \note may change without stream version bump
+ * Stands for a message whose payload is held in a
+ * reference-counted block instead of the buffer itself.
+ */
+typedef struct {
+	/** header of referenced message */
+	glc_message_header_t header;
+	/** payload size */
+	glc_size_t size;
+	/** payload, see glc_packet_ref_t */
+	struct glc_packet_ref_s *ref;
+} glc_ref_message_t;
+
 #ifdef __cplusplus
 }
 #endif
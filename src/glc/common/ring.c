@@ -0,0 +1,281 @@
+/**
+ * \file glc/common/ring.c
+ * \brief single-producer single-consumer packet ring
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup ring
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "glc.h"
+#include "ring.h"
+#include "optimization.h"
+
+#define GLC_RING_CACHELINE  64
+/** busy-wait iterations before sleeping */
+#define GLC_RING_SPIN       1024
+/** record length marking the end of a lap */
+#define GLC_RING_WRAP       UINT64_MAX
+
+/** record: 8 byte length followed by data, padded to 8 bytes */
+#define GLC_RING_RECORD(size) \
+	(sizeof(uint64_t) + (((size) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1)))
+
+/**
+ * \brief ring
+ *
+ * head is only written by the writer and tail by the reader, each
+ * on its own cache line along with a private copy of the other
+ * index so the shared line is only touched when the copy says
+ * the ring is full (or empty).
+ */
+struct glc_ring_s {
+	/* writer */
+	uint64_t head __attribute__ ((aligned (GLC_RING_CACHELINE)));
+	uint64_t cached_tail;
+	uint64_t write_pos, write_len;
+
+	/* reader */
+	uint64_t tail __attribute__ ((aligned (GLC_RING_CACHELINE)));
+	uint64_t cached_head;
+	uint64_t read_pos, read_len;
+
+	/* futex words, incremented to wake up the other side */
+	int data_seq __attribute__ ((aligned (GLC_RING_CACHELINE)));
+	int space_seq;
+	int reader_waiting, writer_waiting;
+	int cancel;
+
+	char *data __attribute__ ((aligned (GLC_RING_CACHELINE)));
+	uint64_t size, mask;
+};
+
+static int glc_ring_readable(glc_ring_t ring, uint64_t need);
+static int glc_ring_writable(glc_ring_t ring, uint64_t need);
+static int glc_ring_wait(glc_ring_t ring, int *seq, int *waiting,
+			 int (*ready)(glc_ring_t, uint64_t), uint64_t need);
+static void glc_ring_wake(int *seq, int *waiting);
+
+static __inline__ void glc_ring_relax(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__ ("pause" ::: "memory");
+#else
+	__asm__ __volatile__ ("" ::: "memory");
+#endif
+}
+
+int glc_ring_init(glc_ring_t *ring, size_t size)
+{
+	uint64_t ring_size = GLC_RING_CACHELINE;
+
+	while (ring_size < size)
+		ring_size <<= 1;
+
+	if (unlikely(posix_memalign((void **) ring, GLC_RING_CACHELINE,
+				    sizeof(struct glc_ring_s))))
+		return ENOMEM;
+	memset(*ring, 0, sizeof(struct glc_ring_s));
+
+	if (unlikely(posix_memalign((void **) &(*ring)->data, GLC_RING_CACHELINE,
+				    ring_size))) {
+		free(*ring);
+		return ENOMEM;
+	}
+	(*ring)->size = ring_size;
+	(*ring)->mask = ring_size - 1;
+
+	return 0;
+}
+
+int glc_ring_destroy(glc_ring_t ring)
+{
+	free(ring->data);
+	free(ring);
+	return 0;
+}
+
+int glc_ring_write_open(glc_ring_t ring, size_t size, char **data)
+{
+	uint64_t need = GLC_RING_RECORD(size), pos = ring->head;
+	uint64_t off = pos & ring->mask, skip = 0;
+	int ret;
+
+	if (unlikely(need > ring->size / 2))
+		return EINVAL;
+
+	/* packets never wrap around, start a new lap instead */
+	if (off + need > ring->size)
+		skip = ring->size - off;
+
+	if (unlikely((ret = glc_ring_wait(ring, &ring->space_seq, &ring->writer_waiting,
+					  &glc_ring_writable, skip + need))))
+		return ret;
+
+	if (skip) {
+		*((uint64_t *) &ring->data[off]) = GLC_RING_WRAP;
+		pos += skip;
+		off = 0;
+	}
+
+	*((uint64_t *) &ring->data[off]) = size;
+	ring->write_pos = pos;
+	ring->write_len = need;
+	*data = &ring->data[off + sizeof(uint64_t)];
+
+	return 0;
+}
+
+int glc_ring_write_close(glc_ring_t ring)
+{
+	__atomic_store_n(&ring->head, ring->write_pos + ring->write_len,
+			 __ATOMIC_RELEASE);
+	glc_ring_wake(&ring->data_seq, &ring->reader_waiting);
+	return 0;
+}
+
+int glc_ring_read_open(glc_ring_t ring, char **data, size_t *size)
+{
+	uint64_t pos = ring->tail, off, len;
+	int ret;
+
+	if (unlikely((ret = glc_ring_wait(ring, &ring->data_seq, &ring->reader_waiting,
+					  &glc_ring_readable, 0))))
+		return ret;
+
+	off = pos & ring->mask;
+	len = *((uint64_t *) &ring->data[off]);
+	if (len == GLC_RING_WRAP) {
+		/* writer publishes the marker along with the next packet */
+		pos += ring->size - off;
+		off = 0;
+		len = *((uint64_t *) &ring->data[0]);
+	}
+
+	ring->read_pos = pos;
+	ring->read_len = GLC_RING_RECORD(len);
+	*data = &ring->data[off + sizeof(uint64_t)];
+	*size = len;
+
+	return 0;
+}
+
+int glc_ring_read_close(glc_ring_t ring)
+{
+	__atomic_store_n(&ring->tail, ring->read_pos + ring->read_len,
+			 __ATOMIC_RELEASE);
+	glc_ring_wake(&ring->space_seq, &ring->writer_waiting);
+	return 0;
+}
+
+int glc_ring_cancel(glc_ring_t ring)
+{
+	__atomic_store_n(&ring->cancel, 1, __ATOMIC_RELAXED);
+	__sync_fetch_and_add(&ring->data_seq, 1);
+	__sync_fetch_and_add(&ring->space_seq, 1);
+	syscall(SYS_futex, &ring->data_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	syscall(SYS_futex, &ring->space_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	return 0;
+}
+
+int glc_ring_readable(glc_ring_t ring, uint64_t need)
+{
+	if (ring->cached_head != ring->tail)
+		return 1;
+	ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	return ring->cached_head != ring->tail;
+}
+
+int glc_ring_writable(glc_ring_t ring, uint64_t need)
+{
+	if (ring->head + need - ring->cached_tail <= ring->size)
+		return 1;
+	ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	return ring->head + need - ring->cached_tail <= ring->size;
+}
+
+/**
+ * \brief wait until ready() is true
+ *
+ * Sleeping side raises its waiting flag and checks ready() again
+ * after a full barrier, the waking side publishes its index before
+ * checking the flag, so one of them always sees the other.
+ * \return 0 on success, EINTR if ring was cancelled
+ */
+int glc_ring_wait(glc_ring_t ring, int *seq, int *waiting,
+		  int (*ready)(glc_ring_t, uint64_t), uint64_t need)
+{
+	unsigned int spin;
+	int val;
+
+	for (spin = 0; spin < GLC_RING_SPIN; spin++) {
+		if (unlikely(__atomic_load_n(&ring->cancel, __ATOMIC_RELAXED)))
+			return EINTR;
+		if (ready(ring, need))
+			return 0;
+		glc_ring_relax();
+	}
+
+	for (;;) {
+		val = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+		*waiting = 1;
+		__sync_synchronize();
+
+		if (unlikely(__atomic_load_n(&ring->cancel, __ATOMIC_RELAXED))) {
+			*waiting = 0;
+			return EINTR;
+		}
+		if (ready(ring, need)) {
+			*waiting = 0;
+			return 0;
+		}
+
+		syscall(SYS_futex, seq, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+	}
+}
+
+/**
+ * \brief wake up the other side if it is sleeping
+ */
+void glc_ring_wake(int *seq, int *waiting)
+{
+	__sync_synchronize();
+	if (!__atomic_load_n(waiting, __ATOMIC_RELAXED))
+		return;
+
+	*waiting = 0;
+	__sync_fetch_and_add(seq, 1);
+	syscall(SYS_futex, seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**  \} */
@@ -0,0 +1,127 @@
+/**
+ * \file glc/common/ring.h
+ * \brief single-producer single-consumer packet ring
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup common
+ *  \{
+ * \defgroup ring spsc ring
+ *  \{
+ */
+
+#ifndef _RING_H
+#define _RING_H
+
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief ring object
+ *
+ * Lock-free replacement for a ps_buffer_t on links that have
+ * exactly one writer thread and one reader thread. Packets are
+ * stored contiguously so both sides work directly in the ring
+ * memory. A side that has to wait spins for a while and then
+ * sleeps on a futex, the other side only makes a system call
+ * when it knows somebody is sleeping.
+ */
+typedef struct glc_ring_s* glc_ring_t;
+
+/**
+ * \brief initialize ring
+ * \param ring ring object
+ * \param size ring size in bytes, rounded up to a power of two.
+ *             A packet may take at most half of the ring.
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_ring_init(glc_ring_t *ring, size_t size);
+
+/**
+ * \brief destroy ring
+ * \param ring ring object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_ring_destroy(glc_ring_t ring);
+
+/**
+ * \brief reserve room for a packet
+ *
+ * Blocks until there is room. Packet is not visible to the reader
+ * until glc_ring_write_close() is called, a reserved packet that
+ * is never closed is simply dropped.
+ * \param ring ring object
+ * \param size packet size
+ * \param data returned pointer to packet data
+ * \return 0 on success, EINTR if ring was cancelled
+ *         otherwise an error code
+ */
+__PUBLIC int glc_ring_write_open(glc_ring_t ring, size_t size, char **data);
+
+/**
+ * \brief publish reserved packet
+ * \param ring ring object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_ring_write_close(glc_ring_t ring);
+
+/**
+ * \brief get next packet
+ *
+ * Blocks until a packet is available.
+ * \param ring ring object
+ * \param data returned pointer to packet data
+ * \param size returned packet size
+ * \return 0 on success, EINTR if ring was cancelled
+ *         otherwise an error code
+ */
+__PUBLIC int glc_ring_read_open(glc_ring_t ring, char **data, size_t *size);
+
+/**
+ * \brief release packet returned by glc_ring_read_open()
+ * \param ring ring object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_ring_read_close(glc_ring_t ring);
+
+/**
+ * \brief cancel ring
+ *
+ * Wakes up both sides, every blocking call returns EINTR from
+ * now on.
+ * \param ring ring object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_ring_cancel(glc_ring_t ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
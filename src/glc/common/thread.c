@@ -35,6 +35,9 @@
 #include <unistd.h>
 #include <packetstream.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include "glc.h"
 #include "core.h"
@@ -44,9 +47,67 @@
 #include "state.h"
 #include "optimization.h"
 
+/** reorder window size, in packets per worker thread */
+#define GLC_THREAD_REORDER_WINDOW 2
+/**
+ * how long an idle pool worker sleeps at most, only matters for
+ * producers that don't call glc_thread_pool_notify()
+ */
+#define GLC_THREAD_POOL_IDLE_NS   100000000
+/** smallest stripe worth handing to another worker, in rows */
+#define GLC_STRIPE_MIN_ROWS       16
+/** sub-buckets per power of two in latency histograms */
+#define GLC_THREAD_STAT_SUB_BITS  3
+#define GLC_THREAD_STAT_SUB       (1 << GLC_THREAD_STAT_SUB_BITS)
+#define GLC_THREAD_STAT_BUCKETS   ((64 - GLC_THREAD_STAT_SUB_BITS + 1) * GLC_THREAD_STAT_SUB)
+
+/**
+ * \brief reorder buffer slot
+ *
+ * Holds a processed packet until all packets read before
+ * it have been committed to the output buffer.
+ */
+struct glc_thread_reorder_slot_s {
+	glc_message_header_t header;
+	char *data;
+	size_t data_size;
+	size_t size;
+	int ready;
+	int skip;
+};
+
 /**
  * \brief thread private variables
  */
+/**
+ * \brief log-linear latency histogram
+ *
+ * Values below GLC_THREAD_STAT_SUB get a bucket of their own,
+ * every power of two above is split in GLC_THREAD_STAT_SUB buckets.
+ */
+struct glc_thread_stat_s {
+	uint64_t count, sum, min, max;
+	uint64_t buckets[GLC_THREAD_STAT_BUCKETS];
+};
+
+/**
+ * \brief reference-counted packet payload
+ */
+struct glc_packet_ref_s {
+	int refs;
+	size_t size;
+	char *ptr;
+	/* owner of wrapped memory, see glc_packet_ref_wrap() */
+	void (*release)(void *arg);
+	void *arg;
+	/* live payloads, for glc_packet_ref_reap() */
+	struct glc_packet_ref_s *prev, *next;
+	char data[];
+};
+
+static pthread_mutex_t glc_packet_ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct glc_packet_ref_s *glc_packet_ref_live = NULL;
+
 struct glc_thread_private_s {
 	glc_t *glc;
 	ps_buffer_t *from;
@@ -58,13 +119,157 @@ struct glc_thread_private_s {
 	glc_thread_t *thread;
 	size_t running_threads;
 
+	/* GLC_THREAD_REORDER */
+	pthread_mutex_t reorder_mutex;
+	pthread_cond_t reorder_cond;
+	struct glc_thread_reorder_slot_s *reorder_slots;
+	size_t reorder_window;
+	uint64_t read_seq, commit_seq;
+	int committing;
+	int reorder_abort;
+
+	/* shared pool, stage state */
+	struct glc_thread_pool_s *pool;
+	struct glc_thread_worker_s *workers;
+	struct glc_thread_private_s *next;
+	size_t busy;
+	uint64_t close_seq;
+	int closing;
+	int done;
+	int direct;
+
+	struct glc_thread_stat_s stats[GLC_THREAD_STATS];
+
 	int stop;
 	int ret;
 };
 
+/**
+ * \brief per-worker scratch area used in reorder mode
+ */
+struct glc_thread_scratch_s {
+	char *data;
+	size_t size;
+};
+
+/**
+ * \brief stage context of a pool worker
+ */
+struct glc_thread_worker_s {
+	glc_thread_state_t state;
+	ps_packet_t read, write;
+	struct glc_thread_scratch_s scratch;
+	glc_ref_message_t in;
+	int init;
+};
+
+struct glc_thread_pool_arg_s {
+	struct glc_thread_pool_s *pool;
+	size_t index;
+};
+
+/**
+ * \brief shared worker pool
+ */
+struct glc_thread_pool_s {
+	glc_t *glc;
+	pthread_t *pthread_thread;
+	struct glc_thread_pool_arg_s *args;
+	size_t workers;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct glc_thread_private_s *stages;
+	size_t num_stages;
+	int quit;
+
+	/* bumped whenever a buffer might have changed state */
+	uint64_t events;
+	size_t sleeping;
+};
+
 static void *glc_thread(void *argptr);
+static int glc_thread_reorder_process(struct glc_thread_private_s *private,
+				      glc_thread_state_t *state, ps_packet_t *write,
+				      struct glc_thread_scratch_s *scratch,
+				      glc_ref_message_t *in, uint64_t seq);
+static int glc_thread_reorder_commit(struct glc_thread_private_s *private,
+				     ps_packet_t *write, struct glc_thread_scratch_s *scratch,
+				     uint64_t seq, glc_message_header_t *header,
+				     char *data, size_t size, int skip);
+static int glc_thread_reorder_flush(struct glc_thread_private_s *private,
+				    ps_packet_t *write, int *committed);
+static int glc_thread_reorder_direct(struct glc_thread_private_s *private,
+				     glc_thread_state_t *state, ps_packet_t *write,
+				     uint64_t seq);
+static int glc_thread_reorder_wait(struct glc_thread_private_s *private, uint64_t seq);
+static void glc_thread_reorder_abort(struct glc_thread_private_s *private);
+static void *glc_thread_pool_worker(void *argptr);
+static int glc_thread_pool_add(struct glc_thread_pool_s *pool,
+			       struct glc_thread_private_s *private);
+static void glc_thread_pool_remove(struct glc_thread_private_s *private);
 static int glc_thread_block_signals(void);
 static int glc_thread_set_rt_priority(glc_t *glc, int ask_rt);
+static void glc_thread_stat_dump(struct glc_thread_private_s *private);
+static int glc_thread_ref_resolve(ps_packet_t *read, glc_thread_state_t *state,
+				  glc_ref_message_t *in);
+static int glc_thread_ref_forward(glc_thread_state_t *state, glc_ref_message_t *in,
+				  glc_ref_message_t *out, int create);
+static void glc_packet_ref_link(glc_packet_ref_t ref);
+
+static const char *glc_thread_stat_name[GLC_THREAD_STATS] = {
+	"read wait", "header", "read", "write wait", "write", "close"
+};
+
+static __inline__ uint64_t glc_thread_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static __inline__ unsigned int glc_thread_stat_bucket(uint64_t v)
+{
+	unsigned int shift;
+
+	if (v < GLC_THREAD_STAT_SUB)
+		return v;
+	shift = 63 - __builtin_clzll(v) - GLC_THREAD_STAT_SUB_BITS;
+	return (shift + 1) * GLC_THREAD_STAT_SUB +
+	       ((v >> shift) - GLC_THREAD_STAT_SUB);
+}
+
+static __inline__ uint64_t glc_thread_stat_value(unsigned int bucket)
+{
+	if (bucket < 2 * GLC_THREAD_STAT_SUB)
+		return bucket;
+	return ((uint64_t) (bucket % GLC_THREAD_STAT_SUB + GLC_THREAD_STAT_SUB)) <<
+	       (bucket / GLC_THREAD_STAT_SUB - 1);
+}
+
+/**
+ * \brief record time elapsed since start
+ *
+ * Workers of a same thread share the histograms, so everything
+ * is updated atomically.
+ */
+static __inline__ void glc_thread_stat_add(struct glc_thread_private_s *private,
+					   int stat, uint64_t start)
+{
+	struct glc_thread_stat_s *s = &private->stats[stat];
+	uint64_t v = glc_thread_time() - start, cur;
+
+	__sync_fetch_and_add(&s->buckets[glc_thread_stat_bucket(v)], 1);
+	__sync_fetch_and_add(&s->sum, v);
+	__sync_fetch_and_add(&s->count, 1);
+
+	while ((cur = s->min) > v)
+		if (__sync_bool_compare_and_swap(&s->min, cur, v))
+			break;
+	while ((cur = s->max) < v)
+		if (__sync_bool_compare_and_swap(&s->max, cur, v))
+			break;
+}
 
 int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from,
 			ps_buffer_t *to)
@@ -76,6 +281,17 @@ int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from,
 	if (unlikely(thread->threads < 1))
 		return EINVAL;
 
+	if (unlikely((thread->flags & GLC_THREAD_REORDER) &&
+		     ((thread->flags & (GLC_THREAD_READ | GLC_THREAD_WRITE)) !=
+		      (GLC_THREAD_READ | GLC_THREAD_WRITE))))
+		return EINVAL;
+
+	/* a ring has a single reader */
+	if (unlikely((thread->ring) && ((thread->threads != 1) ||
+		     ((thread->flags & (GLC_THREAD_READ | GLC_THREAD_WRITE)) !=
+		      GLC_THREAD_READ))))
+		return EINVAL;
+
 	if (unlikely(!(private = (struct glc_thread_private_s *)
 		calloc(1, sizeof(struct glc_thread_private_s)))))
 		return ENOMEM;
@@ -88,6 +304,35 @@ int glc_thread_create(glc_t *glc, glc_thread_t *thread, ps_buffer_t *from,
 
 	pthread_mutex_init(&private->open, NULL);
 	pthread_mutex_init(&private->finish, NULL);
+	for (t = 0; t < GLC_THREAD_STATS; t++)
+		private->stats[t].min = UINT64_MAX;
+
+	/* stages in the shared pool always go through the reorder buffer */
+	if ((glc->pool) && ((thread->flags & (GLC_THREAD_READ | GLC_THREAD_WRITE)) ==
+			    (GLC_THREAD_READ | GLC_THREAD_WRITE))) {
+		private->pool = glc->pool;
+		/* processed by one worker at a time, can write in place */
+		private->direct = (thread->threads == 1) || (glc->pool->workers == 1);
+	}
+
+	if ((thread->flags & GLC_THREAD_REORDER) || (private->pool)) {
+		private->reorder_window = (private->pool ? private->pool->workers :
+					   thread->threads) * GLC_THREAD_REORDER_WINDOW;
+		if (unlikely(!(private->reorder_slots = (struct glc_thread_reorder_slot_s *)
+			calloc(private->reorder_window,
+			       sizeof(struct glc_thread_reorder_slot_s))))) {
+			pthread_mutex_destroy(&private->finish);
+			pthread_mutex_destroy(&private->open);
+			free(private);
+			thread->priv = NULL;
+			return ENOMEM;
+		}
+		pthread_mutex_init(&private->reorder_mutex, NULL);
+		pthread_cond_init(&private->reorder_cond, NULL);
+	}
+
+	if (private->pool)
+		return glc_thread_pool_add(private->pool, private);
 
 	private->pthread_thread = malloc(sizeof(pthread_t) * thread->threads);
 	for (t = 0; t < thread->threads; t++) {
@@ -110,15 +355,27 @@ int glc_thread_wait(glc_thread_t *thread)
 	int ret;
 	size_t t;
 
-	for (t = 0; t < thread->threads; t++) {
-		if (unlikely((ret = pthread_join(private->pthread_thread[t], NULL)))) {
-			glc_log(private->glc, GLC_ERROR, "glc_thread",
-				 "can't join thread: %s (%d)", strerror(ret), ret);
-			return ret;
+	if (private->pool)
+		glc_thread_pool_remove(private);
+	else {
+		for (t = 0; t < thread->threads; t++) {
+			if (unlikely((ret = pthread_join(private->pthread_thread[t], NULL)))) {
+				glc_log(private->glc, GLC_ERROR, "glc_thread",
+					 "can't join thread: %s (%d)", strerror(ret), ret);
+				return ret;
+			}
 		}
 	}
 
 	free(private->pthread_thread);
+	if (private->reorder_slots) {
+		for (t = 0; t < private->reorder_window; t++)
+			free(private->reorder_slots[t].data);
+		free(private->reorder_slots);
+		pthread_cond_destroy(&private->reorder_cond);
+		pthread_mutex_destroy(&private->reorder_mutex);
+	}
+	glc_thread_stat_dump(private);
 	pthread_mutex_destroy(&private->finish);
 	pthread_mutex_destroy(&private->open);
 	free(private);
@@ -127,6 +384,226 @@ int glc_thread_wait(glc_thread_t *thread)
 	return 0;
 }
 
+int glc_thread_get_stat(glc_thread_t *thread, int stat, glc_thread_stat_t *summary)
+{
+	struct glc_thread_private_s *private = thread->priv;
+	struct glc_thread_stat_s *s;
+	glc_utime_t *pct[4];
+	uint64_t rank[4], seen = 0;
+	unsigned int b, p = 0;
+
+	if (unlikely((!private) || (stat < 0) || (stat >= GLC_THREAD_STATS)))
+		return EINVAL;
+	s = &private->stats[stat];
+
+	memset(summary, 0, sizeof(glc_thread_stat_t));
+	if (!(summary->count = s->count))
+		return 0;
+	summary->min  = s->min;
+	summary->max  = s->max;
+	summary->mean = s->sum / summary->count;
+
+	pct[0] = &summary->p50;
+	pct[1] = &summary->p90;
+	pct[2] = &summary->p99;
+	pct[3] = &summary->p999;
+
+	/* ceil(count * q) for the 50th, 90th, 99th and 99.9th percentiles */
+	rank[0] = (summary->count * 500 + 999) / 1000;
+	rank[1] = (summary->count * 900 + 999) / 1000;
+	rank[2] = (summary->count * 990 + 999) / 1000;
+	rank[3] = (summary->count * 999 + 999) / 1000;
+
+	for (b = 0; (b < GLC_THREAD_STAT_BUCKETS) && (p < 4); b++) {
+		seen += s->buckets[b];
+		for (; (p < 4) && (seen >= rank[p]); p++)
+			*pct[p] = glc_thread_stat_value(b);
+	}
+	/* late samples may still be missing from the buckets */
+	for (; p < 4; p++)
+		*pct[p] = summary->max;
+
+	return 0;
+}
+
+/**
+ * \brief log latency statistics of a thread
+ * \param private thread state
+ */
+void glc_thread_stat_dump(struct glc_thread_private_s *private)
+{
+	glc_thread_stat_t summary;
+	int stat;
+
+	for (stat = 0; stat < GLC_THREAD_STATS; stat++) {
+		glc_thread_get_stat(private->thread, stat, &summary);
+		if (!summary.count)
+			continue;
+		glc_log(private->glc, GLC_PERF,
+			private->thread->name ? private->thread->name : "glc_thread",
+			"%s: %" PRIu64 " samples, min %" PRIu64 " ns, mean %" PRIu64
+			" ns, p50 %" PRIu64 " ns, p90 %" PRIu64 " ns, p99 %" PRIu64
+			" ns, p99.9 %" PRIu64 " ns, max %" PRIu64 " ns",
+			glc_thread_stat_name[stat], summary.count, summary.min,
+			summary.mean, summary.p50, summary.p90, summary.p99,
+			summary.p999, summary.max);
+	}
+}
+
+int glc_packet_ref_create(glc_packet_ref_t *ref, size_t size)
+{
+	if (unlikely(!(*ref = (glc_packet_ref_t)
+		malloc(sizeof(struct glc_packet_ref_s) + size))))
+		return ENOMEM;
+	(*ref)->refs = 1;
+	(*ref)->size = size;
+	(*ref)->ptr = (*ref)->data;
+	(*ref)->release = NULL;
+	glc_packet_ref_link(*ref);
+	return 0;
+}
+
+int glc_packet_ref_wrap(glc_packet_ref_t *ref, char *data, size_t size,
+			void (*release)(void *arg), void *arg)
+{
+	if (unlikely(!(*ref = (glc_packet_ref_t)
+		malloc(sizeof(struct glc_packet_ref_s)))))
+		return ENOMEM;
+	(*ref)->refs = 1;
+	(*ref)->size = size;
+	(*ref)->ptr = data;
+	(*ref)->release = release;
+	(*ref)->arg = arg;
+	glc_packet_ref_link(*ref);
+	return 0;
+}
+
+char *glc_packet_ref_data(glc_packet_ref_t ref)
+{
+	return ref->ptr;
+}
+
+void glc_packet_ref_get(glc_packet_ref_t ref)
+{
+	__sync_fetch_and_add(&ref->refs, 1);
+}
+
+void glc_packet_ref_link(glc_packet_ref_t ref)
+{
+	pthread_mutex_lock(&glc_packet_ref_mutex);
+	ref->prev = NULL;
+	ref->next = glc_packet_ref_live;
+	if (ref->next)
+		ref->next->prev = ref;
+	glc_packet_ref_live = ref;
+	pthread_mutex_unlock(&glc_packet_ref_mutex);
+}
+
+/**
+ * \brief forget a payload, called with ref lock held
+ */
+static void glc_packet_ref_unlink(glc_packet_ref_t ref)
+{
+	if (ref->prev)
+		ref->prev->next = ref->next;
+	else
+		glc_packet_ref_live = ref->next;
+	if (ref->next)
+		ref->next->prev = ref->prev;
+}
+
+static void glc_packet_ref_free(glc_packet_ref_t ref)
+{
+	if (ref->release)
+		ref->release(ref->arg);
+	free(ref);
+}
+
+void glc_packet_ref_put(glc_packet_ref_t ref)
+{
+	if (__sync_sub_and_fetch(&ref->refs, 1) == 0) {
+		pthread_mutex_lock(&glc_packet_ref_mutex);
+		glc_packet_ref_unlink(ref);
+		pthread_mutex_unlock(&glc_packet_ref_mutex);
+		glc_packet_ref_free(ref);
+	}
+}
+
+size_t glc_packet_ref_reap(void)
+{
+	glc_packet_ref_t ref;
+	size_t count = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&glc_packet_ref_mutex);
+		if ((ref = glc_packet_ref_live))
+			glc_packet_ref_unlink(ref);
+		pthread_mutex_unlock(&glc_packet_ref_mutex);
+		if (!ref)
+			break;
+		glc_packet_ref_free(ref);
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * \brief read a GLC_MESSAGE_REF packet
+ *
+ * state gets the header and size of the referenced message,
+ * reference is owned by the caller until forwarded or dropped.
+ * \param read read packet, header already read
+ * \param state thread state
+ * \param in returned reference
+ * \return 0 on success otherwise an error code
+ */
+int glc_thread_ref_resolve(ps_packet_t *read, glc_thread_state_t *state,
+			   glc_ref_message_t *in)
+{
+	int ret;
+
+	if (unlikely((ret = ps_packet_read(read, in, sizeof(glc_ref_message_t)))))
+		return ret;
+	memcpy(&state->header, &in->header, sizeof(glc_message_header_t));
+	state->read_size = state->write_size = in->size;
+	return 0;
+}
+
+/**
+ * \brief prepare a GLC_MESSAGE_REF for a GLC_THREAD_COPY packet
+ *
+ * A packet that came in by reference keeps its payload. With create,
+ * payloads of at least GLC_PACKET_REF_MIN bytes are moved into a
+ * new reference so later stages don't have to copy them again.
+ * out->ref is left NULL if the packet should be copied.
+ * \param state thread state
+ * \param in reference read by calling thread, or NULL ref
+ * \param out returned reference message
+ * \param create move copied payloads into a new reference
+ * \return 0 on success otherwise an error code
+ */
+int glc_thread_ref_forward(glc_thread_state_t *state, glc_ref_message_t *in,
+			   glc_ref_message_t *out, int create)
+{
+	int ret;
+
+	out->ref = NULL;
+	if (in->ref) {
+		out->ref = in->ref;
+		in->ref = NULL;
+	} else if ((create) && (state->write_size >= GLC_PACKET_REF_MIN)) {
+		if (unlikely((ret = glc_packet_ref_create(&out->ref, state->write_size))))
+			return ret;
+		memcpy(glc_packet_ref_data(out->ref), state->read_data, state->write_size);
+	} else
+		return 0;
+
+	memcpy(&out->header, &state->header, sizeof(glc_message_header_t));
+	out->size = state->write_size;
+	return 0;
+}
+
 /**
  * \brief thread loop
  *
@@ -137,24 +614,40 @@ int glc_thread_wait(glc_thread_t *thread)
  */
 void *glc_thread(void *argptr)
 {
-	int has_locked, ret, write_size_set, packets_init;
+	int has_locked, ret, write_size_set, packets_init, reorder, forward;
+	uint64_t seq = 0, t0;
 
 	struct glc_thread_private_s *private = (struct glc_thread_private_s *) argptr;
 	glc_thread_t *thread = private->thread;
 	glc_thread_state_t state;
-	ps_packet_t read, write;
+	ps_packet_t packets[2], *read = &packets[0], *held = NULL, write;
+	glc_packet_ref_t held_ref = NULL;
+	struct glc_thread_scratch_s scratch;
+	glc_message_header_t ref_header;
+	glc_ref_message_t in, out;
+	char *ring_data = NULL;
+	size_t ring_size = 0;
 
 	memset(&state, 0, sizeof(state));
+	memset(&scratch, 0, sizeof(scratch));
+	in.ref = out.ref = NULL;
+	ref_header.type = GLC_MESSAGE_REF;
+	reorder = thread->flags & GLC_THREAD_REORDER;
 	write_size_set = ret = has_locked = packets_init = 0;
 	state.ptr   = thread->ptr;
 	state.from  = private->from;
 
 	glc_thread_block_signals();
 	glc_thread_set_rt_priority(private->glc, thread->ask_rt);
+	glc_apply_affinity(private->glc, thread->name);
 
-	if (thread->flags & GLC_THREAD_READ) {
-		if (unlikely((ret = ps_packet_init(&read, private->from))))
+	if ((thread->flags & GLC_THREAD_READ) && (!thread->ring)) {
+		if (unlikely((ret = ps_packet_init(&packets[0], private->from))))
 			goto err;
+		if (unlikely((ret = ps_packet_init(&packets[1], private->from)))) {
+			ps_packet_destroy(&packets[0]);
+			goto err;
+		}
 	}
 
 	if (thread->flags & GLC_THREAD_WRITE) {
@@ -184,37 +677,90 @@ void *glc_thread(void *argptr)
 		}
 
 		if ((thread->flags & GLC_THREAD_READ) && (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
-			if (unlikely((ret = ps_packet_open(&read, PS_PACKET_READ))))
+			t0 = glc_thread_time();
+			if (thread->ring)
+				ret = glc_ring_read_open(thread->ring, &ring_data, &ring_size);
+			else
+				ret = ps_packet_open(read, PS_PACKET_READ);
+			if (unlikely(ret))
 				goto err;
-			if (unlikely((ret = ps_packet_read(&read, &state.header,
-						  sizeof(glc_message_header_t)))))
-				goto err;
-			if (unlikely((ret = ps_packet_getsize(&read, &state.read_size))))
-				goto err;
-			state.read_size -= sizeof(glc_message_header_t);
-			state.write_size = state.read_size;
+			glc_thread_stat_add(private, GLC_THREAD_STAT_READ_WAIT, t0);
+		}
+
+		if (reorder) {
+			/*
+			 * Only the sequence number needs to be taken in read order,
+			 * callbacks run in parallel and the reorder buffer restores
+			 * the order when committing.
+			 */
+			seq = private->read_seq++;
+			has_locked = 0;
+			pthread_mutex_unlock(&private->open);
+		}
+
+		if ((thread->flags & GLC_THREAD_READ) && (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
+			if (thread->ring) {
+				/* packet is right there in the ring */
+				memcpy(&state.header, ring_data, sizeof(glc_message_header_t));
+				ring_data += sizeof(glc_message_header_t);
+				ring_size -= sizeof(glc_message_header_t);
+				if (state.header.type == GLC_MESSAGE_REF) {
+					memcpy(&in, ring_data, sizeof(glc_ref_message_t));
+					memcpy(&state.header, &in.header, sizeof(glc_message_header_t));
+					state.read_size = in.size;
+				} else
+					state.read_size = ring_size;
+				state.write_size = state.read_size;
+			} else {
+				if (unlikely((ret = ps_packet_read(read, &state.header,
+							  sizeof(glc_message_header_t)))))
+					goto err;
+				if (state.header.type == GLC_MESSAGE_REF) {
+					if (unlikely((ret = glc_thread_ref_resolve(read, &state, &in))))
+						goto err;
+				} else {
+					if (unlikely((ret = ps_packet_getsize(read, &state.read_size))))
+						goto err;
+					state.read_size -= sizeof(glc_message_header_t);
+					state.write_size = state.read_size;
+				}
+			}
 
 			/* header callback */
 			if (thread->header_callback) {
+				t0 = glc_thread_time();
 				if (unlikely((ret = thread->header_callback(&state))))
 					goto err;
+				glc_thread_stat_add(private, GLC_THREAD_STAT_HEADER, t0);
 			}
 
-			if (unlikely((ret = ps_packet_dma(&read, (void *) &state.read_data,
+			if (in.ref)
+				state.read_data = glc_packet_ref_data(in.ref);
+			else if (thread->ring)
+				state.read_data = ring_data;
+			else if (unlikely((ret = ps_packet_dma(read, (void *) &state.read_data,
 						 state.read_size, PS_ACCEPT_FAKE_DMA))))
 				goto err;
 
 			/* read callback */
 			if (thread->read_callback) {
+				t0 = glc_thread_time();
 				if (unlikely((ret = thread->read_callback(&state))))
 					goto err;
+				glc_thread_stat_add(private, GLC_THREAD_STAT_READ, t0);
 			}
 		}
 
-		if ((thread->flags & GLC_THREAD_WRITE) &&
+		if (reorder) {
+			if (unlikely((ret = glc_thread_reorder_process(private, &state, &write,
+								       &scratch, &in, seq))))
+				goto err;
+		} else if ((thread->flags & GLC_THREAD_WRITE) &&
 		    (!(state.flags & GLC_THREAD_STATE_SKIP_WRITE))) {
+			t0 = glc_thread_time();
 			if (unlikely((ret = ps_packet_open(&write, PS_PACKET_WRITE))))
 				goto err;
+			glc_thread_stat_add(private, GLC_THREAD_STAT_WRITE_WAIT, t0);
 
 			if (has_locked) {
 				has_locked = 0;
@@ -226,29 +772,60 @@ void *glc_thread(void *argptr)
 							sizeof(glc_message_header_t)))))
 				goto err;
 
-			if (!(state.flags & GLC_THREAD_STATE_UNKNOWN_FINAL_SIZE)) {
-				/* 'unlock' write */
-				if (unlikely((ret = ps_packet_setsize(&write,
-					   sizeof(glc_message_header_t) + state.write_size))))
+			forward = 0;
+			if ((state.flags & GLC_THREAD_COPY) &&
+			    (thread->flags & GLC_THREAD_FORWARD_REF)) {
+				if (unlikely((ret = glc_thread_ref_forward(&state, &in, &out,
+						thread->flags & GLC_THREAD_NEW_REF))))
 					goto err;
-				write_size_set = 1;
+				forward = (out.ref != NULL);
 			}
 
-			if (state.flags & GLC_THREAD_COPY) {
-				/* should be faster, no need for fake dma */
-				if (unlikely((ret = ps_packet_write(&write, state.read_data,
-							state.write_size))))
+			if (forward) {
+				/* payload is passed by reference */
+				if (unlikely((ret = ps_packet_setsize(&write,
+					   sizeof(glc_message_header_t) + sizeof(glc_ref_message_t)))))
+					goto err;
+				write_size_set = 1;
+				if (unlikely((ret = ps_packet_write(&write, &out,
+							sizeof(glc_ref_message_t)))))
 					goto err;
 			} else {
-				if (unlikely((ret = ps_packet_dma(&write,
-							(void *) &state.write_data,
-							 state.write_size, PS_ACCEPT_FAKE_DMA))))
+				if (!(state.flags & (GLC_THREAD_STATE_UNKNOWN_FINAL_SIZE |
+						     GLC_THREAD_STATE_SHRINK))) {
+					/* 'unlock' write */
+					if (unlikely((ret = ps_packet_setsize(&write,
+						   sizeof(glc_message_header_t) + state.write_size))))
 						goto err;
+					write_size_set = 1;
+				}
 
-				/* write callback */
-				if (thread->write_callback) {
-					if (unlikely((ret = thread->write_callback(&state))))
+				if (state.flags & GLC_THREAD_COPY) {
+					/* should be faster, no need for fake dma */
+					if (unlikely((ret = ps_packet_write(&write, state.read_data,
+								state.write_size))))
 						goto err;
+				} else {
+					if (unlikely((ret = ps_packet_dma(&write,
+								(void *) &state.write_data,
+								 state.write_size, PS_ACCEPT_FAKE_DMA))))
+							goto err;
+
+					/* write callback */
+					if (thread->write_callback) {
+						t0 = glc_thread_time();
+						if (unlikely((ret = thread->write_callback(&state))))
+							goto err;
+						glc_thread_stat_add(private, GLC_THREAD_STAT_WRITE, t0);
+					}
+
+					/* final size is known, shrink the reservation */
+					if (state.flags & GLC_THREAD_STATE_SHRINK) {
+						if (unlikely((ret = ps_packet_setsize(&write,
+							   sizeof(glc_message_header_t) + state.write_size))))
+							goto err;
+						write_size_set = 1;
+					}
 				}
 			}
 
@@ -256,8 +833,10 @@ void *glc_thread(void *argptr)
 			if (unlikely((ret = ps_packet_seek(&write, 0))))
 				goto err;
 			if (unlikely((ret = ps_packet_write(&write,
-					&state.header, sizeof(glc_message_header_t)))))
+					forward ? &ref_header : &state.header,
+					sizeof(glc_message_header_t)))))
 				goto err;
+			out.ref = NULL;
 		}
 
 		/* in case of we skipped writing */
@@ -268,12 +847,31 @@ void *glc_thread(void *argptr)
 
 		if ((thread->flags & GLC_THREAD_READ) &&
 		    (!(state.flags & GLC_THREAD_STATE_SKIP_READ))) {
-			ps_packet_close(&read);
+			if (thread->ring)
+				glc_ring_read_close(thread->ring);
+			else if ((state.flags & GLC_THREAD_STATE_HOLD_READ) && (!reorder)) {
+				/* previous packet is let go, this one stays open */
+				if (held)
+					ps_packet_close(held);
+				if (held_ref)
+					glc_packet_ref_put(held_ref);
+				held_ref = in.ref;
+				in.ref = NULL;
+				held = read;
+				read = (read == &packets[0]) ? &packets[1] : &packets[0];
+			} else
+				ps_packet_close(read);
 			state.read_data = NULL;
 			state.read_size = 0;
 		}
 
-		if ((thread->flags & GLC_THREAD_WRITE) &&
+		/* reference was not forwarded */
+		if (in.ref) {
+			glc_packet_ref_put(in.ref);
+			in.ref = NULL;
+		}
+
+		if ((thread->flags & GLC_THREAD_WRITE) && (!reorder) &&
 		    (!(state.flags & GLC_THREAD_STATE_SKIP_WRITE))) {
 			if (!write_size_set) {
 				if (unlikely((ret = ps_packet_setsize(&write,
@@ -287,8 +885,20 @@ void *glc_thread(void *argptr)
 
 		/* close callback */
 		if (thread->close_callback) {
+			t0 = glc_thread_time();
 			if (unlikely((ret = thread->close_callback(&state))))
 				goto err;
+			glc_thread_stat_add(private, GLC_THREAD_STAT_CLOSE, t0);
+		}
+
+		/* pool stages might be waiting for this packet or its space */
+		glc_thread_pool_notify(private->glc);
+
+		/* last packet must be committed before waking up remaining threads */
+		if ((reorder) && ((state.flags & GLC_THREAD_STOP) ||
+				  (state.header.type == GLC_MESSAGE_CLOSE))) {
+			if (unlikely((ret = glc_thread_reorder_wait(private, seq))))
+				goto err;
 		}
 
 		if (state.flags & GLC_THREAD_STOP)
@@ -301,9 +911,21 @@ void *glc_thread(void *argptr)
 		 (!private->stop));
 
 finish:
+	free(scratch.data);
+	if (in.ref)
+		glc_packet_ref_put(in.ref);
+	if (out.ref)
+		glc_packet_ref_put(out.ref);
+	if (held_ref)
+		glc_packet_ref_put(held_ref);
+
 	if (packets_init) {
-		if (thread->flags & GLC_THREAD_READ)
-			ps_packet_destroy(&read);
+		if ((thread->flags & GLC_THREAD_READ) && (!thread->ring)) {
+			if (held)
+				ps_packet_close(held);
+			ps_packet_destroy(&packets[0]);
+			ps_packet_destroy(&packets[1]);
+		}
 		if (thread->flags & GLC_THREAD_WRITE)
 			ps_packet_destroy(&write);
 	}
@@ -311,13 +933,17 @@ finish:
 	/* wake up remaining threads */
 	if ((thread->flags & GLC_THREAD_READ) && (!private->stop)) {
 		private->stop = 1;
-		ps_buffer_cancel(private->from);
+		if (thread->ring)
+			glc_ring_cancel(thread->ring);
+		else
+			ps_buffer_cancel(private->from);
 
 		/* error might have happened @ write buffer
 		   so there could be blocking threads */
 		if ((glc_state_test(private->glc, GLC_STATE_CANCEL)) &&
 		    (thread->flags & GLC_THREAD_WRITE))
 			ps_buffer_cancel(private->to);
+		glc_thread_pool_notify(private->glc);
 	}
 
 	/* thread finish callback */
@@ -349,6 +975,10 @@ err:
 	if (has_locked)
 		pthread_mutex_unlock(&private->open);
 
+	/* packets after this one can't be committed anymore */
+	if (reorder)
+		glc_thread_reorder_abort(private);
+
 	if (ret == EINTR)
 		ret = 0;
 	else {
@@ -359,6 +989,1039 @@ err:
 	goto finish;
 }
 
+/**
+ * \brief run write callback and hand the result to the reorder buffer
+ *
+ * The write callback writes into a thread private scratch area
+ * instead of a dma to the output buffer so it can run
+ * concurrently with other workers.
+ * \param private thread private variables
+ * \param state thread state
+ * \param write write packet of calling thread
+ * \param scratch scratch area of calling thread
+ * \param in reference read by calling thread
+ * \param seq sequence number of the packet
+ * \return 0 on success otherwise an error code
+ */
+int glc_thread_reorder_process(struct glc_thread_private_s *private,
+			       glc_thread_state_t *state, ps_packet_t *write,
+			       struct glc_thread_scratch_s *scratch,
+			       glc_ref_message_t *in, uint64_t seq)
+{
+	glc_thread_t *thread = private->thread;
+	glc_message_header_t ref_header;
+	glc_ref_message_t out;
+	uint64_t t0;
+	char *data;
+	int ret;
+
+	if (state->flags & GLC_THREAD_STATE_SKIP_WRITE)
+		return glc_thread_reorder_commit(private, write, scratch, seq,
+						 &state->header, NULL, 0, 1);
+
+	if ((state->flags & GLC_THREAD_COPY) &&
+	    (thread->flags & GLC_THREAD_FORWARD_REF)) {
+		if (unlikely((ret = glc_thread_ref_forward(state, in, &out,
+						thread->flags & GLC_THREAD_NEW_REF))))
+			return ret;
+		if (out.ref) {
+			/* the reference message is small enough to be parked */
+			ref_header.type = GLC_MESSAGE_REF;
+			return glc_thread_reorder_commit(private, write, scratch, seq,
+							 &ref_header, (char *) &out,
+							 sizeof(glc_ref_message_t), 0);
+		}
+	}
+
+	if ((private->direct) && (!(state->flags & GLC_THREAD_COPY))) {
+		ret = glc_thread_reorder_direct(private, state, write, seq);
+		if (ret != EAGAIN)
+			return ret;
+	}
+
+	if (state->flags & GLC_THREAD_COPY)
+		data = state->read_data;
+	else {
+		if (scratch->size < state->write_size) {
+			if (unlikely(!(data = (char *) realloc(scratch->data,
+							       state->write_size))))
+				return ENOMEM;
+			scratch->data = data;
+			scratch->size = state->write_size;
+		}
+		state->write_data = data = scratch->data;
+
+		if (thread->write_callback) {
+			t0 = glc_thread_time();
+			if (unlikely((ret = thread->write_callback(state))))
+				return ret;
+			glc_thread_stat_add(private, GLC_THREAD_STAT_WRITE, t0);
+		}
+	}
+
+	ret = glc_thread_reorder_commit(private, write, scratch, seq, &state->header,
+					data, state->write_size, 0);
+	state->write_data = NULL;
+	state->write_size = 0;
+	return ret;
+}
+
+/**
+ * \brief write a packet to the output buffer
+ *
+ * Stages running in the shared pool must never block on a full
+ * buffer, EBUSY is returned instead and the packet stays parked.
+ */
+static int glc_thread_reorder_write(struct glc_thread_private_s *private,
+				    ps_packet_t *write, glc_message_header_t *header,
+				    char *data, size_t size)
+{
+	uint64_t t0 = glc_thread_time();
+	int ret;
+
+	if (unlikely((ret = ps_packet_open(write, private->pool ?
+					   PS_PACKET_WRITE | PS_PACKET_TRY :
+					   PS_PACKET_WRITE))))
+		return ret;
+	glc_thread_stat_add(private, GLC_THREAD_STAT_WRITE_WAIT, t0);
+	if (unlikely((ret = ps_packet_setsize(write, sizeof(glc_message_header_t) + size))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(write, header, sizeof(glc_message_header_t)))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(write, data, size))))
+		goto cancel;
+	return ps_packet_close(write);
+cancel:
+	ps_packet_cancel(write);
+	return ret;
+}
+
+/**
+ * \brief write consecutive parked packets
+ *
+ * Called with reorder lock held and committing set.
+ * \return 0 on success otherwise an error code
+ */
+static int glc_thread_reorder_drain(struct glc_thread_private_s *private,
+				    ps_packet_t *write)
+{
+	struct glc_thread_reorder_slot_s *slot;
+	int ret = 0;
+
+	slot = &private->reorder_slots[private->commit_seq % private->reorder_window];
+	while (slot->ready) {
+		pthread_mutex_unlock(&private->reorder_mutex);
+		if (!slot->skip)
+			ret = glc_thread_reorder_write(private, write, &slot->header,
+						       slot->data, slot->size);
+		pthread_mutex_lock(&private->reorder_mutex);
+		if (ret)
+			break;
+		slot->ready = 0;
+		private->commit_seq++;
+		slot = &private->reorder_slots[private->commit_seq %
+					       private->reorder_window];
+	}
+
+	/* output buffer is full, retry later */
+	if (ret == EBUSY)
+		ret = 0;
+	return ret;
+}
+
+/**
+ * \brief run write callback straight into the output buffer
+ *
+ * Stages processed by one pool worker at a time don't need the
+ * scratch area: when the packet is next in line, the write callback
+ * fills the output buffer in place as glc_thread() would.
+ * \return 0 on success, EAGAIN if the packet has to go through
+ *         the reorder buffer, otherwise an error code
+ */
+int glc_thread_reorder_direct(struct glc_thread_private_s *private,
+			      glc_thread_state_t *state, ps_packet_t *write,
+			      uint64_t seq)
+{
+	glc_thread_t *thread = private->thread;
+	int ret, size_set = 0;
+	uint64_t t0;
+
+	pthread_mutex_lock(&private->reorder_mutex);
+	if ((private->committing) || (private->reorder_abort) ||
+	    (seq != private->commit_seq)) {
+		pthread_mutex_unlock(&private->reorder_mutex);
+		return EAGAIN;
+	}
+	private->committing = 1;
+	pthread_mutex_unlock(&private->reorder_mutex);
+
+	t0 = glc_thread_time();
+	ret = ps_packet_open(write, PS_PACKET_WRITE | PS_PACKET_TRY);
+	if (ret == EBUSY) {
+		/* output is full, park it */
+		ret = EAGAIN;
+		goto out;
+	} else if (unlikely(ret))
+		goto out;
+	glc_thread_stat_add(private, GLC_THREAD_STAT_WRITE_WAIT, t0);
+
+	/* reserve space for header */
+	if (unlikely((ret = ps_packet_seek(write, sizeof(glc_message_header_t)))))
+		goto cancel;
+	if (!(state->flags & (GLC_THREAD_STATE_UNKNOWN_FINAL_SIZE |
+			      GLC_THREAD_STATE_SHRINK))) {
+		if (unlikely((ret = ps_packet_setsize(write,
+			   sizeof(glc_message_header_t) + state->write_size))))
+			goto cancel;
+		size_set = 1;
+	}
+	if (unlikely((ret = ps_packet_dma(write, (void *) &state->write_data,
+					  state->write_size, PS_ACCEPT_FAKE_DMA))))
+		goto cancel;
+
+	if (thread->write_callback) {
+		t0 = glc_thread_time();
+		if (unlikely((ret = thread->write_callback(state))))
+			goto cancel;
+		glc_thread_stat_add(private, GLC_THREAD_STAT_WRITE, t0);
+	}
+
+	if (!size_set) {
+		if (unlikely((ret = ps_packet_setsize(write,
+			   sizeof(glc_message_header_t) + state->write_size))))
+			goto cancel;
+	}
+	if (unlikely((ret = ps_packet_seek(write, 0))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(write, &state->header,
+					    sizeof(glc_message_header_t)))))
+		goto cancel;
+	ret = ps_packet_close(write);
+	state->write_data = NULL;
+	state->write_size = 0;
+	goto out;
+
+cancel:
+	ps_packet_cancel(write);
+out:
+	pthread_mutex_lock(&private->reorder_mutex);
+	if (likely(!ret)) {
+		private->commit_seq++;
+		ret = glc_thread_reorder_drain(private, write);
+	}
+	private->committing = 0;
+	if (unlikely((ret) && (ret != EAGAIN)))
+		private->reorder_abort = 1;
+	pthread_cond_broadcast(&private->reorder_cond);
+	pthread_mutex_unlock(&private->reorder_mutex);
+
+	return ret;
+}
+
+/**
+ * \brief write parked packets if nobody else is doing it
+ * \return 0 on success otherwise an error code
+ */
+int glc_thread_reorder_flush(struct glc_thread_private_s *private,
+			     ps_packet_t *write, int *committed)
+{
+	uint64_t commit_seq;
+	int ret = 0;
+
+	pthread_mutex_lock(&private->reorder_mutex);
+	if ((!private->committing) && (!private->reorder_abort) &&
+	    (private->reorder_slots[private->commit_seq %
+				    private->reorder_window].ready)) {
+		private->committing = 1;
+		commit_seq = private->commit_seq;
+		ret = glc_thread_reorder_drain(private, write);
+		if (private->commit_seq != commit_seq)
+			*committed = 1;
+		private->committing = 0;
+		if (unlikely(ret))
+			private->reorder_abort = 1;
+		pthread_cond_broadcast(&private->reorder_cond);
+	}
+	pthread_mutex_unlock(&private->reorder_mutex);
+
+	return ret;
+}
+
+/**
+ * \brief commit a packet in read order
+ *
+ * If every packet read before this one is already committed,
+ * the packet is written directly, followed by all consecutive
+ * packets waiting in the reorder buffer. Otherwise it is parked
+ * in the reorder buffer and whoever commits the preceding packet
+ * writes it. Only one thread commits at a time but writing to the
+ * output buffer is done without holding the reorder lock.
+ * \return 0 on success otherwise an error code
+ */
+int glc_thread_reorder_commit(struct glc_thread_private_s *private,
+			      ps_packet_t *write, struct glc_thread_scratch_s *scratch,
+			      uint64_t seq, glc_message_header_t *header,
+			      char *data, size_t size, int skip)
+{
+	struct glc_thread_reorder_slot_s *slot;
+	char *tmp_data;
+	size_t tmp_size;
+	int ret = 0;
+
+	pthread_mutex_lock(&private->reorder_mutex);
+	while ((seq - private->commit_seq >= private->reorder_window) &&
+	       (!private->reorder_abort))
+		pthread_cond_wait(&private->reorder_cond, &private->reorder_mutex);
+
+	if (unlikely(private->reorder_abort)) {
+		pthread_mutex_unlock(&private->reorder_mutex);
+		return EINTR;
+	}
+
+	if ((!private->committing) && (seq == private->commit_seq)) {
+		/* our turn, no need to park the packet */
+		private->committing = 1;
+		pthread_mutex_unlock(&private->reorder_mutex);
+		if (!skip)
+			ret = glc_thread_reorder_write(private, write, header, data, size);
+		pthread_mutex_lock(&private->reorder_mutex);
+
+		if (ret == EBUSY) {
+			/* pool mode and output is full, park it */
+			private->committing = 0;
+			ret = 0;
+		} else {
+			if (likely(!ret)) {
+				private->commit_seq++;
+				ret = glc_thread_reorder_drain(private, write);
+			}
+
+			private->committing = 0;
+			if (unlikely(ret))
+				private->reorder_abort = 1;
+			pthread_cond_broadcast(&private->reorder_cond);
+			pthread_mutex_unlock(&private->reorder_mutex);
+			return ret;
+		}
+	}
+
+	slot = &private->reorder_slots[seq % private->reorder_window];
+	if (!skip) {
+		if (data == scratch->data) {
+			/* swap buffers instead of copying */
+			tmp_data = slot->data;
+			tmp_size = slot->data_size;
+			slot->data = scratch->data;
+			slot->data_size = scratch->size;
+			scratch->data = tmp_data;
+			scratch->size = tmp_size;
+		} else {
+			if (slot->data_size < size) {
+				if (unlikely(!(tmp_data = (char *) realloc(slot->data, size)))) {
+					private->reorder_abort = 1;
+					pthread_cond_broadcast(&private->reorder_cond);
+					pthread_mutex_unlock(&private->reorder_mutex);
+					return ENOMEM;
+				}
+				slot->data = tmp_data;
+				slot->data_size = size;
+			}
+			memcpy(slot->data, data, size);
+		}
+	}
+
+	memcpy(&slot->header, header, sizeof(glc_message_header_t));
+	slot->size  = size;
+	slot->skip  = skip;
+	slot->ready = 1;
+	pthread_mutex_unlock(&private->reorder_mutex);
+
+	return 0;
+}
+
+/**
+ * \brief block until packet has been committed
+ * \return 0 on success, EINTR if reorder buffer was aborted
+ */
+int glc_thread_reorder_wait(struct glc_thread_private_s *private, uint64_t seq)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&private->reorder_mutex);
+	while ((private->commit_seq <= seq) && (!private->reorder_abort))
+		pthread_cond_wait(&private->reorder_cond, &private->reorder_mutex);
+	if (private->commit_seq <= seq)
+		ret = EINTR;
+	pthread_mutex_unlock(&private->reorder_mutex);
+
+	return ret;
+}
+
+void glc_thread_reorder_abort(struct glc_thread_private_s *private)
+{
+	pthread_mutex_lock(&private->reorder_mutex);
+	private->reorder_abort = 1;
+	pthread_cond_broadcast(&private->reorder_cond);
+	pthread_mutex_unlock(&private->reorder_mutex);
+}
+
+int glc_thread_pool_init(glc_t *glc, size_t workers)
+{
+	struct glc_thread_pool_s *pool;
+	size_t t;
+	int ret;
+
+	if (unlikely(glc->pool))
+		return EALREADY;
+	if (unlikely(workers < 1))
+		return EINVAL;
+
+	if (unlikely(!(pool = (struct glc_thread_pool_s *)
+		calloc(1, sizeof(struct glc_thread_pool_s)))))
+		return ENOMEM;
+
+	pool->glc = glc;
+	pool->pthread_thread = (pthread_t *) malloc(sizeof(pthread_t) * workers);
+	pool->args = (struct glc_thread_pool_arg_s *)
+		malloc(sizeof(struct glc_thread_pool_arg_s) * workers);
+	if (unlikely((!pool->pthread_thread) || (!pool->args))) {
+		free(pool->args);
+		free(pool->pthread_thread);
+		free(pool);
+		return ENOMEM;
+	}
+
+	pthread_mutex_init(&pool->mutex, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	glc->pool = pool;
+
+	for (t = 0; t < workers; t++) {
+		pool->args[t].pool  = pool;
+		pool->args[t].index = t;
+		if (unlikely((ret = pthread_create(&pool->pthread_thread[t], NULL,
+						   glc_thread_pool_worker, &pool->args[t])))) {
+			glc_log(glc, GLC_ERROR, "glc_thread",
+				"can't create pool worker: %s (%d)", strerror(ret), ret);
+			glc_thread_pool_destroy(glc);
+			return ret;
+		}
+		pool->workers++;
+	}
+
+	glc_log(glc, GLC_INFO, "glc_thread", "%zd workers in shared pool", workers);
+	return 0;
+}
+
+int glc_thread_pool_destroy(glc_t *glc)
+{
+	struct glc_thread_pool_s *pool = glc->pool;
+	size_t t;
+
+	if (unlikely(!pool))
+		return EAGAIN;
+
+	pthread_mutex_lock(&pool->mutex);
+	if (unlikely(pool->num_stages))
+		glc_log(glc, GLC_WARN, "glc_thread",
+			"%zd stages still attached to shared pool", pool->num_stages);
+	pool->quit = 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (t = 0; t < pool->workers; t++)
+		pthread_join(pool->pthread_thread[t], NULL);
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool->args);
+	free(pool->pthread_thread);
+	free(pool);
+	glc->pool = NULL;
+
+	return 0;
+}
+
+/**
+ * \brief attach a stage to the shared pool
+ *
+ * No thread is created, pool workers pick up the stage
+ * on their next scan.
+ * \param pool shared pool
+ * \param private thread private variables
+ * \return 0 on success otherwise an error code
+ */
+int glc_thread_pool_add(struct glc_thread_pool_s *pool,
+			struct glc_thread_private_s *private)
+{
+	if (unlikely(!(private->workers = (struct glc_thread_worker_s *)
+		calloc(pool->workers, sizeof(struct glc_thread_worker_s)))))
+		return ENOMEM;
+
+	pthread_mutex_lock(&pool->mutex);
+	private->next = pool->stages;
+	pool->stages  = private;
+	pool->num_stages++;
+	__sync_fetch_and_add(&pool->events, 1);
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->mutex);
+
+	return 0;
+}
+
+/**
+ * \brief wait until a stage is done and detach it from the shared pool
+ *
+ * Thread finish callbacks are called here for every worker that
+ * has run the stage, followed by the finish callback.
+ * \param private thread private variables
+ */
+void glc_thread_pool_remove(struct glc_thread_private_s *private)
+{
+	struct glc_thread_pool_s *pool = private->pool;
+	struct glc_thread_private_s **prev;
+	glc_thread_t *thread = private->thread;
+	struct glc_thread_worker_s *worker;
+	size_t t;
+
+	pthread_mutex_lock(&pool->mutex);
+	while ((!private->done) || (private->busy))
+		pthread_cond_wait(&pool->cond, &pool->mutex);
+
+	for (prev = &pool->stages; *prev != private; prev = &(*prev)->next);
+	*prev = private->next;
+	pool->num_stages--;
+	pthread_mutex_unlock(&pool->mutex);
+
+	for (t = 0; t < pool->workers; t++) {
+		worker = &private->workers[t];
+		if (!worker->init)
+			continue;
+
+		ps_packet_destroy(&worker->read);
+		ps_packet_destroy(&worker->write);
+		free(worker->scratch.data);
+		if (worker->in.ref)
+			glc_packet_ref_put(worker->in.ref);
+
+		if (thread->thread_finish_callback)
+			thread->thread_finish_callback(worker->state.ptr,
+						       worker->state.threadptr,
+						       private->ret);
+	}
+	free(private->workers);
+
+	if (thread->finish_callback)
+		thread->finish_callback(thread->ptr, private->ret);
+}
+
+/**
+ * \brief stage has failed or was cancelled
+ *
+ * Called without any lock held.
+ * \param private thread private variables
+ * \param ret error code, EINTR when cancelled
+ */
+static void glc_thread_pool_abort(struct glc_thread_private_s *private, int ret)
+{
+	/* packets after this one can't be committed anymore */
+	glc_thread_reorder_abort(private);
+
+	if (ret != EINTR) {
+		glc_state_set(private->glc, GLC_STATE_CANCEL);
+		glc_log(private->glc, GLC_ERROR, "glc_thread", "%s (%d)", strerror(ret), ret);
+		private->ret = ret;
+	}
+
+	if (!private->stop) {
+		private->stop = 1;
+		ps_buffer_cancel(private->from);
+		if (glc_state_test(private->glc, GLC_STATE_CANCEL))
+			ps_buffer_cancel(private->to);
+	}
+
+	pthread_mutex_lock(&private->reorder_mutex);
+	private->done = 1;
+	pthread_mutex_unlock(&private->reorder_mutex);
+}
+
+/**
+ * \brief check whether the last packet of a stage has been committed
+ * \param private thread private variables
+ * \return 1 if stage is done, 0 otherwise
+ */
+static int glc_thread_pool_check_done(struct glc_thread_private_s *private)
+{
+	int done, last;
+
+	pthread_mutex_lock(&private->reorder_mutex);
+	done = (private->closing) && (private->commit_seq > private->close_seq);
+	last = (done) && (!private->done);
+	if (last)
+		private->done = 1;
+	pthread_mutex_unlock(&private->reorder_mutex);
+
+	/* wake up upstream, same as the last thread would */
+	if (last)
+		ps_buffer_cancel(private->from);
+	return done;
+}
+
+/**
+ * \brief process at most one packet of a stage
+ *
+ * Nothing here blocks on a buffer: reads and writes are opened
+ * with PS_PACKET_TRY and a full output buffer leaves the packet
+ * parked in the reorder buffer. Stages asking for a single thread
+ * keep the open lock for the whole packet, so they never run
+ * concurrently and write in place.
+ * \param private thread private variables
+ * \param index pool worker index
+ * \return 0 if some work was done, EAGAIN if there was nothing to do
+ */
+static int glc_thread_pool_step(struct glc_thread_private_s *private, size_t index)
+{
+	glc_thread_t *thread = private->thread;
+	struct glc_thread_worker_s *worker = &private->workers[index];
+	glc_thread_state_t *state = &worker->state;
+	int ret, has_locked = 0, has_read = 0, progress = 0, full;
+	uint64_t seq, t0;
+
+	if (unlikely(!worker->init)) {
+		state->ptr  = thread->ptr;
+		state->from = private->from;
+		if (unlikely((ret = ps_packet_init(&worker->read, private->from))))
+			goto err;
+		if (unlikely((ret = ps_packet_init(&worker->write, private->to)))) {
+			ps_packet_destroy(&worker->read);
+			goto err;
+		}
+		worker->init = 1;
+
+		if (thread->thread_create_callback) {
+			if (unlikely((ret = thread->thread_create_callback(state->ptr,
+									   &state->threadptr))))
+				goto err;
+		}
+	}
+
+	if (unlikely(glc_state_test(private->glc, GLC_STATE_CANCEL))) {
+		ret = EINTR;
+		goto err;
+	}
+
+	/* packets left behind because the output buffer was full */
+	if (unlikely((ret = glc_thread_reorder_flush(private, &worker->write, &progress))))
+		goto err;
+
+	if ((private->stop) || (glc_thread_pool_check_done(private)))
+		return progress ? 0 : EAGAIN;
+
+	/* somebody else is reading */
+	if (pthread_mutex_trylock(&private->open))
+		return progress ? 0 : EAGAIN;
+	has_locked = 1;
+
+	/* committing must never block */
+	pthread_mutex_lock(&private->reorder_mutex);
+	full = private->read_seq - private->commit_seq >= private->reorder_window;
+	pthread_mutex_unlock(&private->reorder_mutex);
+	if ((full) || (private->stop)) {
+		pthread_mutex_unlock(&private->open);
+		return progress ? 0 : EAGAIN;
+	}
+
+	state->flags = 0;
+	if (thread->open_callback) {
+		if (unlikely((ret = thread->open_callback(state))))
+			goto err;
+	}
+
+	if (!(state->flags & GLC_THREAD_STATE_SKIP_READ)) {
+		ret = ps_packet_open(&worker->read, PS_PACKET_READ | PS_PACKET_TRY);
+		if (ret == EBUSY) {
+			pthread_mutex_unlock(&private->open);
+			return progress ? 0 : EAGAIN;
+		} else if (unlikely(ret))
+			goto err;
+		has_read = 1;
+	}
+
+	seq = private->read_seq++;
+	if ((thread->flags & GLC_THREAD_REORDER) && (!private->direct)) {
+		has_locked = 0;
+		pthread_mutex_unlock(&private->open);
+	}
+
+	if (has_read) {
+		if (unlikely((ret = ps_packet_read(&worker->read, &state->header,
+						   sizeof(glc_message_header_t)))))
+			goto err;
+		if (state->header.type == GLC_MESSAGE_REF) {
+			if (unlikely((ret = glc_thread_ref_resolve(&worker->read, state,
+								   &worker->in))))
+				goto err;
+		} else {
+			if (unlikely((ret = ps_packet_getsize(&worker->read,
+							      &state->read_size))))
+				goto err;
+			state->read_size -= sizeof(glc_message_header_t);
+			state->write_size = state->read_size;
+		}
+
+		if (thread->header_callback) {
+			t0 = glc_thread_time();
+			if (unlikely((ret = thread->header_callback(state))))
+				goto err;
+			glc_thread_stat_add(private, GLC_THREAD_STAT_HEADER, t0);
+		}
+
+		if (worker->in.ref)
+			state->read_data = glc_packet_ref_data(worker->in.ref);
+		else if (unlikely((ret = ps_packet_dma(&worker->read,
+						       (void *) &state->read_data,
+						       state->read_size, PS_ACCEPT_FAKE_DMA))))
+			goto err;
+
+		if (thread->read_callback) {
+			t0 = glc_thread_time();
+			if (unlikely((ret = thread->read_callback(state))))
+				goto err;
+			glc_thread_stat_add(private, GLC_THREAD_STAT_READ, t0);
+		}
+	}
+
+	/*
+	 * Stages without GLC_THREAD_REORDER expect their read callbacks
+	 * to be called in packet order, keep the open lock until here.
+	 */
+	if ((has_locked) && (!private->direct)) {
+		has_locked = 0;
+		pthread_mutex_unlock(&private->open);
+	}
+
+	if ((state->flags & GLC_THREAD_STOP) ||
+	    (state->header.type == GLC_MESSAGE_CLOSE)) {
+		pthread_mutex_lock(&private->reorder_mutex);
+		private->close_seq = seq;
+		private->closing = 1;
+		pthread_mutex_unlock(&private->reorder_mutex);
+		private->stop = 1;
+	}
+
+	if (unlikely((ret = glc_thread_reorder_process(private, state, &worker->write,
+						       &worker->scratch, &worker->in, seq))))
+		goto err;
+
+	if (has_read) {
+		ps_packet_close(&worker->read);
+		state->read_data = NULL;
+		state->read_size = 0;
+	}
+
+	if (worker->in.ref) {
+		glc_packet_ref_put(worker->in.ref);
+		worker->in.ref = NULL;
+	}
+
+	if (thread->close_callback) {
+		t0 = glc_thread_time();
+		if (unlikely((ret = thread->close_callback(state))))
+			goto err;
+		glc_thread_stat_add(private, GLC_THREAD_STAT_CLOSE, t0);
+	}
+
+	if (has_locked)
+		pthread_mutex_unlock(&private->open);
+
+	glc_thread_pool_check_done(private);
+	return 0;
+
+err:
+	if (has_locked)
+		pthread_mutex_unlock(&private->open);
+	glc_thread_pool_abort(private, ret);
+	return 0;
+}
+
+/**
+ * \brief shared pool worker loop
+ *
+ * Workers scan attached stages, starting from a different stage
+ * each, and process whatever is ready. Packetstream has no way
+ * to tell when a buffer becomes readable or writable, so an idle
+ * worker sleeps until a worker makes progress or a producer calls
+ * glc_thread_pool_notify().
+ * \param argptr pool worker argument
+ * \return always NULL
+ */
+void *glc_thread_pool_worker(void *argptr)
+{
+	struct glc_thread_pool_arg_s *arg = (struct glc_thread_pool_arg_s *) argptr;
+	struct glc_thread_pool_s *pool = arg->pool;
+	struct glc_thread_private_s *stage;
+	struct timespec ts;
+	uint64_t events;
+	size_t n, s;
+	int progress;
+
+	glc_thread_block_signals();
+	glc_apply_affinity(pool->glc, "pool");
+
+	pthread_mutex_lock(&pool->mutex);
+	while (!pool->quit) {
+		events = __sync_fetch_and_add(&pool->events, 0);
+		progress = 0;
+		for (n = 0; n < pool->num_stages; n++) {
+			stage = pool->stages;
+			for (s = (arg->index + n) % pool->num_stages; s > 0; s--)
+				stage = stage->next;
+
+			if (stage->done)
+				continue;
+
+			stage->busy++;
+			pthread_mutex_unlock(&pool->mutex);
+			if (!glc_thread_pool_step(stage, arg->index))
+				progress = 1;
+			pthread_mutex_lock(&pool->mutex);
+			stage->busy--;
+		}
+
+		if (progress) {
+			/* there might be work downstream, or a stage done */
+			__sync_fetch_and_add(&pool->events, 1);
+			pthread_cond_broadcast(&pool->cond);
+			continue;
+		}
+
+		/*
+		 * Producers bump events before looking at sleeping, so
+		 * either they see us sleeping and broadcast, or we see
+		 * their event here and scan again.
+		 */
+		__sync_fetch_and_add(&pool->sleeping, 1);
+		if ((__sync_fetch_and_add(&pool->events, 0) == events) && (!pool->quit)) {
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec  += GLC_THREAD_POOL_IDLE_NS / 1000000000;
+			ts.tv_nsec += GLC_THREAD_POOL_IDLE_NS % 1000000000;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&pool->cond, &pool->mutex, &ts);
+		}
+		__sync_fetch_and_sub(&pool->sleeping, 1);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+void glc_thread_pool_notify(glc_t *glc)
+{
+	struct glc_thread_pool_s *pool = glc->pool;
+
+	if (!pool)
+		return;
+
+	__sync_fetch_and_add(&pool->events, 1);
+	if (__sync_fetch_and_add(&pool->sleeping, 0)) {
+		pthread_mutex_lock(&pool->mutex);
+		pthread_cond_broadcast(&pool->cond);
+		pthread_mutex_unlock(&pool->mutex);
+	}
+}
+
+/**
+ * \brief frame split into row stripes
+ */
+struct glc_stripe_job_s {
+	glc_stripe_proc_t proc;
+	void *arg;
+	unsigned int rows, stripes;
+	unsigned int taken, done;
+	struct glc_stripe_job_s *next;
+};
+
+/**
+ * \brief stripe workers
+ */
+struct glc_stripe_s {
+	glc_t *glc;
+	pthread_t *pthread_thread;
+	size_t workers;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond, done_cond;
+	struct glc_stripe_job_s *jobs;
+	int quit;
+};
+
+/**
+ * \brief take next stripe of a job
+ *
+ * Called with stripe lock held. Job leaves the queue when its
+ * last stripe is taken.
+ */
+static void glc_stripe_take(struct glc_stripe_s *stripe, struct glc_stripe_job_s *job,
+			    unsigned int *first, unsigned int *last)
+{
+	struct glc_stripe_job_s **prev;
+	unsigned int s = job->taken++;
+
+	*first = (unsigned int) (((uint64_t) job->rows * s) / job->stripes);
+	*last  = (unsigned int) (((uint64_t) job->rows * (s + 1)) / job->stripes);
+
+	if (job->taken == job->stripes) {
+		for (prev = &stripe->jobs; *prev != job; prev = &(*prev)->next);
+		*prev = job->next;
+	}
+}
+
+/**
+ * \brief stripe worker loop
+ * \param argptr stripe workers
+ * \return always NULL
+ */
+static void *glc_stripe_worker(void *argptr)
+{
+	struct glc_stripe_s *stripe = (struct glc_stripe_s *) argptr;
+	struct glc_stripe_job_s *job;
+	unsigned int first, last;
+
+	glc_thread_block_signals();
+	glc_apply_affinity(stripe->glc, "stripe");
+
+	pthread_mutex_lock(&stripe->mutex);
+	while (!stripe->quit) {
+		if (!(job = stripe->jobs)) {
+			pthread_cond_wait(&stripe->work_cond, &stripe->mutex);
+			continue;
+		}
+
+		glc_stripe_take(stripe, job, &first, &last);
+		pthread_mutex_unlock(&stripe->mutex);
+		job->proc(job->arg, first, last);
+		pthread_mutex_lock(&stripe->mutex);
+
+		/* job belongs to the caller, don't touch it after this */
+		if (++job->done == job->stripes)
+			pthread_cond_broadcast(&stripe->done_cond);
+	}
+	pthread_mutex_unlock(&stripe->mutex);
+
+	return NULL;
+}
+
+int glc_stripe_init(glc_t *glc, size_t workers)
+{
+	struct glc_stripe_s *stripe;
+	size_t t;
+	int ret;
+
+	if (unlikely(glc->stripe))
+		return EALREADY;
+	if (unlikely(workers < 1))
+		return EINVAL;
+
+	if (unlikely(!(stripe = (struct glc_stripe_s *)
+		calloc(1, sizeof(struct glc_stripe_s)))))
+		return ENOMEM;
+	if (unlikely(!(stripe->pthread_thread = (pthread_t *)
+		malloc(sizeof(pthread_t) * workers)))) {
+		free(stripe);
+		return ENOMEM;
+	}
+
+	stripe->glc = glc;
+	pthread_mutex_init(&stripe->mutex, NULL);
+	pthread_cond_init(&stripe->work_cond, NULL);
+	pthread_cond_init(&stripe->done_cond, NULL);
+	glc->stripe = stripe;
+
+	for (t = 0; t < workers; t++) {
+		if (unlikely((ret = pthread_create(&stripe->pthread_thread[t], NULL,
+						   glc_stripe_worker, stripe)))) {
+			glc_log(glc, GLC_ERROR, "glc_thread",
+				"can't create stripe worker: %s (%d)", strerror(ret), ret);
+			glc_stripe_destroy(glc);
+			return ret;
+		}
+		stripe->workers++;
+	}
+
+	glc_log(glc, GLC_INFO, "glc_thread", "%zd stripe workers", workers);
+	return 0;
+}
+
+int glc_stripe_destroy(glc_t *glc)
+{
+	struct glc_stripe_s *stripe = glc->stripe;
+	size_t t;
+
+	if (unlikely(!stripe))
+		return EAGAIN;
+
+	pthread_mutex_lock(&stripe->mutex);
+	stripe->quit = 1;
+	pthread_cond_broadcast(&stripe->work_cond);
+	pthread_mutex_unlock(&stripe->mutex);
+
+	for (t = 0; t < stripe->workers; t++)
+		pthread_join(stripe->pthread_thread[t], NULL);
+
+	pthread_cond_destroy(&stripe->done_cond);
+	pthread_cond_destroy(&stripe->work_cond);
+	pthread_mutex_destroy(&stripe->mutex);
+	free(stripe->pthread_thread);
+	free(stripe);
+	glc->stripe = NULL;
+
+	return 0;
+}
+
+int glc_stripe_run(glc_t *glc, glc_stripe_proc_t proc, void *arg,
+		   unsigned int rows)
+{
+	struct glc_stripe_s *stripe = glc->stripe;
+	struct glc_stripe_job_s job, **tail;
+	unsigned int first, last;
+
+	if ((!stripe) || (rows < 2 * GLC_STRIPE_MIN_ROWS)) {
+		proc(arg, 0, rows);
+		return 0;
+	}
+
+	job.proc    = proc;
+	job.arg     = arg;
+	job.rows    = rows;
+	job.stripes = rows / GLC_STRIPE_MIN_ROWS;
+	if (job.stripes > stripe->workers + 1)
+		job.stripes = stripe->workers + 1;
+	job.taken   = job.done = 0;
+	job.next    = NULL;
+
+	pthread_mutex_lock(&stripe->mutex);
+	for (tail = &stripe->jobs; *tail; tail = &(*tail)->next);
+	*tail = &job;
+	pthread_cond_broadcast(&stripe->work_cond);
+
+	/* calling thread does its share, workers might be busy */
+	while (job.taken < job.stripes) {
+		glc_stripe_take(stripe, &job, &first, &last);
+		pthread_mutex_unlock(&stripe->mutex);
+		proc(arg, first, last);
+		pthread_mutex_lock(&stripe->mutex);
+		job.done++;
+	}
+
+	while (job.done < job.stripes)
+		pthread_cond_wait(&stripe->done_cond, &stripe->mutex);
+	pthread_mutex_unlock(&stripe->mutex);
+
+	return 0;
+}
+
 int glc_thread_set_rt_priority(glc_t *glc, int ask_rt)
 {
 	int ret = 0;
@@ -406,6 +2069,7 @@ typedef struct {
 	void *arg;
 	glc_t *glc;
 	int   ask_rt;
+	const char *name;
 } glc_simple_thread_param_t;
 
 static void *glc_simple_thread_start_routine(void *arg)
@@ -415,6 +2079,7 @@ static void *glc_simple_thread_start_routine(void *arg)
 
 	glc_thread_block_signals();
 	glc_thread_set_rt_priority(param->glc, param->ask_rt);
+	glc_apply_affinity(param->glc, param->name);
 	res  = param->start_routine(param->arg);
 	free(param);
 	return res;
@@ -437,6 +2102,7 @@ int glc_simple_thread_create(glc_t *glc, glc_simple_thread_t *thread,
 	param->arg           = arg;
 	param->glc           = glc;
 	param->ask_rt        = thread->ask_rt;
+	param->name          = thread->name;
 
 	/* May need to set before starting the thread as some threads
 	 * might use this flag as a stop condition.
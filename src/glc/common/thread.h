@@ -35,6 +35,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/common/ring.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,6 +56,14 @@ extern "C" {
 #define GLC_THREAD_COPY                      32
 /** thread wants to stop */
 #define GLC_THREAD_STOP                      64
+/** write_size set by read callback is only an upper bound, write
+    callback lowers it and the unused tail of the reservation is
+    given back to the buffer as soon as it returns */
+#define GLC_THREAD_STATE_SHRINK             128
+/** read callback keeps read_data, read packet stays open until the read
+    callback of a later packet sets this again or the thread finishes.
+    Ignored with GLC_THREAD_REORDER or a ring */
+#define GLC_THREAD_STATE_HOLD_READ          256
 
 /**
  * \brief thread state
@@ -97,6 +106,31 @@ typedef struct {
 #define GLC_THREAD_READ                       1
 /** thread does write operations */
 #define GLC_THREAD_WRITE                      2
+/**
+ * workers process packets out of order and commit them
+ * through a reorder buffer. Requires GLC_THREAD_READ and
+ * GLC_THREAD_WRITE. Callbacks must not depend on packet
+ * order since read and write callbacks of different
+ * packets run concurrently. write_data points to a
+ * thread private scratch area so the write callback may
+ * shrink write_size once the final size is known.
+ */
+#define GLC_THREAD_REORDER                    4
+/**
+ * packets flagged GLC_THREAD_COPY that came in by reference
+ * (GLC_MESSAGE_REF) are forwarded by reference instead of being
+ * copied into target buffer. Only valid when whoever reads target
+ * buffer resolves references, which glc_thread always does.
+ */
+#define GLC_THREAD_FORWARD_REF                8
+/**
+ * with GLC_THREAD_FORWARD_REF, copied payloads of at least
+ * GLC_PACKET_REF_MIN bytes are also moved into a new reference
+ * so the stages after this one don't copy them again. Memory
+ * held by references is not bounded by buffer sizes, stages in
+ * capture using this must keep their target buffer small.
+ */
+#define GLC_THREAD_NEW_REF                   16
 /**
  * \brief thread vtable
  *
@@ -105,7 +139,8 @@ typedef struct {
  * If callback is NULL, it is ignored.
  */
 typedef struct {
-	/** flags, GLC_THREAD_READ or GLC_THREAD_WRITE or both */
+	/** flags, GLC_THREAD_READ or GLC_THREAD_WRITE or both,
+	    optionally GLC_THREAD_REORDER */
 	glc_flags_t flags;
 	/** global argument pointer */
 	void *ptr;
@@ -113,6 +148,11 @@ typedef struct {
 	size_t threads;
 	/** flag to indicate that rt prio is desired. */
 	int    ask_rt;
+	/** module name, selects CPU set, see glc_set_affinity() */
+	const char *name;
+	/** if set, packets are read from this ring instead of source
+	    buffer. Only for a single thread doing GLC_THREAD_READ only */
+	glc_ring_t ring;
 	/** implementation specific */
 	void *priv;
 
@@ -143,7 +183,10 @@ typedef struct {
 /**
  * \brief create thread
  *
- * Creates thread.threads threads (glc_thread()).
+ * Creates thread.threads threads (glc_thread()). If a shared
+ * worker pool has been set up with glc_thread_pool_init() and
+ * thread does both GLC_THREAD_READ and GLC_THREAD_WRITE, no thread
+ * is created and packets are processed by the pool workers instead.
  * \param glc glc
  * \param thread thread information structure
  * \param from buffer where data is read from
@@ -155,15 +198,218 @@ __PUBLIC int glc_thread_create(glc_t *glc, glc_thread_t *thread,
 
 /**
  * \brief block until threads have finished and clean up
+ *
+ * Latency statistics of every stage that saw at least one packet
+ * are logged at GLC_PERF level before thread state is released.
  * \param thread thread
  * \return 0 on success otherwise an error code
  */
 __PUBLIC int glc_thread_wait(glc_thread_t *thread);
 
+/** time spent waiting for a packet in source buffer */
+#define GLC_THREAD_STAT_READ_WAIT             0
+/** time spent in header callback */
+#define GLC_THREAD_STAT_HEADER                1
+/** time spent in read callback */
+#define GLC_THREAD_STAT_READ                  2
+/** time spent waiting for room in target buffer */
+#define GLC_THREAD_STAT_WRITE_WAIT            3
+/** time spent in write callback */
+#define GLC_THREAD_STAT_WRITE                 4
+/** time spent in close callback */
+#define GLC_THREAD_STAT_CLOSE                 5
+/** number of latency statistics */
+#define GLC_THREAD_STATS                      6
+
+/**
+ * \brief latency summary of a thread stage
+ *
+ * All times are in nanoseconds. Percentiles are taken from a
+ * log-linear histogram and are accurate to within 12.5%.
+ */
+typedef struct {
+	/** number of samples */
+	u_int64_t count;
+	/** smallest sample */
+	glc_utime_t min;
+	/** largest sample */
+	glc_utime_t max;
+	/** average */
+	glc_utime_t mean;
+	/** median */
+	glc_utime_t p50;
+	/** 90th percentile */
+	glc_utime_t p90;
+	/** 99th percentile */
+	glc_utime_t p99;
+	/** 99.9th percentile */
+	glc_utime_t p999;
+} glc_thread_stat_t;
+
+/**
+ * \brief read latency statistics of a thread
+ *
+ * Can be called any time between glc_thread_create() and
+ * glc_thread_wait(). Samples recorded concurrently may or may not
+ * be included.
+ * \param thread thread
+ * \param stat one of GLC_THREAD_STAT_*
+ * \param summary returned summary
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_thread_get_stat(glc_thread_t *thread, int stat,
+				 glc_thread_stat_t *summary);
+
+/** packets smaller than this are always copied */
+#define GLC_PACKET_REF_MIN                 4096
+
+/**
+ * \brief reference-counted packet payload
+ *
+ * Carried between buffers by GLC_MESSAGE_REF messages. A reader
+ * owns the reference held by the message it read and either
+ * forwards it, or drops it with glc_packet_ref_put().
+ */
+typedef struct glc_packet_ref_s* glc_packet_ref_t;
+
+/**
+ * \brief allocate a packet payload with a single reference
+ * \param ref returned payload
+ * \param size payload size
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_packet_ref_create(glc_packet_ref_t *ref, size_t size);
+
+/**
+ * \brief wrap memory owned by someone else with a single reference
+ *
+ * Lets a producer hand its own memory downstream without copying
+ * it. release is called, from whichever thread drops the last
+ * reference, once data is no longer used.
+ * \param ref returned payload
+ * \param data wrapped memory
+ * \param size payload size
+ * \param release called with arg when last reference is dropped
+ * \param arg argument to release
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_packet_ref_wrap(glc_packet_ref_t *ref, char *data, size_t size,
+				 void (*release)(void *arg), void *arg);
+
+/**
+ * \brief payload data
+ * \param ref payload
+ * \return pointer to data
+ */
+__PUBLIC char *glc_packet_ref_data(glc_packet_ref_t ref);
+
+/**
+ * \brief take an additional reference
+ * \param ref payload
+ */
+__PUBLIC void glc_packet_ref_get(glc_packet_ref_t ref);
+
+/**
+ * \brief drop a reference, last one frees the payload
+ * \param ref payload
+ */
+__PUBLIC void glc_packet_ref_put(glc_packet_ref_t ref);
+
+/**
+ * \brief drop every payload still referenced
+ *
+ * References left in a cancelled buffer are never read so nobody
+ * drops them. Call this once every thread that could hold a
+ * reference has finished, release callbacks of wrapped memory
+ * are called as usual.
+ * \return number of payloads dropped
+ */
+__PUBLIC size_t glc_packet_ref_reap(void);
+
+/**
+ * \brief set up a shared worker pool
+ *
+ * All filters doing both read and write operations that are created
+ * afterwards submit their packets to a single, fixed size set of
+ * workers instead of creating their own threads. An idle worker picks
+ * up packets from any stage with pending input so a busy stage gets
+ * help from the others. Packet order is preserved per stage.
+ * \param glc glc
+ * \param workers number of workers
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_thread_pool_init(glc_t *glc, size_t workers);
+
+/**
+ * \brief stop and destroy the shared worker pool
+ *
+ * Every filter using the pool must have been waited for.
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_thread_pool_destroy(glc_t *glc);
+
+/**
+ * \brief wake up idle pool workers
+ *
+ * Packetstream can't tell when a buffer becomes readable or
+ * writable, so anything that writes to or reads from a buffer
+ * outside glc_thread() calls this after closing the packet.
+ * Does nothing if there is no pool or no worker is idle.
+ * \param glc glc
+ */
+__PUBLIC void glc_thread_pool_notify(glc_t *glc);
+
+/**
+ * \brief stripe procedure
+ *
+ * Processes rows [first, last) of a frame. What a row is, is
+ * up to the procedure, eg. a pair of pixel rows for 4:2:0 data.
+ */
+typedef void (*glc_stripe_proc_t)(void *arg, unsigned int first,
+				  unsigned int last);
+
+/**
+ * \brief set up stripe workers
+ *
+ * Once set up, glc_stripe_run() splits frames into row stripes
+ * that are processed concurrently by the calling thread and the
+ * stripe workers. This cuts the time spent on a single frame,
+ * instead of the number of frames processed per second.
+ * \param glc glc
+ * \param workers number of workers besides calling threads
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_stripe_init(glc_t *glc, size_t workers);
+
+/**
+ * \brief stop and destroy stripe workers
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_stripe_destroy(glc_t *glc);
+
+/**
+ * \brief run a procedure over all rows of a frame
+ *
+ * Returns when every stripe is done, ie. the frame is complete.
+ * Without stripe workers or if the frame is too small to be worth
+ * splitting, proc is simply called for all rows.
+ * \param glc glc
+ * \param proc stripe procedure
+ * \param arg argument passed to proc
+ * \param rows number of rows
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_stripe_run(glc_t *glc, glc_stripe_proc_t proc, void *arg,
+			    unsigned int rows);
+
 typedef struct {
 	pthread_t thread;
 	/** flag to indicate that rt prio is desired. */
 	int ask_rt;
+	/** module name, selects CPU set, see glc_set_affinity() */
+	const char *name;
 	int running;
 } glc_simple_thread_t;
 
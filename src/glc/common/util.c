@@ -32,17 +32,21 @@
 #include <stddef.h> // for offsetof()
 #include <alloca.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include "glc.h"
 #include "core.h"
 #include "log.h"
 #include "util.h"
+#include "thread.h"
 #include "optimization.h"
 
 /**
@@ -51,6 +55,8 @@
 struct glc_util_s {
 	double fps;
 	int pid;
+	glc_flags_t buffer_memory;
+	long minflt, majflt;
 };
 
 /**
@@ -159,6 +165,7 @@ int glc_util_write_end_of_stream(glc_t *glc, ps_buffer_t *to)
 		goto finish;
 	if (unlikely((ret = ps_packet_close(&packet))))
 		goto finish;
+	glc_thread_pool_notify(glc);
 	if (unlikely((ret = ps_packet_destroy(&packet))))
 		goto finish;
 
@@ -166,6 +173,114 @@ finish:
 	return ret;
 }
 
+int glc_util_set_buffer_memory(glc_t *glc, glc_flags_t flags)
+{
+	glc->util->buffer_memory = flags;
+	return 0;
+}
+
+int glc_util_prepare_buffer(glc_t *glc, ps_buffer_t *buffer,
+			    size_t size, const char *name)
+{
+	glc_flags_t flags = glc->util->buffer_memory;
+	long page = sysconf(_SC_PAGESIZE);
+	struct rusage before, after;
+	ps_packet_t packet;
+	uintptr_t start, end, p;
+	size_t len, lo, hi, mid;
+	char *dma = NULL;
+	int ret;
+
+	if (!flags)
+		return 0;
+
+	getrusage(RUSAGE_SELF, &before);
+
+	if (unlikely((ret = ps_packet_init(&packet, buffer))))
+		return ret;
+
+	/*
+	 * Largest real dma an empty buffer gives is its storage minus
+	 * packetstream bookkeeping, which is not known here. Search it
+	 * down to the page, lo pages always fit and hi pages never do.
+	 */
+	for (lo = 0, hi = size / page + 1; hi - lo > 1;) {
+		mid = lo + (hi - lo) / 2;
+		if (unlikely((ret = ps_packet_open(&packet, PS_PACKET_WRITE))))
+			goto finish;
+		if (ps_packet_dma(&packet, (void *) &dma, mid * page, 0))
+			hi = mid;
+		else
+			lo = mid;
+		ps_packet_cancel(&packet);
+	}
+
+	dma = NULL;
+	len = lo * page;
+	if (len) {
+		if (unlikely((ret = ps_packet_open(&packet, PS_PACKET_WRITE))))
+			goto finish;
+		if (ps_packet_dma(&packet, (void *) &dma, len, 0)) {
+			ps_packet_cancel(&packet);
+			dma = NULL;
+		}
+	}
+
+	if (unlikely(!dma)) {
+		glc_log(glc, GLC_WARN, "util", "can't reach %s buffer memory", name);
+		ret = 0;
+		goto finish;
+	}
+
+	start = ((uintptr_t) dma + page - 1) & ~((uintptr_t) page - 1);
+	end = ((uintptr_t) dma + len) & ~((uintptr_t) page - 1);
+	if (unlikely(end <= start)) {
+		ps_packet_cancel(&packet);
+		goto finish;
+	}
+
+	if ((flags & GLC_UTIL_BUFFER_HUGEPAGES) &&
+	    (madvise((void *) start, end - start, MADV_HUGEPAGE)))
+		glc_log(glc, GLC_WARN, "util", "can't use huge pages for %s buffer: %s (%d)",
+			name, strerror(errno), errno);
+
+	/* content is meaningless until a packet is written */
+	for (p = start; p < end; p += page)
+		*((volatile char *) p) = 0;
+
+	if ((flags & GLC_UTIL_BUFFER_MLOCK) && (mlock((void *) start, end - start)))
+		glc_log(glc, GLC_WARN, "util", "can't lock %s buffer: %s (%d)",
+			name, strerror(errno), errno);
+
+	ps_packet_cancel(&packet);
+
+	getrusage(RUSAGE_SELF, &after);
+	glc_log(glc, GLC_PERF, "util",
+		"%s buffer: prepared %zu KiB, page faults %ld minor / %ld major before,"
+		" %ld minor / %ld major after",
+		name, (size_t) (end - start) / 1024, before.ru_minflt, before.ru_majflt,
+		after.ru_minflt, after.ru_majflt);
+
+finish:
+	ps_packet_destroy(&packet);
+	return ret;
+}
+
+void glc_util_log_faults(glc_t *glc, const char *what)
+{
+	struct rusage usage;
+
+	if (glc_log_get_level(glc) < GLC_PERF)
+		return;
+	getrusage(RUSAGE_SELF, &usage);
+	glc_log(glc, GLC_PERF, "util",
+		"%s: page faults %ld minor / %ld major, %ld minor / %ld major since last report",
+		what, usage.ru_minflt, usage.ru_majflt,
+		usage.ru_minflt - glc->util->minflt, usage.ru_majflt - glc->util->majflt);
+	glc->util->minflt = usage.ru_minflt;
+	glc->util->majflt = usage.ru_majflt;
+}
+
 int glc_util_log_info(glc_t *glc)
 {
 	char *name;
@@ -416,6 +531,15 @@ const char *glc_util_msgtype_to_str(glc_message_type_t type)
 	case GLC_CALLBACK_REQUEST:
 		res = "GLC_CALLBACK_REQUEST";
 		break;
+	case GLC_MESSAGE_REF:
+		res = "GLC_MESSAGE_REF";
+		break;
+	case GLC_MESSAGE_VIDEO_REPEAT:
+		res = "GLC_MESSAGE_VIDEO_REPEAT";
+		break;
+	case GLC_MESSAGE_VIDEO_TILES:
+		res = "GLC_MESSAGE_VIDEO_TILES";
+		break;
 	default:
 		res = "unknown";
 		break;
@@ -494,5 +618,64 @@ void glc_util_close_fds(int start_fd)
 	closedir(dirp);
 }
 
+#define GLC_UTIL_HASH_PRIME1 0x9e3779b185ebca87ULL
+#define GLC_UTIL_HASH_PRIME2 0xc2b2ae3d27d4eb4fULL
+#define GLC_UTIL_HASH_PRIME3 0x165667b19e3779f9ULL
+
+static inline u_int64_t glc_util_rotl64(u_int64_t x, unsigned int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline u_int64_t glc_util_hash_round(u_int64_t acc, u_int64_t input)
+{
+	return glc_util_rotl64(acc + input * GLC_UTIL_HASH_PRIME2, 31)
+	       * GLC_UTIL_HASH_PRIME1;
+}
+
+u_int64_t glc_util_hash(const void *data, size_t size)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	u_int64_t lane[4] = { GLC_UTIL_HASH_PRIME1 + GLC_UTIL_HASH_PRIME2,
+			      GLC_UTIL_HASH_PRIME2, 0, -GLC_UTIL_HASH_PRIME1 };
+	u_int64_t word[4], hash;
+	size_t left;
+	unsigned int l;
+
+	/*
+	 * 4 independent lanes over 32 byte blocks, loads and multiplies
+	 * of different lanes overlap and the loop vectorizes where the
+	 * target has 64bit vector multiplies.
+	 */
+	for (left = size; left >= sizeof(word); left -= sizeof(word)) {
+		memcpy(word, p, sizeof(word));
+		for (l = 0; l < 4; l++)
+			lane[l] = glc_util_hash_round(lane[l], word[l]);
+		p += sizeof(word);
+	}
+
+	hash = glc_util_rotl64(lane[0], 1) + glc_util_rotl64(lane[1], 7) +
+	       glc_util_rotl64(lane[2], 12) + glc_util_rotl64(lane[3], 18);
+	hash += size;
+
+	for (; left >= sizeof(u_int64_t); left -= sizeof(u_int64_t)) {
+		memcpy(word, p, sizeof(u_int64_t));
+		hash = glc_util_rotl64(hash ^ glc_util_hash_round(0, word[0]), 27)
+		       * GLC_UTIL_HASH_PRIME1 + GLC_UTIL_HASH_PRIME3;
+		p += sizeof(u_int64_t);
+	}
+	for (; left > 0; left--)
+		hash = glc_util_rotl64(hash ^ (*p++ * GLC_UTIL_HASH_PRIME3), 11)
+		       * GLC_UTIL_HASH_PRIME1;
+
+	/* every input bit affects every output bit */
+	hash ^= hash >> 33;
+	hash *= GLC_UTIL_HASH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= GLC_UTIL_HASH_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
 /**  \} */
 
@@ -95,6 +95,48 @@ __PUBLIC int glc_util_log_info(glc_t *glc);
  */
 __PUBLIC int glc_util_write_end_of_stream(glc_t *glc, ps_buffer_t *to);
 
+/** touch every page of buffer memory at init */
+#define GLC_UTIL_BUFFER_PREFAULT       0x1
+/** ask for transparent huge pages, implies prefault */
+#define GLC_UTIL_BUFFER_HUGEPAGES      0x2
+/** lock buffer memory in RAM, implies prefault */
+#define GLC_UTIL_BUFFER_MLOCK          0x4
+
+/**
+ * \brief set how glc_util_prepare_buffer() treats buffer memory
+ * \param glc glc
+ * \param flags GLC_UTIL_BUFFER_* flags, 0 leaves buffers alone
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_util_set_buffer_memory(glc_t *glc, glc_flags_t flags);
+
+/**
+ * \brief prepare memory of a freshly initialized buffer
+ *
+ * Buffer storage is reached through a write dma of an empty
+ * buffer which is cancelled afterwards, so buffer must not be
+ * in use yet. Page faults taken by the process before and after
+ * are logged at GLC_PERF level.
+ * \param glc glc
+ * \param buffer buffer
+ * \param size buffer size given to ps_bufferattr_setsize()
+ * \param name buffer name for log messages
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int glc_util_prepare_buffer(glc_t *glc, ps_buffer_t *buffer,
+				     size_t size, const char *name);
+
+/**
+ * \brief log page faults taken by the process
+ *
+ * Logs at GLC_PERF level the totals and the faults taken since the
+ * previous call, so calls at capture start and stop give the faults
+ * taken during the capture.
+ * \param glc glc
+ * \param what event name for log message
+ */
+__PUBLIC void glc_util_log_faults(glc_t *glc, const char *what);
+
 /**
  * \brief replace all occurences of string with another string
  * \param str string to manipulate
@@ -133,6 +175,16 @@ __PUBLIC const char *glc_util_videofmt_to_str(glc_video_format_t fmt);
 __PUBLIC int glc_util_get_videofmt_bpp(glc_video_format_t fmt);
 __PUBLIC void glc_util_close_fds(int start_fd);
 
+/**
+ * \brief fast 64bit hash, not suited for anything adversarial
+ *
+ * Used to spot unchanged video frames.
+ * \param data data to hash
+ * \param size data size
+ * \return hash
+ */
+__PUBLIC u_int64_t glc_util_hash(const void *data, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,336 @@
+/**
+ * \file glc/core/chain.c
+ * \brief fused filter chain
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup chain
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <packetstream.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+#include <glc/common/thread.h>
+#include <glc/common/optimization.h>
+
+#include "chain.h"
+
+#define CHAIN_RUNNING      0x1
+
+/**
+ * \brief per-worker chain state
+ *
+ * Each filter gets its own thread state, like it would
+ * have if it was running in its own glc_thread.
+ */
+struct chain_worker_s {
+	glc_thread_state_t state[CHAIN_MAX_FILTERS];
+	unsigned int active[CHAIN_MAX_FILTERS];
+	unsigned int num_active;
+
+	/* intermediate results, used in turn */
+	char *scratch[2];
+	size_t scratch_size[2];
+};
+
+struct chain_s {
+	glc_t *glc;
+	glc_flags_t flags;
+	glc_thread_t thread;
+
+	glc_thread_t *filter[CHAIN_MAX_FILTERS];
+	unsigned int num_filters;
+};
+
+static int chain_thread_create_callback(void *ptr, void **threadptr);
+static void chain_thread_finish_callback(void *ptr, void *threadptr, int err);
+static int chain_read_callback(glc_thread_state_t *state);
+static int chain_write_callback(glc_thread_state_t *state);
+static void chain_finish_callback(void *ptr, int err);
+
+static int chain_run(chain_t chain, struct chain_worker_s *worker,
+		     char *from, char *to);
+
+int chain_init(chain_t *chain, glc_t *glc)
+{
+	*chain = (chain_t) calloc(1, sizeof(struct chain_s));
+	if (unlikely(!*chain))
+		return ENOMEM;
+
+	(*chain)->glc = glc;
+
+	(*chain)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_FORWARD_REF | GLC_THREAD_NEW_REF;
+	(*chain)->thread.ptr = *chain;
+	(*chain)->thread.thread_create_callback = &chain_thread_create_callback;
+	(*chain)->thread.thread_finish_callback = &chain_thread_finish_callback;
+	(*chain)->thread.read_callback = &chain_read_callback;
+	(*chain)->thread.write_callback = &chain_write_callback;
+	(*chain)->thread.finish_callback = &chain_finish_callback;
+	(*chain)->thread.threads = glc_threads_hint(glc);
+	(*chain)->thread.name = "chain";
+
+	return 0;
+}
+
+int chain_destroy(chain_t chain)
+{
+	free(chain);
+	return 0;
+}
+
+int chain_append(chain_t chain, glc_thread_t *filter)
+{
+	if (unlikely(chain->flags & CHAIN_RUNNING))
+		return EALREADY;
+
+	if (unlikely(chain->num_filters >= CHAIN_MAX_FILTERS))
+		return ENOSPC;
+
+	chain->filter[chain->num_filters++] = filter;
+	if (filter->ask_rt)
+		chain->thread.ask_rt = 1;
+
+	return 0;
+}
+
+int chain_process_start(chain_t chain, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (unlikely(chain->flags & CHAIN_RUNNING))
+		return EAGAIN;
+
+	if (unlikely(!chain->num_filters)) {
+		glc_log(chain->glc, GLC_ERROR, "chain",
+			"attempt to start an empty chain");
+		return EINVAL;
+	}
+
+	if (unlikely((ret = glc_thread_create(chain->glc, &chain->thread, from, to))))
+		return ret;
+	chain->flags |= CHAIN_RUNNING;
+
+	return 0;
+}
+
+int chain_process_wait(chain_t chain)
+{
+	if (unlikely(!(chain->flags & CHAIN_RUNNING)))
+		return EAGAIN;
+
+	/* finish callback lets filters free their stream data */
+	glc_thread_wait(&chain->thread);
+	chain->flags &= ~CHAIN_RUNNING;
+
+	return 0;
+}
+
+void chain_finish_callback(void *ptr, int err)
+{
+	chain_t chain = (chain_t) ptr;
+	unsigned int i;
+
+	for (i = 0; i < chain->num_filters; i++) {
+		if (chain->filter[i]->finish_callback)
+			chain->filter[i]->finish_callback(chain->filter[i]->ptr, err);
+	}
+}
+
+int chain_thread_create_callback(void *ptr, void **threadptr)
+{
+	chain_t chain = (chain_t) ptr;
+	struct chain_worker_s *worker;
+	unsigned int i;
+	int ret;
+
+	if (unlikely(!(worker = (struct chain_worker_s *)
+		calloc(1, sizeof(struct chain_worker_s)))))
+		return ENOMEM;
+	*threadptr = worker;
+
+	for (i = 0; i < chain->num_filters; i++) {
+		worker->state[i].ptr = chain->filter[i]->ptr;
+		if (chain->filter[i]->thread_create_callback) {
+			if (unlikely((ret = chain->filter[i]->thread_create_callback(
+					chain->filter[i]->ptr, &worker->state[i].threadptr))))
+				goto err;
+		}
+	}
+
+	return 0;
+err:
+	/* release states of the filters created so far */
+	while (i--) {
+		if (chain->filter[i]->thread_finish_callback)
+			chain->filter[i]->thread_finish_callback(chain->filter[i]->ptr,
+								 worker->state[i].threadptr, ret);
+	}
+	free(worker);
+	*threadptr = NULL;
+	return ret;
+}
+
+void chain_thread_finish_callback(void *ptr, void *threadptr, int err)
+{
+	chain_t chain = (chain_t) ptr;
+	struct chain_worker_s *worker = (struct chain_worker_s *) threadptr;
+	unsigned int i;
+
+	if (!worker)
+		return;
+
+	for (i = 0; i < chain->num_filters; i++) {
+		if (chain->filter[i]->thread_finish_callback)
+			chain->filter[i]->thread_finish_callback(chain->filter[i]->ptr,
+								 worker->state[i].threadptr, err);
+	}
+
+	free(worker->scratch[0]);
+	free(worker->scratch[1]);
+	free(worker);
+}
+
+int chain_read_callback(glc_thread_state_t *state)
+{
+	chain_t chain = (chain_t) state->ptr;
+	struct chain_worker_s *worker = (struct chain_worker_s *) state->threadptr;
+	glc_thread_state_t *sub;
+	size_t size = state->read_size;
+	unsigned int i;
+	int ret;
+
+	worker->num_active = 0;
+	for (i = 0; i < chain->num_filters; i++) {
+		sub = &worker->state[i];
+		sub->flags = 0;
+		memcpy(&sub->header, &state->header, sizeof(glc_message_header_t));
+		/*
+		 * Filters only look at the frame header which is
+		 * left untouched, and every other message is copied
+		 * and modified in place, so the original read data
+		 * is good enough at this point.
+		 */
+		sub->read_data = state->read_data;
+		sub->read_size = sub->write_size = size;
+		sub->from = state->from;
+
+		if (chain->filter[i]->read_callback) {
+			if (unlikely((ret = chain->filter[i]->read_callback(sub))))
+				return ret;
+		}
+
+		memcpy(&state->header, &sub->header, sizeof(glc_message_header_t));
+		state->flags |= sub->flags & GLC_THREAD_STOP;
+
+		if (sub->flags & GLC_THREAD_STATE_SKIP_WRITE) {
+			state->flags |= GLC_THREAD_STATE_SKIP_WRITE;
+			break;
+		}
+
+		if (!(sub->flags & GLC_THREAD_COPY)) {
+			worker->active[worker->num_active++] = i;
+			size = sub->write_size;
+		}
+	}
+
+	if (!worker->num_active)
+		state->flags |= GLC_THREAD_COPY;
+	else if (state->flags & GLC_THREAD_STATE_SKIP_WRITE)
+		return chain_run(chain, worker, state->read_data, NULL); /* release filters */
+	else
+		state->write_size = size;
+
+	return 0;
+}
+
+int chain_write_callback(glc_thread_state_t *state)
+{
+	chain_t chain = (chain_t) state->ptr;
+	struct chain_worker_s *worker = (struct chain_worker_s *) state->threadptr;
+	int ret;
+
+	ret = chain_run(chain, worker, state->read_data, state->write_data);
+	memcpy(&state->header,
+	       &worker->state[worker->active[worker->num_active - 1]].header,
+	       sizeof(glc_message_header_t));
+	return ret;
+}
+
+/**
+ * \brief run write callbacks of active filters
+ *
+ * Last active filter writes directly into to, the others
+ * into scratch buffers. If to is NULL, the result is discarded.
+ * \param chain chain object
+ * \param worker worker state
+ * \param from source data
+ * \param to destination data or NULL
+ * \return 0 on success otherwise an error code
+ */
+int chain_run(chain_t chain, struct chain_worker_s *worker,
+	      char *from, char *to)
+{
+	glc_thread_state_t *sub;
+	glc_thread_t *filter;
+	char *data = from, *scratch;
+	unsigned int n, s;
+	int ret;
+
+	for (n = 0; n < worker->num_active; n++) {
+		filter = chain->filter[worker->active[n]];
+		sub = &worker->state[worker->active[n]];
+		sub->read_data = data;
+
+		if ((n + 1 == worker->num_active) && (to))
+			sub->write_data = to;
+		else {
+			s = n % 2;
+			if (worker->scratch_size[s] < sub->write_size) {
+				if (unlikely(!(scratch = (char *) realloc(worker->scratch[s],
+									  sub->write_size))))
+					return ENOMEM;
+				worker->scratch[s] = scratch;
+				worker->scratch_size[s] = sub->write_size;
+			}
+			sub->write_data = worker->scratch[s];
+		}
+
+		if (filter->write_callback) {
+			if (unlikely((ret = filter->write_callback(sub))))
+				return ret;
+		}
+
+		data = sub->write_data;
+		sub->read_data = sub->write_data = NULL;
+	}
+
+	return 0;
+}
+
+/**  \} */
@@ -0,0 +1,114 @@
+/**
+ * \file glc/core/chain.h
+ * \brief fused filter chain
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup chain fused filter chain
+ *  \{
+ */
+
+#ifndef _CHAIN_H
+#define _CHAIN_H
+
+#include <packetstream.h>
+#include <glc/common/glc.h>
+#include <glc/common/thread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** maximum number of filters in a chain */
+#define CHAIN_MAX_FILTERS 8
+
+/**
+ * \brief chain object
+ *
+ * A chain runs several filters (rgb, scale, color, ycbcr...) on
+ * each packet from a single worker, without intermediate buffers.
+ * Filters that have nothing to do for a given packet are left out
+ * so a frame is copied only once, into the target buffer, when
+ * every filter is a no-op.
+ */
+typedef struct chain_s* chain_t;
+
+/**
+ * \brief initialize chain object
+ * \param chain chain object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int chain_init(chain_t *chain, glc_t *glc);
+
+/**
+ * \brief append a filter to the chain
+ *
+ * Filters are run in the order they were appended. The filter
+ * callbacks must follow the conventions of the stock filters:
+ * messages other than video frames are flagged GLC_THREAD_COPY
+ * and modified in place, and a video frame keeps its
+ * glc_video_frame_header_t untouched. Filter objects provide a
+ * *_chain_append() wrapper around this function.
+ * \param chain chain object
+ * \param filter filter thread vtable
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int chain_append(chain_t chain, glc_thread_t *filter);
+
+/**
+ * \brief start chain process
+ * \param chain chain object
+ * \param from source buffer
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int chain_process_start(chain_t chain, ps_buffer_t *from,
+				 ps_buffer_t *to);
+
+/**
+ * \brief block until current process has finished
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int chain_process_wait(chain_t chain);
+
+/**
+ * \brief destroy chain object
+ *
+ * Filters appended to the chain are not destroyed.
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int chain_destroy(chain_t chain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
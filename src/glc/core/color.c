@@ -57,8 +57,10 @@
 
 struct color_video_stream_s;
 
+/* processes rows [first, last), chroma rows for Y'CbCr */
 typedef void (*color_proc)(color_t color, struct color_video_stream_s *video,
-			   unsigned char *from, unsigned char *to);
+			   unsigned char *from, unsigned char *to,
+			   unsigned int first, unsigned int last);
 
 struct color_video_stream_s {
 	glc_stream_id_t id;
@@ -77,6 +79,13 @@ struct color_video_stream_s {
 	struct color_video_stream_s *next;
 };
 
+/* argument for stripe workers */
+struct color_stripe_s {
+	color_t color;
+	struct color_video_stream_s *video;
+	unsigned char *from, *to;
+};
+
 struct color_s {
 	glc_t *glc;
 	glc_flags_t flags;
@@ -103,10 +112,14 @@ static int color_generate_ycbcr_lookup_table(color_t color,
 static int color_generate_rgb_lookup_table(color_t color,
 				    struct color_video_stream_s *video);
 
+static void color_stripe(void *arg, unsigned int first, unsigned int last);
+
 static void color_ycbcr(color_t color, struct color_video_stream_s *video,
-		 unsigned char *from, unsigned char *to);
+		 unsigned char *from, unsigned char *to,
+		 unsigned int first, unsigned int last);
 static void color_bgr(color_t color, struct color_video_stream_s *video,
-	       unsigned char *from, unsigned char *to);
+	       unsigned char *from, unsigned char *to,
+	       unsigned int first, unsigned int last);
 
 /* unfortunately over- and underflows will occur */
 __inline__ static unsigned char color_clamp(int val)
@@ -124,12 +137,14 @@ int color_init(color_t *color, glc_t *glc)
 
 	(*color)->glc = glc;
 
-	(*color)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*color)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_FORWARD_REF;
 	(*color)->thread.read_callback = &color_read_callback;
 	(*color)->thread.write_callback = &color_write_callback;
 	(*color)->thread.finish_callback = &color_finish_callback;
 	(*color)->thread.ptr = *color;
 	(*color)->thread.threads = glc_threads_hint(glc);
+	(*color)->thread.name = "color";
 
 	return 0;
 }
@@ -153,6 +168,14 @@ int color_process_start(color_t color, ps_buffer_t *from, ps_buffer_t *to)
 	return 0;
 }
 
+int color_chain_append(color_t color, chain_t chain)
+{
+	if (unlikely(color->flags & COLOR_RUNNING))
+		return EAGAIN;
+
+	return chain_append(chain, &color->thread);
+}
+
 int color_process_wait(color_t color)
 {
 	if (unlikely(!(color->flags & COLOR_RUNNING)))
@@ -237,17 +260,30 @@ int color_read_callback(glc_thread_state_t *state)
 
 int color_write_callback(glc_thread_state_t *state)
 {
+	color_t color = (color_t) state->ptr;
 	struct color_video_stream_s *video = state->threadptr;
+	struct color_stripe_s stripe;
 
 	memcpy(state->write_data, state->read_data, sizeof(glc_video_frame_header_t));
-	video->proc(state->ptr, video,
-		  (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
-		  (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)]);
+	stripe.color = color;
+	stripe.video = video;
+	stripe.from  = (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)];
+	stripe.to    = (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)];
+	glc_stripe_run(color->glc, &color_stripe, &stripe,
+		       video->format == GLC_VIDEO_YCBCR_420JPEG ? video->h / 2 : video->h);
 
 	pthread_rwlock_unlock(&video->update);
 	return 0;
 }
 
+void color_stripe(void *arg, unsigned int first, unsigned int last)
+{
+	struct color_stripe_s *stripe = (struct color_stripe_s *) arg;
+
+	stripe->video->proc(stripe->color, stripe->video,
+			    stripe->from, stripe->to, first, last);
+}
+
 void color_get_video_stream(color_t color, glc_stream_id_t id,
 		   struct color_video_stream_s **video)
 {
@@ -397,7 +433,8 @@ int color_color_msg(color_t color, glc_color_message_t *msg)
 
 void color_ycbcr(color_t color,
 		 struct color_video_stream_s *video,
-		 unsigned char *from, unsigned char *to)
+		 unsigned char *from, unsigned char *to,
+		 unsigned int first, unsigned int last)
 {
 	unsigned int x, y, Cpix, Y;
 	unsigned int pos;
@@ -412,7 +449,7 @@ void color_ycbcr(color_t color,
 	Cb_to = &to[video->h * video->w];
 	Cr_to = &to[video->h * video->w + (video->h / 2) * (video->w / 2)];
 
-	Cpix = 0;
+	Cpix = first * (video->w / 2);
 
 #define CONVERT_Y(xadd, yadd) 								\
 	pos = YCBCR_LOOKUP_POS(Y_from[(x + (xadd)) + (y + (yadd)) * video->w],		\
@@ -420,7 +457,7 @@ void color_ycbcr(color_t color,
 	Y_to[(x + (xadd)) + (y + (yadd)) * video->w] = video->lookup_table[pos + 0];	\
 	Y += video->lookup_table[pos + 0];
 
-	for (y = 0; y < video->h; y += 2) {
+	for (y = first * 2; y < last * 2; y += 2) {
 		for (x = 0; x < video->w; x += 2) {
 			Y = 0;
 
@@ -440,11 +477,12 @@ void color_ycbcr(color_t color,
 
 void color_bgr(color_t color,
 	       struct color_video_stream_s *video,
-	       unsigned char *from, unsigned char *to)
+	       unsigned char *from, unsigned char *to,
+	       unsigned int first, unsigned int last)
 {
 	unsigned int x, y, p;
 
-	for (y = 0; y < video->h; y++) {
+	for (y = first; y < last; y++) {
 		for (x = 0; x < video->w; x++) {
 			p = video->row * y + x * video->bpp;
 
@@ -18,6 +18,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/core/chain.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -75,6 +76,17 @@ __PUBLIC int color_override_clear(color_t color);
  */
 __PUBLIC int color_process_start(color_t color, ps_buffer_t *from, ps_buffer_t *to);
 
+/**
+ * \brief run color as part of a filter chain
+ *
+ * color is then run by the chain workers and color_process_start()
+ * must not be used.
+ * \param color color object
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int color_chain_append(color_t color, chain_t chain);
+
 /**
  * \brief block until process has finished
  * \param color color object
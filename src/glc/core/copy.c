@@ -63,6 +63,10 @@ struct copy_s {
 };
 
 void *copy_thread(void *argptr);
+static int copy_read(ps_packet_t *read, glc_message_header_t *header,
+		     void **data, size_t *size, glc_packet_ref_t *ref);
+static int copy_send(struct copy_target_s *target, glc_message_header_t *header,
+		     void *data, size_t size, glc_packet_ref_t ref);
 
 int copy_init(copy_t *copy, glc_t *glc)
 {
@@ -110,6 +114,7 @@ int copy_process_start(copy_t copy, ps_buffer_t *from)
 		return EALREADY;
 
 	copy->from = from;
+	copy->thread.name = "copy";
 
 	return glc_simple_thread_create(copy->glc, &copy->thread,
 				 copy_thread, copy);
@@ -125,6 +130,7 @@ void *copy_thread(void *argptr)
 	copy_t copy = (copy_t) argptr;
 	struct copy_target_s *target;
 	glc_message_header_t msg_hdr;
+	glc_packet_ref_t ref = NULL;
 	size_t data_size;
 	void *data;
 	int ret = 0;
@@ -138,41 +144,33 @@ void *copy_thread(void *argptr)
 		if (unlikely((ret = ps_packet_open(&read, PS_PACKET_READ))))
 			goto err;
 
-		if (unlikely((ret = ps_packet_read(&read, &msg_hdr,
-					sizeof(glc_message_header_t)))))
-			goto err;
-		if (unlikely((ret = ps_packet_getsize(&read, &data_size))))
-			goto err;
-		data_size -= sizeof(glc_message_header_t);
-		if (unlikely((ret = ps_packet_dma(&read, &data, data_size,
-						PS_ACCEPT_FAKE_DMA))))
+		if (unlikely((ret = copy_read(&read, &msg_hdr, &data, &data_size, &ref))))
 			goto err;
 
 		target = copy->copy_target;
 		while (target != NULL) {
 			if ((target->type == 0) ||
 			    (target->type == msg_hdr.type)) {
-				if (unlikely((ret = ps_packet_open(&target->packet,
-							 PS_PACKET_WRITE))))
-					goto err;
-				if (unlikely((ret = ps_packet_write(&target->packet, &msg_hdr,
-					sizeof(glc_message_header_t)))))
-					goto err;
-				if (unlikely((ret = ps_packet_write(&target->packet, data,
-					data_size))))
-					goto err;
-				if (unlikely((ret = ps_packet_close(&target->packet))))
+				if (unlikely((ret = copy_send(target, &msg_hdr, data,
+							      data_size, ref))))
 					goto err;
 			}
 			target = target->next;
 		}
 
 		ps_packet_close(&read);
+		glc_thread_pool_notify(copy->glc);
+		if (ref) {
+			glc_packet_ref_put(ref);
+			ref = NULL;
+		}
 	} while ((!glc_state_test(copy->glc, GLC_STATE_CANCEL)) &&
 		 (msg_hdr.type != GLC_MESSAGE_CLOSE));
 
 finish:
 	ps_packet_destroy(&read);
+	if (ref)
+		glc_packet_ref_put(ref);
 
 	if (glc_state_test(copy->glc, GLC_STATE_CANCEL)) {
 		ps_buffer_cancel(copy->from);
@@ -194,4 +192,71 @@ err:
 	goto finish;
 }
 
+/**
+ * \brief read a packet, resolving references
+ *
+ * If the packet is a GLC_MESSAGE_REF, ref is set and owned by
+ * the caller, header, data and size describe the referenced message.
+ */
+int copy_read(ps_packet_t *read, glc_message_header_t *header,
+	      void **data, size_t *size, glc_packet_ref_t *ref)
+{
+	glc_ref_message_t ref_msg;
+	int ret;
+
+	if (unlikely((ret = ps_packet_read(read, header,
+					   sizeof(glc_message_header_t)))))
+		return ret;
+
+	if (header->type == GLC_MESSAGE_REF) {
+		if (unlikely((ret = ps_packet_read(read, &ref_msg,
+						   sizeof(glc_ref_message_t)))))
+			return ret;
+		memcpy(header, &ref_msg.header, sizeof(glc_message_header_t));
+		*ref = ref_msg.ref;
+		*data = glc_packet_ref_data(ref_msg.ref);
+		*size = ref_msg.size;
+		return 0;
+	}
+
+	if (unlikely((ret = ps_packet_getsize(read, size))))
+		return ret;
+	*size -= sizeof(glc_message_header_t);
+	return ps_packet_dma(read, data, *size, PS_ACCEPT_FAKE_DMA);
+}
+
+/**
+ * \brief write a message to a target, by reference if ref is set
+ */
+int copy_send(struct copy_target_s *target, glc_message_header_t *header,
+	      void *data, size_t size, glc_packet_ref_t ref)
+{
+	glc_message_header_t ref_header;
+	glc_ref_message_t ref_msg;
+	int ret;
+
+	if (unlikely((ret = ps_packet_open(&target->packet, PS_PACKET_WRITE))))
+		return ret;
+
+	if (ref) {
+		ref_header.type = GLC_MESSAGE_REF;
+		memcpy(&ref_msg.header, header, sizeof(glc_message_header_t));
+		ref_msg.size = size;
+		ref_msg.ref = ref;
+		header = &ref_header;
+		data = &ref_msg;
+		size = sizeof(glc_ref_message_t);
+	}
+
+	if (unlikely((ret = ps_packet_write(&target->packet, header,
+					    sizeof(glc_message_header_t)))))
+		return ret;
+	if (unlikely((ret = ps_packet_write(&target->packet, data, size))))
+		return ret;
+	/* each reader gets its own reference */
+	if (ref)
+		glc_packet_ref_get(ref);
+	return ps_packet_close(&target->packet);
+}
+
 /**  \} */
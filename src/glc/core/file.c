@@ -160,6 +160,7 @@ int file_sink_init(sink_t *sink, glc_t *glc)
 	file->thread.read_callback   = &file_read_callback;
 	file->thread.finish_callback = &file_finish_callback;
 	file->thread.threads = 1;
+	file->thread.name = "file";
 
 	tracker_init(&file->state_tracker, file->mpriv.glc);
 
@@ -609,9 +610,15 @@ int file_test_stream_version(u_int32_t version)
 	 * code, we normalize timestamps in this module
 	 * by making sure that all outgoing timestamps are in
 	 * nanoseconds.
+	 * 0x06 adds GLC_MESSAGE_VIDEO_REPEAT, which 0x05 streams
+	 * never contain, and 0x07 adds GLC_MESSAGE_VIDEO_TILES.
 	 */
 	if (likely(version == GLC_STREAM_VERSION)) {
 		return 0;
+	} else if (version == 0x06) {
+		return 0;
+	} else if (version == 0x05) {
+		return 0;
 	} else if (version == 0x03 || version ==0x04) {
 		/*
 		 0.5.5 was last version to use 0x03.
@@ -749,6 +756,7 @@ int file_read(source_t source, ps_buffer_t *to)
 
 		if (unlikely((ret = ps_packet_close(&packet))))
 			goto err;
+		glc_thread_pool_notify(file->mpriv.glc);
 	} while ((header.type != GLC_MESSAGE_CLOSE) &&
 		 (!glc_state_test(file->mpriv.glc, GLC_STATE_CANCEL)));
 
@@ -763,6 +771,7 @@ send_eof:
 	ps_packet_open(&packet, PS_PACKET_WRITE);
 	ps_packet_write(&packet, &header, sizeof(glc_message_header_t));
 	ps_packet_close(&packet);
+	glc_thread_pool_notify(file->mpriv.glc);
 
 	glc_log(file->mpriv.glc, GLC_ERROR, "file", "unexpected EOF");
 	goto finish;
@@ -59,6 +59,8 @@ struct info_video_stream_s {
 	unsigned int w, h;
 
 	unsigned long pictures;
+	unsigned long repeats;
+	unsigned long tiled;
 	size_t bytes;
 
 	unsigned long fps;
@@ -98,6 +100,9 @@ static int info_read_callback();
 
 static void video_format_info(info_t info, glc_video_format_message_t *video_message);
 static void video_frame_info(info_t info, glc_video_frame_header_t *pic_header);
+static void video_repeat_info(info_t info, glc_video_frame_header_t *pic_header);
+static void video_tiles_info(info_t info, glc_video_tiles_header_t *tiles_header,
+			     size_t size);
 static void audio_format_info(info_t info, glc_audio_format_message_t *fmt_message);
 static void audio_data_info(info_t info, glc_audio_data_header_t *audio_header);
 static void color_info(info_t info, glc_color_message_t *color_msg);
@@ -121,6 +126,7 @@ int info_init(info_t *info, glc_t *glc)
 	(*info)->thread.read_callback = &info_read_callback;
 	(*info)->thread.finish_callback = &info_finish_callback;
 	(*info)->thread.threads = 1;
+	(*info)->thread.name = "info";
 
 	return 0;
 }
@@ -186,6 +192,10 @@ void info_finish_callback(void *ptr, int err)
 
 		fprintf(info->stream, "video stream %d\n", video->id);
 		fprintf(info->stream, "  frames      = %lu\n", video->pictures);
+		if (video->repeats)
+			fprintf(info->stream, "  repeated    = %lu\n", video->repeats);
+		if (video->tiled)
+			fprintf(info->stream, "  tiled       = %lu\n", video->tiled);
 		fprintf(info->stream, "  fps         = %04.2f\n",
 		       (double) (video->pictures) / (double) (info->time/1000000000.0));
 		fprintf(info->stream, "  bytes       = ");
@@ -221,6 +231,11 @@ int info_read_callback(glc_thread_state_t *state)
 		video_format_info(info, (glc_video_format_message_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
 		video_frame_info(info, (glc_video_frame_header_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_REPEAT)
+		video_repeat_info(info, (glc_video_frame_header_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_TILES)
+		video_tiles_info(info, (glc_video_tiles_header_t *) state->read_data,
+				 state->read_size);
 	else if (state->header.type == GLC_MESSAGE_AUDIO_FORMAT)
 		audio_format_info(info, (glc_audio_format_message_t *) state->read_data);
 	else if (state->header.type == GLC_MESSAGE_AUDIO_DATA)
@@ -326,6 +341,8 @@ void video_format_info(info_t info, glc_video_format_message_t *format_message)
 		}
 		fprintf(info->stream, "  flags       = ");
 		INFO_FLAG(format_message->flags, GLC_VIDEO_DWORD_ALIGNED)
+		INFO_FLAG(format_message->flags, GLC_VIDEO_REPEATS)
+		INFO_FLAG(format_message->flags, GLC_VIDEO_TILES)
 		fprintf(info->stream, "\n");
 		fprintf(info->stream, "  width       = %u\n", format_message->width);
 		fprintf(info->stream, "  height      = %u\n", format_message->height);
@@ -376,6 +393,51 @@ void video_frame_info(info_t info, glc_video_frame_header_t *pic_header)
 	}
 }
 
+void video_repeat_info(info_t info, glc_video_frame_header_t *pic_header)
+{
+	struct info_video_stream_s *video;
+	info->time = pic_header->time;
+
+	info_get_video_stream(info, &video, pic_header->id);
+
+	if (info->level >= INFO_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "repeated picture (video %d)\n", pic_header->id);
+	}
+
+	/* shown as a picture, but no picture data */
+	video->pictures++;
+	video->repeats++;
+	video->fps++;
+}
+
+void video_tiles_info(info_t info, glc_video_tiles_header_t *tiles_header, size_t size)
+{
+	struct info_video_stream_s *video;
+	info->time = tiles_header->frame.time;
+
+	info_get_video_stream(info, &video, tiles_header->frame.id);
+
+	if (info->level >= INFO_DETAILED_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "tiles\n");
+
+		fprintf(info->stream, "  stream id   = %d\n", tiles_header->frame.id);
+		fprintf(info->stream, "  time        = %" PRIu64 "\n", tiles_header->frame.time);
+		fprintf(info->stream, "  tiles       = %u of %ux%u pixels\n",
+			tiles_header->count, tiles_header->size, tiles_header->size);
+	} else if (info->level >= INFO_PICTURE) {
+		print_time(info->stream, info->time);
+		fprintf(info->stream, "tiles (video %d)\n", tiles_header->frame.id);
+	}
+
+	/* shown as a picture, only changed tiles are stored */
+	video->pictures++;
+	video->tiled++;
+	video->fps++;
+	video->bytes += size - sizeof(glc_video_tiles_header_t);
+}
+
 void audio_format_info(info_t info, glc_audio_format_message_t *fmt_message)
 {
 	INFO_FLAGS
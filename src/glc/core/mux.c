@@ -0,0 +1,325 @@
+/**
+ * \file glc/core/mux.c
+ * \brief producer lane multiplexer
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup mux
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <packetstream.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/thread.h>
+#include <glc/common/log.h>
+#include <glc/common/state.h>
+#include <glc/common/optimization.h>
+
+#include "mux.h"
+
+/** how long the mux thread sleeps when every lane is empty */
+#define MUX_IDLE_NS 250000
+
+struct mux_lane_s {
+	ps_buffer_t *buffer;
+	ps_packet_t packet;
+	int priority;
+
+	/* head packet, kept open until it is forwarded */
+	int open, timed;
+	glc_message_header_t header;
+	glc_utime_t time;
+	size_t size;
+
+	unsigned long packets;
+};
+
+struct mux_s {
+	glc_t *glc;
+	ps_buffer_t *to;
+
+	glc_simple_thread_t thread;
+
+	struct mux_lane_s lane[MUX_MAX_LANES];
+	unsigned int num_lanes;
+};
+
+void *mux_thread(void *argptr);
+static int mux_peek(struct mux_lane_s *lane);
+static struct mux_lane_s *mux_next(mux_t mux);
+static int mux_forward(ps_packet_t *write, struct mux_lane_s *lane);
+
+int mux_init(mux_t *mux, glc_t *glc)
+{
+	*mux = (mux_t) calloc(1, sizeof(struct mux_s));
+	if (unlikely(!*mux))
+		return ENOMEM;
+
+	(*mux)->glc = glc;
+	return 0;
+}
+
+int mux_destroy(mux_t mux)
+{
+	unsigned int i;
+
+	for (i = 0; i < mux->num_lanes; i++)
+		ps_packet_destroy(&mux->lane[i].packet);
+
+	free(mux);
+	return 0;
+}
+
+int mux_add_lane(mux_t mux, ps_buffer_t *lane, int priority)
+{
+	int ret;
+
+	if (unlikely(mux->thread.running))
+		return EALREADY;
+
+	if (unlikely(mux->num_lanes >= MUX_MAX_LANES))
+		return ENOSPC;
+
+	if (unlikely((ret = ps_packet_init(&mux->lane[mux->num_lanes].packet, lane))))
+		return ret;
+
+	mux->lane[mux->num_lanes].buffer = lane;
+	mux->lane[mux->num_lanes].priority = priority;
+	mux->num_lanes++;
+
+	return 0;
+}
+
+int mux_process_start(mux_t mux, ps_buffer_t *to)
+{
+	if (unlikely(mux->thread.running))
+		return EALREADY;
+
+	if (unlikely(!mux->num_lanes)) {
+		glc_log(mux->glc, GLC_ERROR, "mux", "no lanes");
+		return EINVAL;
+	}
+
+	mux->to = to;
+	mux->thread.name = "mux";
+
+	return glc_simple_thread_create(mux->glc, &mux->thread,
+					mux_thread, mux);
+}
+
+int mux_process_wait(mux_t mux)
+{
+	return glc_simple_thread_wait(mux->glc, &mux->thread);
+}
+
+void *mux_thread(void *argptr)
+{
+	mux_t mux = (mux_t) argptr;
+	struct mux_lane_s *lane;
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = MUX_IDLE_NS };
+	ps_packet_t write;
+	unsigned int i;
+	int closing, ret = 0;
+
+	if (unlikely((ret = ps_packet_init(&write, mux->to))))
+		goto err;
+
+	while (!glc_state_test(mux->glc, GLC_STATE_CANCEL)) {
+		closing = 0;
+		for (i = 0; i < mux->num_lanes; i++) {
+			if (unlikely((ret = mux_peek(&mux->lane[i]))))
+				goto err;
+			if ((mux->lane[i].open) &&
+			    (mux->lane[i].header.type == GLC_MESSAGE_CLOSE))
+				closing = 1;
+		}
+
+		if ((lane = mux_next(mux))) {
+			if (unlikely((ret = mux_forward(&write, lane))))
+				goto err;
+			glc_thread_pool_notify(mux->glc);
+		} else if (closing) {
+			/* other lanes are drained, end of stream */
+			for (i = 0; i < mux->num_lanes; i++) {
+				if (mux->lane[i].open)
+					break;
+			}
+			if (unlikely((ret = mux_forward(&write, &mux->lane[i]))))
+				goto err;
+			break;
+		} else
+			nanosleep(&ts, NULL);
+	}
+
+finish:
+	ps_packet_destroy(&write);
+
+	for (i = 0; i < mux->num_lanes; i++) {
+		if (mux->lane[i].open) {
+			ps_packet_cancel(&mux->lane[i].packet);
+			mux->lane[i].open = 0;
+		}
+		/* late writers must not block on a lane nobody reads */
+		ps_buffer_cancel(mux->lane[i].buffer);
+
+		glc_log(mux->glc, GLC_PERF, "mux", "lane %u: %lu packets",
+			i, mux->lane[i].packets);
+	}
+
+	if (glc_state_test(mux->glc, GLC_STATE_CANCEL))
+		ps_buffer_cancel(mux->to);
+
+	return NULL;
+err:
+	if (ret != EINTR) {
+		glc_log(mux->glc, GLC_ERROR, "mux", "%s (%d)",
+			strerror(ret), ret);
+		glc_state_set(mux->glc, GLC_STATE_CANCEL);
+	}
+	goto finish;
+}
+
+/**
+ * \brief open head packet of a lane if there is one
+ *
+ * Only the header and the timestamp are read, the packet stays
+ * open until it is forwarded.
+ * \return 0 on success, even if lane is empty, otherwise an error code
+ */
+int mux_peek(struct mux_lane_s *lane)
+{
+	glc_video_frame_header_t pic;
+	glc_ref_message_t ref_msg;
+	glc_message_type_t type;
+	int ret;
+
+	if (lane->open)
+		return 0;
+
+	ret = ps_packet_open(&lane->packet, PS_PACKET_READ | PS_PACKET_TRY);
+	if (ret == EBUSY)
+		return 0;
+	else if (unlikely(ret))
+		return ret;
+	lane->open = 1;
+	lane->timed = 0;
+
+	if (unlikely((ret = ps_packet_read(&lane->packet, &lane->header,
+					   sizeof(glc_message_header_t)))))
+		return ret;
+	if (unlikely((ret = ps_packet_getsize(&lane->packet, &lane->size))))
+		return ret;
+
+	/* audio data header starts like the video frame header */
+	type = lane->header.type;
+	if (type == GLC_MESSAGE_REF) {
+		if (unlikely((ret = ps_packet_read(&lane->packet, &ref_msg,
+						   sizeof(glc_ref_message_t)))))
+			return ret;
+		if (((ref_msg.header.type == GLC_MESSAGE_VIDEO_FRAME) ||
+		     (ref_msg.header.type == GLC_MESSAGE_AUDIO_DATA)) &&
+		    (ref_msg.size >= sizeof(glc_video_frame_header_t))) {
+			memcpy(&pic, glc_packet_ref_data(ref_msg.ref),
+			       sizeof(glc_video_frame_header_t));
+			lane->timed = 1;
+		}
+	} else if (((type == GLC_MESSAGE_VIDEO_FRAME) ||
+		    (type == GLC_MESSAGE_VIDEO_REPEAT) ||
+		    (type == GLC_MESSAGE_AUDIO_DATA)) &&
+		   (lane->size >= sizeof(glc_message_header_t) +
+				  sizeof(glc_video_frame_header_t))) {
+		if (unlikely((ret = ps_packet_read(&lane->packet, &pic,
+						   sizeof(glc_video_frame_header_t)))))
+			return ret;
+		lane->timed = 1;
+	}
+
+	if (lane->timed)
+		lane->time = pic.time;
+
+	return 0;
+}
+
+/**
+ * \brief pick the lane whose head packet goes next
+ * \return lane or NULL if there is nothing to forward but
+ *         end of stream
+ */
+struct mux_lane_s *mux_next(mux_t mux)
+{
+	struct mux_lane_s *lane, *best = NULL;
+	unsigned int i;
+
+	for (i = 0; i < mux->num_lanes; i++) {
+		lane = &mux->lane[i];
+		if ((!lane->open) || (lane->header.type == GLC_MESSAGE_CLOSE))
+			continue;
+
+		/* untimed packets kept the time of the one before them */
+		if ((!best) || (lane->time < best->time) ||
+		    ((lane->time == best->time) && (lane->priority > best->priority)))
+			best = lane;
+	}
+
+	return best;
+}
+
+/**
+ * \brief copy head packet of a lane to target buffer
+ * \return 0 on success otherwise an error code
+ */
+int mux_forward(ps_packet_t *write, struct mux_lane_s *lane)
+{
+	char *data;
+	int ret;
+
+	if (unlikely((ret = ps_packet_seek(&lane->packet, 0))))
+		return ret;
+	if (unlikely((ret = ps_packet_dma(&lane->packet, (void *) &data,
+					  lane->size, PS_ACCEPT_FAKE_DMA))))
+		return ret;
+
+	if (unlikely((ret = ps_packet_open(write, PS_PACKET_WRITE))))
+		return ret;
+	if (unlikely((ret = ps_packet_setsize(write, lane->size))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_write(write, data, lane->size))))
+		goto cancel;
+	if (unlikely((ret = ps_packet_close(write))))
+		return ret;
+
+	lane->open = 0;
+	lane->packets++;
+	return ps_packet_close(&lane->packet);
+cancel:
+	ps_packet_cancel(write);
+	return ret;
+}
+
+/**  \} */
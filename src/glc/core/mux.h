@@ -0,0 +1,113 @@
+/**
+ * \file glc/core/mux.h
+ * \brief producer lane multiplexer
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup mux producer lane multiplexer
+ *  \{
+ */
+
+#ifndef _MUX_H
+#define _MUX_H
+
+#include <packetstream.h>
+#include <glc/common/glc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** maximum number of lanes */
+#define MUX_MAX_LANES          8
+
+/** lane priority for bulky streams, ie. video */
+#define MUX_PRIORITY_NORMAL    0
+/** lane priority for latency sensitive streams, ie. audio, wins ties */
+#define MUX_PRIORITY_HIGH      1
+
+/**
+ * \brief mux object
+ *
+ * Each capture source writes into a lane of its own so producers
+ * never wait on each other. The mux thread merges the lanes into
+ * the target buffer strictly by timestamp, oldest packet first,
+ * and high priority lanes first on equal timestamps. Messages
+ * without a timestamp (formats, color...) take the one of the
+ * packet before them in their lane. A packet keeps its place in
+ * its lane so stream order is never changed.
+ *
+ * A GLC_MESSAGE_CLOSE on any lane ends the stream once packets
+ * already waiting in the other lanes have been forwarded.
+ */
+typedef struct mux_s* mux_t;
+
+/**
+ * \brief initialize mux object
+ * \param mux mux object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int mux_init(mux_t *mux, glc_t *glc);
+
+/**
+ * \brief destroy mux object
+ * \param mux mux object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int mux_destroy(mux_t mux);
+
+/**
+ * \brief add a lane
+ * \param mux mux object
+ * \param lane lane buffer, written by a single capture source
+ * \param priority MUX_PRIORITY_NORMAL or MUX_PRIORITY_HIGH
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int mux_add_lane(mux_t mux, ps_buffer_t *lane, int priority);
+
+/**
+ * \brief start mux process
+ * \param mux mux object
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int mux_process_start(mux_t mux, ps_buffer_t *to);
+
+/**
+ * \brief block until mux process has finished
+ * \param mux mux object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int mux_process_wait(mux_t mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -118,13 +118,22 @@ int pack_init(pack_t *pack, glc_t *glc)
 	(*pack)->glc = glc;
 	(*pack)->compress_min = 1024;
 
-	(*pack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ;
+	(*pack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ |
+				GLC_THREAD_FORWARD_REF;
 	(*pack)->thread.ptr = *pack;
 	(*pack)->thread.thread_create_callback = &pack_thread_create_callback;
 	(*pack)->thread.thread_finish_callback = &pack_thread_finish_callback;
 	(*pack)->thread.read_callback = &pack_read_callback;
 	(*pack)->thread.finish_callback = &pack_finish_callback;
 	(*pack)->thread.threads = glc_threads_hint(glc);
+	(*pack)->thread.name = "pack";
+
+	/*
+	 * Compression is stateless, workers don't need to run in lockstep.
+	 * A lone worker compresses straight into the buffer instead.
+	 */
+	if ((*pack)->thread.threads > 1)
+		(*pack)->thread.flags |= GLC_THREAD_REORDER;
 
 	return 0;
 #endif
@@ -265,6 +274,7 @@ int pack_read_callback(glc_thread_state_t *state)
 	/* compress only audio and pictures */
 	if ((state->read_size > pack->compress_min) &&
 	    ((state->header.type == GLC_MESSAGE_VIDEO_FRAME) ||
+	     (state->header.type == GLC_MESSAGE_VIDEO_TILES) ||
 	     (state->header.type == GLC_MESSAGE_AUDIO_DATA))) {
 		if (pack->compression == PACK_QUICKLZ) {
 #ifdef __QUICKLZ
@@ -293,6 +303,8 @@ int pack_read_callback(glc_thread_state_t *state)
 		} else
 			goto copy;
 
+		/* worst case is only reserved until the frame is compressed */
+		state->flags |= GLC_THREAD_STATE_SHRINK;
 		return 0;
 	}
 copy:
@@ -321,6 +333,8 @@ int pack_lzo_write_callback(glc_thread_state_t *state)
 	container->header.type = GLC_MESSAGE_LZO;
 
 	state->header.type = GLC_MESSAGE_CONTAINER;
+	/* commit only what was used of the worst case reservation */
+	state->write_size = sizeof(glc_container_message_header_t) + container->size;
 
 	__sync_fetch_and_add(&((pack_t) state->ptr)->stats.pack_size,
 				compressed_size);
@@ -351,6 +365,8 @@ int pack_quicklz_write_callback(glc_thread_state_t *state)
 	container->header.type = GLC_MESSAGE_QUICKLZ;
 
 	state->header.type = GLC_MESSAGE_CONTAINER;
+	/* commit only what was used of the worst case reservation */
+	state->write_size = sizeof(glc_container_message_header_t) + container->size;
 
 	__sync_fetch_and_add(&((pack_t) state->ptr)->stats.pack_size,
 				compressed_size);
@@ -380,6 +396,8 @@ int pack_lzjb_write_callback(glc_thread_state_t *state)
 	container->header.type = GLC_MESSAGE_LZJB;
 
 	state->header.type = GLC_MESSAGE_CONTAINER;
+	/* commit only what was used of the worst case reservation */
+	state->write_size = sizeof(glc_container_message_header_t) + container->size;
 
 	__sync_fetch_and_add(&((pack_t) state->ptr)->stats.pack_size,
 				compressed_size);
@@ -396,13 +414,15 @@ int unpack_init(unpack_t *unpack, glc_t *glc)
 
 	(*unpack)->glc = glc;
 
-	(*unpack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ;
+	(*unpack)->thread.flags = GLC_THREAD_WRITE | GLC_THREAD_READ |
+				  GLC_THREAD_FORWARD_REF | GLC_THREAD_NEW_REF;
 	(*unpack)->thread.ptr = *unpack;
 	(*unpack)->thread.thread_finish_callback = &unpack_thread_finish_callback;
 	(*unpack)->thread.read_callback = &unpack_read_callback;
 	(*unpack)->thread.write_callback = &unpack_write_callback;
 	(*unpack)->thread.finish_callback = &unpack_finish_callback;
 	(*unpack)->thread.threads = glc_threads_hint(glc);
+	(*unpack)->thread.name = "unpack";
 
 #ifdef __LZO
 	lzo_init();
@@ -78,6 +78,9 @@ struct pipe_runtime_s
 	glc_stream_id_t id;
 	struct timespec wait_time;
 	int write_frame_ret;
+	/* stream has repeats, last frame is kept in its held read packet */
+	int repeats;
+	char *last_frame;
 };
 
 typedef struct {
@@ -162,6 +165,7 @@ int pipe_sink_init(sink_t *sink, glc_t *glc, const char *exec_file,
 	pipe_sink->thread.close_callback  = &pipe_close_callback;
 	pipe_sink->thread.finish_callback = &pipe_finish_callback;
 	pipe_sink->thread.threads = 1;
+	pipe_sink->thread.name = "pipe";
 
 	tracker_init(&pipe_sink->state_tracker, pipe_sink->glc);
 
@@ -336,6 +340,10 @@ static int open_pipe(pipe_sink_t *pipe_sink, glc_video_format_message_t *format,
 		return EINVAL;
 	}
 
+	/* repeated frames are written again from the last frame packet */
+	pipe_sink->runtime.last_frame = NULL;
+	pipe_sink->runtime.repeats = !!(format->flags & GLC_VIDEO_REPEATS);
+
 	if (unlikely((ret = pipe(stream_pipe)) < 0)) {
 		glc_log(pipe_sink->glc, GLC_ERROR, "pipe", "error creating pipe: %s (%d)",
 			strerror(errno), errno);
@@ -580,6 +588,26 @@ int pipe_read_callback(glc_thread_state_t *state)
 				pipe_sink->runtime.write_frame_ret = write_video_frame(pipe_sink,
 					&state->read_data[sizeof(glc_video_frame_header_t)]
 				);
+			if (pipe_sink->runtime.repeats) {
+				state->flags |= GLC_THREAD_STATE_HOLD_READ;
+				pipe_sink->runtime.last_frame =
+					&state->read_data[sizeof(glc_video_frame_header_t)];
+			}
+			break;
+		}
+		case GLC_MESSAGE_VIDEO_REPEAT:
+		{
+			glc_video_frame_header_t *pic_hdr =
+				(glc_video_frame_header_t *)state->read_data;
+
+			/* nothing to repeat before the first frame */
+			if (unlikely((pipe_sink->runtime.w_pipefd < 0) ||
+				     (!pipe_sink->runtime.last_frame) ||
+				     (pic_hdr->id != pipe_sink->runtime.id)))
+				return 0;
+			if (likely(pic_hdr->time >= pipe_sink->runtime.first_frame_ts))
+				pipe_sink->runtime.write_frame_ret = write_video_frame(pipe_sink,
+					pipe_sink->runtime.last_frame);
 			break;
 		}
 		case GLC_MESSAGE_CLOSE: // noop
@@ -663,6 +691,9 @@ child_gone:
 			glcs_signal_pr_exit(glc, rt->consumer_proc, status);
 		rt->consumer_proc = 0;
 	}
+
+	/* held packet is let go with the next frame or the thread */
+	rt->last_frame = NULL;
 }
 
 /*
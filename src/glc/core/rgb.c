@@ -107,6 +107,13 @@ struct rgb_video_stream_s {
 	struct rgb_video_stream_s *next;
 };
 
+/* argument for stripe workers */
+struct rgb_stripe_s {
+	rgb_t rgb;
+	struct rgb_video_stream_s *ctx;
+	unsigned char *from, *to;
+};
+
 struct rgb_s {
 	glc_t *glc;
 	glc_thread_t thread;
@@ -127,8 +134,10 @@ static void rgbget_video_stream(rgb_t rgb, glc_stream_id_t id,
 static int rgb_video_format_message(rgb_t rgb, glc_video_format_message_t *video_format_message);
 
 static int rgb_init_lookup(rgb_t rgb);
+static void rgb_stripe(void *arg, unsigned int first, unsigned int last);
 static int rgb_convert_lookup(rgb_t rgb, struct rgb_video_stream_s *ctx,
-		       unsigned char *from, unsigned char *to);
+		       unsigned char *from, unsigned char *to,
+		       unsigned int first, unsigned int last);
 
 int rgb_init(rgb_t *rgb, glc_t *glc)
 {
@@ -138,12 +147,14 @@ int rgb_init(rgb_t *rgb, glc_t *glc)
 
 	rgb_init_lookup(*rgb);
 
-	(*rgb)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*rgb)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+			       GLC_THREAD_FORWARD_REF;
 	(*rgb)->thread.read_callback = &rgb_read_callback;
 	(*rgb)->thread.write_callback = &rgb_write_callback;
 	(*rgb)->thread.finish_callback = &rgb_finish_callback;
 	(*rgb)->thread.ptr = *rgb;
 	(*rgb)->thread.threads = glc_threads_hint(glc);
+	(*rgb)->thread.name = "rgb";
 
 	return 0;
 }
@@ -167,6 +178,14 @@ int rgb_process_start(rgb_t rgb, ps_buffer_t *from, ps_buffer_t *to)
 	return ret;
 }
 
+int rgb_chain_append(rgb_t rgb, chain_t chain)
+{
+	if (unlikely(rgb->running))
+		return EAGAIN;
+
+	return chain_append(chain, &rgb->thread);
+}
+
 int rgb_process_wait(rgb_t rgb)
 {
 	if (unlikely(!rgb->running))
@@ -227,16 +246,27 @@ int rgb_write_callback(glc_thread_state_t *state)
 {
 	rgb_t rgb = (rgb_t) state->ptr;
 	struct rgb_video_stream_s *ctx = state->threadptr;
+	struct rgb_stripe_s stripe;
 
 	memcpy(state->write_data, state->read_data, sizeof(glc_video_frame_header_t));
-	rgb_convert_lookup(rgb, ctx,
-		    (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
-		    (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)]);
+	stripe.rgb  = rgb;
+	stripe.ctx  = ctx;
+	stripe.from = (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)];
+	stripe.to   = (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)];
+	glc_stripe_run(rgb->glc, &rgb_stripe, &stripe, ctx->h / 2);
 	pthread_rwlock_unlock(&ctx->update);
 
 	return 0;
 }
 
+void rgb_stripe(void *arg, unsigned int first, unsigned int last)
+{
+	struct rgb_stripe_s *stripe = (struct rgb_stripe_s *) arg;
+
+	rgb_convert_lookup(stripe->rgb, stripe->ctx, stripe->from, stripe->to,
+			   first, last);
+}
+
 void rgbget_video_stream(rgb_t rgb, glc_stream_id_t id,
 		struct rgb_video_stream_s **ctx)
 {
@@ -304,7 +334,8 @@ int rgb_init_lookup(rgb_t rgb)
 }
 
 int rgb_convert_lookup(rgb_t rgb, struct rgb_video_stream_s *video,
-		       unsigned char *from, unsigned char *to)
+		       unsigned char *from, unsigned char *to,
+		       unsigned int first, unsigned int last)
 {
 	unsigned int x, y, Cpix;
 	unsigned int color;
@@ -313,7 +344,7 @@ int rgb_convert_lookup(rgb_t rgb, struct rgb_video_stream_s *video,
 	Y = from;
 	Cb = &from[video->h * video->w];
 	Cr = &from[video->h * video->w + (video->h / 2) * (video->w / 2)];
-	Cpix = 0;
+	Cpix = first * (video->w / 2);
 
 #define CONVERT(xadd, yrgbadd, yadd) 						\
 	color = LOOKUP_POS(Y[(x + (xadd)) + (y + (yadd)) * video->w],		\
@@ -326,7 +357,7 @@ int rgb_convert_lookup(rgb_t rgb, struct rgb_video_stream_s *video,
 		rgb->lookup_table[color + 2];
 
 	/* YCBCR_420JPEG frame dimensions are always divisible by two */
-	for (y = 0; y < video->h; y += 2) {
+	for (y = first * 2; y < last * 2; y += 2) {
 		for (x = 0; x < video->w; x += 2) {
 			CONVERT(0, -1, 0)
 			CONVERT(1, -1, 0)
@@ -18,6 +18,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/core/chain.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -55,6 +56,17 @@ __PUBLIC int rgb_destroy(rgb_t rgb);
  */
 __PUBLIC int rgb_process_start(rgb_t rgb, ps_buffer_t *from, ps_buffer_t *to);
 
+/**
+ * \brief run rgb as part of a filter chain
+ *
+ * rgb is then run by the chain workers and rgb_process_start()
+ * must not be used.
+ * \param rgb rgb object
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int rgb_chain_append(rgb_t rgb, chain_t chain);
+
 /**
  * \brief block until process has finished
  * \param rgb rgb object
@@ -50,10 +50,13 @@
 
 struct scale_video_stream_s;
 
+/* processes rows [first, last) out of video->rows */
 typedef void (*scale_proc)(scale_t scale,
 			   struct scale_video_stream_s *video,
 			   unsigned char *from,
-			   unsigned char *to);
+			   unsigned char *to,
+			   unsigned int first,
+			   unsigned int last);
 
 struct scale_video_stream_s {
 	glc_stream_id_t id;
@@ -71,11 +74,19 @@ struct scale_video_stream_s {
 	float *factor;
 
 	scale_proc proc;
+	unsigned int rows;
 
 	pthread_rwlock_t update;
 	struct scale_video_stream_s *next;
 };
 
+/* argument for stripe workers */
+struct scale_stripe_s {
+	scale_t scale;
+	struct scale_video_stream_s *video;
+	unsigned char *from, *to;
+};
+
 struct scale_s {
 	glc_t *glc;
 	glc_flags_t flags;
@@ -97,17 +108,25 @@ static int scale_get_video_stream(scale_t scale, glc_stream_id_t id, struct scal
 static int scale_generate_rgb_map(scale_t scale, struct scale_video_stream_s *video);
 static int scale_generate_ycbcr_map(scale_t scale, struct scale_video_stream_s *video);
 
+static void scale_stripe(void *arg, unsigned int first, unsigned int last);
+
 static void scale_rgb_convert(scale_t scale, struct scale_video_stream_s *video,
-		       unsigned char *from, unsigned char *to);
+		       unsigned char *from, unsigned char *to,
+		       unsigned int first, unsigned int last);
 static void scale_rgb_half(scale_t scale, struct scale_video_stream_s *video,
-		    unsigned char *from, unsigned char *to);
+		    unsigned char *from, unsigned char *to,
+		    unsigned int first, unsigned int last);
 static void scale_rgb_scale(scale_t scale, struct scale_video_stream_s *video,
-		     unsigned char *from, unsigned char *to);
+		     unsigned char *from, unsigned char *to,
+		     unsigned int first, unsigned int last);
 
+/* Y'CbCr procs work on the whole frame, video->rows is 1 */
 static void scale_ycbcr_half(scale_t scale, struct scale_video_stream_s *video,
-		      unsigned char *from, unsigned char *to);
+		      unsigned char *from, unsigned char *to,
+		      unsigned int first, unsigned int last);
 static void scale_ycbcr_scale(scale_t scale, struct scale_video_stream_s *video,
-		       unsigned char *from, unsigned char *to);
+		       unsigned char *from, unsigned char *to,
+		       unsigned int first, unsigned int last);
 
 int scale_init(scale_t *scale, glc_t *glc)
 {
@@ -115,12 +134,14 @@ int scale_init(scale_t *scale, glc_t *glc)
 
 	(*scale)->glc = glc;
 
-	(*scale)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*scale)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_FORWARD_REF;
 	(*scale)->thread.read_callback = &scale_read_callback;
 	(*scale)->thread.write_callback = &scale_write_callback;
 	(*scale)->thread.finish_callback = &scale_finish_callback;
 	(*scale)->thread.ptr = *scale;
 	(*scale)->thread.threads = glc_threads_hint(glc);
+	(*scale)->thread.name = "scale";
 	(*scale)->scale = 1.0;
 
 	return 0;
@@ -166,6 +187,14 @@ int scale_process_start(scale_t scale, ps_buffer_t *from, ps_buffer_t *to)
 	return 0;
 }
 
+int scale_chain_append(scale_t scale, chain_t chain)
+{
+	if (unlikely(scale->flags & SCALE_RUNNING))
+		return EAGAIN;
+
+	return chain_append(chain, &scale->thread);
+}
+
 int scale_process_wait(scale_t scale)
 {
 	if (unlikely(!(scale->flags & SCALE_RUNNING)))
@@ -230,16 +259,27 @@ int scale_read_callback(glc_thread_state_t *state) {
 int scale_write_callback(glc_thread_state_t *state) {
 	scale_t scale = (scale_t) state->ptr;
 	struct scale_video_stream_s *video = state->threadptr;
+	struct scale_stripe_s stripe;
 
 	memcpy(state->write_data, state->read_data, sizeof(glc_video_frame_header_t));
-	video->proc(scale, video,
-		  (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
-		  (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)]);
+	stripe.scale = scale;
+	stripe.video = video;
+	stripe.from  = (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)];
+	stripe.to    = (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)];
+	glc_stripe_run(scale->glc, &scale_stripe, &stripe, video->rows);
 	pthread_rwlock_unlock(&video->update);
 
 	return 0;
 }
 
+void scale_stripe(void *arg, unsigned int first, unsigned int last)
+{
+	struct scale_stripe_s *stripe = (struct scale_stripe_s *) arg;
+
+	stripe->video->proc(stripe->scale, stripe->video,
+			    stripe->from, stripe->to, first, last);
+}
+
 int scale_get_video_stream(scale_t scale, glc_stream_id_t id, struct scale_video_stream_s **video)
 {
 	struct scale_video_stream_s *list = scale->video;
@@ -265,15 +305,17 @@ int scale_get_video_stream(scale_t scale, glc_stream_id_t id, struct scale_video
 }
 
 void scale_rgb_convert(scale_t scale, struct scale_video_stream_s *video,
-		       unsigned char *from, unsigned char *to)
+		       unsigned char *from, unsigned char *to,
+		       unsigned int first, unsigned int last)
 {
 	unsigned int x, y, ox, oy, op, tp;
 	unsigned int swi = video->sw * 3;
-	unsigned int shi = video->sh * 3;
-	ox = oy = 0;
+	unsigned int shi = last * 3;
+	ox = 0;
+	oy = first;
 
 	/* just convert from different bpp to 3 */
-	for (y = 0; y < shi; y += 3) {
+	for (y = first * 3; y < shi; y += 3) {
 		for (x = 0; x < swi; x += 3) {
 			tp = x + y * video->sw;
 			op = ox + oy * video->row;
@@ -290,11 +332,13 @@ void scale_rgb_convert(scale_t scale, struct scale_video_stream_s *video,
 }
 
 void scale_rgb_half(scale_t scale, struct scale_video_stream_s *video,
-		    unsigned char *from, unsigned char *to)
+		    unsigned char *from, unsigned char *to,
+		    unsigned int first, unsigned int last)
 {
 	unsigned int ox, oy, op1, op2, op3, op4;
 
-	for (oy = 0; oy < video->h; oy += 2) {
+	to += first * ((video->w + 1) / 2) * 3;
+	for (oy = first * 2; (oy < last * 2) && (oy < video->h); oy += 2) {
 		for (ox = 0; ox < video->w; ox += 2) {
 			op1 = ox * video->bpp + oy * video->row;
 			op2 = op1 + video->bpp;
@@ -319,14 +363,19 @@ void scale_rgb_half(scale_t scale, struct scale_video_stream_s *video,
 }
 
 void scale_rgb_scale(scale_t scale, struct scale_video_stream_s *video,
-		     unsigned char *from, unsigned char *to)
+		     unsigned char *from, unsigned char *to,
+		     unsigned int first, unsigned int last)
 {
-	unsigned int x, y, tp, sp;
+	unsigned int x, y, tp, sp, top, bottom;
 
-	if (scale->flags & SCALE_SIZE)
-		memset(to, 0, video->size);
+	if (scale->flags & SCALE_SIZE) {
+		/* first and last stripes also clear the borders */
+		top = first ? first + video->ry : 0;
+		bottom = (last == video->sh) ? video->rh : last + video->ry;
+		memset(&to[top * video->rw * 3], 0, (bottom - top) * video->rw * 3);
+	}
 
-	for (y = 0; y < video->sh; y++) {
+	for (y = first; y < last; y++) {
 		for (x = 0; x < video->sw; x++) {
 			sp = (x + y * video->sw) * 4;
 			tp = ((x + video->rx) + (y + video->ry) * video->rw) * 3;
@@ -348,7 +397,8 @@ void scale_rgb_scale(scale_t scale, struct scale_video_stream_s *video,
 }
 
 void scale_ycbcr_half(scale_t scale, struct scale_video_stream_s *video,
-		      unsigned char *from, unsigned char *to)
+		      unsigned char *from, unsigned char *to,
+		      unsigned int first, unsigned int last)
 {
 	unsigned int x, y, ox, oy, cw_from, ch_from, cw_to, ch_to, op1, op2, op3, op4;
 	unsigned char *Cb_to, *Cr_to;
@@ -408,7 +458,8 @@ void scale_ycbcr_half(scale_t scale, struct scale_video_stream_s *video,
 }
 
 void scale_ycbcr_scale(scale_t scale, struct scale_video_stream_s *video,
-		       unsigned char *from, unsigned char *to)
+		       unsigned char *from, unsigned char *to,
+		       unsigned int first, unsigned int last)
 {
 	unsigned int x, y, sp, cw, ch;
 	unsigned char *Y_to, *Cb_to, *Cr_to;
@@ -467,10 +518,15 @@ int scale_video_format_message(scale_t scale,
 {
 	struct scale_video_stream_s *video;
 	glc_flags_t old_flags;
+	int scaled;
 
 	scale_get_video_stream(scale, format_message->id, &video);
 	pthread_rwlock_wrlock(&video->update);
 
+	/* picture was scaled on GPU */
+	scaled = format_message->flags & GLC_VIDEO_SCALED;
+	format_message->flags &= ~GLC_VIDEO_SCALED;
+
 	old_flags = video->flags;
 	video->flags = format_message->flags;
 	video->format = format_message->format;
@@ -494,7 +550,7 @@ int scale_video_format_message(scale_t scale,
 			 "real size is %ux%u, scaled picture starts at %ux%u",
 			 video->rw, video->rh, video->rx, video->ry);
 	} else {
-		video->scale = scale->scale;
+		video->scale = scaled ? 1.0 : scale->scale;
 		video->sw = video->scale * video->w;
 		video->sh = video->scale * video->h;
 
@@ -527,16 +583,19 @@ int scale_video_format_message(scale_t scale,
 				 "scaling RGB data to half-size (from %ux%u to %ux%u)",
 				 video->w, video->h, video->sw, video->sh);
 			video->proc = scale_rgb_half;
+			video->rows = (video->h + 1) / 2;
 		} else if ((video->rw == video->w) &&
 			   (video->rh == video->h) &&
 			   (video->format == GLC_VIDEO_BGRA)) {
 			glc_log(scale->glc, GLC_DEBUG, "scale", "converting BGRA to BGR");
 			video->proc = scale_rgb_convert;
+			video->rows = video->sh;
 		} else if ((video->rw != video->w) | (video->rh != video->h)) {
 			glc_log(scale->glc, GLC_DEBUG, "scale",
 				 "scaling RGB data with factor %f (from %ux%u to %ux%u)",
 				 video->scale, video->w, video->h, video->sw, video->sh);
 			video->proc = scale_rgb_scale;
+			video->rows = video->sh;
 			scale_generate_rgb_map(scale, video);
 		}
 
@@ -567,11 +626,13 @@ int scale_video_format_message(scale_t scale,
 				 "scaling Y'CbCr data to half-size (from %ux%u to %ux%u)",
 				 video->w, video->h, video->sw, video->sh);
 			video->proc = scale_ycbcr_half;
+			video->rows = 1;
 		} else if ((video->rw != video->w) || (video->rh != video->h)) {
 			glc_log(scale->glc, GLC_DEBUG, "scale",
 				 "scaling Y'CbCr data with factor %f (from %ux%u to %ux%u)",
 				 video->scale, video->w, video->h, video->sw, video->sh);
 			video->proc = scale_ycbcr_scale;
+			video->rows = 1;
 			scale_generate_ycbcr_map(scale, video);
 		}
 
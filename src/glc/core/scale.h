@@ -18,6 +18,7 @@
 
 #include <packetstream.h>
 #include <glc/common/glc.h>
+#include <glc/core/chain.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,17 @@ __PUBLIC int scale_set_size(scale_t scale, unsigned int width,
 __PUBLIC int scale_process_start(scale_t scale, ps_buffer_t *from,
 				 ps_buffer_t *to);
 
+/**
+ * \brief run scale as part of a filter chain
+ *
+ * scale is then run by the chain workers and scale_process_start()
+ * must not be used.
+ * \param scale scale object
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int scale_chain_append(scale_t scale, chain_t chain);
+
 /**
  * \brief block until current process has finished
  * \param scale scale object
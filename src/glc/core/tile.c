@@ -0,0 +1,1027 @@
+/**
+ * \file glc/core/tile.c
+ * \brief tile based frame differencing
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup tile
+ *  \{
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <packetstream.h>
+#include <errno.h>
+
+#include <glc/common/glc.h>
+#include <glc/common/core.h>
+#include <glc/common/log.h>
+#include <glc/common/state.h>
+#include <glc/common/thread.h>
+#include <glc/common/optimization.h>
+
+#include "tile.h"
+
+/** busy stream is waited for in steps of this, cancel is checked between */
+#define UNTILE_WAIT_NS 100000000
+
+struct tile_plane_s {
+	size_t offset;
+	size_t stride;
+	unsigned int bpp;   /* bytes per pixel */
+	unsigned int shift; /* chroma subsampling */
+};
+
+/* frame layout and tile grid, shared by tile and untile */
+struct tile_layout_s {
+	unsigned int w, h;
+	size_t size;
+	unsigned int num_planes;
+	struct tile_plane_s plane[3];
+
+	unsigned int tile;
+	unsigned int tiles_x, tiles_y;
+};
+
+struct tile_video_stream_s {
+	glc_stream_id_t id;
+	int tiled;
+	struct tile_layout_s layout;
+
+	char *prev;
+	int prev_valid;
+	unsigned int since_key;
+
+	unsigned long frames, tiled_frames;
+	size_t frame_bytes, sent_bytes;
+
+	/* taken by read callbacks only, write callbacks use the result */
+	pthread_mutex_t update;
+	struct tile_video_stream_s *next;
+};
+
+/* comparison result of the packet in flight, one per thread */
+struct tile_result_s {
+	struct tile_layout_s layout;
+	unsigned char *dirty;
+	u_int32_t *index;
+	unsigned int num_tiles;
+	unsigned int count;
+	size_t payload;
+};
+
+/* argument for stripe workers */
+struct tile_stripe_s {
+	struct tile_video_stream_s *video;
+	struct tile_result_s *result;
+	const char *frame;
+};
+
+struct tile_s {
+	glc_t *glc;
+	glc_thread_t thread;
+	int running;
+
+	unsigned int size;
+	unsigned int key_interval;
+
+	struct tile_video_stream_s *video;
+};
+
+struct untile_video_stream_s {
+	glc_stream_id_t id;
+	int tiled;
+	struct tile_layout_s layout;
+
+	char *frame;
+	int frame_valid;
+
+	/*
+	 * frame is being written out by a write callback, it must not
+	 * change meanwhile. Guarded by update, cleared by the thread
+	 * that set it, even if its write callback never runs.
+	 */
+	int busy;
+	pthread_mutex_t update;
+	pthread_cond_t idle;
+	struct untile_video_stream_s *next;
+};
+
+/* stream a thread has marked busy */
+struct untile_thread_s {
+	struct untile_video_stream_s *busy;
+};
+
+struct untile_s {
+	glc_t *glc;
+	glc_thread_t thread;
+	int running;
+
+	struct untile_video_stream_s *video;
+};
+
+static int tile_layout_init(struct tile_layout_s *layout,
+			    glc_video_format_message_t *format);
+static void tile_layout_grid(struct tile_layout_s *layout, unsigned int tile);
+static void tile_rect(struct tile_layout_s *layout, unsigned int p, u_int32_t t,
+		      size_t *offset, size_t *width, unsigned int *rows);
+static size_t tile_bytes(struct tile_layout_s *layout, u_int32_t t);
+
+static int tile_thread_create_callback(void *ptr, void **threadptr);
+static void tile_thread_finish_callback(void *ptr, void *threadptr, int err);
+static int tile_read_callback(glc_thread_state_t *state);
+static int tile_write_callback(glc_thread_state_t *state);
+static void tile_finish_callback(void *ptr, int err);
+
+static int tile_get_video_stream(tile_t tile, glc_stream_id_t id,
+				 struct tile_video_stream_s **video);
+static int tile_video_format_message(tile_t tile,
+				     glc_video_format_message_t *format);
+static int tile_video_frame_message(tile_t tile, struct tile_video_stream_s *video,
+				    glc_thread_state_t *state);
+static void tile_stripe(void *arg, unsigned int first, unsigned int last);
+static int tile_compare(struct tile_video_stream_s *video, const char *frame,
+			u_int32_t t);
+
+static int untile_thread_create_callback(void *ptr, void **threadptr);
+static void untile_thread_finish_callback(void *ptr, void *threadptr, int err);
+static int untile_lock(untile_t untile, struct untile_video_stream_s *video);
+static void untile_release(struct untile_thread_s *thread);
+static int untile_read_callback(glc_thread_state_t *state);
+static int untile_write_callback(glc_thread_state_t *state);
+static void untile_finish_callback(void *ptr, int err);
+
+static int untile_get_video_stream(untile_t untile, glc_stream_id_t id,
+				   struct untile_video_stream_s **video);
+static int untile_video_format_message(untile_t untile,
+				       glc_video_format_message_t *format);
+static int untile_video_frame_message(untile_t untile, glc_thread_state_t *state);
+static int untile_video_tiles_message(untile_t untile, glc_thread_state_t *state);
+static int untile_apply(struct untile_video_stream_s *video, const char *data,
+			size_t size);
+
+/**
+ * \brief frame layout of a video format
+ * \return 0 on success, ENOTSUP if format can't be tiled
+ */
+int tile_layout_init(struct tile_layout_s *layout,
+		     glc_video_format_message_t *format)
+{
+	memset(layout, 0, sizeof(struct tile_layout_s));
+	layout->w = format->width;
+	layout->h = format->height;
+
+	if ((format->format == GLC_VIDEO_BGR) ||
+	    (format->format == GLC_VIDEO_RGB) ||
+	    (format->format == GLC_VIDEO_BGRA)) {
+		layout->num_planes = 1;
+		layout->plane[0].bpp = (format->format == GLC_VIDEO_BGRA) ? 4 : 3;
+		layout->plane[0].stride = layout->w * layout->plane[0].bpp;
+		if ((format->flags & GLC_VIDEO_DWORD_ALIGNED) &&
+		    (layout->plane[0].stride % 8))
+			layout->plane[0].stride += 8 - layout->plane[0].stride % 8;
+		layout->size = layout->plane[0].stride * layout->h;
+	} else if (format->format == GLC_VIDEO_YCBCR_420JPEG) {
+		/* YCBCR_420JPEG frame dimensions are always divisible by two */
+		layout->num_planes = 3;
+		layout->plane[0].bpp = 1;
+		layout->plane[0].stride = layout->w;
+		layout->plane[1].bpp = 1;
+		layout->plane[1].stride = layout->w / 2;
+		layout->plane[1].shift = 1;
+		layout->plane[1].offset = layout->w * layout->h;
+		layout->plane[2] = layout->plane[1];
+		layout->plane[2].offset += (layout->w / 2) * (layout->h / 2);
+		layout->size = layout->plane[2].offset + (layout->w / 2) * (layout->h / 2);
+	} else
+		return ENOTSUP;
+
+	if (unlikely((!layout->w) || (!layout->h)))
+		return ENOTSUP;
+	return 0;
+}
+
+void tile_layout_grid(struct tile_layout_s *layout, unsigned int tile)
+{
+	layout->tile = tile;
+	layout->tiles_x = (layout->w + tile - 1) / tile;
+	layout->tiles_y = (layout->h + tile - 1) / tile;
+}
+
+/**
+ * \brief area of a tile in a plane
+ *
+ * Offset and width are in bytes, edge tiles are clipped.
+ */
+void tile_rect(struct tile_layout_s *layout, unsigned int p, u_int32_t t,
+	       size_t *offset, size_t *width, unsigned int *rows)
+{
+	struct tile_plane_s *plane = &layout->plane[p];
+	unsigned int x0, y0, x1, y1;
+
+	x0 = (t % layout->tiles_x) * layout->tile;
+	y0 = (t / layout->tiles_x) * layout->tile;
+	x1 = x0 + layout->tile;
+	y1 = y0 + layout->tile;
+	if (x1 > layout->w)
+		x1 = layout->w;
+	if (y1 > layout->h)
+		y1 = layout->h;
+
+	x0 >>= plane->shift;
+	y0 >>= plane->shift;
+	x1 >>= plane->shift;
+	y1 >>= plane->shift;
+
+	*offset = plane->offset + y0 * plane->stride + x0 * plane->bpp;
+	*width = (x1 - x0) * plane->bpp;
+	*rows = y1 - y0;
+}
+
+size_t tile_bytes(struct tile_layout_s *layout, u_int32_t t)
+{
+	size_t offset, width, bytes = 0;
+	unsigned int p, rows;
+
+	for (p = 0; p < layout->num_planes; p++) {
+		tile_rect(layout, p, t, &offset, &width, &rows);
+		bytes += width * rows;
+	}
+	return bytes;
+}
+
+int tile_init(tile_t *tile, glc_t *glc)
+{
+	*tile = (tile_t) calloc(1, sizeof(struct tile_s));
+	if (unlikely(!*tile))
+		return ENOMEM;
+
+	(*tile)->glc = glc;
+	(*tile)->size = TILE_DEFAULT_SIZE;
+	(*tile)->key_interval = TILE_DEFAULT_KEY_INTERVAL;
+
+	/*
+	 * Every frame is compared with the previous one,
+	 * comparison itself is split between stripe workers.
+	 * Frames sent in full move on by reference, so the next
+	 * buffer only has to hold tiles messages.
+	 */
+	(*tile)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				GLC_THREAD_FORWARD_REF | GLC_THREAD_NEW_REF;
+	(*tile)->thread.thread_create_callback = &tile_thread_create_callback;
+	(*tile)->thread.thread_finish_callback = &tile_thread_finish_callback;
+	(*tile)->thread.read_callback = &tile_read_callback;
+	(*tile)->thread.write_callback = &tile_write_callback;
+	(*tile)->thread.finish_callback = &tile_finish_callback;
+	(*tile)->thread.ptr = *tile;
+	(*tile)->thread.threads = 1;
+	(*tile)->thread.name = "tile";
+
+	return 0;
+}
+
+int tile_set_size(tile_t tile, unsigned int size)
+{
+	if (unlikely(tile->running))
+		return EALREADY;
+	if (unlikely((!size) || (size % 2)))
+		return EINVAL;
+
+	tile->size = size;
+	return 0;
+}
+
+int tile_set_key_interval(tile_t tile, unsigned int interval)
+{
+	if (unlikely(tile->running))
+		return EALREADY;
+
+	tile->key_interval = interval;
+	return 0;
+}
+
+int tile_destroy(tile_t tile)
+{
+	free(tile);
+	return 0;
+}
+
+int tile_process_start(tile_t tile, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (unlikely(tile->running))
+		return EAGAIN;
+
+	if (likely(!(ret = glc_thread_create(tile->glc, &tile->thread, from, to))))
+		tile->running = 1;
+
+	return ret;
+}
+
+int tile_process_wait(tile_t tile)
+{
+	if (unlikely(!tile->running))
+		return EAGAIN;
+
+	glc_thread_wait(&tile->thread);
+	tile->running = 0;
+
+	return 0;
+}
+
+void tile_finish_callback(void *ptr, int err)
+{
+	tile_t tile = (tile_t) ptr;
+	struct tile_video_stream_s *del;
+
+	if (unlikely(err))
+		glc_log(tile->glc, GLC_ERROR, "tile", "%s (%d)", strerror(err), err);
+
+	while (tile->video != NULL) {
+		del = tile->video;
+		tile->video = tile->video->next;
+
+		if (del->frames)
+			glc_log(tile->glc, GLC_PERF, "tile",
+				"video %d: %lu of %lu frames sent as tiles, %zd of %zd bytes",
+				del->id, del->tiled_frames, del->frames,
+				del->sent_bytes, del->frame_bytes);
+
+		pthread_mutex_destroy(&del->update);
+		free(del->prev);
+		free(del);
+	}
+}
+
+int tile_thread_create_callback(void *ptr, void **threadptr)
+{
+	*threadptr = calloc(1, sizeof(struct tile_result_s));
+	if (unlikely(!*threadptr))
+		return ENOMEM;
+	return 0;
+}
+
+void tile_thread_finish_callback(void *ptr, void *threadptr, int err)
+{
+	struct tile_result_s *result = (struct tile_result_s *) threadptr;
+
+	if (!result)
+		return;
+	free(result->dirty);
+	free(result->index);
+	free(result);
+}
+
+int tile_read_callback(glc_thread_state_t *state)
+{
+	tile_t tile = (tile_t) state->ptr;
+	struct tile_video_stream_s *video;
+	glc_video_frame_header_t *pic_hdr;
+	int ret;
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT) {
+		if (unlikely((ret = tile_video_format_message(tile,
+				(glc_video_format_message_t *) state->read_data))))
+			return ret;
+	} else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME) {
+		pic_hdr = (glc_video_frame_header_t *) state->read_data;
+		if (unlikely((ret = tile_get_video_stream(tile, pic_hdr->id, &video))))
+			return ret;
+		return tile_video_frame_message(tile, video, state);
+	} else if (state->header.type == GLC_CALLBACK_REQUEST) {
+		/* sink might start a new file, it must begin with full frames */
+		for (video = tile->video; video != NULL; video = video->next) {
+			pthread_mutex_lock(&video->update);
+			video->prev_valid = 0;
+			pthread_mutex_unlock(&video->update);
+		}
+	}
+
+	state->flags |= GLC_THREAD_COPY;
+	return 0;
+}
+
+int tile_write_callback(glc_thread_state_t *state)
+{
+	struct tile_result_s *result = (struct tile_result_s *) state->threadptr;
+	glc_video_tiles_header_t *tiles_hdr = (glc_video_tiles_header_t *) state->write_data;
+	const char *frame = &state->read_data[sizeof(glc_video_frame_header_t)];
+	char *to;
+	size_t offset, width;
+	unsigned int i, p, r, rows;
+
+	memcpy(&tiles_hdr->frame, state->read_data, sizeof(glc_video_frame_header_t));
+	tiles_hdr->size = result->layout.tile;
+	tiles_hdr->count = result->count;
+
+	to = &state->write_data[sizeof(glc_video_tiles_header_t)];
+	memcpy(to, result->index, result->count * sizeof(u_int32_t));
+	to += result->count * sizeof(u_int32_t);
+
+	for (i = 0; i < result->count; i++) {
+		for (p = 0; p < result->layout.num_planes; p++) {
+			tile_rect(&result->layout, p, result->index[i], &offset, &width, &rows);
+			for (r = 0; r < rows; r++) {
+				memcpy(to, &frame[offset], width);
+				offset += result->layout.plane[p].stride;
+				to += width;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int tile_get_video_stream(tile_t tile, glc_stream_id_t id,
+			  struct tile_video_stream_s **video)
+{
+	*video = tile->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			return 0;
+		*video = (*video)->next;
+	}
+
+	*video = (struct tile_video_stream_s *)
+		calloc(1, sizeof(struct tile_video_stream_s));
+	if (unlikely(!*video))
+		return ENOMEM;
+
+	(*video)->id = id;
+	pthread_mutex_init(&(*video)->update, NULL);
+	(*video)->next = tile->video;
+	tile->video = *video;
+	return 0;
+}
+
+int tile_video_format_message(tile_t tile, glc_video_format_message_t *format)
+{
+	struct tile_video_stream_s *video;
+	void *ptr;
+	int ret;
+
+	if (unlikely((ret = tile_get_video_stream(tile, format->id, &video))))
+		return ret;
+
+	pthread_mutex_lock(&video->update);
+
+	/* next frame is sent in full */
+	video->tiled = 0;
+	video->prev_valid = 0;
+
+	if (tile_layout_init(&video->layout, format)) {
+		glc_log(tile->glc, GLC_WARN, "tile",
+			"video %d: can't tile format 0x%02x, frames are sent in full",
+			format->id, format->format);
+		goto unlock;
+	}
+	tile_layout_grid(&video->layout, tile->size);
+
+	if (unlikely(!(ptr = realloc(video->prev, video->layout.size)))) {
+		ret = ENOMEM;
+		goto unlock;
+	}
+	video->prev = (char *) ptr;
+
+	video->tiled = 1;
+	format->flags |= GLC_VIDEO_TILES;
+
+	glc_log(tile->glc, GLC_DEBUG, "tile",
+		"video %d: %ux%u tiles of %ux%u pixels", format->id,
+		video->layout.tiles_x, video->layout.tiles_y,
+		video->layout.tile, video->layout.tile);
+unlock:
+	pthread_mutex_unlock(&video->update);
+	return ret;
+}
+
+int tile_video_frame_message(tile_t tile, struct tile_video_stream_s *video,
+			     glc_thread_state_t *state)
+{
+	struct tile_result_s *result = (struct tile_result_s *) state->threadptr;
+	const char *frame = &state->read_data[sizeof(glc_video_frame_header_t)];
+	unsigned int t, num_tiles;
+	struct tile_stripe_s stripe;
+	size_t size;
+	void *ptr;
+	int ret = 0;
+
+	/*
+	 * Only the comparison needs the stream, what the write
+	 * callback needs is kept in the result of this thread.
+	 */
+	pthread_mutex_lock(&video->update);
+	if (!video->tiled)
+		goto copy;
+	num_tiles = video->layout.tiles_x * video->layout.tiles_y;
+
+	if (unlikely(state->read_size < sizeof(glc_video_frame_header_t) +
+					video->layout.size)) {
+		glc_log(tile->glc, GLC_WARN, "tile",
+			"video %d: frame is too small (%zd bytes)",
+			video->id, state->read_size);
+		video->prev_valid = 0;
+		goto copy;
+	}
+
+	video->frames++;
+	video->frame_bytes += video->layout.size;
+
+	if ((!video->prev_valid) ||
+	    ((tile->key_interval) && (video->since_key + 1 >= tile->key_interval))) {
+		memcpy(video->prev, frame, video->layout.size);
+		video->prev_valid = 1;
+		goto key;
+	}
+
+	if (unlikely(result->num_tiles < num_tiles)) {
+		if (unlikely(!(ptr = realloc(result->dirty, num_tiles)))) {
+			ret = ENOMEM;
+			goto copy;
+		}
+		result->dirty = (unsigned char *) ptr;
+		if (unlikely(!(ptr = realloc(result->index, num_tiles * sizeof(u_int32_t))))) {
+			ret = ENOMEM;
+			goto copy;
+		}
+		result->index = (u_int32_t *) ptr;
+		result->num_tiles = num_tiles;
+	}
+
+	/* changed tiles are flagged and copied to prev */
+	stripe.video = video;
+	stripe.result = result;
+	stripe.frame = frame;
+	glc_stripe_run(tile->glc, &tile_stripe, &stripe, video->layout.tiles_y);
+
+	result->count = 0;
+	result->payload = 0;
+	for (t = 0; t < num_tiles; t++) {
+		if (!result->dirty[t])
+			continue;
+		result->index[result->count++] = t;
+		result->payload += tile_bytes(&video->layout, t);
+	}
+
+	/*
+	 * full frame costs about the same and can be played from,
+	 * tiles messages never take more than half a frame
+	 */
+	size = sizeof(glc_video_tiles_header_t) + result->count * sizeof(u_int32_t) +
+	       result->payload;
+	if (size * 2 > video->layout.size)
+		goto key;
+
+	result->layout = video->layout;
+	video->since_key++;
+	video->tiled_frames++;
+	video->sent_bytes += size - sizeof(glc_video_frame_header_t);
+	pthread_mutex_unlock(&video->update);
+
+	state->header.type = GLC_MESSAGE_VIDEO_TILES;
+	state->write_size = size;
+	return 0;
+key:
+	video->since_key = 0;
+	video->sent_bytes += video->layout.size;
+copy:
+	pthread_mutex_unlock(&video->update);
+	state->flags |= GLC_THREAD_COPY;
+	return ret;
+}
+
+void tile_stripe(void *arg, unsigned int first, unsigned int last)
+{
+	struct tile_stripe_s *stripe = (struct tile_stripe_s *) arg;
+	struct tile_video_stream_s *video = stripe->video;
+	u_int32_t t;
+
+	for (t = first * video->layout.tiles_x; t < last * video->layout.tiles_x; t++)
+		stripe->result->dirty[t] = tile_compare(video, stripe->frame, t);
+}
+
+/**
+ * \brief compare a tile with the previous frame
+ *
+ * A changed tile is copied to the previous frame.
+ * \return 1 if tile has changed, otherwise 0
+ */
+int tile_compare(struct tile_video_stream_s *video, const char *frame, u_int32_t t)
+{
+	size_t offset, width;
+	unsigned int p, r, rows;
+	int changed = 0;
+
+	for (p = 0; (p < video->layout.num_planes) && (!changed); p++) {
+		tile_rect(&video->layout, p, t, &offset, &width, &rows);
+		for (r = 0; r < rows; r++) {
+			if (memcmp(&video->prev[offset], &frame[offset], width)) {
+				changed = 1;
+				break;
+			}
+			offset += video->layout.plane[p].stride;
+		}
+	}
+
+	if (!changed)
+		return 0;
+
+	for (p = 0; p < video->layout.num_planes; p++) {
+		tile_rect(&video->layout, p, t, &offset, &width, &rows);
+		for (r = 0; r < rows; r++) {
+			memcpy(&video->prev[offset], &frame[offset], width);
+			offset += video->layout.plane[p].stride;
+		}
+	}
+	return 1;
+}
+
+int untile_init(untile_t *untile, glc_t *glc)
+{
+	*untile = (untile_t) calloc(1, sizeof(struct untile_s));
+	if (unlikely(!*untile))
+		return ENOMEM;
+
+	(*untile)->glc = glc;
+
+	(*untile)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				  GLC_THREAD_FORWARD_REF;
+	(*untile)->thread.thread_create_callback = &untile_thread_create_callback;
+	(*untile)->thread.thread_finish_callback = &untile_thread_finish_callback;
+	(*untile)->thread.read_callback = &untile_read_callback;
+	(*untile)->thread.write_callback = &untile_write_callback;
+	(*untile)->thread.finish_callback = &untile_finish_callback;
+	(*untile)->thread.ptr = *untile;
+	(*untile)->thread.threads = glc_threads_hint(glc);
+	(*untile)->thread.name = "untile";
+
+	return 0;
+}
+
+int untile_destroy(untile_t untile)
+{
+	free(untile);
+	return 0;
+}
+
+int untile_process_start(untile_t untile, ps_buffer_t *from, ps_buffer_t *to)
+{
+	int ret;
+	if (unlikely(untile->running))
+		return EAGAIN;
+
+	if (likely(!(ret = glc_thread_create(untile->glc, &untile->thread, from, to))))
+		untile->running = 1;
+
+	return ret;
+}
+
+int untile_chain_append(untile_t untile, chain_t chain)
+{
+	if (unlikely(untile->running))
+		return EAGAIN;
+
+	return chain_append(chain, &untile->thread);
+}
+
+int untile_process_wait(untile_t untile)
+{
+	if (unlikely(!untile->running))
+		return EAGAIN;
+
+	glc_thread_wait(&untile->thread);
+	untile->running = 0;
+
+	return 0;
+}
+
+void untile_finish_callback(void *ptr, int err)
+{
+	untile_t untile = (untile_t) ptr;
+	struct untile_video_stream_s *del;
+
+	if (unlikely(err))
+		glc_log(untile->glc, GLC_ERROR, "untile", "%s (%d)", strerror(err), err);
+
+	while (untile->video != NULL) {
+		del = untile->video;
+		untile->video = untile->video->next;
+
+		pthread_cond_destroy(&del->idle);
+		pthread_mutex_destroy(&del->update);
+		free(del->frame);
+		free(del);
+	}
+}
+
+int untile_thread_create_callback(void *ptr, void **threadptr)
+{
+	*threadptr = calloc(1, sizeof(struct untile_thread_s));
+	if (unlikely(!*threadptr))
+		return ENOMEM;
+	return 0;
+}
+
+void untile_thread_finish_callback(void *ptr, void *threadptr, int err)
+{
+	struct untile_thread_s *thread = (struct untile_thread_s *) threadptr;
+
+	if (!thread)
+		return;
+	/* write callback did not run */
+	untile_release(thread);
+	free(thread);
+}
+
+/**
+ * \brief lock a stream once its frame is not being written out
+ *
+ * A stream whose write callback failed is only released when that
+ * thread finishes, so waiting stops if capture is cancelled.
+ * \return 0 with the stream locked, EINTR if cancelled
+ */
+int untile_lock(untile_t untile, struct untile_video_stream_s *video)
+{
+	struct timespec ts;
+
+	pthread_mutex_lock(&video->update);
+	while (video->busy) {
+		if (unlikely(glc_state_test(untile->glc, GLC_STATE_CANCEL))) {
+			pthread_mutex_unlock(&video->update);
+			return EINTR;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_nsec += UNTILE_WAIT_NS;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&video->idle, &video->update, &ts);
+	}
+	return 0;
+}
+
+/**
+ * \brief let go of the stream a thread has marked busy, if any
+ */
+void untile_release(struct untile_thread_s *thread)
+{
+	struct untile_video_stream_s *video = thread->busy;
+
+	if (!video)
+		return;
+	pthread_mutex_lock(&video->update);
+	video->busy = 0;
+	pthread_cond_broadcast(&video->idle);
+	pthread_mutex_unlock(&video->update);
+	thread->busy = NULL;
+}
+
+int untile_read_callback(glc_thread_state_t *state)
+{
+	untile_t untile = (untile_t) state->ptr;
+	int ret = 0;
+
+	if (state->header.type == GLC_MESSAGE_VIDEO_FORMAT)
+		ret = untile_video_format_message(untile,
+				(glc_video_format_message_t *) state->read_data);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_FRAME)
+		ret = untile_video_frame_message(untile, state);
+	else if (state->header.type == GLC_MESSAGE_VIDEO_TILES)
+		return untile_video_tiles_message(untile, state);
+
+	state->flags |= GLC_THREAD_COPY;
+	return ret;
+}
+
+int untile_write_callback(glc_thread_state_t *state)
+{
+	struct untile_thread_s *thread = (struct untile_thread_s *) state->threadptr;
+	struct untile_video_stream_s *video = thread->busy;
+
+	/* tiles header starts with the frame header */
+	memcpy(state->write_data, state->read_data, sizeof(glc_video_frame_header_t));
+	memcpy(&state->write_data[sizeof(glc_video_frame_header_t)], video->frame,
+	       video->layout.size);
+	untile_release(thread);
+
+	return 0;
+}
+
+int untile_get_video_stream(untile_t untile, glc_stream_id_t id,
+			    struct untile_video_stream_s **video)
+{
+	pthread_condattr_t attr;
+
+	*video = untile->video;
+
+	while (*video != NULL) {
+		if ((*video)->id == id)
+			return 0;
+		*video = (*video)->next;
+	}
+
+	*video = (struct untile_video_stream_s *)
+		calloc(1, sizeof(struct untile_video_stream_s));
+	if (unlikely(!*video))
+		return ENOMEM;
+
+	(*video)->id = id;
+	pthread_mutex_init(&(*video)->update, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(*video)->idle, &attr);
+	pthread_condattr_destroy(&attr);
+	(*video)->next = untile->video;
+	untile->video = *video;
+	return 0;
+}
+
+int untile_video_format_message(untile_t untile, glc_video_format_message_t *format)
+{
+	struct untile_video_stream_s *video;
+	void *ptr;
+	int ret;
+
+	if (unlikely((ret = untile_get_video_stream(untile, format->id, &video))))
+		return ret;
+
+	if (unlikely((ret = untile_lock(untile, video))))
+		return ret;
+	video->tiled = 0;
+	video->frame_valid = 0;
+
+	if (format->flags & GLC_VIDEO_TILES) {
+		/* frames leave here complete */
+		format->flags &= ~GLC_VIDEO_TILES;
+
+		if (unlikely(tile_layout_init(&video->layout, format))) {
+			glc_log(untile->glc, GLC_ERROR, "untile",
+				"video %d: tiles of unsupported format 0x%02x",
+				format->id, format->format);
+			goto unlock;
+		}
+		if (unlikely(!(ptr = realloc(video->frame, video->layout.size)))) {
+			ret = ENOMEM;
+			goto unlock;
+		}
+		video->frame = (char *) ptr;
+		video->tiled = 1;
+	}
+unlock:
+	pthread_mutex_unlock(&video->update);
+	return ret;
+}
+
+int untile_video_frame_message(untile_t untile, glc_thread_state_t *state)
+{
+	glc_video_frame_header_t *pic_hdr = (glc_video_frame_header_t *) state->read_data;
+	struct untile_video_stream_s *video;
+	int ret;
+
+	if (unlikely((ret = untile_get_video_stream(untile, pic_hdr->id, &video))))
+		return ret;
+
+	/* tiled is only read with the stream locked, formats change it */
+	if (unlikely((ret = untile_lock(untile, video))))
+		return ret;
+	if (!video->tiled)
+		goto unlock;
+
+	if (likely(state->read_size >= sizeof(glc_video_frame_header_t) +
+				       video->layout.size)) {
+		memcpy(video->frame, &state->read_data[sizeof(glc_video_frame_header_t)],
+		       video->layout.size);
+		video->frame_valid = 1;
+	} else
+		video->frame_valid = 0;
+unlock:
+	pthread_mutex_unlock(&video->update);
+
+	return 0;
+}
+
+int untile_video_tiles_message(untile_t untile, glc_thread_state_t *state)
+{
+	glc_video_tiles_header_t *tiles_hdr = (glc_video_tiles_header_t *) state->read_data;
+	struct untile_video_stream_s *video;
+	int ret;
+
+	if (unlikely(state->read_size < sizeof(glc_video_tiles_header_t))) {
+		glc_log(untile->glc, GLC_ERROR, "untile", "truncated tiles message");
+		goto skip;
+	}
+
+	if (unlikely((ret = untile_get_video_stream(untile, tiles_hdr->frame.id, &video))))
+		return ret;
+
+	if (unlikely((ret = untile_lock(untile, video))))
+		return ret;
+
+	if (unlikely((!video->tiled) || (!video->frame_valid))) {
+		glc_log(untile->glc, GLC_WARN, "untile",
+			"video %d: tiles without a previous frame dropped",
+			tiles_hdr->frame.id);
+		goto unlock;
+	}
+
+	if (unlikely(untile_apply(video, state->read_data, state->read_size))) {
+		glc_log(untile->glc, GLC_ERROR, "untile",
+			"video %d: invalid tiles message", tiles_hdr->frame.id);
+		/* following tiles would apply to a wrong picture */
+		video->frame_valid = 0;
+		goto unlock;
+	}
+
+	/* frame must not change until the write callback has copied it */
+	video->busy = 1;
+	((struct untile_thread_s *) state->threadptr)->busy = video;
+	pthread_mutex_unlock(&video->update);
+
+	state->header.type = GLC_MESSAGE_VIDEO_FRAME;
+	state->write_size = sizeof(glc_video_frame_header_t) + video->layout.size;
+	return 0;
+unlock:
+	pthread_mutex_unlock(&video->update);
+skip:
+	state->flags |= GLC_THREAD_STATE_SKIP_WRITE;
+	return 0;
+}
+
+/**
+ * \brief copy tiles into current frame
+ *
+ * Message is checked before the frame is touched.
+ * \return 0 on success, EINVAL if message is malformed
+ */
+int untile_apply(struct untile_video_stream_s *video, const char *data, size_t size)
+{
+	glc_video_tiles_header_t *tiles_hdr = (glc_video_tiles_header_t *) data;
+	const char *index, *from;
+	size_t offset, width, payload = 0;
+	unsigned int i, p, r, rows;
+	u_int32_t t, last = 0;
+
+	if (unlikely((!tiles_hdr->size) || (tiles_hdr->size % 2)))
+		return EINVAL;
+	if (tiles_hdr->size != video->layout.tile)
+		tile_layout_grid(&video->layout, tiles_hdr->size);
+
+	if (unlikely(tiles_hdr->count > video->layout.tiles_x * video->layout.tiles_y))
+		return EINVAL;
+	index = &data[sizeof(glc_video_tiles_header_t)];
+	from = &index[tiles_hdr->count * sizeof(u_int32_t)];
+	if (unlikely(from > &data[size]))
+		return EINVAL;
+
+	for (i = 0; i < tiles_hdr->count; i++) {
+		memcpy(&t, &index[i * sizeof(u_int32_t)], sizeof(u_int32_t));
+		if (unlikely((t >= video->layout.tiles_x * video->layout.tiles_y) ||
+			     ((i) && (t <= last))))
+			return EINVAL;
+		payload += tile_bytes(&video->layout, t);
+		last = t;
+	}
+	if (unlikely(payload > (size_t) (&data[size] - from)))
+		return EINVAL;
+
+	for (i = 0; i < tiles_hdr->count; i++) {
+		memcpy(&t, &index[i * sizeof(u_int32_t)], sizeof(u_int32_t));
+		for (p = 0; p < video->layout.num_planes; p++) {
+			tile_rect(&video->layout, p, t, &offset, &width, &rows);
+			for (r = 0; r < rows; r++) {
+				memcpy(&video->frame[offset], from, width);
+				offset += video->layout.plane[p].stride;
+				from += width;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**  \} */
@@ -0,0 +1,172 @@
+/**
+ * \file glc/core/tile.h
+ * \brief tile based frame differencing
+ * \author Olivier Langlois <olivier@trillion01.com>
+ * \date 2014
+
+    Copyright 2014 Olivier Langlois
+
+    This file is part of glcs.
+
+    glcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    glcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with glcs.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+/**
+ * \addtogroup core
+ *  \{
+ * \defgroup tile tile based frame differencing
+ *  \{
+ */
+
+#ifndef _TILE_H
+#define _TILE_H
+
+#include <packetstream.h>
+#include <glc/common/glc.h>
+#include <glc/core/chain.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** default tile size in pixels */
+#define TILE_DEFAULT_SIZE          32
+/** default number of frames between full frames */
+#define TILE_DEFAULT_KEY_INTERVAL 120
+
+/**
+ * \brief tile object
+ */
+typedef struct tile_s* tile_t;
+
+/**
+ * \brief untile object
+ */
+typedef struct untile_s* untile_t;
+
+/**
+ * \brief initialize tile object
+ * \param tile tile object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_init(tile_t *tile, glc_t *glc);
+
+/**
+ * \brief set tile size
+ *
+ * Default size is TILE_DEFAULT_SIZE.
+ * \param tile tile object
+ * \param size tile width and height in pixels, even
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_set_size(tile_t tile, unsigned int size);
+
+/**
+ * \brief set full frame interval
+ *
+ * A full frame is sent at least every interval frames so a
+ * stream can be played from there. Default interval is
+ * TILE_DEFAULT_KEY_INTERVAL.
+ * \param tile tile object
+ * \param interval number of frames, 0 means only when needed
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_set_key_interval(tile_t tile, unsigned int interval);
+
+/**
+ * \brief start tile process
+ *
+ * tile compares every BGR, BGRA, RGB and Y'CbCr frame with the
+ * previous one of its stream, tile by tile, and sends only the
+ * changed tiles as a GLC_MESSAGE_VIDEO_TILES message, never larger
+ * than half a frame. Full frames are kept when too much has changed
+ * and at key interval, they are passed on by reference.
+ * \param tile tile object
+ * \param from source buffer
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_process_start(tile_t tile, ps_buffer_t *from, ps_buffer_t *to);
+
+/**
+ * \brief block until process has finished
+ * \param tile tile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_process_wait(tile_t tile);
+
+/**
+ * \brief destroy tile object
+ * \param tile tile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int tile_destroy(tile_t tile);
+
+/**
+ * \brief initialize untile object
+ * \param untile untile object
+ * \param glc glc
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_init(untile_t *untile, glc_t *glc);
+
+/**
+ * \brief start untile process
+ *
+ * untile applies GLC_MESSAGE_VIDEO_TILES messages to the last
+ * frame of their stream and sends the result as a regular video
+ * frame. Tiles received before a full frame are dropped.
+ * \param untile untile object
+ * \param from source buffer
+ * \param to target buffer
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_process_start(untile_t untile, ps_buffer_t *from,
+				  ps_buffer_t *to);
+
+/**
+ * \brief run untile as part of a filter chain
+ *
+ * untile must be the first filter of the chain. It is then run
+ * by the chain workers and untile_process_start() must not be used.
+ * \param untile untile object
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_chain_append(untile_t untile, chain_t chain);
+
+/**
+ * \brief block until process has finished
+ * \param untile untile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_process_wait(untile_t untile);
+
+/**
+ * \brief destroy untile object
+ * \param untile untile object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int untile_destroy(untile_t untile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/**  \} */
+/**  \} */
@@ -75,10 +75,13 @@ Y', Cb, Cr      in {0, 1, 2, ..., 255}
 struct ycbcr_video_stream_s;
 struct ycbcr_private_s;
 
+/* converts chroma rows [first, last), ie. luma row pairs */
 typedef void (*ycbcr_convert_proc)(ycbcr_t ycbcr,
 				   struct ycbcr_video_stream_s *video,
 				   unsigned char *from,
-				   unsigned char *to);
+				   unsigned char *to,
+				   unsigned int first,
+				   unsigned int last);
 
 struct ycbcr_video_stream_s {
 	glc_stream_id_t id;
@@ -98,6 +101,13 @@ struct ycbcr_video_stream_s {
 	struct ycbcr_video_stream_s *next;
 };
 
+/* argument for stripe workers */
+struct ycbcr_stripe_s {
+	ycbcr_t ycbcr;
+	struct ycbcr_video_stream_s *video;
+	unsigned char *from, *to;
+};
+
 struct ycbcr_s {
 	glc_t *glc;
 	glc_thread_t thread;
@@ -116,12 +126,17 @@ static void ycbcr_get_video_stream(ycbcr_t ycbcr, glc_stream_id_t id, struct ycb
 
 static int ycbcr_generate_map(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video);
 
+static void ycbcr_stripe(void *arg, unsigned int first, unsigned int last);
+
 static void ycbcr_bgr_to_jpeg420(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
-			  unsigned char *from, unsigned char *to);
+			  unsigned char *from, unsigned char *to,
+			  unsigned int first, unsigned int last);
 static void ycbcr_bgr_to_jpeg420_half(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
-			       unsigned char *from, unsigned char *to);
+			       unsigned char *from, unsigned char *to,
+			       unsigned int first, unsigned int last);
 static void ycbcr_bgr_to_jpeg420_scale(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
-				unsigned char *from, unsigned char *to);
+				unsigned char *from, unsigned char *to,
+				unsigned int first, unsigned int last);
 
 int ycbcr_init(ycbcr_t *ycbcr, glc_t *glc)
 {
@@ -129,12 +144,14 @@ int ycbcr_init(ycbcr_t *ycbcr, glc_t *glc)
 
 	(*ycbcr)->glc = glc;
 
-	(*ycbcr)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE;
+	(*ycbcr)->thread.flags = GLC_THREAD_READ | GLC_THREAD_WRITE |
+				 GLC_THREAD_FORWARD_REF;
 	(*ycbcr)->thread.read_callback = &ycbcr_read_callback;
 	(*ycbcr)->thread.write_callback = &ycbcr_write_callback;
 	(*ycbcr)->thread.finish_callback = &ycbcr_finish_callback;
 	(*ycbcr)->thread.ptr = *ycbcr;
 	(*ycbcr)->thread.threads = glc_threads_hint(glc);
+	(*ycbcr)->thread.name = "ycbcr";
 	(*ycbcr)->scale = 1.0;
 
 	return 0;
@@ -169,6 +186,14 @@ int ycbcr_process_start(ycbcr_t ycbcr, ps_buffer_t *from, ps_buffer_t *to)
 	return 0;
 }
 
+int ycbcr_chain_append(ycbcr_t ycbcr, chain_t chain)
+{
+	if (unlikely(ycbcr->running))
+		return EAGAIN;
+
+	return chain_append(chain, &ycbcr->thread);
+}
+
 int ycbcr_process_wait(ycbcr_t ycbcr)
 {
 	/* finish callback takes care of old video data */
@@ -234,16 +259,27 @@ int ycbcr_write_callback(glc_thread_state_t *state)
 {
 	ycbcr_t ycbcr = state->ptr;
 	struct ycbcr_video_stream_s *video = state->threadptr;
+	struct ycbcr_stripe_s stripe;
 
 	memcpy(state->write_data, state->read_data, sizeof(glc_video_frame_header_t));
-	video->convert(ycbcr, video,
-		     (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)],
-		     (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)]);
+	stripe.ycbcr = ycbcr;
+	stripe.video = video;
+	stripe.from  = (unsigned char *) &state->read_data[sizeof(glc_video_frame_header_t)];
+	stripe.to    = (unsigned char *) &state->write_data[sizeof(glc_video_frame_header_t)];
+	glc_stripe_run(ycbcr->glc, &ycbcr_stripe, &stripe, video->ch);
 	pthread_rwlock_unlock(&video->update);
 
 	return 0;
 }
 
+void ycbcr_stripe(void *arg, unsigned int first, unsigned int last)
+{
+	struct ycbcr_stripe_s *stripe = (struct ycbcr_stripe_s *) arg;
+
+	stripe->video->convert(stripe->ycbcr, stripe->video,
+			       stripe->from, stripe->to, first, last);
+}
+
 void ycbcr_get_video_stream(ycbcr_t ycbcr, glc_stream_id_t id, struct ycbcr_video_stream_s **video)
 {
 	*video = ycbcr->video;
@@ -266,7 +302,8 @@ void ycbcr_get_video_stream(ycbcr_t ycbcr, glc_stream_id_t id, struct ycbcr_vide
 }
 
 void ycbcr_bgr_to_jpeg420(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
-			  unsigned char *from, unsigned char *to)
+			  unsigned char *from, unsigned char *to,
+			  unsigned int first, unsigned int last)
 {
 	unsigned int Ypix;
 	unsigned int op1, op2, op3, op4;
@@ -275,13 +312,13 @@ void ycbcr_bgr_to_jpeg420(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
 	unsigned char *Y, *Cb, *Cr;
 
 	Y = to;
-	Cb = &to[video->yw * video->yh];
-	Cr = &to[video->yw * video->yh + video->cw * video->ch];
+	Cb = &to[video->yw * video->yh + first * video->cw];
+	Cr = &to[video->yw * video->yh + video->cw * video->ch + first * video->cw];
 
-	oy = (video->h - 2) * video->row;
+	oy = (video->h - 2 - first * 2) * video->row;
 	ox = 0;
 
-	for (Yy = 0; Yy < video->yh; Yy += 2) {
+	for (Yy = first * 2; Yy < last * 2; Yy += 2) {
 		for (Yx = 0; Yx < video->yw; Yx += 2) {
 			op1 = ox + oy;
 			op2 = op1 + video->bpp;
@@ -326,7 +363,8 @@ void ycbcr_bgr_to_jpeg420(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
 	Bd = (from[op1 + 0] + from[op2 + 0] + from[op3 + 0] + from[op4 + 0]) >> 2;
 
 void ycbcr_bgr_to_jpeg420_half(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
-			       unsigned char *from, unsigned char *to)
+			       unsigned char *from, unsigned char *to,
+			       unsigned int first, unsigned int last)
 {
 	unsigned int Ypix;
 	unsigned int op1, op2, op3, op4;
@@ -334,13 +372,13 @@ void ycbcr_bgr_to_jpeg420_half(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video
 	unsigned int ox, oy, Yy, Yx;
 	unsigned char *Cb, *Cr;
 
-	Cb = &to[video->yw * video->yh];
-	Cr = &to[video->yw * video->yh + video->cw * video->ch];
+	Cb = &to[video->yw * video->yh + first * video->cw];
+	Cr = &to[video->yw * video->yh + video->cw * video->ch + first * video->cw];
 
-	oy = (video->h - 4);
+	oy = (video->h - 4 - first * 4);
 	ox = 0;
 
-	for (Yy = 0; Yy < video->yh; Yy += 2) {
+	for (Yy = first * 2; Yy < last * 2; Yy += 2) {
 		for (Yx = 0; Yx < video->yw; Yx += 2) {
 			/* CbCr */
 			CALC_BILINEAR_RGB(video->bpp, video->bpp * 2, 1, 2)
@@ -372,7 +410,8 @@ void ycbcr_bgr_to_jpeg420_half(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video
 #undef CALC_BILINEAR_RGB
 
 void ycbcr_bgr_to_jpeg420_scale(ycbcr_t ycbcr, struct ycbcr_video_stream_s *video,
-				unsigned char *from, unsigned char *to)
+				unsigned char *from, unsigned char *to,
+				unsigned int first, unsigned int last)
 {
 	unsigned int Cpix;
 	unsigned char *Y, *Cb, *Cr;
@@ -383,7 +422,7 @@ void ycbcr_bgr_to_jpeg420_scale(ycbcr_t ycbcr, struct ycbcr_video_stream_s *vide
 	Cb = &to[video->yw * video->yh];
 	Cr = &to[video->yw * video->yh + video->cw * video->ch];
 
-	Cpix = 0;
+	Cpix = first * video->cw;
 	Cmap = video->yw * video->yh;
 
 #define CALC_Rd(m) (from[video->pos[m + 0] + 2] * video->factor[m + 0] \
@@ -404,7 +443,7 @@ void ycbcr_bgr_to_jpeg420_scale(ycbcr_t ycbcr, struct ycbcr_video_stream_s *vide
 	Gd = CALC_Bd((m) * 4); \
 	Bd = CALC_Gd((m) * 4);
 
-	for (Yy = 0; Yy < video->yh; Yy += 2) {
+	for (Yy = first * 2; Yy < last * 2; Yy += 2) {
 		for (Yx = 0; Yx < video->yw; Yx += 2) {
 			/* CbCr */
 			CALC_RdBdGd(Cmap + Cpix)
@@ -437,6 +476,13 @@ int ycbcr_video_format_message(ycbcr_t ycbcr, glc_video_format_message_t *video_
 	ycbcr_get_video_stream(ycbcr, video_format->id, &video);
 	pthread_rwlock_wrlock(&video->update);
 
+	/* picture was scaled on GPU */
+	if (video_format->flags & GLC_VIDEO_SCALED)
+		video->scale = 1.0;
+	else
+		video->scale = ycbcr->scale;
+	video_format->flags &= ~GLC_VIDEO_SCALED;
+
 	if (video_format->format == GLC_VIDEO_BGRA)
 		video->bpp = 4;
 	else if (video_format->format == GLC_VIDEO_BGR)
@@ -457,7 +503,6 @@ int ycbcr_video_format_message(ycbcr_t ycbcr, glc_video_format_message_t *video_
 			video->row += 8 - video->row % 8;
 	}
 
-	video->scale = ycbcr->scale;
 	video->yw = video->w * video->scale;
 	video->yh = video->h * video->scale;
 	video->yw -= video->yw % 2; /* safer and faster             */
@@ -17,6 +17,7 @@
 #define _YCBCR_H
 
 #include <glc/common/glc.h>
+#include <glc/core/chain.h>
 #include <packetstream.h>
 
 #ifdef __cplusplus
@@ -62,6 +63,17 @@ __PUBLIC int ycbcr_set_scale(ycbcr_t ycbcr, double scale);
 __PUBLIC int ycbcr_process_start(ycbcr_t ycbcr, ps_buffer_t *from,
 				 ps_buffer_t *to);
 
+/**
+ * \brief run ycbcr as part of a filter chain
+ *
+ * ycbcr is then run by the chain workers and ycbcr_process_start()
+ * must not be used.
+ * \param ycbcr ycbcr object
+ * \param chain chain object
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int ycbcr_chain_append(ycbcr_t ycbcr, chain_t chain);
+
 /**
  * \brief block until current process has finished
  * \param ycbcr ycbcr object
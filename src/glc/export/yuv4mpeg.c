@@ -91,6 +91,7 @@ int yuv4mpeg_init(yuv4mpeg_t *yuv4mpeg, glc_t *glc)
 	(*yuv4mpeg)->thread.read_callback = &yuv4mpeg_read_callback;
 	(*yuv4mpeg)->thread.finish_callback = &yuv4mpeg_finish_callback;
 	(*yuv4mpeg)->thread.threads = 1;
+	(*yuv4mpeg)->thread.name = "yuv4mpeg";
 
 	return 0;
 }
@@ -182,6 +183,11 @@ int yuv4mpeg_read_callback(glc_thread_state_t *state)
 		return yuv4mpeg_handle_video_frame_message(yuv4mpeg,
 			(glc_video_frame_header_t *) state->read_data,
 			&state->read_data[sizeof(glc_video_frame_header_t)]);
+	else if ((state->header.type == GLC_MESSAGE_VIDEO_REPEAT) &&
+		 (yuv4mpeg->prev_video_frame_message))
+		return yuv4mpeg_handle_video_frame_message(yuv4mpeg,
+			(glc_video_frame_header_t *) state->read_data,
+			yuv4mpeg->prev_video_frame_message);
 
 	return 0;
 }
@@ -218,7 +224,8 @@ int yuv4mpeg_handle_hdr(yuv4mpeg_t yuv4mpeg, glc_video_format_message_t *video_f
 	yuv4mpeg->size = video_format->width * video_format->height +
 			 (video_format->width * video_format->height) / 2;
 
-	if (yuv4mpeg->interpolate) {
+	/* repeated frames are written from the previous one too */
+	if ((yuv4mpeg->interpolate) || (video_format->flags & GLC_VIDEO_REPEATS)) {
 		if (yuv4mpeg->prev_video_frame_message)
 			yuv4mpeg->prev_video_frame_message = (char *)
 			realloc(yuv4mpeg->prev_video_frame_message, yuv4mpeg->size);
@@ -231,6 +238,9 @@ int yuv4mpeg_handle_hdr(yuv4mpeg_t yuv4mpeg, glc_video_format_message_t *video_f
 		/* Set CbCr 128 */
 		memset(&yuv4mpeg->prev_video_frame_message[video_format->width * video_format->height],
 		       128, (video_format->width * video_format->height) / 2);
+	} else if (yuv4mpeg->prev_video_frame_message) {
+		free(yuv4mpeg->prev_video_frame_message);
+		yuv4mpeg->prev_video_frame_message = NULL;
 	}
 
 	/* calculate fps in p/q */
@@ -263,7 +273,8 @@ int yuv4mpeg_handle_video_frame_message(yuv4mpeg_t yuv4mpeg, glc_video_frame_hea
 		yuv4mpeg->time += yuv4mpeg->fps_usec;
 	}
 
-	if (yuv4mpeg->interpolate)
+	if ((yuv4mpeg->prev_video_frame_message) &&
+	    (data != yuv4mpeg->prev_video_frame_message))
 		memcpy(yuv4mpeg->prev_video_frame_message, data, yuv4mpeg->size);
 
 	return 0;
@@ -107,6 +107,7 @@ int alsa_play_init(alsa_play_t *alsa_play, glc_t *glc)
 	(*alsa_play)->thread.read_callback = &alsa_play_read_callback;
 	(*alsa_play)->thread.finish_callback = &alsa_play_finish_callback;
 	(*alsa_play)->thread.threads = 1;
+	(*alsa_play)->thread.name = "alsa_play";
 	(*alsa_play)->thread.ask_rt  = 1;
 
 	return 0;
@@ -143,6 +144,20 @@ int alsa_play_process_start(alsa_play_t alsa_play, ps_buffer_t *from)
 	return 0;
 }
 
+int alsa_play_process_start_ring(alsa_play_t alsa_play, glc_ring_t from)
+{
+	int ret;
+	if (unlikely(alsa_play->running))
+		return EAGAIN;
+
+	alsa_play->thread.ring = from;
+	if ((ret = glc_thread_create(alsa_play->glc, &alsa_play->thread, NULL, NULL)))
+		return ret;
+	alsa_play->running = 1;
+
+	return 0;
+}
+
 int alsa_play_process_wait(alsa_play_t alsa_play)
 {
 	if (unlikely(!alsa_play->running))
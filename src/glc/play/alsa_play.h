@@ -74,6 +74,17 @@ __PUBLIC int alsa_play_set_alsa_playback_device(alsa_play_t alsa_play,
  */
 __PUBLIC int alsa_play_process_start(alsa_play_t alsa_play, ps_buffer_t *from);
 
+/**
+ * \brief start alsa_play process reading from a ring
+ *
+ * Same as alsa_play_process_start() except that packets come
+ * from a single-producer ring.
+ * \param alsa_play alsa_play object
+ * \param from source ring
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int alsa_play_process_start_ring(alsa_play_t alsa_play, glc_ring_t from);
+
 /**
  * \brief block until process has finished
  * \param alsa_play alsa_play object
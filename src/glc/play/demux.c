@@ -62,6 +62,7 @@ struct demux_audio_stream_s {
 	glc_stream_id_t id;
 	ps_buffer_t buffer;
 	ps_packet_t packet;
+	glc_ring_t ring;
 
 	int running;
 	alsa_play_t alsa_play;
@@ -106,6 +107,8 @@ struct demux_s {
 
 	ps_bufferattr_t video_bufferattr;
 	ps_bufferattr_t audio_bufferattr;
+	size_t audio_size;
+	int audio_ring;
 
 	struct demux_video_stream_s *video;
 	struct demux_audio_stream_s *audio;
@@ -118,27 +121,33 @@ static int demux_vfilter_close(demux_t demux);
 static void *vfilter_thread(void *argptr);
 static void *demux_thread(void *argptr);
 
-static int demux_send(ps_packet_t *packet,
-		      glc_message_header_t *header, char *data, size_t size);
+static int demux_send(ps_packet_t *packet, glc_message_header_t *header,
+		      char *data, size_t size, glc_packet_ref_t ref);
 static int demux_video_filter_message(demux_t demux, glc_message_header_t *header,
-			       char *data, size_t size);
+			       char *data, size_t size, glc_packet_ref_t ref);
 static int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
-			       char *data, size_t size);
+			       char *data, size_t size, glc_packet_ref_t ref);
 static int demux_video_stream_get(demux_t demux, glc_stream_id_t id,
 			   struct demux_video_stream_s **video);
 static int demux_video_stream_send(demux_t demux, struct demux_video_stream_s *video,
-			    glc_message_header_t *header, char *data, size_t size);
+			    glc_message_header_t *header, char *data, size_t size,
+			    glc_packet_ref_t ref);
 static int demux_video_stream_close(demux_t demux);
 static int demux_video_stream_clean(demux_t demux, struct demux_video_stream_s *video);
 
 static int demux_audio_stream_message(demux_t demux, glc_message_header_t *header,
-			       char *data, size_t size);
+			       char *data, size_t size, glc_packet_ref_t ref);
 static int demux_audio_stream_get(demux_t demux, glc_stream_id_t id,
 			   struct demux_audio_stream_s **audio);
 static int demux_audio_stream_send(demux_t demux, struct demux_audio_stream_s *audio,
-			 glc_message_header_t *header, char *data, size_t size);
+			 glc_message_header_t *header, char *data, size_t size,
+			 glc_packet_ref_t ref);
 static int demux_audio_stream_close(demux_t demux);
 static int demux_audio_stream_clean(demux_t demux, struct demux_audio_stream_s *audio);
+static int demux_read(ps_packet_t *read, glc_message_header_t *header,
+		      char **data, size_t *size, glc_packet_ref_t *ref);
+static int demux_ring_send(glc_ring_t ring, glc_message_header_t *header,
+			   char *data, size_t size, glc_packet_ref_t ref);
 
 int demux_init(demux_t *demux, glc_t *glc)
 {
@@ -152,6 +161,8 @@ int demux_init(demux_t *demux, glc_t *glc)
 
 	ps_bufferattr_setsize(&(*demux)->video_bufferattr, 1024 * 1024 * 10);
 	ps_bufferattr_setsize(&(*demux)->audio_bufferattr, 1024 * 1024 * 1);
+	(*demux)->audio_size = 1024 * 1024 * 1;
+	(*demux)->audio_ring = 1;
 
 	return 0;
 }
@@ -177,9 +188,16 @@ int demux_set_video_buffer_size(demux_t demux, size_t size)
 
 int demux_set_audio_buffer_size(demux_t demux, size_t size)
 {
+	demux->audio_size = size;
 	return ps_bufferattr_setsize(&demux->audio_bufferattr, size);
 }
 
+int demux_set_audio_ring(demux_t demux, int ring)
+{
+	demux->audio_ring = ring;
+	return 0;
+}
+
 int demux_set_alsa_playback_device(demux_t demux, const char *device)
 {
 	demux->alsa_playback_device = device;
@@ -206,6 +224,7 @@ int demux_process_start(demux_t demux, ps_buffer_t *from)
 		return EAGAIN;
 
 	demux->from = from;
+	demux->thread.name = "demux";
 
 	return glc_simple_thread_create(demux->glc, &demux->thread,
 					demux_thread, demux);
@@ -216,6 +235,7 @@ int demux_vfilter_start(demux_t demux)
 	if (!demux->vfilter)
 		return 0;
 
+	demux->vfilter->thread.name = "vfilter";
 	return glc_simple_thread_create(demux->glc, &demux->vfilter->thread,
 					vfilter_thread, demux);
 }
@@ -237,6 +257,7 @@ void *demux_thread(void *argptr)
 {
 	demux_t demux = (demux_t ) argptr;
 	glc_message_header_t msg_hdr;
+	glc_packet_ref_t ref = NULL;
 	size_t data_size;
 	char *data;
 	int ret;
@@ -253,27 +274,21 @@ void *demux_thread(void *argptr)
 		if (unlikely((ret = ps_packet_open(&read, PS_PACKET_READ))))
 			goto err;
 
-		if (unlikely((ret = ps_packet_read(&read, &msg_hdr,
-						sizeof(glc_message_header_t)))))
-			goto err;
-		if (unlikely((ret = ps_packet_getsize(&read, &data_size))))
-			goto err;
-		data_size -= sizeof(glc_message_header_t);
-		if (unlikely((ret = ps_packet_dma(&read, (void *) &data,
-						data_size,
-						PS_ACCEPT_FAKE_DMA))))
+		if (unlikely((ret = demux_read(&read, &msg_hdr, &data,
+					       &data_size, &ref))))
 			goto err;
 
-		if ((msg_hdr.type == GLC_MESSAGE_CLOSE)       ||
-		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FRAME) ||
+		if ((msg_hdr.type == GLC_MESSAGE_CLOSE)        ||
+		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FRAME)  ||
+		    (msg_hdr.type == GLC_MESSAGE_VIDEO_REPEAT) ||
 		    (msg_hdr.type == GLC_MESSAGE_VIDEO_FORMAT)) {
 			if (!demux->vfilter) {
 				/* handle msg to gl_play */
 				demux_video_stream_message(demux, &msg_hdr,
-							data, data_size);
+							data, data_size, ref);
 			} else {
 				demux_video_filter_message(demux, &msg_hdr,
-							data, data_size);
+							data, data_size, ref);
 			}
 		}
 
@@ -281,15 +296,23 @@ void *demux_thread(void *argptr)
 		    (msg_hdr.type == GLC_MESSAGE_AUDIO_FORMAT) ||
 		    (msg_hdr.type == GLC_MESSAGE_AUDIO_DATA)) {
 			/* handle msg to alsa_play */
-			demux_audio_stream_message(demux, &msg_hdr, data, data_size);
+			demux_audio_stream_message(demux, &msg_hdr, data, data_size,
+						   ref);
 		}
 
 		ps_packet_close(&read);
+		glc_thread_pool_notify(demux->glc);
+		if (ref) {
+			glc_packet_ref_put(ref);
+			ref = NULL;
+		}
 	} while ((!glc_state_test(demux->glc, GLC_STATE_CANCEL)) &&
 		 (msg_hdr.type != GLC_MESSAGE_CLOSE));
 
 finish:
 	ps_packet_destroy(&read);
+	if (ref)
+		glc_packet_ref_put(ref);
 
 	if (glc_state_test(demux->glc, GLC_STATE_CANCEL))
 		ps_buffer_cancel(demux->from);
@@ -311,6 +334,7 @@ void *vfilter_thread(void *argptr)
 {
 	demux_t demux = (demux_t ) argptr;
 	glc_message_header_t msg_hdr;
+	glc_packet_ref_t ref = NULL;
 	size_t data_size;
 	char *data;
 	int ret;
@@ -324,25 +348,25 @@ void *vfilter_thread(void *argptr)
 		if (unlikely((ret = ps_packet_open(&read, PS_PACKET_READ))))
 			goto err;
 
-		if (unlikely((ret = ps_packet_read(&read, &msg_hdr,
-						sizeof(glc_message_header_t)))))
-			goto err;
-		if (unlikely((ret = ps_packet_getsize(&read, &data_size))))
-			goto err;
-		data_size -= sizeof(glc_message_header_t);
-		if (unlikely((ret = ps_packet_dma(&read, (void *) &data,
-						data_size,
-						PS_ACCEPT_FAKE_DMA))))
+		if (unlikely((ret = demux_read(&read, &msg_hdr, &data,
+					       &data_size, &ref))))
 			goto err;
 
-		demux_video_stream_message(demux, &msg_hdr, data, data_size);
+		demux_video_stream_message(demux, &msg_hdr, data, data_size, ref);
 
 		ps_packet_close(&read);
+		glc_thread_pool_notify(demux->glc);
+		if (ref) {
+			glc_packet_ref_put(ref);
+			ref = NULL;
+		}
 	} while ((!glc_state_test(demux->glc, GLC_STATE_CANCEL)) &&
 		 (msg_hdr.type != GLC_MESSAGE_CLOSE));
 
 finish:
 	ps_packet_destroy(&read);
+	if (ref)
+		glc_packet_ref_put(ref);
 
 	if (glc_state_test(demux->glc, GLC_STATE_CANCEL))
 		ps_buffer_cancel(demux->vfilter->out);
@@ -358,7 +382,7 @@ err:
 }
 
 int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
-			char *data, size_t size)
+			char *data, size_t size, glc_packet_ref_t ref)
 {
 	struct demux_video_stream_s *video;
 	glc_stream_id_t id;
@@ -370,7 +394,7 @@ int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
 		while (video != NULL) {
 			if (video->running) {
 				if ((ret = demux_video_stream_send(demux, video,
-							header, data, size)))
+							header, data, size, NULL)))
 					return ret;
 			}
 			video = video->next;
@@ -378,7 +402,8 @@ int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
 		return 0;
 	} else if (header->type == GLC_MESSAGE_VIDEO_FORMAT)
 		id = ((glc_video_format_message_t *) data)->id;
-	else if (header->type == GLC_MESSAGE_VIDEO_FRAME)
+	else if ((header->type == GLC_MESSAGE_VIDEO_FRAME) ||
+		 (header->type == GLC_MESSAGE_VIDEO_REPEAT))
 		id = ((glc_video_frame_header_t *) data)->id;
 	else
 		return EINVAL;
@@ -387,17 +412,71 @@ int demux_video_stream_message(demux_t demux, glc_message_header_t *header,
 	if (unlikely((ret = demux_video_stream_get(demux, id, &video))))
 		return ret;
 
-	ret = demux_video_stream_send(demux, video, header, data, size);
+	ret = demux_video_stream_send(demux, video, header, data, size, ref);
 
 	return ret;
 }
 
-int demux_send(ps_packet_t *packet,
-		glc_message_header_t *header, char *data, size_t size)
+/**
+ * \brief read a packet, resolving references
+ *
+ * If the packet is a GLC_MESSAGE_REF, ref is set and owned by
+ * the caller, header, data and size describe the referenced message.
+ */
+int demux_read(ps_packet_t *read, glc_message_header_t *header,
+	       char **data, size_t *size, glc_packet_ref_t *ref)
 {
+	glc_ref_message_t ref_msg;
 	int ret;
+
+	if (unlikely((ret = ps_packet_read(read, header,
+					   sizeof(glc_message_header_t)))))
+		return ret;
+
+	if (header->type == GLC_MESSAGE_REF) {
+		if (unlikely((ret = ps_packet_read(read, &ref_msg,
+						   sizeof(glc_ref_message_t)))))
+			return ret;
+		memcpy(header, &ref_msg.header, sizeof(glc_message_header_t));
+		*ref = ref_msg.ref;
+		*data = glc_packet_ref_data(ref_msg.ref);
+		*size = ref_msg.size;
+		return 0;
+	}
+
+	if (unlikely((ret = ps_packet_getsize(read, size))))
+		return ret;
+	*size -= sizeof(glc_message_header_t);
+	return ps_packet_dma(read, (void *) data, *size, PS_ACCEPT_FAKE_DMA);
+}
+
+/**
+ * \brief send a message, by reference if it came in by reference
+ */
+int demux_send(ps_packet_t *packet, glc_message_header_t *header,
+	       char *data, size_t size, glc_packet_ref_t ref)
+{
+	glc_message_header_t ref_header;
+	glc_ref_message_t ref_msg;
+	int ret;
+
 	if (unlikely((ret = ps_packet_open(packet, PS_PACKET_WRITE))))
 		return ret;
+	if (ref) {
+		ref_header.type = GLC_MESSAGE_REF;
+		memcpy(&ref_msg.header, header, sizeof(glc_message_header_t));
+		ref_msg.size = size;
+		ref_msg.ref = ref;
+		if (unlikely((ret = ps_packet_write(packet, &ref_header,
+						    sizeof(glc_message_header_t)))))
+			return ret;
+		if (unlikely((ret = ps_packet_write(packet, &ref_msg,
+						    sizeof(glc_ref_message_t)))))
+			return ret;
+		/* reader gets its own reference */
+		glc_packet_ref_get(ref);
+		return ps_packet_close(packet);
+	}
 	if (unlikely((ret = ps_packet_write(packet, header,
 						sizeof(glc_message_header_t)))))
 		return ret;
@@ -406,10 +485,41 @@ int demux_send(ps_packet_t *packet,
 	return  ps_packet_close(packet);
 }
 
+/**
+ * \brief send a message through a ring, by reference if ref is set
+ */
+int demux_ring_send(glc_ring_t ring, glc_message_header_t *header,
+		    char *data, size_t size, glc_packet_ref_t ref)
+{
+	glc_message_header_t ref_header;
+	glc_ref_message_t ref_msg;
+	char *dma;
+	int ret;
+
+	if (ref) {
+		ref_header.type = GLC_MESSAGE_REF;
+		memcpy(&ref_msg.header, header, sizeof(glc_message_header_t));
+		ref_msg.size = size;
+		ref_msg.ref = ref;
+		header = &ref_header;
+		data = (char *) &ref_msg;
+		size = sizeof(glc_ref_message_t);
+	}
+
+	if (unlikely((ret = glc_ring_write_open(ring, sizeof(glc_message_header_t) + size,
+						&dma))))
+		return ret;
+	memcpy(dma, header, sizeof(glc_message_header_t));
+	memcpy(&dma[sizeof(glc_message_header_t)], data, size);
+	if (ref)
+		glc_packet_ref_get(ref);
+	return glc_ring_write_close(ring);
+}
+
 int demux_video_filter_message(demux_t demux, glc_message_header_t *header,
-			       char *data, size_t size)
+			       char *data, size_t size, glc_packet_ref_t ref)
 {
-	int ret = demux_send(&demux->vfilter->packet, header, data, size);
+	int ret = demux_send(&demux->vfilter->packet, header, data, size, ref);
 	if (likely(ret != EINTR))
 		return ret;
 
@@ -419,9 +529,10 @@ int demux_video_filter_message(demux_t demux, glc_message_header_t *header,
 }
 
 int demux_video_stream_send(demux_t demux, struct demux_video_stream_s *video,
-			 glc_message_header_t *header, char *data, size_t size)
+			 glc_message_header_t *header, char *data, size_t size,
+			 glc_packet_ref_t ref)
 {
-	int ret = demux_send(&video->packet, header, data, size);
+	int ret = demux_send(&video->packet, header, data, size, ref);
 	if (likely(ret != EINTR))
 		return ret;
 
@@ -508,7 +619,7 @@ int demux_video_stream_clean(demux_t demux, struct demux_video_stream_s *video)
 }
 
 int demux_audio_stream_message(demux_t demux, glc_message_header_t *header,
-			char *data, size_t size)
+			char *data, size_t size, glc_packet_ref_t ref)
 {
 	struct demux_audio_stream_s *audio;
 	glc_stream_id_t id;
@@ -520,7 +631,7 @@ int demux_audio_stream_message(demux_t demux, glc_message_header_t *header,
 		while (audio != NULL) {
 			if (audio->running) {
 				if ((ret = demux_audio_stream_send(demux, audio,
-							header, data, size)))
+							header, data, size, NULL)))
 					return ret;
 			}
 			audio = audio->next;
@@ -537,7 +648,7 @@ int demux_audio_stream_message(demux_t demux, glc_message_header_t *header,
 	if (unlikely((ret = demux_audio_stream_get(demux, id, &audio))))
 		return ret;
 
-	ret = demux_audio_stream_send(demux, audio, header, data, size);
+	ret = demux_audio_stream_send(demux, audio, header, data, size, ref);
 
 	return ret;
 }
@@ -551,8 +662,12 @@ int demux_audio_stream_close(demux_t demux)
 		demux->audio = demux->audio->next;
 
 		if (del->running) {
-			if (glc_state_test(demux->glc, GLC_STATE_CANCEL))
-				ps_buffer_cancel(&del->buffer);
+			if (glc_state_test(demux->glc, GLC_STATE_CANCEL)) {
+				if (del->ring)
+					glc_ring_cancel(del->ring);
+				else
+					ps_buffer_cancel(&del->buffer);
+			}
 			demux_audio_stream_clean(demux, del);
 		}
 
@@ -578,12 +693,18 @@ int demux_audio_stream_get(demux_t demux, glc_stream_id_t id,
 			calloc(1, sizeof(struct demux_audio_stream_s));
 		(*audio)->id = id;
 
-		if (unlikely((ret = ps_buffer_init(&(*audio)->buffer,
-						&demux->audio_bufferattr))))
-			return ret;
-		if (unlikely((ret = ps_packet_init(&(*audio)->packet,
-						&(*audio)->buffer))))
-			return ret;
+		if (demux->audio_ring) {
+			if (unlikely((ret = glc_ring_init(&(*audio)->ring,
+							  demux->audio_size))))
+				return ret;
+		} else {
+			if (unlikely((ret = ps_buffer_init(&(*audio)->buffer,
+							&demux->audio_bufferattr))))
+				return ret;
+			if (unlikely((ret = ps_packet_init(&(*audio)->packet,
+							&(*audio)->buffer))))
+				return ret;
+		}
 
 		if (unlikely((ret = alsa_play_init(&(*audio)->alsa_play,
 						demux->glc))))
@@ -594,8 +715,13 @@ int demux_audio_stream_get(demux_t demux, glc_stream_id_t id,
 		if (unlikely((ret = alsa_play_set_alsa_playback_device((*audio)->alsa_play,
 					       demux->alsa_playback_device))))
 			return ret;
-		if (unlikely((ret = alsa_play_process_start((*audio)->alsa_play,
-						    &(*audio)->buffer))))
+		if ((*audio)->ring)
+			ret = alsa_play_process_start_ring((*audio)->alsa_play,
+							   (*audio)->ring);
+		else
+			ret = alsa_play_process_start((*audio)->alsa_play,
+						      &(*audio)->buffer);
+		if (unlikely(ret))
 			return ret;
 		(*audio)->running = 1;
 
@@ -606,9 +732,15 @@ int demux_audio_stream_get(demux_t demux, glc_stream_id_t id,
 }
 
 int demux_audio_stream_send(demux_t demux, struct demux_audio_stream_s *audio,
-			 glc_message_header_t *header, char *data, size_t size)
+			 glc_message_header_t *header, char *data, size_t size,
+			 glc_packet_ref_t ref)
 {
-	int ret = demux_send(&audio->packet, header, data, size);
+	int ret;
+
+	if (audio->ring)
+		ret = demux_ring_send(audio->ring, header, data, size, ref);
+	else
+		ret = demux_send(&audio->packet, header, data, size, ref);
 	if (likely(ret != EINTR))
 		return ret;
 
@@ -627,8 +759,13 @@ int demux_audio_stream_clean(demux_t demux, struct demux_audio_stream_s *audio)
 		return ret;
 	alsa_play_destroy(audio->alsa_play);
 
-	ps_packet_destroy(&audio->packet);
-	ps_buffer_destroy(&audio->buffer);
+	if (audio->ring) {
+		glc_ring_destroy(audio->ring);
+		audio->ring = NULL;
+	} else {
+		ps_packet_destroy(&audio->packet);
+		ps_buffer_destroy(&audio->buffer);
+	}
 
 	return 0;
 }
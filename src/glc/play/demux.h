@@ -63,6 +63,19 @@ __PUBLIC int demux_set_video_buffer_size(demux_t demux, size_t size);
  */
 __PUBLIC int demux_set_audio_buffer_size(demux_t demux, size_t size);
 
+/**
+ * \brief use lock-free rings for audio streams
+ *
+ * Each audio stream has exactly one writer (demux) and one reader
+ * (alsa_play), so a glc_ring_t can replace the packetstream buffer
+ * and save its locking on every one of the many small audio packets.
+ * Enabled by default.
+ * \param demux demux object
+ * \param ring 1 to use rings, 0 to use packetstream buffers
+ * \return 0 on success otherwise an error code
+ */
+__PUBLIC int demux_set_audio_ring(demux_t demux, int ring);
+
 /**
  * \brief set ALSA playback device
  *
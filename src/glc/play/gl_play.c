@@ -129,6 +129,7 @@ int gl_play_init(gl_play_t *gl_play, glc_t *glc)
 	(*gl_play)->play_thread.read_callback = &gl_play_read_callback;
 	(*gl_play)->play_thread.finish_callback = &gl_play_finish_callback;
 	(*gl_play)->play_thread.threads = 1;
+	(*gl_play)->play_thread.name = "gl_play";
 
 	/* TODO support more formats */
 	(*gl_play)->format = GL_BGR;
@@ -695,6 +696,10 @@ int gl_play_read_callback(glc_thread_state_t *state)
 
 		glXSwapBuffers(gl_play->dpy, gl_play->win);
 	}
+	/*
+	 * GLC_MESSAGE_VIDEO_REPEAT needs nothing, previous picture is
+	 * still on screen and next one waits for its own time.
+	 */
 
 	return 0;
 }
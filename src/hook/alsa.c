@@ -107,8 +107,11 @@ int alsa_init(glc_t *glc)
 	/* make sure libasound.so does not call our hooked functions */
 	alsa_unhook_so("*libasound.so*");
 
-	/* Assume 1 dedicated thread on the host app side + our own threads */
-	glc_account_threads(alsa.glc, 1+(alsa.capture != 0)+captured_stream_num, 0);
+	/*
+	 * Assume 1 dedicated thread on the host app side + our own threads,
+	 * all of them mostly waiting on the sound device.
+	 */
+	glc_account_io_threads(alsa.glc, 1+(alsa.capture != 0)+captured_stream_num);
 
 	return 0;
 }
@@ -193,6 +196,11 @@ int alsa_start(ps_buffer_t *buffer)
 	return 0;
 }
 
+int alsa_active()
+{
+	return (alsa.capture) || (alsa.capture_stream != NULL);
+}
+
 int alsa_close()
 {
 	struct alsa_capture_stream_s *del;
@@ -77,6 +77,7 @@ __PRIVATE int stop_capture();
  */
 __PRIVATE int alsa_init(glc_t *glc);
 __PRIVATE int alsa_start(ps_buffer_t *buffer);
+__PRIVATE int alsa_active();
 __PRIVATE int alsa_close();
 __PRIVATE int alsa_capture_start_all();
 __PRIVATE int alsa_capture_stop_all();
@@ -92,6 +93,8 @@ __PRIVATE int opengl_start(ps_buffer_t *buffer);
 __PRIVATE int opengl_capture_start();
 __PRIVATE int opengl_capture_stop();
 __PRIVATE int opengl_refresh_color_correction();
+__PRIVATE int opengl_window_configured(Display *dpy, Window window,
+				       unsigned int w, unsigned int h);
 __PRIVATE int opengl_close();
 __PRIVATE int opengl_push_message(glc_message_header_t *hdr, void *message, size_t message_size);
 /**  \} */
@@ -119,6 +122,25 @@ __PRIVATE void __opengl_glXSwapBuffers(Display *dpy, GLXDrawable drawable);
 __PRIVATE void __opengl_glFinish(void);
 __PRIVATE void __opengl_glXSwapBuffers(Display *dpy, GLXDrawable drawable);
 __PRIVATE GLXWindow __opengl_glXCreateWindow(Display *dpy, GLXFBConfig config, Window win, const int *attrib_list);
+__PRIVATE Bool __opengl_glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx);
+__PRIVATE Bool __opengl_glXMakeContextCurrent(Display *dpy, GLXDrawable draw, GLXDrawable read, GLXContext ctx);
+__PRIVATE void __opengl_glBindBuffer(GLenum target, GLuint buffer);
+__PRIVATE void __opengl_glBindBufferARB(GLenum target, GLuint buffer);
+__PRIVATE void __opengl_glDeleteBuffers(GLsizei n, const GLuint *buffers);
+__PRIVATE void __opengl_glDeleteBuffersARB(GLsizei n, const GLuint *buffers);
+__PRIVATE void __opengl_glBindFramebuffer(GLenum target, GLuint framebuffer);
+__PRIVATE void __opengl_glBindFramebufferEXT(GLenum target, GLuint framebuffer);
+__PRIVATE void __opengl_glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers);
+__PRIVATE void __opengl_glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers);
+__PRIVATE void __opengl_glUseProgram(GLuint program);
+__PRIVATE void __opengl_glUseProgramObjectARB(GLhandleARB program);
+__PRIVATE void __opengl_glActiveTexture(GLenum texture);
+__PRIVATE void __opengl_glActiveTextureARB(GLenum texture);
+__PRIVATE void __opengl_glReadBuffer(GLenum mode);
+__PRIVATE void __opengl_glPixelStorei(GLenum pname, GLint param);
+__PRIVATE void __opengl_glPixelStoref(GLenum pname, GLfloat param);
+__PRIVATE void __opengl_glPopAttrib(void);
+__PRIVATE void __opengl_glPopClientAttrib(void);
 
 __PRIVATE int __x11_XNextEvent(Display *display, XEvent *event_return);
 __PRIVATE int __x11_XPeekEvent(Display *display, XEvent *event_return);
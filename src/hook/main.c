@@ -44,9 +44,12 @@
 #include <glc/common/log.h>
 #include <glc/common/util.h>
 #include <glc/common/state.h>
+#include <glc/common/thread.h>
 #include <glc/core/pack.h>
 #include <glc/core/file.h>
 #include <glc/core/pipe.h>
+#include <glc/core/mux.h>
+#include <glc/core/tile.h>
 
 #include "lib.h"
 
@@ -58,6 +61,11 @@
 #define MAIN_SYNC                 0x20
 #define MAIN_COMPRESS_LZJB        0x40
 #define MAIN_START                0x80
+#define MAIN_LANES               0x100
+#define MAIN_TILES               0x200
+
+/** audio lane size, audio packets are small */
+#define MAIN_AUDIO_LANE_SIZE     (1024 * 1024 * 2)
 
 #define SINK_CB_RELOAD_ARG         (void *)0x1
 #define SINK_CB_STOP_ARG           (void *)0x2
@@ -70,11 +78,24 @@ struct main_private_s {
 	ps_buffer_t *compressed;
 	size_t uncompressed_size, compressed_size;
 
+	/* per capture source lanes, merged into uncompressed */
+	ps_buffer_t *video_lane;
+	ps_buffer_t *audio_lane;
+	mux_t mux;
+
+	/* frames as changed tiles, between uncompressed and pack */
+	ps_buffer_t *tiled;
+	tile_t tile;
+	unsigned int tile_size;
+	unsigned int key_interval;
+
 	sink_t sink;
 	pack_t pack;
 
 	unsigned int capture_id;
 	unsigned pipe_delay_ms;
+	size_t pool_workers;
+	size_t stripe_workers;
 	const char *pipe_exec_file;
 	const char *stream_file_fmt;
 	char *stream_file;
@@ -101,6 +122,8 @@ __PRIVATE struct main_private_s mpriv = {
 };
 
 __PRIVATE int  init_buffers();
+__PRIVATE int  init_lanes();
+__PRIVATE void destroy_lane(ps_buffer_t *lane, const char *name);
 __PRIVATE void lib_close();
 __PRIVATE int  load_environ();
 __PRIVATE void get_real_libc_dlsym();
@@ -159,6 +182,7 @@ err:
 
 int load_environ()
 {
+	glc_flags_t buffer_memory;
 	char *log_file;
 	char *env_val;
 
@@ -170,6 +194,11 @@ int load_environ()
 	if ((env_val = getenv("GLC_FILE")))
 		mpriv.stream_file_fmt = env_val;
 
+	if ((env_val = getenv("GLC_LANES"))) {
+		if (atoi(env_val))
+			mpriv.flags |= MAIN_LANES;
+	}
+
 	if ((env_val = getenv("GLC_LOG")))
 		glc_log_set_level(&mpriv.glc, atoi(env_val));
 
@@ -231,11 +260,59 @@ int load_environ()
 	} else
 		 mpriv.flags |= MAIN_COMPRESS_NONE;
 
+	/* pipe sink needs complete frames too */
+	if ((env_val = getenv("GLC_TILES")) && (atoi(env_val))) {
+		if (mpriv.pipe_exec_file)
+			glc_log(&mpriv.glc, GLC_WARN, "main",
+				"GLC_TILES ignored, pipe sink needs complete frames");
+		else
+			mpriv.flags |= MAIN_TILES;
+	}
+
+	mpriv.tile_size = TILE_DEFAULT_SIZE;
+	if ((env_val = getenv("GLC_TILE_SIZE"))) {
+		if ((atoi(env_val) > 0) && (!(atoi(env_val) % 2)))
+			mpriv.tile_size = atoi(env_val);
+		else
+			glc_log(&mpriv.glc, GLC_WARN, "main",
+				"GLC_TILE_SIZE must be even and positive, using %u",
+				mpriv.tile_size);
+	}
+
+	mpriv.key_interval = TILE_DEFAULT_KEY_INTERVAL;
+	if ((env_val = getenv("GLC_KEY_INTERVAL")))
+		mpriv.key_interval = atoi(env_val);
+
 	if ((env_val = getenv("GLC_RTPRIO")))
 		glc_set_allow_rt(&mpriv.glc, atoi(env_val));
 
+	if ((env_val = getenv("GLC_THREADS")))
+		mpriv.pool_workers = atoi(env_val);
+
+	if ((env_val = getenv("GLC_STRIPES")))
+		mpriv.stripe_workers = atoi(env_val);
+
+	if ((env_val = getenv("GLC_AFFINITY")))
+		glc_parse_affinity(&mpriv.glc, env_val);
+
+	if ((env_val = getenv("GLC_AFFINITY_EXCLUDE")))
+		glc_exclude_cpus(&mpriv.glc, env_val);
+
+	if ((env_val = getenv("GLC_BUFFER_MEMORY"))) {
+		buffer_memory = 0;
+		if (strstr(env_val, "prefault"))
+			buffer_memory |= GLC_UTIL_BUFFER_PREFAULT;
+		if (strstr(env_val, "hugepages"))
+			buffer_memory |= GLC_UTIL_BUFFER_HUGEPAGES;
+		if (strstr(env_val, "mlock"))
+			buffer_memory |= GLC_UTIL_BUFFER_MLOCK;
+		glc_util_set_buffer_memory(&mpriv.glc, buffer_memory);
+	}
+
 	/* Account for sink thread and possibly compress filter ones */
-	glc_account_threads(&mpriv.glc, 1, !(mpriv.flags & MAIN_COMPRESS_NONE));
+	glc_account_io_threads(&mpriv.glc, 1);
+	glc_account_threads(&mpriv.glc, !!(mpriv.flags & MAIN_TILES),
+			    !(mpriv.flags & MAIN_COMPRESS_NONE));
 
 	glc_log(&mpriv.glc, GLC_DEBUG, "main", "flags: %08X", mpriv.flags);
 
@@ -255,18 +332,101 @@ int init_buffers()
 	mpriv.uncompressed = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
 	if (unlikely((ret = ps_buffer_init(mpriv.uncompressed, &attr))))
 		return ret;
+	glc_util_prepare_buffer(&mpriv.glc, mpriv.uncompressed,
+				mpriv.uncompressed_size, "uncompressed");
+
+	/*
+	 * A tiles message is never larger than half a frame and frames
+	 * sent in full pass by reference, so half of the uncompressed
+	 * buffer holds at least as many frames.
+	 */
+	if (mpriv.flags & MAIN_TILES) {
+		ps_bufferattr_setsize(&attr, mpriv.uncompressed_size / 2);
+		mpriv.tiled = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
+		if (unlikely((ret = ps_buffer_init(mpriv.tiled, &attr))))
+			return ret;
+		glc_util_prepare_buffer(&mpriv.glc, mpriv.tiled,
+					mpriv.uncompressed_size / 2, "tiled");
+	}
 
 	if (!(mpriv.flags & MAIN_COMPRESS_NONE)) {
 		ps_bufferattr_setsize(&attr, mpriv.compressed_size);
 		mpriv.compressed = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
 		if (unlikely((ret = ps_buffer_init(mpriv.compressed, &attr))))
 			return ret;
+		glc_util_prepare_buffer(&mpriv.glc, mpriv.compressed,
+					mpriv.compressed_size, "compressed");
 	}
 
 	ps_bufferattr_destroy(&attr);
 	return 0;
 }
 
+/**
+ * \brief give audio and video capture a buffer of their own
+ *
+ * The render thread then never contends with audio threads, and
+ * audio never waits behind a frame. The mux thread merges both
+ * lanes into the uncompressed buffer. Without audio there is
+ * nothing to separate and video goes straight to the buffer.
+ *
+ * Off by default: the mux copies every frame once more and polls
+ * lanes while they are empty.
+ */
+int init_lanes()
+{
+	ps_bufferattr_t attr;
+	int ret;
+
+	if ((!(mpriv.flags & MAIN_LANES)) || (!alsa_active()))
+		return 0;
+
+	ps_bufferattr_init(&attr);
+	if (glc_log_get_level(&mpriv.glc) >= GLC_PERF)
+		ps_bufferattr_setflags(&attr, PS_BUFFER_STATS);
+
+	ps_bufferattr_setsize(&attr, mpriv.uncompressed_size);
+	mpriv.video_lane = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
+	if (unlikely((ret = ps_buffer_init(mpriv.video_lane, &attr))))
+		return ret;
+	glc_util_prepare_buffer(&mpriv.glc, mpriv.video_lane,
+				mpriv.uncompressed_size, "video lane");
+
+	ps_bufferattr_setsize(&attr, MAIN_AUDIO_LANE_SIZE);
+	mpriv.audio_lane = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
+	if (unlikely((ret = ps_buffer_init(mpriv.audio_lane, &attr))))
+		return ret;
+	glc_util_prepare_buffer(&mpriv.glc, mpriv.audio_lane,
+				MAIN_AUDIO_LANE_SIZE, "audio lane");
+	ps_bufferattr_destroy(&attr);
+
+	if (unlikely((ret = mux_init(&mpriv.mux, &mpriv.glc))))
+		return ret;
+	if (unlikely((ret = mux_add_lane(mpriv.mux, mpriv.video_lane,
+					 MUX_PRIORITY_NORMAL))))
+		return ret;
+	if (unlikely((ret = mux_add_lane(mpriv.mux, mpriv.audio_lane,
+					 MUX_PRIORITY_HIGH))))
+		return ret;
+
+	return mux_process_start(mpriv.mux, mpriv.uncompressed);
+}
+
+void destroy_lane(ps_buffer_t *lane, const char *name)
+{
+	ps_stats_t stats;
+
+	if (!lane)
+		return;
+
+	if(!ps_buffer_stats(lane, &stats)) {
+		glc_log(&mpriv.glc, GLC_PERF, "main", "%s buffer stats:", name);
+		ps_stats_text(&stats, glc_log_get_stream(&mpriv.glc));
+	}
+	ps_buffer_destroy(lane);
+	free(lane);
+}
+
 int open_stream()
 {
 	glc_stream_info_t *stream_info;
@@ -416,7 +576,8 @@ int start_capture_impl()
 	if (unlikely(!lib.running)) {
 		if (unlikely((ret = start_glc())))
 			goto err;
-	}
+	} else
+		glc_compute_threads_hint(&mpriv.glc); /* cpu budget might have changed */
 
 	glc_state_time_add_diff(&mpriv.glc,
 				glc_state_time(&mpriv.glc) - mpriv.stop_time);
@@ -428,6 +589,7 @@ int start_capture_impl()
 
 	lib.flags |= LIB_CAPTURING;
 	glc_log(&mpriv.glc, GLC_INFO, "main", "started capturing");
+	glc_util_log_faults(&mpriv.glc, "capture start");
 
 func_exit:
 	pthread_mutex_unlock(&mpriv.capture_action_lock);
@@ -463,6 +625,7 @@ int stop_capture()
 	lib.flags &= ~LIB_CAPTURING;
 	mpriv.stop_time = glc_state_time(&mpriv.glc);
 	glc_log(&mpriv.glc, GLC_INFO, "main", "stopped capturing");
+	glc_util_log_faults(&mpriv.glc, "capture stop");
 func_exit:
 	pthread_mutex_unlock(&mpriv.capture_action_lock);
 	return ret;
@@ -476,6 +639,7 @@ err_nolock:
 
 int start_glc()
 {
+	ps_buffer_t *stream = mpriv.tiled ? mpriv.tiled : mpriv.uncompressed;
 	int ret;
 
 	if (lib.running)
@@ -485,6 +649,18 @@ int start_glc()
 
 	glc_compute_threads_hint(&mpriv.glc);
 
+	/* filters share a fixed number of workers */
+	if ((mpriv.pool_workers) && (!mpriv.glc.pool)) {
+		if (unlikely((ret = glc_thread_pool_init(&mpriv.glc, mpriv.pool_workers))))
+			return ret;
+	}
+
+	/* frames are split between the filter thread and stripe workers */
+	if ((mpriv.stripe_workers) && (!mpriv.glc.stripe)) {
+		if (unlikely((ret = glc_stripe_init(&mpriv.glc, mpriv.stripe_workers))))
+			return ret;
+	}
+
 	/* initialize sink & write stream info */
 	if (mpriv.pipe_exec_file) {
 		if (unlikely((ret = pipe_sink_init(&mpriv.sink, &mpriv.glc,
@@ -518,19 +694,37 @@ int start_glc()
 		else if (mpriv.flags & MAIN_COMPRESS_LZJB)
 			pack_set_compression(mpriv.pack, PACK_LZJB);
 
-		if (unlikely((ret = pack_process_start(mpriv.pack, mpriv.uncompressed,
+		if (unlikely((ret = pack_process_start(mpriv.pack, stream,
 						       mpriv.compressed))))
 			return ret;
 	} else {
 		glc_log(&mpriv.glc, GLC_WARN, "main", "compression disabled");
 		if (unlikely((ret = mpriv.sink->ops->write_process_start(mpriv.sink,
-								mpriv.uncompressed))))
+									stream))))
+			return ret;
+	}
+
+	if (mpriv.flags & MAIN_TILES) {
+		if (unlikely((ret = tile_init(&mpriv.tile, &mpriv.glc))))
+			return ret;
+		/* size was checked by load_environ() */
+		tile_set_size(mpriv.tile, mpriv.tile_size);
+		tile_set_key_interval(mpriv.tile, mpriv.key_interval);
+		if (unlikely((ret = tile_process_start(mpriv.tile, mpriv.uncompressed,
+						       mpriv.tiled)))) {
+			tile_destroy(mpriv.tile);
+			mpriv.tile = NULL;
 			return ret;
+		}
 	}
 
-	if (unlikely((ret = alsa_start(mpriv.uncompressed))))
+	if (unlikely((ret = init_lanes())))
 		return ret;
-	if (unlikely((ret = opengl_start(mpriv.uncompressed))))
+	if (unlikely((ret = alsa_start(mpriv.audio_lane ? mpriv.audio_lane :
+					       mpriv.uncompressed))))
+		return ret;
+	if (unlikely((ret = opengl_start(mpriv.video_lane ? mpriv.video_lane :
+						 mpriv.uncompressed))))
 		return ret;
 
 	lib.running = 1;
@@ -542,6 +736,7 @@ int start_glc()
 void lib_close()
 {
 	int ret;
+	size_t refs;
 	ps_stats_t stats;
 	/*
 	 There is a small possibility that a capture operation in another
@@ -563,12 +758,23 @@ void lib_close()
 	if (unlikely((ret = opengl_close())))
 		goto err;
 
+	/* end of stream went through the video lane */
+	if (mpriv.mux) {
+		mux_process_wait(mpriv.mux);
+		mux_destroy(mpriv.mux);
+		mpriv.mux = NULL;
+	}
+
 	if (lib.running) {
 	/*
 	 opengl_close() is inserting an eof message in the stream.
 	 as the downstream threads process that message, they will all
 	 exit.
 	 */
+		if (mpriv.flags & MAIN_TILES) {
+			tile_process_wait(mpriv.tile);
+			tile_destroy(mpriv.tile);
+		}
 		if (!(mpriv.flags & MAIN_COMPRESS_NONE)) {
 			pack_process_wait(mpriv.pack);
 			pack_destroy(mpriv.pack);
@@ -579,6 +785,16 @@ void lib_close()
 		mpriv.sink = NULL;
 	}
 
+	if (mpriv.glc.pool)
+		glc_thread_pool_destroy(&mpriv.glc);
+	if (mpriv.glc.stripe)
+		glc_stripe_destroy(&mpriv.glc);
+
+	/* references left in cancelled buffers */
+	if ((refs = glc_packet_ref_reap()))
+		glc_log(&mpriv.glc, GLC_DEBUG, "main",
+			"dropped %zd unread references", refs);
+
 	if (mpriv.compressed) {
 		if(!ps_buffer_stats(mpriv.compressed, &stats)) {
 			glc_log(&mpriv.glc, GLC_PERF, "main", "compressed buffer stats:");
@@ -588,6 +804,18 @@ void lib_close()
 		free(mpriv.compressed);
 	}
 
+	if (mpriv.tiled) {
+		if(!ps_buffer_stats(mpriv.tiled, &stats)) {
+			glc_log(&mpriv.glc, GLC_PERF, "main", "tiled buffer stats:");
+			ps_stats_text(&stats, glc_log_get_stream(&mpriv.glc));
+		}
+		ps_buffer_destroy(mpriv.tiled);
+		free(mpriv.tiled);
+	}
+
+	destroy_lane(mpriv.video_lane, "video lane");
+	destroy_lane(mpriv.audio_lane, "audio lane");
+
 	if(!ps_buffer_stats(mpriv.uncompressed, &stats)) {
 		glc_log(&mpriv.glc, GLC_PERF, "main", "uncompressed buffer stats:");
 		ps_stats_text(&stats, glc_log_get_stream(&mpriv.glc));
@@ -662,6 +890,44 @@ void *wrapped_func(const char *symbol)
 		return &__opengl_glFinish;
 	else if (!strcmp(symbol, "glXCreateWindow"))
 		return &__opengl_glXCreateWindow;
+	else if (!strcmp(symbol, "glXMakeCurrent"))
+		return &__opengl_glXMakeCurrent;
+	else if (!strcmp(symbol, "glXMakeContextCurrent"))
+		return &__opengl_glXMakeContextCurrent;
+	else if (!strcmp(symbol, "glBindBuffer"))
+		return &__opengl_glBindBuffer;
+	else if (!strcmp(symbol, "glBindBufferARB"))
+		return &__opengl_glBindBufferARB;
+	else if (!strcmp(symbol, "glDeleteBuffers"))
+		return &__opengl_glDeleteBuffers;
+	else if (!strcmp(symbol, "glDeleteBuffersARB"))
+		return &__opengl_glDeleteBuffersARB;
+	else if (!strcmp(symbol, "glBindFramebuffer"))
+		return &__opengl_glBindFramebuffer;
+	else if (!strcmp(symbol, "glBindFramebufferEXT"))
+		return &__opengl_glBindFramebufferEXT;
+	else if (!strcmp(symbol, "glDeleteFramebuffers"))
+		return &__opengl_glDeleteFramebuffers;
+	else if (!strcmp(symbol, "glDeleteFramebuffersEXT"))
+		return &__opengl_glDeleteFramebuffersEXT;
+	else if (!strcmp(symbol, "glUseProgram"))
+		return &__opengl_glUseProgram;
+	else if (!strcmp(symbol, "glUseProgramObjectARB"))
+		return &__opengl_glUseProgramObjectARB;
+	else if (!strcmp(symbol, "glActiveTexture"))
+		return &__opengl_glActiveTexture;
+	else if (!strcmp(symbol, "glActiveTextureARB"))
+		return &__opengl_glActiveTextureARB;
+	else if (!strcmp(symbol, "glReadBuffer"))
+		return &__opengl_glReadBuffer;
+	else if (!strcmp(symbol, "glPixelStorei"))
+		return &__opengl_glPixelStorei;
+	else if (!strcmp(symbol, "glPixelStoref"))
+		return &__opengl_glPixelStoref;
+	else if (!strcmp(symbol, "glPopAttrib"))
+		return &__opengl_glPopAttrib;
+	else if (!strcmp(symbol, "glPopClientAttrib"))
+		return &__opengl_glPopClientAttrib;
 	else if (!strcmp(symbol, "snd_pcm_open"))
 		return &__alsa_snd_pcm_open;
 	else if (!strcmp(symbol, "snd_pcm_close"))
@@ -32,6 +32,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <dlfcn.h>
 
 #include <glc/common/glc.h>
@@ -64,8 +65,31 @@ struct opengl_private_s {
 	__GLXextFuncPtr (*glXGetProcAddressARB)(const GLubyte *);
 	GLXWindow (*glXCreateWindow)(Display *, GLXFBConfig, Window, const int *);
 
+	/* state tracked for gl_capture */
+	Bool (*glXMakeCurrent)(Display *, GLXDrawable, GLXContext);
+	Bool (*glXMakeContextCurrent)(Display *, GLXDrawable, GLXDrawable, GLXContext);
+	void (*glBindBuffer)(GLenum, GLuint);
+	void (*glBindBufferARB)(GLenum, GLuint);
+	void (*glDeleteBuffers)(GLsizei, const GLuint *);
+	void (*glDeleteBuffersARB)(GLsizei, const GLuint *);
+	void (*glBindFramebuffer)(GLenum, GLuint);
+	void (*glBindFramebufferEXT)(GLenum, GLuint);
+	void (*glDeleteFramebuffers)(GLsizei, const GLuint *);
+	void (*glDeleteFramebuffersEXT)(GLsizei, const GLuint *);
+	void (*glUseProgram)(GLuint);
+	void (*glUseProgramObjectARB)(GLhandleARB);
+	void (*glActiveTexture)(GLenum);
+	void (*glActiveTextureARB)(GLenum);
+	void (*glReadBuffer)(GLenum);
+	void (*glPixelStorei)(GLenum, GLint);
+	void (*glPixelStoref)(GLenum, GLfloat);
+	void (*glPopAttrib)(void);
+	void (*glPopClientAttrib)(void);
+
 	int capture_glfinish;
 	int colorspace;
+	int gpu_colorspace;
+	int gpu_scale;
 	double scale_factor;
 	GLenum read_buffer;
 	double fps;
@@ -77,6 +101,7 @@ struct opengl_private_s {
 __PRIVATE struct opengl_private_s opengl;
 
 __PRIVATE void get_real_opengl();
+__PRIVATE int opengl_cpu_filter();
 __PRIVATE void opengl_capture_current();
 __PRIVATE void opengl_draw_indicator();
 
@@ -84,7 +109,7 @@ int opengl_init(glc_t *glc)
 {
 	int ret = 0;
 	unsigned int x, y, w, h;
-	char *env_val;
+	char *env_val, profile[PATH_MAX];
 
 	opengl.glc              = glc;
 	opengl.buffer = opengl.unscaled = NULL;
@@ -120,11 +145,23 @@ int opengl_init(glc_t *glc)
 	} else
 		opengl.colorspace = CS_YCBCR_420JPEG;
 
+	opengl.gpu_colorspace = 0;
+	if ((env_val = getenv("GLC_GPU_COLORSPACE")))
+		opengl.gpu_colorspace = atoi(env_val);
+
+	opengl.gpu_scale = 0;
+	if ((env_val = getenv("GLC_GPU_SCALE")))
+		opengl.gpu_scale = atoi(env_val);
+
 	if ((env_val = getenv("GLC_UNSCALED_BUFFER_SIZE")))
 		opengl.unscaled_size = atoi(env_val) * 1024 * 1024;
 	else
 		opengl.unscaled_size = 1024 * 1024 * 25;
 
+	if ((env_val = getenv("GLC_ELASTIC_BUFFER_SIZE")))
+		gl_capture_set_elastic(opengl.gl_capture, GLC_ELASTIC_CHUNK_SIZE,
+				       (size_t) atoi(env_val) * 1024 * 1024);
+
 	if ((env_val = getenv("GLC_CAPTURE"))) {
 		if (!strcmp(env_val, "front"))
 			opengl.read_buffer = GL_FRONT;
@@ -145,6 +182,21 @@ int opengl_init(glc_t *glc)
 	if ((env_val = getenv("GLC_TRY_PBO")))
 		gl_capture_try_pbo(opengl.gl_capture, atoi(env_val));
 
+	if ((env_val = getenv("GLC_PBO_COUNT")))
+		gl_capture_set_pbo_count(opengl.gl_capture, atoi(env_val));
+
+	/* every call changing state read back by gl_capture is hooked */
+	if ((env_val = getenv("GLC_TRACK_GL_STATE")))
+		gl_capture_track_state(opengl.gl_capture, atoi(env_val));
+	else
+		gl_capture_track_state(opengl.gl_capture, 1);
+
+	if ((env_val = getenv("GLC_PBO_PERSISTENT")))
+		gl_capture_try_persistent_pbo(opengl.gl_capture, atoi(env_val));
+
+	if ((env_val = getenv("GLC_SKIP_REPEATS")))
+		gl_capture_skip_repeats(opengl.gl_capture, atoi(env_val));
+
 	gl_capture_set_pack_alignment(opengl.gl_capture, 8);
 	if ((env_val = getenv("GLC_CAPTURE_DWORD_ALIGNED"))) {
 		if (!atoi(env_val))
@@ -168,10 +220,24 @@ int opengl_init(glc_t *glc)
 	if ((env_val = getenv("GLC_LOCK_FPS")))
 		gl_capture_lock_fps(opengl.gl_capture, atoi(env_val));
 
+	/* filters take GL_BGRA or GL_BGR, otherwise colorspace decides */
+	if ((env_val = getenv("GLC_AUTOTUNE")) && (atoi(env_val))) {
+		profile[0] = '\0';
+		if ((env_val = getenv("GLC_AUTOTUNE_PROFILE")))
+			snprintf(profile, sizeof(profile), "%s", env_val);
+		else if ((env_val = getenv("XDG_CACHE_HOME")))
+			snprintf(profile, sizeof(profile), "%s/glcs-readback", env_val);
+		else if ((env_val = getenv("HOME")))
+			snprintf(profile, sizeof(profile), "%s/.cache/glcs-readback", env_val);
+
+		gl_capture_autotune(opengl.gl_capture, profile[0] ? profile : NULL,
+				    (opengl.scale_factor != 1.0) ||
+				    (opengl.colorspace == CS_YCBCR_420JPEG));
+	}
+
 	get_real_opengl();
 	/* Count host app rendering thread and possible filter threads on glcs side */
-	glc_account_threads(opengl.glc, 1, (opengl.scale_factor != 1.0) ||
-					   opengl.colorspace == CS_YCBCR_420JPEG);
+	glc_account_threads(opengl.glc, 1, opengl_cpu_filter());
 	return 0;
 }
 
@@ -183,7 +249,7 @@ int opengl_start(ps_buffer_t *buffer)
 	opengl.buffer = buffer;
 
 	/* init unscaled buffer if it is needed */
-	if ((opengl.scale_factor != 1.0) || opengl.colorspace == CS_YCBCR_420JPEG) {
+	if (opengl_cpu_filter()) {
 		/* if scaling is enabled, it is faster to capture as GL_BGRA */
 		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGRA);
 
@@ -195,6 +261,12 @@ int opengl_start(ps_buffer_t *buffer)
 		ps_bufferattr_setsize(&attr, opengl.unscaled_size);
 		opengl.unscaled = (ps_buffer_t *) malloc(sizeof(ps_buffer_t));
 		ps_buffer_init(opengl.unscaled, &attr);
+		glc_util_prepare_buffer(opengl.glc, opengl.unscaled,
+					opengl.unscaled_size, "unscaled");
+
+		/* filters leave frames already scaled on GPU at their size */
+		if ((opengl.gpu_scale) && (opengl.scale_factor < 1.0))
+			gl_capture_set_scale(opengl.gl_capture, opengl.scale_factor);
 
 		if (opengl.colorspace == CS_YCBCR_420JPEG) {
 			ycbcr_init(&opengl.ycbcr, opengl.glc);
@@ -207,6 +279,13 @@ int opengl_start(ps_buffer_t *buffer)
 		}
 
 		gl_capture_set_buffer(opengl.gl_capture, opengl.unscaled);
+	} else if (opengl.colorspace == CS_YCBCR_420JPEG) {
+		/* streams that can't be converted on GPU are sent as BGRA */
+		gl_capture_set_pixel_format(opengl.gl_capture, GL_BGRA);
+		if (opengl.scale_factor != 1.0)
+			gl_capture_set_scale(opengl.gl_capture, opengl.scale_factor);
+		gl_capture_convert_ycbcr(opengl.gl_capture, 1);
+		gl_capture_set_buffer(opengl.gl_capture, opengl.buffer);
 	} else {
 		gl_capture_set_pixel_format(opengl.gl_capture,
 					    opengl.colorspace==CS_BGR?GL_BGR:GL_BGRA);
@@ -217,8 +296,26 @@ int opengl_start(ps_buffer_t *buffer)
 	return 0;
 }
 
+/**
+ * \brief check if a CPU filter sits between gl_capture and buffer
+ *
+ * Frames converted to Y'CbCr, and scaled, on GPU are written
+ * straight to the stream buffer.
+ */
+int opengl_cpu_filter()
+{
+	if ((opengl.colorspace == CS_YCBCR_420JPEG) && (opengl.gpu_colorspace) &&
+	    ((opengl.scale_factor == 1.0) ||
+	     ((opengl.gpu_scale) && (opengl.scale_factor < 1.0))))
+		return 0;
+
+	return (opengl.scale_factor != 1.0) ||
+	       (opengl.colorspace == CS_YCBCR_420JPEG);
+}
+
 int opengl_close()
 {
+	glc_message_header_t hdr;
 	int ret;
 	ps_stats_t stats;
 	if (!opengl.started)
@@ -226,22 +323,27 @@ int opengl_close()
 
 	glc_log(opengl.glc, GLC_DEBUG, "opengl", "closing");
 
+	/* spilled frames can't be delivered, don't wait for them */
+	if (!lib.running)
+		ps_buffer_cancel(opengl.unscaled ? opengl.unscaled : opengl.buffer);
+
 	if (opengl.capturing)
 		gl_capture_stop(opengl.gl_capture);
+
+	/* goes behind spilled frames, destroy waits until they are written */
+	if (lib.running) {
+		hdr.type = GLC_MESSAGE_CLOSE;
+		if (unlikely((ret = gl_capture_push_message(opengl.gl_capture,
+							    &hdr, NULL, 0)))) {
+			glc_log(opengl.glc, GLC_ERROR, "opengl",
+				"can't write end of stream: %s (%d)",
+				strerror(ret), ret);
+			return ret;
+		}
+	}
 	gl_capture_destroy(opengl.gl_capture);
 
 	if (opengl.unscaled) {
-		if (lib.running) {
-			if (unlikely((ret = glc_util_write_end_of_stream(opengl.glc,
-									 opengl.unscaled)))) {
-				glc_log(opengl.glc, GLC_ERROR, "opengl",
-					"can't write end of stream: %s (%d)",
-					strerror(ret), ret);
-				return ret;
-			}
-		} else
-			ps_buffer_cancel(opengl.unscaled);
-
 		if (opengl.colorspace == CS_YCBCR_420JPEG) {
 			ycbcr_process_wait(opengl.ycbcr);
 			ycbcr_destroy(opengl.ycbcr);
@@ -249,14 +351,7 @@ int opengl_close()
 			scale_process_wait(opengl.scale);
 			scale_destroy(opengl.scale);
 		}
-	} else if (lib.running) {
-		if (unlikely((ret = glc_util_write_end_of_stream(opengl.glc, opengl.buffer)))) {
-			glc_log(opengl.glc, GLC_ERROR, "opengl",
-				"can't write end of stream: %s (%d)", strerror(ret), ret);
-			return ret;
-		}
-	} else
-		ps_buffer_cancel(opengl.buffer);
+	}
 
 	if (opengl.unscaled) {
 		if(!ps_buffer_stats(opengl.unscaled, &stats)) {
@@ -272,32 +367,11 @@ int opengl_close()
 
 int opengl_push_message(glc_message_header_t *hdr, void *message, size_t message_size)
 {
-	ps_packet_t packet;
-	int ret = 0;
-	ps_buffer_t *to;
 	if (unlikely(!lib.running))
 		return EAGAIN;
 
-	if (opengl.unscaled)
-		to = opengl.unscaled;
-	else
-		to = opengl.buffer;
-
-	if (unlikely((ret = ps_packet_init(&packet, to))))
-		goto finish;
-	if (unlikely((ret = ps_packet_open(&packet, PS_PACKET_WRITE))))
-		goto finish;
-	if (unlikely((ret = ps_packet_write(&packet, hdr, sizeof(glc_message_header_t)))))
-		goto finish;
-	if (unlikely((ret = ps_packet_write(&packet, message, message_size))))
-		goto finish;
-	if (unlikely((ret = ps_packet_close(&packet))))
-		goto finish;
-	if (unlikely((ret = ps_packet_destroy(&packet))))
-		goto finish;
-
-finish:
-	return ret;
+	/* must not overtake frames still in the elastic store */
+	return gl_capture_push_message(opengl.gl_capture, hdr, message, message_size);
 }
 
 int opengl_capture_start()
@@ -329,6 +403,14 @@ int opengl_refresh_color_correction()
 	return gl_capture_refresh_color_correction(opengl.gl_capture);
 }
 
+int opengl_window_configured(Display *dpy, Window window,
+			     unsigned int w, unsigned int h)
+{
+	if (unlikely(!lib.running))
+		return 0;
+	return gl_capture_window_configured(opengl.gl_capture, dpy, window, w, h);
+}
+
 void get_real_opengl()
 {
 	if (!lib.dlopen)
@@ -355,6 +437,66 @@ void get_real_opengl()
 	opengl.glXCreateWindow =
 	  (GLXWindow (*)(Display *dpy, GLXFBConfig, Window, const int *))
 	    lib.dlsym(opengl.libGL_handle, "glXCreateWindow");
+
+	opengl.glXMakeCurrent =
+	  (Bool (*)(Display *, GLXDrawable, GLXContext))
+	    lib.dlsym(opengl.libGL_handle, "glXMakeCurrent");
+	opengl.glXMakeContextCurrent =
+	  (Bool (*)(Display *, GLXDrawable, GLXDrawable, GLXContext))
+	    lib.dlsym(opengl.libGL_handle, "glXMakeContextCurrent");
+	opengl.glReadBuffer =
+	  (void (*)(GLenum))
+	    lib.dlsym(opengl.libGL_handle, "glReadBuffer");
+	opengl.glPixelStorei =
+	  (void (*)(GLenum, GLint))
+	    lib.dlsym(opengl.libGL_handle, "glPixelStorei");
+	opengl.glPixelStoref =
+	  (void (*)(GLenum, GLfloat))
+	    lib.dlsym(opengl.libGL_handle, "glPixelStoref");
+	opengl.glPopAttrib =
+	  (void (*)(void))
+	    lib.dlsym(opengl.libGL_handle, "glPopAttrib");
+	opengl.glPopClientAttrib =
+	  (void (*)(void))
+	    lib.dlsym(opengl.libGL_handle, "glPopClientAttrib");
+
+	/* not exported by every libGL */
+	opengl.glBindBuffer =
+	  (void (*)(GLenum, GLuint))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glBindBuffer");
+	opengl.glBindBufferARB =
+	  (void (*)(GLenum, GLuint))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glBindBufferARB");
+	opengl.glDeleteBuffers =
+	  (void (*)(GLsizei, const GLuint *))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glDeleteBuffers");
+	opengl.glDeleteBuffersARB =
+	  (void (*)(GLsizei, const GLuint *))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glDeleteBuffersARB");
+	opengl.glBindFramebuffer =
+	  (void (*)(GLenum, GLuint))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glBindFramebuffer");
+	opengl.glBindFramebufferEXT =
+	  (void (*)(GLenum, GLuint))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glBindFramebufferEXT");
+	opengl.glDeleteFramebuffers =
+	  (void (*)(GLsizei, const GLuint *))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glDeleteFramebuffers");
+	opengl.glDeleteFramebuffersEXT =
+	  (void (*)(GLsizei, const GLuint *))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glDeleteFramebuffersEXT");
+	opengl.glUseProgram =
+	  (void (*)(GLuint))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glUseProgram");
+	opengl.glUseProgramObjectARB =
+	  (void (*)(GLhandleARB))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glUseProgramObjectARB");
+	opengl.glActiveTexture =
+	  (void (*)(GLenum))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glActiveTexture");
+	opengl.glActiveTextureARB =
+	  (void (*)(GLenum))
+	    opengl.glXGetProcAddressARB((const GLubyte *) "glActiveTextureARB");
 	return;
 err:
 	fprintf(stderr, "(glc) can't get real OpenGL\n");
@@ -435,6 +577,259 @@ GLXWindow __opengl_glXCreateWindow(Display *dpy, GLXFBConfig config, Window win,
 	return retWin;
 }
 
+__PUBLIC Bool glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	return __opengl_glXMakeCurrent(dpy, drawable, ctx);
+}
+
+Bool __opengl_glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+{
+	INIT_GLC
+
+	/* state of another context, or of a new drawable */
+	gl_capture_track_reset();
+	return opengl.glXMakeCurrent(dpy, drawable, ctx);
+}
+
+__PUBLIC Bool glXMakeContextCurrent(Display *dpy, GLXDrawable draw,
+				    GLXDrawable read, GLXContext ctx)
+{
+	return __opengl_glXMakeContextCurrent(dpy, draw, read, ctx);
+}
+
+Bool __opengl_glXMakeContextCurrent(Display *dpy, GLXDrawable draw,
+				    GLXDrawable read, GLXContext ctx)
+{
+	INIT_GLC
+
+	gl_capture_track_reset();
+	if (unlikely(!opengl.glXMakeContextCurrent))
+		return False;
+	return opengl.glXMakeContextCurrent(dpy, draw, read, ctx);
+}
+
+__PUBLIC void glBindBuffer(GLenum target, GLuint buffer)
+{
+	__opengl_glBindBuffer(target, buffer);
+}
+
+void __opengl_glBindBuffer(GLenum target, GLuint buffer)
+{
+	INIT_GLC
+
+	opengl.glBindBuffer(target, buffer);
+	gl_capture_track_bind_buffer(target, buffer);
+}
+
+__PUBLIC void glBindBufferARB(GLenum target, GLuint buffer)
+{
+	__opengl_glBindBufferARB(target, buffer);
+}
+
+void __opengl_glBindBufferARB(GLenum target, GLuint buffer)
+{
+	INIT_GLC
+
+	opengl.glBindBufferARB(target, buffer);
+	gl_capture_track_bind_buffer(target, buffer);
+}
+
+__PUBLIC void glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	__opengl_glDeleteBuffers(n, buffers);
+}
+
+void __opengl_glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	INIT_GLC
+
+	gl_capture_track_delete_buffers(n, buffers);
+	opengl.glDeleteBuffers(n, buffers);
+}
+
+__PUBLIC void glDeleteBuffersARB(GLsizei n, const GLuint *buffers)
+{
+	__opengl_glDeleteBuffersARB(n, buffers);
+}
+
+void __opengl_glDeleteBuffersARB(GLsizei n, const GLuint *buffers)
+{
+	INIT_GLC
+
+	gl_capture_track_delete_buffers(n, buffers);
+	opengl.glDeleteBuffersARB(n, buffers);
+}
+
+__PUBLIC void glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	__opengl_glBindFramebuffer(target, framebuffer);
+}
+
+void __opengl_glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	INIT_GLC
+
+	opengl.glBindFramebuffer(target, framebuffer);
+	gl_capture_track_bind_framebuffer(target, framebuffer);
+}
+
+__PUBLIC void glBindFramebufferEXT(GLenum target, GLuint framebuffer)
+{
+	__opengl_glBindFramebufferEXT(target, framebuffer);
+}
+
+void __opengl_glBindFramebufferEXT(GLenum target, GLuint framebuffer)
+{
+	INIT_GLC
+
+	opengl.glBindFramebufferEXT(target, framebuffer);
+	gl_capture_track_bind_framebuffer(target, framebuffer);
+}
+
+__PUBLIC void glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	__opengl_glDeleteFramebuffers(n, framebuffers);
+}
+
+void __opengl_glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	INIT_GLC
+
+	gl_capture_track_delete_framebuffers(n, framebuffers);
+	opengl.glDeleteFramebuffers(n, framebuffers);
+}
+
+__PUBLIC void glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers)
+{
+	__opengl_glDeleteFramebuffersEXT(n, framebuffers);
+}
+
+void __opengl_glDeleteFramebuffersEXT(GLsizei n, const GLuint *framebuffers)
+{
+	INIT_GLC
+
+	gl_capture_track_delete_framebuffers(n, framebuffers);
+	opengl.glDeleteFramebuffersEXT(n, framebuffers);
+}
+
+__PUBLIC void glUseProgram(GLuint program)
+{
+	__opengl_glUseProgram(program);
+}
+
+void __opengl_glUseProgram(GLuint program)
+{
+	INIT_GLC
+
+	opengl.glUseProgram(program);
+	gl_capture_track_use_program(program);
+}
+
+__PUBLIC void glUseProgramObjectARB(GLhandleARB program)
+{
+	__opengl_glUseProgramObjectARB(program);
+}
+
+void __opengl_glUseProgramObjectARB(GLhandleARB program)
+{
+	INIT_GLC
+
+	opengl.glUseProgramObjectARB(program);
+	gl_capture_track_use_program((GLuint) program);
+}
+
+__PUBLIC void glActiveTexture(GLenum texture)
+{
+	__opengl_glActiveTexture(texture);
+}
+
+void __opengl_glActiveTexture(GLenum texture)
+{
+	INIT_GLC
+
+	opengl.glActiveTexture(texture);
+	gl_capture_track_active_texture(texture);
+}
+
+__PUBLIC void glActiveTextureARB(GLenum texture)
+{
+	__opengl_glActiveTextureARB(texture);
+}
+
+void __opengl_glActiveTextureARB(GLenum texture)
+{
+	INIT_GLC
+
+	opengl.glActiveTextureARB(texture);
+	gl_capture_track_active_texture(texture);
+}
+
+__PUBLIC void glReadBuffer(GLenum mode)
+{
+	__opengl_glReadBuffer(mode);
+}
+
+void __opengl_glReadBuffer(GLenum mode)
+{
+	INIT_GLC
+
+	opengl.glReadBuffer(mode);
+	gl_capture_track_read_buffer(mode);
+}
+
+__PUBLIC void glPixelStorei(GLenum pname, GLint param)
+{
+	__opengl_glPixelStorei(pname, param);
+}
+
+void __opengl_glPixelStorei(GLenum pname, GLint param)
+{
+	INIT_GLC
+
+	opengl.glPixelStorei(pname, param);
+	gl_capture_track_pixel_store(pname, param);
+}
+
+__PUBLIC void glPixelStoref(GLenum pname, GLfloat param)
+{
+	__opengl_glPixelStoref(pname, param);
+}
+
+void __opengl_glPixelStoref(GLenum pname, GLfloat param)
+{
+	INIT_GLC
+
+	opengl.glPixelStoref(pname, param);
+	gl_capture_track_pixel_store(pname, (GLint) param);
+}
+
+__PUBLIC void glPopAttrib(void)
+{
+	__opengl_glPopAttrib();
+}
+
+void __opengl_glPopAttrib(void)
+{
+	INIT_GLC
+
+	/* restored values are unknown */
+	opengl.glPopAttrib();
+	gl_capture_track_reset();
+}
+
+__PUBLIC void glPopClientAttrib(void)
+{
+	__opengl_glPopClientAttrib();
+}
+
+void __opengl_glPopClientAttrib(void)
+{
+	INIT_GLC
+
+	opengl.glPopClientAttrib();
+	gl_capture_track_reset();
+}
+
 void opengl_capture_current()
 {
 	INIT_GLC
@@ -192,7 +192,10 @@ void x11_event(Display *dpy, XEvent *event)
 		}
 
 		x11.last_event_time = event->xkey.time;
-	}
+	} else if (event->type == ConfigureNotify)
+		opengl_window_configured(dpy, event->xconfigure.window,
+					 event->xconfigure.width,
+					 event->xconfigure.height);
 }
 
 void get_real_x11()
@@ -35,15 +35,18 @@
 #include <glc/common/log.h>
 #include <glc/common/util.h>
 #include <glc/common/state.h>
+#include <glc/common/thread.h>
 #include <glc/common/optimization.h>
 
 #include <glc/core/file.h>
 #include <glc/core/pack.h>
+#include <glc/core/chain.h>
 #include <glc/core/rgb.h>
 #include <glc/core/color.h>
 #include <glc/core/info.h>
 #include <glc/core/ycbcr.h>
 #include <glc/core/scale.h>
+#include <glc/core/tile.h>
 
 #include <glc/export/img.h>
 #include <glc/export/wav.h>
@@ -91,6 +94,9 @@ struct play_s {
 
 	int log_level;
 	int allow_rt;
+	size_t pool_workers;
+	size_t stripe_workers;
+	const char *affinity;
 };
 
 int show_info_value(struct play_s *play, const char *value);
@@ -127,6 +133,9 @@ int main(int argc, char *argv[])
 		{"help",		0, NULL, 'h'},
 		{"version",		0, NULL, 'V'},
 		{"rtprio",		0, NULL, 'P'},
+		{"threads",		1, NULL, 'j'},
+		{"stripes",		1, NULL, 'S'},
+		{"affinity",		1, NULL, 'A'},
 		{0, 0, 0, 0}
 	};
 	memset(&play, 0, sizeof(struct play_s));
@@ -161,7 +170,7 @@ int main(int argc, char *argv[])
 	play.green_gamma = 1.0;
 	play.blue_gamma  = 1.0;
 
-	while ((opt = getopt_long(argc, argv, "i:a:b:p:y:o:f:r:g:l:td:c:u:s:v:hVP",
+	while ((opt = getopt_long(argc, argv, "i:a:b:p:y:o:f:r:g:l:td:c:u:s:v:hVPj:S:A:",
 				  long_options, &optind)) != -1) {
 		switch (opt) {
 		case 'i':
@@ -254,6 +263,19 @@ int main(int argc, char *argv[])
 		case 'P':
 			play.allow_rt = 1;
 			break;
+		case 'j':
+			if (atoi(optarg) < 1)
+				goto usage;
+			play.pool_workers = atoi(optarg);
+			break;
+		case 'S':
+			if (atoi(optarg) < 1)
+				goto usage;
+			play.stripe_workers = atoi(optarg);
+			break;
+		case 'A':
+			play.affinity = optarg;
+			break;
 		case 'h':
 		default:
 			goto usage;
@@ -279,6 +301,21 @@ int main(int argc, char *argv[])
 	glc_set_allow_rt(&play.glc, play.allow_rt);
 	glc_util_log_version(&play.glc);
 
+	if (play.affinity) {
+		if (unlikely(glc_parse_affinity(&play.glc, play.affinity)))
+			return EXIT_FAILURE;
+	}
+
+	if (play.pool_workers) {
+		if (unlikely(glc_thread_pool_init(&play.glc, play.pool_workers)))
+			return EXIT_FAILURE;
+	}
+
+	if (play.stripe_workers) {
+		if (unlikely(glc_stripe_init(&play.glc, play.stripe_workers)))
+			return EXIT_FAILURE;
+	}
+
 	/* open stream file */
 	if (unlikely(file_source_init(&play.file, &play.glc)))
 		return EXIT_FAILURE;
@@ -332,6 +369,14 @@ int main(int argc, char *argv[])
 	free(play.info_name);
 	free(play.info_date);
 
+	if (play.glc.pool)
+		glc_thread_pool_destroy(&play.glc);
+	if (play.glc.stripe)
+		glc_stripe_destroy(&play.glc);
+
+	/* references left in cancelled buffers */
+	glc_packet_ref_reap();
+
 	glc_state_destroy(&play.glc);
 	glc_destroy(&play.glc);
 
@@ -364,6 +409,11 @@ usage:
 	       "                             all, signature, version, flags, fps,\n"
 	       "                             pid, name, date\n"
 	       "  -P, --rtprio             use rt priority for alsa threads\n"
+	       "  -j, --threads=NUM        run filters in a shared pool of NUM threads\n"
+	       "  -S, --stripes=NUM        split each frame between NUM extra threads\n"
+	       "  -A, --affinity=SPEC      restrict threads to some CPUs, SPEC is a ';'\n"
+	       "                             separated list of [module=]cpus where cpus\n"
+	       "                             is a list like '0-3,8', 'l3' or 'node'\n"
 	       "  -v, --verbosity=LEVEL    verbosity level\n"
 	       "  -h, --help               show help\n");
 
@@ -429,11 +479,8 @@ static void destroy_buffers(ps_buffer_t *buffer_arr, unsigned nm)
 
 #define compressed_buffer   buffer_arr[0]
 #define uncompressed_buffer buffer_arr[1]
-#define rgb_buffer          buffer_arr[2]
-#define ycbcr_buffer        buffer_arr[2]
-#define color_buffer        buffer_arr[3]
-#define scale_buffer        buffer_arr[4]
-#define vfilter_in_buffer   buffer_arr[5]
+#define chain_buffer        buffer_arr[2]
+#define vfilter_in_buffer   buffer_arr[3]
 
 /*
  * Undef to use the video filter.
@@ -448,9 +495,11 @@ int play_stream(struct play_s *play)
 
 	 file -(uncompressed)->     reads data from stream file
 	 unpack -(uncompressed)->   decompresses lzo/quicklz packets
-	 rgb -(rgb)->               does conversion to BGR
-	 scale -(scale)->           does rescaling
-	 color -(color)->           applies color correction
+	 chain -(chain)->           runs following filters in one pass:
+	   untile                     rebuilds frames sent as changed tiles
+	   rgb                        does conversion to BGR
+	   scale                      does rescaling
+	   color                      applies color correction
 	 demux -(...)-> gl_play, alsa_play
 
 	 Each filter, except demux and file, has glc_threads_hint(glc) worker
@@ -458,16 +507,18 @@ int play_stream(struct play_s *play)
 	 separate buffer and _play handler for each video/audio stream.
 	*/
 #ifndef USE_VFILTER
-	ps_buffer_t buffer_arr[5];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 4};
+	ps_buffer_t buffer_arr[3];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 2};
 #else
-	ps_buffer_t buffer_arr[6];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 5};
+	ps_buffer_t buffer_arr[4];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 3};
 #endif
 	demux_t demux;
+	chain_t chain;
 	color_t color;
 	scale_t scale;
 	unpack_t unpack;
+	untile_t untile;
 	rgb_t rgb;
 	int ret = 0;
 
@@ -475,10 +526,14 @@ int play_stream(struct play_s *play)
 		goto err;
 
 	/* init filters */
-	glc_account_threads(&play->glc,4,4);
+	glc_account_threads(&play->glc,4,2);
 	glc_compute_threads_hint(&play->glc);
 	if (unlikely((ret = unpack_init(&unpack, &play->glc))))
 		goto err;
+	if (unlikely((ret = chain_init(&chain, &play->glc))))
+		goto err;
+	if (unlikely((ret = untile_init(&untile, &play->glc))))
+		goto err;
 	if (unlikely((ret = rgb_init(&rgb, &play->glc))))
 		goto err;
 	if (unlikely((ret = scale_init(&scale, &play->glc))))
@@ -492,6 +547,14 @@ int play_stream(struct play_s *play)
 	if (play->override_color_correction)
 		color_override(color, play->brightness, play->contrast,
 			       play->red_gamma, play->green_gamma, play->blue_gamma);
+	if (unlikely((ret = untile_chain_append(untile, chain))))
+		goto err;
+	if (unlikely((ret = rgb_chain_append(rgb, chain))))
+		goto err;
+	if (unlikely((ret = scale_chain_append(scale, chain))))
+		goto err;
+	if (unlikely((ret = color_chain_append(color, chain))))
+		goto err;
 	if (unlikely((ret = demux_init(&demux, &play->glc))))
 		goto err;
 	demux_set_video_buffer_size(demux, play->buffer_size_arr[UNCOMPRESSED_IDX]);
@@ -500,13 +563,13 @@ int play_stream(struct play_s *play)
 
 	/* construct a pipeline for playback */
 #ifndef USE_VFILTER
-	if (unlikely((ret = rgb_process_start(rgb, &uncompressed_buffer, &rgb_buffer))))
+	if (unlikely((ret = chain_process_start(chain, &uncompressed_buffer, &chain_buffer))))
 		goto err;
-	if (unlikely((ret = demux_process_start(demux, &color_buffer))))
+	if (unlikely((ret = demux_process_start(demux, &chain_buffer))))
 		goto err;
 #else
-	demux_insert_video_filter(demux, &vfilter_in_buffer, &color_buffer);
-	if (unlikely((ret = rgb_process_start(rgb, &vfilter_in_buffer, &rgb_buffer))))
+	demux_insert_video_filter(demux, &vfilter_in_buffer, &chain_buffer);
+	if (unlikely((ret = chain_process_start(chain, &vfilter_in_buffer, &chain_buffer))))
 		goto err;
 	if (unlikely((ret = demux_process_start(demux, &uncompressed_buffer))))
 		goto err;
@@ -514,10 +577,6 @@ int play_stream(struct play_s *play)
 	if (unlikely((ret = unpack_process_start(unpack, &compressed_buffer,
 						&uncompressed_buffer))))
 		goto err;
-	if (unlikely((ret = scale_process_start(scale, &rgb_buffer, &scale_buffer))))
-		goto err;
-	if (unlikely((ret = color_process_start(color, &scale_buffer, &color_buffer))))
-		goto err;
 
 	/* the pipeline is ready - lets give it some data */
 	if (unlikely((ret = play->file->ops->read(play->file, &compressed_buffer))))
@@ -526,17 +585,15 @@ int play_stream(struct play_s *play)
 	/* we've done our part - just wait for the threads */
 	if (unlikely((ret = demux_process_wait(demux))))
 		goto err; /* wait for demux, since when it quits, others should also */
-	if (unlikely((ret = color_process_wait(color))))
-		goto err;
-	if (unlikely((ret = scale_process_wait(scale))))
-		goto err;
-	if (unlikely((ret = rgb_process_wait(rgb))))
+	if (unlikely((ret = chain_process_wait(chain))))
 		goto err;
 	if (unlikely((ret = unpack_process_wait(unpack))))
 		goto err;
 
 	/* stream processed - clean up time */
 	unpack_destroy(unpack);
+	chain_destroy(chain);
+	untile_destroy(untile);
 	rgb_destroy(rgb);
 	scale_destroy(scale);
 	color_destroy(color);
@@ -619,18 +676,22 @@ int export_img(struct play_s *play)
 
 	 file -(uncompressed_buffer)->     reads data from stream file
 	 unpack -(uncompressed_buffer)->   decompresses lzo/quicklz packets
-	 rgb -(rgb)->               does conversion to BGR
-	 scale -(scale)->           does rescaling
-	 color -(color)->           applies color correction
+	 chain -(chain)->           runs following filters in one pass:
+	   untile                     rebuilds frames sent as changed tiles
+	   rgb                        does conversion to BGR
+	   scale                      does rescaling
+	   color                      applies color correction
 	 img                        writes separate image files for each frame
 	*/
 
-	ps_buffer_t buffer_arr[5];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 4};
+	ps_buffer_t buffer_arr[3];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 2};
 	img_t img;
+	chain_t chain;
 	color_t color;
 	scale_t scale;
 	unpack_t unpack;
+	untile_t untile;
 	rgb_t rgb;
 	int ret = 0;
 
@@ -638,10 +699,14 @@ int export_img(struct play_s *play)
 		goto err;
 
 	/* filters */
-	glc_account_threads(&play->glc,2,4);
+	glc_account_threads(&play->glc,2,2);
 	glc_compute_threads_hint(&play->glc);
 	if (unlikely((ret = unpack_init(&unpack, &play->glc))))
 		goto err;
+	if (unlikely((ret = chain_init(&chain, &play->glc))))
+		goto err;
+	if (unlikely((ret = untile_init(&untile, &play->glc))))
+		goto err;
 	if (unlikely((ret = rgb_init(&rgb, &play->glc))))
 		goto err;
 	if (unlikely((ret = scale_init(&scale, &play->glc))))
@@ -655,6 +720,14 @@ int export_img(struct play_s *play)
 	if (play->override_color_correction)
 		color_override(color, play->brightness, play->contrast,
 			       play->red_gamma, play->green_gamma, play->blue_gamma);
+	if (unlikely((ret = untile_chain_append(untile, chain))))
+		goto err;
+	if (unlikely((ret = rgb_chain_append(rgb, chain))))
+		goto err;
+	if (unlikely((ret = scale_chain_append(scale, chain))))
+		goto err;
+	if (unlikely((ret = color_chain_append(color, chain))))
+		goto err;
 	if (unlikely((ret = img_init(&img, &play->glc))))
 		goto err;
 	img_set_filename(img, play->export_filename_format);
@@ -666,13 +739,9 @@ int export_img(struct play_s *play)
 	if (unlikely((ret = unpack_process_start(unpack, &compressed_buffer,
 						&uncompressed_buffer))))
 		goto err;
-	if (unlikely((ret = rgb_process_start(rgb, &uncompressed_buffer, &rgb_buffer))))
+	if (unlikely((ret = chain_process_start(chain, &uncompressed_buffer, &chain_buffer))))
 		goto err;
-	if (unlikely((ret = scale_process_start(scale, &rgb_buffer, &scale_buffer))))
-		goto err;
-	if (unlikely((ret = color_process_start(color, &scale_buffer, &color_buffer))))
-		goto err;
-	if (unlikely((ret = img_process_start(img, &color_buffer))))
+	if (unlikely((ret = img_process_start(img, &chain_buffer))))
 		goto err;
 
 	/* ok, read the file */
@@ -682,16 +751,14 @@ int export_img(struct play_s *play)
 	/* wait 'till its done and clean up the mess... */
 	if (unlikely((ret = img_process_wait(img))))
 		goto err;
-	if (unlikely((ret = color_process_wait(color))))
-		goto err;
-	if (unlikely((ret = scale_process_wait(scale))))
-		goto err;
-	if (unlikely((ret = rgb_process_wait(rgb))))
+	if (unlikely((ret = chain_process_wait(chain))))
 		goto err;
 	if (unlikely((ret = unpack_process_wait(unpack))))
 		goto err;
 
 	unpack_destroy(unpack);
+	chain_destroy(chain);
+	untile_destroy(untile);
 	rgb_destroy(rgb);
 	scale_destroy(scale);
 	color_destroy(color);
@@ -712,18 +779,22 @@ int export_yuv4mpeg(struct play_s *play)
 
 	 file -(uncompressed_buffer)->     reads data from stream file
 	 unpack -(uncompressed_buffer)->   decompresses lzo/quicklz packets
-	 scale -(scale)->           does rescaling
-	 color -(color)->           applies color correction
-	 ycbcr -(ycbcr)->           does conversion to Y'CbCr (if necessary)
+	 chain -(chain)->           runs following filters in one pass:
+	   untile                     rebuilds frames sent as changed tiles
+	   scale                      does rescaling
+	   color                      applies color correction
+	   ycbcr                      does conversion to Y'CbCr (if necessary)
 	 yuv4mpeg                   writes yuv4mpeg stream
 	*/
 
-	ps_buffer_t buffer_arr[5];
-	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 4};
+	ps_buffer_t buffer_arr[3];
+	unsigned nm_arr[BUFFER_SIZE_ARR_SZ] = {1, 2};
 	yuv4mpeg_t yuv4mpeg;
+	chain_t chain;
 	ycbcr_t ycbcr;
 	scale_t scale;
 	unpack_t unpack;
+	untile_t untile;
 	color_t color;
 	int ret = 0;
 
@@ -731,10 +802,14 @@ int export_yuv4mpeg(struct play_s *play)
 		goto err;
 
 	/* initialize filters */
-	glc_account_threads(&play->glc,2,4);
+	glc_account_threads(&play->glc,2,2);
 	glc_compute_threads_hint(&play->glc);
 	if (unlikely((ret = unpack_init(&unpack, &play->glc))))
 		goto err;
+	if (unlikely((ret = chain_init(&chain, &play->glc))))
+		goto err;
+	if (unlikely((ret = untile_init(&untile, &play->glc))))
+		goto err;
 	if (unlikely((ret = ycbcr_init(&ycbcr, &play->glc))))
 		goto err;
 	if (unlikely((ret = scale_init(&scale, &play->glc))))
@@ -748,6 +823,14 @@ int export_yuv4mpeg(struct play_s *play)
 	if (play->override_color_correction)
 		color_override(color, play->brightness, play->contrast,
 			       play->red_gamma, play->green_gamma, play->blue_gamma);
+	if (unlikely((ret = untile_chain_append(untile, chain))))
+		goto err;
+	if (unlikely((ret = scale_chain_append(scale, chain))))
+		goto err;
+	if (unlikely((ret = color_chain_append(color, chain))))
+		goto err;
+	if (unlikely((ret = ycbcr_chain_append(ycbcr, chain))))
+		goto err;
 	if (unlikely((ret = yuv4mpeg_init(&yuv4mpeg, &play->glc))))
 		goto err;
 	yuv4mpeg_set_fps(yuv4mpeg, play->fps);
@@ -759,14 +842,10 @@ int export_yuv4mpeg(struct play_s *play)
 	if (unlikely((ret = unpack_process_start(unpack, &compressed_buffer,
 						&uncompressed_buffer))))
 		goto err;
-	if (unlikely((ret = scale_process_start(scale, &uncompressed_buffer,
-						&scale_buffer))))
-		goto err;
-	if (unlikely((ret = color_process_start(color, &scale_buffer, &color_buffer))))
+	if (unlikely((ret = chain_process_start(chain, &uncompressed_buffer,
+						&chain_buffer))))
 		goto err;
-	if (unlikely((ret = ycbcr_process_start(ycbcr, &color_buffer, &ycbcr_buffer))))
-		goto err;
-	if (unlikely((ret = yuv4mpeg_process_start(yuv4mpeg, &ycbcr_buffer))))
+	if (unlikely((ret = yuv4mpeg_process_start(yuv4mpeg, &chain_buffer))))
 		goto err;
 
 	/* feed it with data */
@@ -776,16 +855,14 @@ int export_yuv4mpeg(struct play_s *play)
 	/* threads will do the dirty work... */
 	if (unlikely((ret = yuv4mpeg_process_wait(yuv4mpeg))))
 		goto err;
-	if (unlikely((ret = color_process_wait(color))))
-		goto err;
-	if (unlikely((ret = scale_process_wait(scale))))
-		goto err;
-	if (unlikely((ret = ycbcr_process_wait(ycbcr))))
+	if (unlikely((ret = chain_process_wait(chain))))
 		goto err;
 	if (unlikely((ret = unpack_process_wait(unpack))))
 		goto err;
 
 	unpack_destroy(unpack);
+	chain_destroy(chain);
+	untile_destroy(untile);
 	ycbcr_destroy(ycbcr);
 	scale_destroy(scale);
 	color_destroy(color);